@@ -0,0 +1,75 @@
+// Compares the FNV-1a hashString()/hashStrings() with hashBytes() and Hasher.
+//
+// For each input size, every function hashes a rotating set of inputs; the results are folded together so that no
+// call can be optimized away.
+//
+// Usage: hash_benchmark [iterations]
+
+#include "stinger/utils/hash.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace stinger::utils;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+const std::size_t kInputs = 64;
+
+std::vector<std::string> makeInputs(std::size_t size) {
+    std::vector<std::string> inputs;
+    for (std::size_t i = 0; i < kInputs; ++i) {
+        std::string input;
+        while (input.size() < size) {
+            input += "devices/" + std::to_string(i * 7919 + input.size()) + "/";
+        }
+        input.resize(size);
+        inputs.push_back(std::move(input));
+    }
+    return inputs;
+}
+
+volatile std::uint64_t gSink;
+
+template <typename Hash>
+double nsPerCall(int iterations, Hash&& hash) {
+    std::uint64_t folded = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        folded ^= hash(static_cast<std::size_t>(i) % kInputs);
+    }
+    double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    gSink = folded;
+    return elapsed / iterations;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 2000000;
+
+    printf("%d calls per cell\n\n", iterations);
+    printf("%-8s %14s %14s %10s %10s\n", "bytes", "fnv ns", "hashBytes ns", "fnv GB/s", "new GB/s");
+    for (std::size_t size : {4, 8, 16, 24, 32, 64, 128, 256, 1024, 4096}) {
+        std::vector<std::string> inputs = makeInputs(size);
+        double fnv = nsPerCall(iterations, [&](std::size_t i) { return hashString(inputs[i]); });
+        double fast = nsPerCall(iterations, [&](std::size_t i) { return hashBytes(inputs[i]); });
+        printf("%-8zu %14.2f %14.2f %10.2f %10.2f\n", size, fnv, fast, size / fnv, size / fast);
+    }
+
+    // A composite key of a topic and a number, as the subscription registry builds.
+    std::vector<std::string> topics = makeInputs(32);
+    std::vector<std::string> numbers;
+    for (std::size_t i = 0; i < kInputs; ++i) {
+        numbers.push_back(std::to_string(i));
+    }
+    double vectorKey = nsPerCall(iterations, [&](std::size_t i) { return hashStrings({topics[i], numbers[i]}); });
+    double hasherKey = nsPerCall(iterations, [&](std::size_t i) { return Hasher().Add(topics[i]).Add(i).Value(); });
+    printf("\n%-32s %8.2f ns\n", "hashStrings({topic, number})", vectorKey);
+    printf("%-32s %8.2f ns\n", "Hasher().Add(topic).Add(number)", hasherKey);
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Compares the libmosquitto-based BrokerConnection with NativeConnection.
+//
+// For each backend, one connection publishes `count` messages to a topic that another connection of the same kind
+// subscribes to.  Each payload starts with its send time, so the subscriber can measure end-to-end latency.
+//
+// Usage: publish_benchmark [host] [port] [count] [payload bytes] [qos]
+
+#include "stinger/mqtt/brokerconnection.hpp"
+#include "stinger/mqtt/nativeconnection.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace stinger::mqtt;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Result {
+    double publishNsPerMessage = 0; // Time spent in Publish() by the caller.
+    double messagesPerSecond = 0;   // First publish to last delivery.
+    double medianLatencyUs = 0;
+    double p99LatencyUs = 0;
+    std::size_t received = 0;
+};
+
+template <typename Connection>
+Result run(const std::string& host, int port, const std::string& name, int count, std::size_t payloadBytes,
+           unsigned qos) {
+    Connection subscriber(host, port, "bench-" + name + "-sub");
+    Connection publisher(host, port, "bench-" + name + "-pub");
+    subscriber.GetConnectedFuture().wait_for(std::chrono::seconds(5));
+    publisher.GetConnectedFuture().wait_for(std::chrono::seconds(5));
+
+    std::mutex mutex;
+    std::vector<double> latencies;
+    latencies.reserve(count);
+    std::atomic<std::size_t> received{0};
+    Clock::time_point lastDelivery;
+    subscriber.AddMessageCallback([&](const Message& message) {
+        auto now = Clock::now();
+        std::int64_t sent = 0;
+        if (message.payload.size() >= sizeof(sent)) {
+            memcpy(&sent, message.payload.data(), sizeof(sent));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        latencies.push_back((now.time_since_epoch().count() - sent) / 1000.0);
+        lastDelivery = now;
+        ++received;
+    });
+    std::string topic = "bench/" + name + "/data";
+    subscriber.Subscribe(topic, static_cast<int>(qos));
+    // Give the SUBSCRIBE a moment to reach the broker before anything is published.
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    Message message(topic, std::string(std::max(payloadBytes, sizeof(std::int64_t)), 'x'), qos);
+    std::vector<std::future<bool>> futures;
+    futures.reserve(count);
+    Clock::duration publishTime{};
+    auto start = Clock::now();
+    for (int i = 0; i < count; ++i) {
+        auto before = Clock::now();
+        std::int64_t stamp = before.time_since_epoch().count();
+        memcpy(&message.payload[0], &stamp, sizeof(stamp));
+        futures.push_back(publisher.Publish(message));
+        publishTime += Clock::now() - before;
+    }
+    for (auto& future : futures) {
+        future.wait_for(std::chrono::seconds(10));
+    }
+    auto deadline = Clock::now() + std::chrono::seconds(10);
+    while (received < static_cast<std::size_t>(count) && Clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    Result result;
+    std::lock_guard<std::mutex> lock(mutex);
+    result.received = received;
+    result.publishNsPerMessage = std::chrono::duration<double, std::nano>(publishTime).count() / count;
+    if (!latencies.empty()) {
+        result.messagesPerSecond = latencies.size() / std::chrono::duration<double>(lastDelivery - start).count();
+        std::sort(latencies.begin(), latencies.end());
+        result.medianLatencyUs = latencies[latencies.size() / 2];
+        result.p99LatencyUs = latencies[latencies.size() * 99 / 100];
+    }
+    return result;
+}
+
+void print(const char* name, const Result& result, int count) {
+    printf("%-10s %10.0f %12.0f %12.1f %12.1f %10zu/%d\n", name, result.publishNsPerMessage, result.messagesPerSecond,
+           result.medianLatencyUs, result.p99LatencyUs, result.received, count);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string host = argc > 1 ? argv[1] : "localhost";
+    int port = argc > 2 ? std::stoi(argv[2]) : 1883;
+    int count = argc > 3 ? std::stoi(argv[3]) : 100000;
+    std::size_t payloadBytes = argc > 4 ? std::stoul(argv[4]) : 64;
+    unsigned qos = argc > 5 ? static_cast<unsigned>(std::stoul(argv[5])) : 0;
+
+    printf("%d messages of %zu bytes at QoS %u via %s:%d\n\n", count, payloadBytes, qos, host.c_str(), port);
+    printf("%-10s %10s %12s %12s %12s %10s\n", "backend", "ns/publish", "msgs/s", "p50 us", "p99 us", "received");
+    print("mosquitto", run<BrokerConnection>(host, port, "mosquitto", count, payloadBytes, qos), count);
+    print("native", run<NativeConnection>(host, port, "native", count, payloadBytes, qos), count);
+    return 0;
+}
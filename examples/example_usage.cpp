@@ -23,14 +23,14 @@ int main() {
         std::cout << "Payload: " << msg.payload << std::endl;
 
         // Check if there's correlation data
-        if (msg.properties.correlationData) {
-            std::cout << "Correlation data present (" << msg.properties.correlationData->size() << " bytes)"
+        if (auto correlationData = msg.properties.GetCorrelationData()) {
+            std::cout << "Correlation data present (" << correlationData->size() << " bytes)"
                       << std::endl;
         }
 
         // Check if there's a response topic
-        if (msg.properties.responseTopic) {
-            std::cout << "Response Topic: " << *msg.properties.responseTopic << std::endl;
+        if (auto responseTopic = msg.properties.GetResponseTopic()) {
+            std::cout << "Response Topic: " << *responseTopic << std::endl;
         }
     });
 
@@ -45,7 +45,7 @@ int main() {
     auto msg = mqtt::Message::Signal("hello/publish", "Hello from example_usage!");
 
     // Optionally set properties
-    msg.properties.contentType = "text/plain";
+    msg.properties.SetContentType("text/plain");
 
     // Publish the message and get a future
     auto publishFuture = mqtt->Publish(msg);
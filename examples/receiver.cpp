@@ -37,65 +37,65 @@ int main(int argc, char* argv[]) {
         std::cout << "\n--- Properties ---" << std::endl;
 
         // Check correlation data
-        if (msg.properties.correlationData) {
-            std::cout << "Correlation Data: " << msg.properties.correlationData->size() << " bytes" << std::endl;
+        if (auto correlationData = msg.properties.GetCorrelationData()) {
+            std::cout << "Correlation Data: " << correlationData->size() << " bytes" << std::endl;
         } else {
             std::cout << "Correlation Data: (none)" << std::endl;
         }
 
         // Check response topic
-        if (msg.properties.responseTopic) {
-            std::cout << "Response Topic: " << *msg.properties.responseTopic << std::endl;
+        if (auto responseTopic = msg.properties.GetResponseTopic()) {
+            std::cout << "Response Topic: " << *responseTopic << std::endl;
         } else {
             std::cout << "Response Topic: (none)" << std::endl;
         }
 
         // Check subscription ID
-        if (msg.properties.subscriptionId) {
-            std::cout << "Subscription ID: " << *msg.properties.subscriptionId << std::endl;
+        if (auto subscriptionId = msg.properties.GetSubscriptionId()) {
+            std::cout << "Subscription ID: " << *subscriptionId << std::endl;
         } else {
             std::cout << "Subscription ID: (none)" << std::endl;
         }
 
         // Check message expiry interval
-        if (msg.properties.messageExpiryInterval) {
-            std::cout << "Message Expiry Interval: " << *msg.properties.messageExpiryInterval << " seconds"
+        if (auto messageExpiryInterval = msg.properties.GetMessageExpiryInterval()) {
+            std::cout << "Message Expiry Interval: " << *messageExpiryInterval << " seconds"
                       << std::endl;
         } else {
             std::cout << "Message Expiry Interval: (none)" << std::endl;
         }
 
         // Check content type
-        if (msg.properties.contentType) {
-            std::cout << "Content Type: " << *msg.properties.contentType << std::endl;
+        if (auto contentType = msg.properties.GetContentType()) {
+            std::cout << "Content Type: " << *contentType << std::endl;
         } else {
             std::cout << "Content Type: (none)" << std::endl;
         }
 
         // Check debug info
-        if (msg.properties.debugInfo) {
-            std::cout << "Debug Info: " << *msg.properties.debugInfo << std::endl;
+        if (auto debugInfo = msg.properties.GetDebugInfo()) {
+            std::cout << "Debug Info: " << *debugInfo << std::endl;
         } else {
             std::cout << "Debug Info: (none)" << std::endl;
         }
 
         // Check return code
-        if (msg.properties.returnCode) {
-            std::cout << "Return Code: " << *msg.properties.returnCode << std::endl;
+        if (auto returnCode = msg.properties.GetReturnCode()) {
+            std::cout << "Return Code: " << *returnCode << std::endl;
         } else {
             std::cout << "Return Code: (none)" << std::endl;
         }
 
         // Check property version
-        if (msg.properties.propertyVersion) {
-            std::cout << "Property Version: " << *msg.properties.propertyVersion << std::endl;
+        if (auto propertyVersion = msg.properties.GetPropertyVersion()) {
+            std::cout << "Property Version: " << *propertyVersion << std::endl;
         } else {
             std::cout << "Property Version: (none)" << std::endl;
         }
 
         // Check version
-        if (msg.properties.version) {
-            std::cout << "Version: " << *msg.properties.version << std::endl;
+        if (auto version = msg.properties.GetVersion()) {
+            std::cout << "Version: " << *version << std::endl;
         } else {
             std::cout << "Version: (none)" << std::endl;
         }
@@ -1,16 +1,25 @@
 #pragma once
 
+#include "stinger/mqtt/connectoptions.hpp"
 #include "stinger/mqtt/message.hpp"
+#include "stinger/utils/callbacklist.hpp"
 #include "stinger/utils/iconnection.hpp"
+#include "stinger/utils/logger.hpp"
+#include "stinger/utils/subscriptiontracker.hpp"
 #include <mosquitto.h>
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
 #include <future>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
@@ -24,13 +33,24 @@ class BrokerConnection : public utils::IConnection {
 public:
     /*! Constructor for a BrokerConnection.
      * \param hostname IP address or hostname of the MQTT broker server.
-     * \param port Port where the MQTT broker is running (often 1883).
+     * \param port Port where the MQTT broker is running (often 1883), or 0 to connect to the Unix domain socket at
+     * the path given by `host`.
      */
     BrokerConnection(const std::string& host, int port, const std::string& clientId);
 
+    /*! Constructor for a BrokerConnection with explicit connect options.
+     * \param hostname IP address or hostname of the MQTT broker server.
+     * \param port Port where the MQTT broker is running (often 1883), or 0 to connect to the Unix domain socket at
+     * the path given by `host`.
+     * \param options keepalive, session expiry and flow-control settings sent in the CONNECT packet.
+     */
+    BrokerConnection(const std::string& host, int port, const std::string& clientId, const ConnectOptions& options);
+
     virtual ~BrokerConnection();
 
     /*! Publish a message to the MQTT broker.
+     * With `ConnectOptions::localDelivery`, a message matching one of this connection's subscriptions is also passed
+     * to the message callbacks on the calling thread before this returns.
      * \param message The MQTT message to publish.
      * \return A future which is resolved to true when the message has been published to the MQTT broker.
      */
@@ -39,14 +59,33 @@ public:
     /*! Subscribe to a topic.
      * \param topic the subscription topic.
      * \param qos an MQTT quality of service value between 0 and 2 inclusive.
-     * \return the MQTT subscription ID.
+     * \return the MQTT subscription ID, or utils::kSubscribeFailed if mosquitto refused the SUBSCRIBE, e.g. for a
+     * malformed topic.  A subscription made while disconnected is queued and always gets an ID.
      */
     virtual int Subscribe(const std::string& topic, int qos);
 
     virtual void Unsubscribe(const std::string& topic);
 
+    /*! Subscribe to several topics with a single SUBSCRIBE packet.
+     * MQTT v5 carries one subscription identifier per SUBSCRIBE packet, so every topic that is newly subscribed by
+     * this call shares the same subscription ID.  Topics that are already subscribed keep their existing ID and
+     * only have their reference count incremented.
+     * \param topics the subscription topics.
+     * \param qos an MQTT quality of service value between 0 and 2 inclusive, used for every topic.
+     * \return the MQTT subscription ID of each topic, in the same order as `topics`.  If mosquitto refuses the
+     * SUBSCRIBE, every topic that it would have added is utils::kSubscribeFailed.
+     */
+    virtual std::vector<int> SubscribeMany(const std::vector<std::string>& topics, int qos);
+
+    /*! Unsubscribe from several topics with a single UNSUBSCRIBE packet.
+     * Only topics whose reference count reaches zero are sent to the broker.
+     * \param topics the subscription topics.
+     */
+    virtual void UnsubscribeMany(const std::vector<std::string>& topics);
+
     /*! Add a function that is called on the receipt of a message.
      * Many callbacks can be added, and each will be called in the order in which the callbacks were added.
+     * The message is only valid during the call; see IConnection::AddMessageCallback().
      * \param cb the callback function.
      */
     virtual utils::CallbackHandleType AddMessageCallback(const std::function<void(const Message&)>& cb);
@@ -55,7 +94,7 @@ public:
 
     /*! Determines if a topic string matches a subscription topic.
      * \param topic a topic to match against a subscription.
-     * \param subscr the subscription topic string to match against.
+     * \param subscr the subscription topic string to match against.  A `$share/<group>/` prefix is ignored.
      * \return true if it is a match.
      */
     virtual bool TopicMatchesSubscription(const std::string& topic, const std::string& subscr) const;
@@ -73,10 +112,46 @@ public:
      */
     virtual bool IsConnected() const;
 
+    const ConnectOptions& GetConnectOptions() const;
+
+    /*! Returns a future that becomes true when the broker first accepts the connection.
+     * It becomes false if the connection is destroyed first.
+     */
+    std::shared_future<bool> GetConnectedFuture() const;
+
     virtual void SetLogFunction(const utils::LogFunctionType& logFunc);
     virtual void SetLogLevel(int level);
     virtual void Log(int level, const char* fmt, ...) const;
 
+    /*! What an external event loop should wait for; see `ConnectOptions::externalLoop`.
+     * The socket changes when the connection is re-established, so query this again after every Loop* call rather
+     * than caching the descriptor.
+     */
+    struct LoopInterest {
+        int fd = -1;            // -1 while there is no socket, e.g. between reconnect attempts.
+        bool wantWrite = false; // Outbound packets are queued; wait for the socket to become writable.
+    };
+
+    LoopInterest GetLoopInterest() const;
+
+    /*! Reads and dispatches inbound packets.  Call when the socket is readable. */
+    void LoopRead();
+
+    /*! Writes queued outbound packets.  Call when the socket is writable and `wantWrite` is set. */
+    void LoopWrite();
+
+    /*! Sends keepalive pings and reconnects, with incremental backoff, after the connection drops.
+     * Call at least once per second, and whenever the socket reports an error or hang-up.
+     */
+    void LoopMisc();
+
+    /*! Sets a function that is called after Publish, Subscribe or Unsubscribe queue outbound packets, so that an
+     * external event loop waiting on another thread can wake up and re-check `GetLoopInterest()`.
+     * It may be replaced while other threads use the connection; once this returns, the previous function is
+     * neither running nor called again.
+     */
+    void SetLoopWakeupFunction(const std::function<void()>& wakeup);
+
 protected:
     /*! Configures the reconnect delay settings for the mosquitto connection.
      * Can be overridden by subclasses to customize reconnect behavior.
@@ -84,22 +159,58 @@ protected:
     virtual void ConfigureReconnectDelay();
 
     /*! Establishes the connection to the broker.
+     * Not virtual: the constructor calls it, with `ConnectOptions::asyncConnect` on a thread that may run while a
+     * subclass constructor is still executing, where a virtual call would race with it.  For the same reason it
+     * registers the will from BrokerConnection's own GetLastWillTopic() and GetOfflinePayload().
      */
-    virtual void Connect();
+    void Connect();
 
     std::string _clientId;
 
 private:
-    // Represents an MQTT subscription, so that it can be queued before connection.
-    struct MqttSubscription {
-        MqttSubscription(const std::string& topic, int qos, int subscriptionId)
-            : topic(topic), qos(qos), subscriptionId(subscriptionId) {}
-        ~MqttSubscription() = default;
-        std::string topic;
-        int qos;
-        int subscriptionId;
+    // A SUBSCRIBE or UNSUBSCRIBE decided on while a registry shard was locked.  Ops are queued in that order and
+    // sent by SendSubscriptionOps() after the lock is released, so the packets for one topic keep their order
+    // without mosquitto being called under a shard lock.
+    struct SubscriptionOp {
+        bool subscribe = true;
+        std::vector<std::string> topics;
+        int subscriptionId = 0;
+        int qos = 0;
+        int rc = MOSQ_ERR_SUCCESS; // Set once the op has been sent.
     };
 
+    // Queues an op, or returns null while disconnected.  Called from the tracker's send functions, with the shards of
+    // `topics` locked.
+    std::shared_ptr<SubscriptionOp> QueueSubscriptionOp(bool subscribe, const std::vector<std::string_view>& topics,
+                                                        int subscriptionId, int qos);
+
+    // Sends every queued op.  When it returns, every op queued before the call has been sent, by this thread or
+    // another one, and carries its return code.
+    void SendSubscriptionOps();
+
+    // Sends the subscriptions that were registered while disconnected or lost with the broker's session.
+    void SendPendingSubscriptions();
+
+    // Checks the result of a SUBSCRIBE sent for a new subscription.  One that failed for lack of a connection is
+    // marked pending again; any other failure returns false, and the caller must drop its references.
+    bool CheckSubscribeSent(const SubscriptionOp& op);
+
+    // Sends the SUBSCRIBE packets for the given topics: one for plain subscriptions and one for shared ones, which
+    // may not use the No Local option.  Returns the first failing mosquitto return code.
+    int SendSubscribe(std::vector<std::string>& topics, int subscriptionId, int qos);
+
+    // Passes a published message to the message callbacks if it matches a local, non-shared subscription.
+    void DeliverLocally(const Message& message);
+
+    // Publishes the retained online status message.
+    void PublishOnlineMessage();
+
+    // Tells an external event loop that outbound packets were queued.
+    void WakeLoop();
+
+    // Applies the socket buffer sizes and network thread affinity from the connect options to a new connection.
+    void ApplySocketOptions();
+
     struct PendingPublish {
         PendingPublish(Message msg) : message(std::move(msg)), pSentPromise(std::make_shared<std::promise<bool>>()) {}
         ~PendingPublish() = default;
@@ -111,22 +222,43 @@ private:
     mosquitto* _mosq;
     std::string _host;
     int _port;
+    ConnectOptions _options;
 
-    int _nextSubscriptionId = 1;
-    std::queue<MqttSubscription> _subscriptions;
     std::mutex _mutex;
-    utils::CallbackHandleType _nextCallbackHandle = 1;
-    std::map<utils::CallbackHandleType, std::function<void(const Message&)>> _messageCallbacks;
+    utils::MessageCallbackList _messageCallbacks;
+    Message _received{"", ""}; // Refilled for each inbound message on the loop thread.
     std::queue<PendingPublish> _msgQueue;
     std::map<int, std::shared_ptr<std::promise<bool>>> _sendMessages;
 
-    // Track subscription reference counts: topic -> (count, subscriptionId)
-    std::map<std::string, std::pair<int, int>> _subscriptionRefCounts;
+    // Subscription reference counts and IDs.  Subscriptions and unsubscribes made before the broker acknowledges the
+    // connection are sent after its CONNACK.
+    utils::SubscriptionTracker _subscriptions;
+    std::mutex _subscriptionOpsMutex; // Guards _subscriptionOps; taken inside registry shard locks.
+    std::deque<std::shared_ptr<SubscriptionOp>> _subscriptionOps;
+    std::mutex _subscriptionSendMutex; // Held while sending ops, so that they go out in queue order.
 
-    utils::LogFunctionType _logger;
-    int _logLevel = 0;
+    utils::Logger _logger;
     std::atomic<bool> _connected = false;
 
+    // Set while the initial connect runs on _connectThread (see ConnectOptions::asyncConnect).  Until it is cleared,
+    // publishes and subscriptions are queued without calling into mosquitto.
+    std::atomic<bool> _connectPending{false};
+    std::thread _connectThread;
+    std::promise<bool> _connectedPromise;
+    std::shared_future<bool> _connectedFuture;
+    bool _connectedPromiseSet = false;
+    bool _affinityApplied = false; // Only touched on the network thread.
+
+    std::mutex _loopWakeupMutex; // Held while _loopWakeup is replaced or called.
+    std::function<void()> _loopWakeup;
+
+    // External event loop state.  Only touched from the thread driving the Loop* calls.
+    int _reconnectAttempts = 0;
+    std::chrono::steady_clock::time_point _nextReconnect;
+#ifdef STINGER_ONLINE_PUBLISH_THREAD
+    std::chrono::steady_clock::time_point _nextOnlinePublish;
+#endif
+
 #ifdef STINGER_ONLINE_PUBLISH_THREAD
     std::thread _onlinePublishThread;
     std::mutex _onlinePublishMutex;
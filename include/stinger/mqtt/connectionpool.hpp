@@ -0,0 +1,118 @@
+#pragma once
+
+#include "stinger/mqtt/brokerconnection.hpp"
+#include "stinger/mqtt/connectoptions.hpp"
+#include "stinger/mqtt/message.hpp"
+#include "stinger/utils/callbacklist.hpp"
+#include "stinger/utils/iconnection.hpp"
+#include "stinger/utils/logger.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace stinger {
+namespace mqtt {
+
+/**
+ * @brief An IConnection that spreads publish traffic over several broker sessions.
+ *
+ * The pool owns `size` BrokerConnections.  The first uses `clientId`; the others use `clientId-1`, `clientId-2`, ...
+ * A message is published through the member chosen by a hash of its topic, so messages on one topic keep their order
+ * while different topics are sent in parallel.  Messages on different topics may arrive in a different order than
+ * they were published.
+ *
+ * Subscriptions all go through the first member, so subscription IDs and reference counts behave exactly as they do
+ * on a single BrokerConnection.  Message callbacks receive messages from every member.
+ *
+ * Like a single connection, the pool never receives its own publishes, whichever member sent them.  No Local keeps
+ * the broker from echoing the first member's publishes.  With more than one member, every member also sets
+ * ConnectOptions::originTag to the pool's client ID, so each published message carries a kOriginProperty user property
+ * and the first member drops the echoes of the others'.  Only the first member publishes the online status message
+ * and registers a will.
+ */
+class ConnectionPool : public utils::IConnection {
+public:
+    /*! The user property that identifies messages published through a pool with more than one member.  Its value is
+     * the pool's client ID.  It is removed from received messages.
+     */
+    static constexpr const char* kOriginProperty = kOriginTagProperty;
+
+    /*! Constructor.
+     * \param host IP address or hostname of the MQTT broker server.
+     * \param port Port where the MQTT broker is running (often 1883).
+     * \param clientId client ID of the first member, and prefix of the others.
+     * \param size number of broker sessions; at least one is created.
+     * \param options connect options used by every member.
+     * \throw std::invalid_argument if `options.localDelivery` is set, since a publishing member does not know the
+     * subscriptions held by the first member.
+     */
+    ConnectionPool(const std::string& host, int port, const std::string& clientId, std::size_t size,
+                   const ConnectOptions& options = ConnectOptions());
+
+    virtual ~ConnectionPool();
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    /*! Publish a message through the member selected by its topic. */
+    virtual std::future<bool> Publish(const Message& message);
+
+    virtual int Subscribe(const std::string& topic, int qos);
+
+    virtual void Unsubscribe(const std::string& topic);
+
+    virtual std::vector<int> SubscribeMany(const std::vector<std::string>& topics, int qos);
+
+    virtual void UnsubscribeMany(const std::vector<std::string>& topics);
+
+    virtual utils::CallbackHandleType AddMessageCallback(const std::function<void(const Message&)>& cb);
+
+    virtual void RemoveMessageCallback(utils::CallbackHandleType handle);
+
+    virtual bool TopicMatchesSubscription(const std::string& topic, const std::string& subscr) const;
+
+    /*! Returns the client ID of the first member. */
+    virtual std::string GetClientId() const;
+
+    /*! Returns the last will topic of the first member, the only one that reports an online status. */
+    virtual std::string GetLastWillTopic() const;
+
+    virtual std::string GetOnlinePayload() const;
+
+    virtual std::string GetOfflinePayload() const;
+
+    /*! Returns whether every member is connected to the broker. */
+    virtual bool IsConnected() const;
+
+    virtual void SetLogFunction(const utils::LogFunctionType& logFunc);
+    virtual void SetLogLevel(int level);
+    virtual void Log(int level, const char* fmt, ...) const;
+
+    std::size_t Size() const;
+
+    /*! Returns a member, e.g. to add it to a ConnectionReactor when the pool uses `ConnectOptions::externalLoop`. */
+    BrokerConnection& GetMember(std::size_t index);
+
+    /*! Returns the index of the member that publishes messages on `topic`. */
+    std::size_t MemberForTopic(const std::string& topic) const;
+
+protected:
+    // Passes a message received by any member to the pool's message callbacks.  The member has already dropped it if
+    // the pool published it.
+    void Dispatch(const Message& message);
+
+private:
+    utils::MessageCallbackList _messageCallbacks;
+
+    utils::Logger _logger;
+
+    // Declared last so that the members, and their network threads, are gone before the callbacks they call into.
+    std::vector<std::unique_ptr<BrokerConnection>> _members;
+};
+
+} // namespace mqtt
+} // namespace stinger
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace stinger {
+namespace mqtt {
+
+class BrokerConnection;
+
+/**
+ * @brief Drives many BrokerConnections from a small, fixed pool of epoll threads.
+ *
+ * Each connection is assigned to one worker thread, round-robin, and driven through the external event-loop
+ * interface of BrokerConnection (see `ConnectOptions::externalLoop`), so a process with thousands of connections
+ * needs only as many network threads as the reactor has workers.  Each worker waits on its connections' sockets with
+ * epoll.  It also keeps a timer wheel that calls `LoopMisc()` on every connection once per second; keepalive pings
+ * and reconnect backoff are timed from there.
+ *
+ * Message callbacks run on the worker thread of their connection, so they should not block.  They must not call
+ * `Add` or `Remove`.
+ */
+class ConnectionReactor {
+public:
+    /*! Constructor.
+     * \param threadCount number of epoll worker threads; at least one is started.
+     */
+    explicit ConnectionReactor(std::size_t threadCount = 1);
+
+    /*! Stops the worker threads.  Connections that are still added are left connected but are no longer driven. */
+    ~ConnectionReactor();
+
+    ConnectionReactor(const ConnectionReactor&) = delete;
+    ConnectionReactor& operator=(const ConnectionReactor&) = delete;
+
+    /*! Starts driving a connection.
+     * The connection must outlive its membership in the reactor.  Its loop wakeup function is replaced.
+     * \param connection a connection created with `ConnectOptions::externalLoop` set.
+     * \throw std::invalid_argument if the connection does not use an external loop or was already added.
+     */
+    void Add(BrokerConnection& connection);
+
+    /*! Stops driving a connection.  Returns once its worker thread no longer touches it.
+     * No other thread may use the connection while it is being removed.
+     */
+    void Remove(BrokerConnection& connection);
+
+    std::size_t Size() const;
+
+    std::size_t ThreadCount() const;
+
+private:
+    struct Worker;
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    mutable std::mutex _mutex;
+    std::map<BrokerConnection*, std::pair<Worker*, std::uint64_t>> _connections;
+    std::uint64_t _nextId = 1;
+    std::size_t _nextWorker = 0;
+};
+
+} // namespace mqtt
+} // namespace stinger
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace stinger {
+namespace mqtt {
+
+/*! The user property that carries ConnectOptions::originTag.  Connections remove it from received messages before
+ * they reach the message callbacks.
+ */
+constexpr const char* kOriginTagProperty = "StingerPoolOrigin";
+
+/**
+ * @brief Options used when a BrokerConnection connects to the broker.
+ */
+struct ConnectOptions {
+    // Seconds between keepalive pings.
+    int keepAliveSeconds = 120;
+    // MQTT v5 Session Expiry Interval, in seconds.  When set, the broker keeps the session (subscriptions and
+    // in-flight QoS 1/2 messages) for this long after the connection drops, so a reconnect within that time resumes
+    // it without resubscribing.  0xFFFFFFFF means the session never expires; unset means it ends on disconnect.
+    std::optional<std::uint32_t> sessionExpiryInterval;
+    // Maximum number of unacknowledged QoS 1/2 messages the broker may send to this client at once.
+    std::optional<std::uint16_t> receiveMaximum;
+    // Largest packet, in bytes, this client accepts.  The broker drops messages that would exceed it.
+    std::optional<std::uint32_t> maximumPacketSize;
+    // Deliver published messages straight to this connection's own message callbacks when they match one of its
+    // non-shared subscriptions, in addition to sending them to the broker for remote subscribers.  Subscriptions
+    // use No Local, so the broker never echoes these messages back.
+    bool localDelivery = false;
+    // Adds a kOriginTagProperty user property with this value to every publish, and drops received messages that
+    // carry the same value.  No Local only filters a session's own publishes, so ConnectionPool gives all of its
+    // members one tag to filter the echoes of each other's.  BrokerConnection only.
+    std::optional<std::string> originTag;
+    // Publish the retained online status message on every connect, and register the offline one as the will.
+    // ConnectionPool clears it on all members but the first, so that the pool reports one status.  BrokerConnection
+    // only.
+    bool onlineStatus = true;
+    // Do not start mosquitto's network thread.  The application drives the connection from its own event loop with
+    // BrokerConnection::GetLoopInterest(), LoopRead(), LoopWrite() and LoopMisc(), and message callbacks run on
+    // that loop's thread.
+    bool externalLoop = false;
+    // Connect on a background thread so that the constructor returns immediately instead of waiting for DNS and the
+    // TCP handshake.  Publishes and subscriptions queue until the connection is established; use
+    // BrokerConnection::GetConnectedFuture() to wait for it.  The destructor waits for an attempt in progress.
+    bool asyncConnect = false;
+    // Disable Nagle's algorithm on TCP connections, so small packets are sent without waiting to be coalesced.
+    bool tcpNoDelay = false;
+    // Socket send and receive buffer sizes (SO_SNDBUF / SO_RCVBUF), in bytes.  Applied when each connection is
+    // accepted by the broker; unset leaves the system default.
+    std::optional<int> sendBufferSize;
+    std::optional<int> receiveBufferSize;
+    // Pin mosquitto's network thread to this CPU (Linux only).  Ignored with externalLoop, where the application owns
+    // the thread.
+    std::optional<int> networkThreadCpu;
+};
+
+} // namespace mqtt
+} // namespace stinger
@@ -1,27 +1,149 @@
 #pragma once
 
 #include "stinger/error/return_codes.hpp"
+#include "stinger/mqtt/messagekind.hpp"
 #include "stinger/mqtt/properties.hpp"
+#include "stinger/utils/topictable.hpp"
+#include <atomic>
+#include <cstddef>
 #include <optional>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace stinger {
 namespace mqtt {
 
+/**
+ * @brief The topic of a Message: a string that caches its TopicId.
+ *
+ * It reads like a `const std::string`, and converts to one.  Changing it goes through assignment, assign() or
+ * clear(), which drop the cached ID, so a looked-up ID is reused until the topic changes and reading it costs nothing.
+ */
+class MessageTopic {
+public:
+    MessageTopic() = default;
+    MessageTopic(std::string name) : _name(std::move(name)) {}
+    MessageTopic(std::string_view name) : _name(name) {}
+    MessageTopic(const char* name) : _name(name) {}
+
+    MessageTopic(const MessageTopic& other) : _name(other._name), _id(other._id.load(std::memory_order_relaxed)) {}
+    MessageTopic(MessageTopic&& other) noexcept
+        : _name(std::move(other._name)), _id(other._id.load(std::memory_order_relaxed)) {}
+    MessageTopic& operator=(const MessageTopic& other);
+    MessageTopic& operator=(MessageTopic&& other) noexcept;
+
+    MessageTopic& operator=(const std::string& name) { return assign(name.data(), name.size()); }
+    MessageTopic& operator=(std::string&& name) {
+        _name = std::move(name);
+        _id.store(utils::kInvalidTopicId, std::memory_order_relaxed);
+        return *this;
+    }
+    MessageTopic& operator=(std::string_view name) { return assign(name.data(), name.size()); }
+    MessageTopic& operator=(const char* name) { return *this = std::string_view(name); }
+
+    /*! Replaces the topic, reusing the memory already allocated for it. */
+    MessageTopic& assign(const char* data, std::size_t size) {
+        _name.assign(data, size);
+        _id.store(utils::kInvalidTopicId, std::memory_order_relaxed);
+        return *this;
+    }
+
+    MessageTopic& assign(std::string_view name) { return assign(name.data(), name.size()); }
+
+    void clear() { assign("", 0); }
+
+    const std::string& str() const { return _name; }
+    operator const std::string&() const { return _name; }
+    operator std::string_view() const { return _name; }
+    const char* c_str() const { return _name.c_str(); }
+    const char* data() const { return _name.data(); }
+    std::size_t size() const { return _name.size(); }
+    std::size_t length() const { return _name.size(); }
+    bool empty() const { return _name.empty(); }
+    std::string::const_iterator begin() const { return _name.begin(); }
+    std::string::const_iterator end() const { return _name.end(); }
+    char operator[](std::size_t i) const { return _name[i]; }
+
+    /*! The ID of the topic in the global TopicTable, interning it on first use. */
+    utils::TopicId Intern() const;
+
+    /*! The ID of the topic if it is already in the global TopicTable, or kInvalidTopicId.  Never adds to the table. */
+    utils::TopicId Find() const;
+
+private:
+    std::string _name;
+    mutable std::atomic<utils::TopicId> _id{utils::kInvalidTopicId};
+};
+
+// Compares with anything that converts to std::string_view, without going through MessageTopic's constructors.
+template <typename String>
+using EnableIfTopicString = std::enable_if_t<!std::is_same_v<String, MessageTopic> &&
+                                             std::is_convertible_v<const String&, std::string_view>>;
+
+inline bool operator==(const MessageTopic& a, const MessageTopic& b) { return a.str() == b.str(); }
+inline bool operator!=(const MessageTopic& a, const MessageTopic& b) { return a.str() != b.str(); }
+
+template <typename String, typename = EnableIfTopicString<String>>
+bool operator==(const MessageTopic& a, const String& b) {
+    return std::string_view(a) == std::string_view(b);
+}
+
+template <typename String, typename = EnableIfTopicString<String>>
+bool operator==(const String& a, const MessageTopic& b) {
+    return b == a;
+}
+
+template <typename String, typename = EnableIfTopicString<String>>
+bool operator!=(const MessageTopic& a, const String& b) {
+    return !(a == b);
+}
+
+template <typename String, typename = EnableIfTopicString<String>>
+bool operator!=(const String& a, const MessageTopic& b) {
+    return !(b == a);
+}
+
+inline std::ostream& operator<<(std::ostream& os, const MessageTopic& topic) {
+    return os << topic.str();
+}
+
 /**
  * @brief Represents an MQTT message
  */
 struct Message {
-    std::string topic;
+    MessageTopic topic;
     std::string payload;
     unsigned qos;
     bool retain;
     Properties properties;
+    MessageKind kind = MessageKind::Generic; // Set by the factories below; lets encoders use the kind's schema.
 
     Message(const std::string& topic, const std::string& payload, unsigned qos = 0, bool retain = false,
             const Properties& props = Properties());
 
     Message(const Message& other);
+    Message(Message&& other) noexcept;
+    Message& operator=(const Message& other);
+    Message& operator=(Message&& other) noexcept;
+
+    /*! Empties the message so it can be refilled, keeping the memory already allocated for its topic, payload and
+     * properties.  Connections use this to receive into one message per thread instead of allocating for each.
+     * A payload buffer or property arena over 64 KB is released, so one outsized message is not held forever.
+     */
+    void Recycle();
+
+    /*! The ID of `topic` in the global TopicTable, interning it on first use.  The ID is cached until `topic` is
+     * next assigned.  Entries are never removed from the table, so use this only for topics from a bounded set, and
+     * FindTopicId() for arbitrary inbound or outbound topics.
+     */
+    utils::TopicId GetTopicId() const { return topic.Intern(); }
+
+    /*! The ID of `topic` if it has already been interned, e.g. because something subscribed to it, or
+     * kInvalidTopicId.  A found ID is cached like that of GetTopicId().
+     */
+    utils::TopicId FindTopicId() const { return topic.Find(); }
 
     static Message Signal(const std::string& topic, const std::string& payload);
 
@@ -31,6 +153,9 @@ struct Message {
                                          const std::vector<std::byte>& correlationData,
                                          const std::string& responseTopic);
 
+    static Message PropertyUpdateRequest(const std::string& topic, const std::string& payload, int propertyVersion,
+                                         const utils::CorrelationId& correlationId, const std::string& responseTopic);
+
     static Message PropertyUpdateResponse(const std::string& topic, const std::string& payload, int propertyVersion,
                                           const std::optional<std::vector<std::byte>>& correlationData,
                                           stinger::error::MethodReturnCode returnCode, const std::string& debugMessage);
@@ -42,6 +167,9 @@ struct Message {
     static Message MethodRequest(const std::string& topic, const std::string& payload,
                                  const std::vector<std::byte>& correlationData, const std::string& responseTopic);
 
+    static Message MethodRequest(const std::string& topic, const std::string& payload,
+                                 const utils::CorrelationId& correlationId, const std::string& responseTopic);
+
     static Message MethodResponse(const std::string& topic, const std::string& payload,
                                   const std::optional<std::vector<std::byte>>& correlationData,
                                   stinger::error::MethodReturnCode returnCode, const std::string& debugMessage);
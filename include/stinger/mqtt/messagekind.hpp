@@ -0,0 +1,220 @@
+#pragma once
+
+#include "stinger/mqtt/properties.hpp"
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <string_view>
+
+namespace stinger {
+namespace mqtt {
+
+/*! The Message factory that built a message.  Each kind has a MessageSchema naming the properties it can carry, so
+ * that encoders can drop the code for every other property at compile time.
+ */
+enum class MessageKind : std::uint8_t {
+    Generic, // Built directly; may carry any property.
+    Signal,
+    PropertyValue,
+    PropertyUpdateRequest,
+    PropertyUpdateResponse,
+    MethodRequest,
+    MethodResponse,
+    ServiceOnline,
+    ServiceOffline
+};
+
+template <typename... Fields>
+constexpr std::uint16_t propertyMask(Fields... fields) {
+    return static_cast<std::uint16_t>((0u | ... | propertyBit(fields)));
+}
+
+/**
+ * @brief Compile-time description of a message kind.
+ *
+ * `kProperties` is the mask of properties a message of the kind may carry; each may still be unset.  Arbitrary user
+ * properties may be added to a message of any kind, so encoders always handle them.  The factory kinds also give
+ * their QoS and retain flag.
+ */
+template <MessageKind Kind>
+struct MessageSchema;
+
+template <>
+struct MessageSchema<MessageKind::Generic> {
+    static constexpr std::uint16_t kProperties = propertyMask(
+        PropertyField::CorrelationData, PropertyField::ResponseTopic, PropertyField::SubscriptionId,
+        PropertyField::MessageExpiryInterval, PropertyField::ContentType, PropertyField::DebugInfo,
+        PropertyField::ReturnCode, PropertyField::PropertyVersion, PropertyField::Version,
+        PropertyField::UserProperties);
+};
+
+template <>
+struct MessageSchema<MessageKind::Signal> {
+    static constexpr std::uint16_t kProperties = propertyMask(PropertyField::ContentType);
+    static constexpr unsigned kQos = 2;
+    static constexpr bool kRetain = false;
+};
+
+template <>
+struct MessageSchema<MessageKind::PropertyValue> {
+    static constexpr std::uint16_t kProperties =
+        propertyMask(PropertyField::ContentType, PropertyField::PropertyVersion);
+    static constexpr unsigned kQos = 1;
+    static constexpr bool kRetain = true;
+};
+
+template <>
+struct MessageSchema<MessageKind::PropertyUpdateRequest> {
+    static constexpr std::uint16_t kProperties =
+        propertyMask(PropertyField::ContentType, PropertyField::PropertyVersion, PropertyField::CorrelationData,
+                     PropertyField::ResponseTopic);
+    static constexpr unsigned kQos = 1;
+    static constexpr bool kRetain = false;
+};
+
+template <>
+struct MessageSchema<MessageKind::PropertyUpdateResponse> {
+    static constexpr std::uint16_t kProperties =
+        propertyMask(PropertyField::ContentType, PropertyField::PropertyVersion, PropertyField::CorrelationData,
+                     PropertyField::ReturnCode, PropertyField::DebugInfo);
+    static constexpr unsigned kQos = 1;
+    static constexpr bool kRetain = false;
+};
+
+template <>
+struct MessageSchema<MessageKind::MethodRequest> {
+    static constexpr std::uint16_t kProperties =
+        propertyMask(PropertyField::ContentType, PropertyField::CorrelationData, PropertyField::ResponseTopic);
+    static constexpr unsigned kQos = 2;
+    static constexpr bool kRetain = false;
+};
+
+template <>
+struct MessageSchema<MessageKind::MethodResponse> {
+    static constexpr std::uint16_t kProperties =
+        propertyMask(PropertyField::ContentType, PropertyField::CorrelationData, PropertyField::ReturnCode,
+                     PropertyField::DebugInfo);
+    static constexpr unsigned kQos = 1;
+    static constexpr bool kRetain = false;
+};
+
+template <>
+struct MessageSchema<MessageKind::ServiceOnline> {
+    static constexpr std::uint16_t kProperties =
+        propertyMask(PropertyField::ContentType, PropertyField::MessageExpiryInterval);
+    static constexpr unsigned kQos = 1;
+    static constexpr bool kRetain = true;
+};
+
+template <>
+struct MessageSchema<MessageKind::ServiceOffline> {
+    static constexpr std::uint16_t kProperties = 0;
+    static constexpr unsigned kQos = 1;
+    static constexpr bool kRetain = true;
+};
+
+/*! Calls `visit` with the MessageSchema of `kind`, so that one runtime switch selects code specialized for it.
+ * `present` is the mask of properties actually set; if any falls outside the schema, e.g. because one was added
+ * after the factory returned, the Generic schema is used instead.
+ */
+template <typename Visitor>
+void visitMessageSchema(MessageKind kind, std::uint16_t present, Visitor&& visit) {
+    auto dispatch = [&](auto schema) {
+        if (present & ~(decltype(schema)::kProperties | propertyBit(PropertyField::UserProperties))) {
+            visit(MessageSchema<MessageKind::Generic>());
+        } else {
+            visit(schema);
+        }
+    };
+    switch (kind) {
+    case MessageKind::Signal:
+        return dispatch(MessageSchema<MessageKind::Signal>());
+    case MessageKind::PropertyValue:
+        return dispatch(MessageSchema<MessageKind::PropertyValue>());
+    case MessageKind::PropertyUpdateRequest:
+        return dispatch(MessageSchema<MessageKind::PropertyUpdateRequest>());
+    case MessageKind::PropertyUpdateResponse:
+        return dispatch(MessageSchema<MessageKind::PropertyUpdateResponse>());
+    case MessageKind::MethodRequest:
+        return dispatch(MessageSchema<MessageKind::MethodRequest>());
+    case MessageKind::MethodResponse:
+        return dispatch(MessageSchema<MessageKind::MethodResponse>());
+    case MessageKind::ServiceOnline:
+        return dispatch(MessageSchema<MessageKind::ServiceOnline>());
+    case MessageKind::ServiceOffline:
+        return dispatch(MessageSchema<MessageKind::ServiceOffline>());
+    default:
+        return visit(MessageSchema<MessageKind::Generic>());
+    }
+}
+
+/*! The MQTT user properties with a field in Properties. */
+enum class UserProperty : std::uint8_t { DebugInfo, ReturnCode, PropertyVersion, Version, Unknown };
+
+constexpr std::string_view kUserPropertyNames[] = {"DebugInfo", "ReturnCode", "PropertyVersion", "Version"};
+
+constexpr std::string_view userPropertyName(UserProperty property) {
+    return property == UserProperty::Unknown ? std::string_view() : kUserPropertyNames[static_cast<int>(property)];
+}
+
+namespace detail {
+
+// The names have distinct lengths modulo this table size, so one length lookup and one compare identify a name.
+constexpr std::size_t kUserPropertySlots = 11;
+
+constexpr std::size_t userPropertySlot(std::string_view name) {
+    return name.size() % kUserPropertySlots;
+}
+
+constexpr std::array<UserProperty, kUserPropertySlots> buildUserPropertyTable() {
+    std::array<UserProperty, kUserPropertySlots> table{};
+    for (auto& slot : table) {
+        slot = UserProperty::Unknown;
+    }
+    for (std::size_t i = 0; i < std::size(kUserPropertyNames); ++i) {
+        table[userPropertySlot(kUserPropertyNames[i])] = static_cast<UserProperty>(i);
+    }
+    return table;
+}
+
+constexpr std::array<UserProperty, kUserPropertySlots> kUserPropertyTable = buildUserPropertyTable();
+
+constexpr bool userPropertyHashIsPerfect() {
+    for (std::size_t i = 0; i < std::size(kUserPropertyNames); ++i) {
+        if (kUserPropertyTable[userPropertySlot(kUserPropertyNames[i])] != static_cast<UserProperty>(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(userPropertyHashIsPerfect(), "user property names collide; change kUserPropertySlots");
+
+} // namespace detail
+
+/*! Identifies a user property name without a chain of string compares. */
+constexpr UserProperty userPropertyFromName(std::string_view name) {
+    UserProperty candidate = detail::kUserPropertyTable[detail::userPropertySlot(name)];
+    if (candidate == UserProperty::Unknown || userPropertyName(candidate) != name) {
+        return UserProperty::Unknown;
+    }
+    return candidate;
+}
+
+/*! The value of a ReturnCode or PropertyVersion user property, or nullopt if it is not a whole int.  Never throws,
+ * since the text comes from the network.
+ */
+inline std::optional<int> parseUserPropertyInt(std::string_view text) {
+    int value = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+} // namespace mqtt
+} // namespace stinger
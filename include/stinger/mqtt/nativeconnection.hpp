@@ -0,0 +1,195 @@
+#pragma once
+
+#include "stinger/mqtt/connectoptions.hpp"
+#include "stinger/mqtt/message.hpp"
+#include "stinger/utils/callbacklist.hpp"
+#include "stinger/utils/iconnection.hpp"
+#include "stinger/utils/logger.hpp"
+#include "stinger/utils/subscriptiontracker.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace stinger {
+namespace mqtt {
+
+struct ConnackView;
+struct FixedHeader;
+
+/**
+ * @brief An MQTT v5 connection that speaks the protocol itself instead of going through libmosquitto.
+ *
+ * Messages and properties are encoded straight from Message into one reusable outbound buffer, which the publishing
+ * thread writes to the socket.  A single epoll-driven I/O thread connects, reads, writes whatever the socket could not
+ * take at once, and sends keepalive pings.  Inbound packets are parsed in place in the receive buffer, and only the
+ * Message handed to the callbacks is copied out of it.  There is no per-message property list or packet allocation.
+ *
+ * Behaviour matches BrokerConnection:
+ * - the same online and last will messages,
+ * - reference-counted subscriptions with No Local,
+ * - queueing while disconnected,
+ * - reconnecting with incremental backoff,
+ * - localDelivery and the socket options in ConnectOptions.
+ * It always connects in the background, as with `ConnectOptions::asyncConnect`.  `externalLoop` is not supported.
+ * TLS and authentication are not supported.  Linux only.
+ */
+class NativeConnection : public utils::IConnection {
+public:
+    /*! Constructor.  Returns immediately; the I/O thread connects in the background.
+     * \param host IP address or hostname of the MQTT broker, or the path of its Unix domain socket when `port` is 0.
+     * \param port Port where the MQTT broker is running (often 1883), or 0 for a Unix domain socket.
+     * \param options keepalive, session expiry, flow-control and socket settings.
+     * \throw std::invalid_argument if `options.externalLoop` is set.
+     * \throw std::runtime_error if the epoll instance cannot be created.
+     */
+    NativeConnection(const std::string& host, int port, const std::string& clientId,
+                     const ConnectOptions& options = ConnectOptions());
+
+    virtual ~NativeConnection();
+
+    NativeConnection(const NativeConnection&) = delete;
+    NativeConnection& operator=(const NativeConnection&) = delete;
+
+    /*! Publish a message.
+     * \return A future which is resolved to true once a QoS 0 message has been handed to the socket, or once the
+     * broker acknowledges a QoS 1 or 2 message.  It resolves to false if the connection is destroyed first.
+     */
+    virtual std::future<bool> Publish(const Message& message) override;
+    virtual int Subscribe(const std::string& topic, int qos) override;
+    virtual void Unsubscribe(const std::string& topic) override;
+    virtual std::vector<int> SubscribeMany(const std::vector<std::string>& topics, int qos) override;
+    virtual void UnsubscribeMany(const std::vector<std::string>& topics) override;
+    virtual utils::CallbackHandleType AddMessageCallback(const std::function<void(const Message&)>& cb) override;
+    virtual void RemoveMessageCallback(utils::CallbackHandleType handle) override;
+    virtual bool TopicMatchesSubscription(const std::string& topic, const std::string& subscr) const override;
+    virtual std::string GetClientId() const override;
+    virtual std::string GetLastWillTopic() const override;
+    virtual std::string GetOnlinePayload() const override;
+    virtual std::string GetOfflinePayload() const override;
+
+    virtual bool IsConnected() const;
+
+    const ConnectOptions& GetConnectOptions() const;
+
+    /*! Returns a future that becomes true when the broker first accepts the connection.
+     * It becomes false if the connection is destroyed first.
+     */
+    std::shared_future<bool> GetConnectedFuture() const;
+
+    virtual void SetLogFunction(const utils::LogFunctionType& logFunc);
+    virtual void SetLogLevel(int level);
+    virtual void Log(int level, const char* fmt, ...) const override;
+
+private:
+    enum class State { Disconnected, Connecting, AwaitingConnack, Connected };
+
+    struct PendingPublish {
+        Message message;
+        std::shared_ptr<std::promise<bool>> promise; // Null for the online message.
+    };
+
+    // A QoS 1 or 2 publish waiting for PUBACK, or for PUBREC and then PUBCOMP.
+    struct Inflight {
+        Message message;
+        std::shared_ptr<std::promise<bool>> promise;
+        std::uint64_t sequence = 0; // Send order, for retransmission after a reconnect.
+        bool released = false;      // PUBREC received and PUBREL sent.
+    };
+
+    void Run();
+    // Creates a non-blocking socket and starts connecting it.  Returns -1 if no address could be tried.
+    int OpenSocket();
+    void ApplySocketOptions(int fd, bool tcp);
+    void StartConnect();
+    void FinishConnect();
+    void ReadSocket();
+    void HandlePacket(const FixedHeader& header, std::string_view body);
+    void HandleConnack(const ConnackView& connack);
+    // Closes the socket, if any, and schedules the next connection attempt.
+    void CloseSocket(const char* reason);
+
+    // Send a SUBSCRIBE or UNSUBSCRIBE for the subscription tracker, or return false while disconnected.
+    bool SendSubscribe(const std::vector<std::string_view>& topics, int subscriptionId, int qos);
+    bool SendUnsubscribe(const std::vector<std::string_view>& topics);
+
+    // The following require _mutex.
+    void SendPublishLocked(const Message& message, const std::shared_ptr<std::promise<bool>>& promise);
+    void DrainSendQueueLocked();
+    void SendSubscribeLocked(const std::vector<std::string_view>& topics, int subscriptionId, int qos);
+    void SendUnsubscribeLocked(const std::vector<std::string_view>& topics);
+    std::uint16_t NextPacketIdLocked();
+    // Writes as much of the outbound buffer as the socket takes, and waits for EPOLLOUT if anything is left.
+    void FlushLocked();
+    void SetWantWriteLocked(bool wantWrite);
+
+    void Dispatch(const Message& message);
+    // Passes a published message to the message callbacks if it matches a local, non-shared subscription.
+    void DeliverLocally(const Message& message);
+
+    Message OnlineMessage() const;
+
+    std::string _host;
+    int _port;
+    std::string _clientId;
+    ConnectOptions _options;
+
+    int _epollFd = -1;
+    int _wakeFd = -1;
+    std::thread _ioThread;
+    std::atomic<bool> _stopping{false};
+    std::atomic<bool> _connected{false};
+
+    // Only touched on the I/O thread.
+    std::string _inbound; // Receive buffer; only the first _inboundLength bytes hold data.
+    std::size_t _inboundLength = 0;
+    std::set<std::uint16_t> _inboundQos2; // PUBREC sent, PUBREL not yet received.
+    Message _received{"", ""};            // Refilled for each inbound PUBLISH.
+    int _reconnectAttempts = 0;
+    int _keepAliveSeconds = 0;
+    std::chrono::steady_clock::time_point _nextReconnect;
+    std::chrono::steady_clock::time_point _connectDeadline;
+    std::chrono::steady_clock::time_point _lastReceive;
+#ifdef STINGER_ONLINE_PUBLISH_THREAD
+    std::chrono::steady_clock::time_point _nextOnlinePublish;
+#endif
+
+    // _fd and _state are only changed on the I/O thread, which may therefore read them without the lock.
+    mutable std::mutex _mutex;
+    State _state = State::Disconnected;
+    int _fd = -1;
+    bool _wantWrite = false;
+    std::string _outbound;
+    std::size_t _outboundSent = 0;
+    std::chrono::steady_clock::time_point _lastSend;
+    std::deque<PendingPublish> _sendQueue; // Waiting for the connection or for the broker's receive maximum.
+    std::map<std::uint16_t, Inflight> _inflight;
+    // SUBSCRIBE and UNSUBSCRIBE packet IDs awaiting acknowledgement, with the topics of each UNSUBSCRIBE.
+    std::map<std::uint16_t, std::vector<std::string>> _subscribeAcks;
+    std::uint16_t _lastPacketId = 0;
+    std::uint64_t _nextSequence = 0;
+    std::size_t _serverReceiveMaximum = 65535;
+    utils::MessageCallbackList _messageCallbacks;
+    std::promise<bool> _connectedPromise;
+    std::shared_future<bool> _connectedFuture;
+    bool _connectedPromiseSet = false;
+
+    utils::SubscriptionTracker _subscriptions;
+
+    utils::Logger _logger;
+};
+
+} // namespace mqtt
+} // namespace stinger
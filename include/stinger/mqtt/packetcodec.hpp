@@ -0,0 +1,154 @@
+#pragma once
+
+#include "stinger/mqtt/connectoptions.hpp"
+#include "stinger/mqtt/message.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace stinger {
+namespace mqtt {
+
+/**
+ * @brief MQTT v5 control packet encoding and decoding, as used by NativeConnection.
+ *
+ * Encoders append a complete packet to a caller-owned buffer, so a connection can build all of its outbound traffic
+ * in one reusable string.  Decoders work in place: strings and binary data in the decoded structs are views into the
+ * packet bytes, which must outlive them.
+ */
+
+enum class PacketType : std::uint8_t {
+    Connect = 1,
+    Connack = 2,
+    Publish = 3,
+    Puback = 4,
+    Pubrec = 5,
+    Pubrel = 6,
+    Pubcomp = 7,
+    Subscribe = 8,
+    Suback = 9,
+    Unsubscribe = 10,
+    Unsuback = 11,
+    Pingreq = 12,
+    Pingresp = 13,
+    Disconnect = 14,
+    Auth = 15
+};
+
+enum class DecodeStatus { Complete, Incomplete, Malformed };
+
+struct FixedHeader {
+    PacketType type = PacketType::Connect;
+    std::uint8_t flags = 0;          // Low nibble of the first byte.
+    std::size_t headerSize = 0;      // First byte plus the remaining-length varint.
+    std::size_t remainingLength = 0; // Bytes that follow the fixed header.
+    std::size_t Size() const { return headerSize + remainingLength; }
+};
+
+/*! An inbound PUBLISH packet.  Views point into the packet. */
+struct PublishView {
+    std::string_view topic;
+    std::string_view payload;
+    unsigned qos = 0;
+    bool retain = false;
+    bool dup = false;
+    std::uint16_t packetId = 0;
+    std::optional<std::string_view> correlationData;
+    std::optional<std::string_view> responseTopic;
+    std::optional<std::string_view> contentType;
+    std::optional<std::uint32_t> messageExpiryInterval;
+    std::optional<std::uint32_t> subscriptionId; // The first one, if the broker sent several.
+    // User properties with the names used by Properties.
+    std::optional<std::string_view> debugInfo;
+    std::optional<std::string_view> returnCode;
+    std::optional<std::string_view> propertyVersion;
+    std::optional<std::string_view> version;
+    // Whether there are user properties besides those above.  They are found by parsing `propertyBlock` again.
+    bool otherUserProperties = false;
+    std::string_view propertyBlock; // The raw property block, without its length.
+
+    /*! The value of the first user property named `name`, found without copying the packet. */
+    std::optional<std::string_view> FindUserProperty(std::string_view name) const;
+
+    /*! Copies the packet into an owned Message. */
+    Message ToMessage() const;
+
+    /*! Copies the packet into `out`, reusing its buffers, so a receive loop that keeps one Message does not allocate
+     * once the buffers have grown to the usual message size.
+     */
+    void ToMessage(Message& out) const;
+};
+
+struct ConnackView {
+    bool sessionPresent = false;
+    std::uint8_t reasonCode = 0;
+    std::optional<std::uint16_t> receiveMaximum;
+    std::optional<std::uint16_t> serverKeepAlive;
+    bool sharedSubscriptionAvailable = true;
+    std::optional<std::string_view> reasonString;
+};
+
+/*! PUBACK, PUBREC, PUBREL, PUBCOMP, SUBACK and UNSUBACK. */
+struct AckView {
+    std::uint16_t packetId = 0;
+    // One reason code for publish acknowledgements; one per topic for SUBACK and UNSUBACK.
+    std::string_view reasonCodes;
+    std::uint8_t FirstReasonCode() const { return reasonCodes.empty() ? 0 : std::uint8_t(reasonCodes[0]); }
+};
+
+const std::uint8_t kSubscribeNoLocal = 0x04;
+
+/*! The longest string MQTT can carry, since topics, the client ID and string properties have a 16-bit length prefix.
+ * The encoders throw std::length_error for a longer one, leaving `out` as it was.
+ */
+const std::size_t kMaxStringSize = 0xFFFF;
+
+/*! Appends a CONNECT packet.
+ * \param will optional last will message; its topic, payload, QoS, retain flag, content type and expiry are used.
+ */
+void encodeConnect(std::string& out, const std::string& clientId, const ConnectOptions& options, bool cleanStart,
+                   const Message* will);
+
+/*! Appends a PUBLISH packet.  `packetId` is ignored for QoS 0. */
+void encodePublish(std::string& out, const Message& message, std::uint16_t packetId, bool dup = false);
+
+/*! The size of the PUBLISH packet `encodePublish` would append, which also checks that it can be encoded. */
+std::size_t publishPacketSize(const Message& message);
+
+/*! Appends a SUBSCRIBE packet for `topics`, all with the same QoS and subscription ID.
+ * Plain subscriptions get the No Local option; shared subscriptions, which may not use it, do not.
+ */
+void encodeSubscribe(std::string& out, std::uint16_t packetId, const std::vector<std::string_view>& topics, int qos,
+                     int subscriptionId);
+
+void encodeUnsubscribe(std::string& out, std::uint16_t packetId, const std::vector<std::string_view>& topics);
+
+/*! Appends a PUBACK, PUBREC, PUBREL or PUBCOMP packet. */
+void encodeAck(std::string& out, PacketType type, std::uint16_t packetId, std::uint8_t reasonCode = 0);
+
+void encodePingreq(std::string& out);
+
+void encodeDisconnect(std::string& out, std::uint8_t reasonCode = 0);
+
+/*! Parses the fixed header at the start of `data`.
+ * \return Incomplete until the whole fixed header is available; the packet itself may still be incomplete.
+ */
+DecodeStatus decodeFixedHeader(std::string_view data, FixedHeader& header);
+
+/*! Decodes the variable header and payload of a PUBLISH packet.
+ * \param flags the fixed header flags, which carry DUP, QoS and RETAIN.
+ */
+bool decodePublish(std::uint8_t flags, std::string_view body, PublishView& out);
+
+bool decodeConnack(std::string_view body, ConnackView& out);
+
+bool decodeAck(PacketType type, std::string_view body, AckView& out);
+
+/*! Decodes a DISCONNECT packet's reason code, which is 0 when the packet has no body. */
+bool decodeDisconnect(std::string_view body, std::uint8_t& reasonCode);
+
+} // namespace mqtt
+} // namespace stinger
@@ -1,29 +1,666 @@
 #pragma once
 
+#include "stinger/utils/uuid.hpp"
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <iterator>
 #include <optional>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace stinger {
 namespace mqtt {
 
-struct Properties {
-    Properties()
-        : correlationData(std::nullopt), responseTopic(std::nullopt), subscriptionId(std::nullopt),
-          messageExpiryInterval(std::nullopt), contentType(std::nullopt), debugInfo(std::nullopt),
-          returnCode(std::nullopt), propertyVersion(std::nullopt), version(std::nullopt) {}
-    std::optional<std::vector<std::byte>> correlationData;
-    std::optional<std::string> responseTopic;
-    std::optional<std::uint32_t> subscriptionId; // Ignored on publish
-    std::optional<std::uint32_t> messageExpiryInterval;
-    std::optional<std::string> contentType;
+enum class PropertyField : std::uint8_t {
+    CorrelationData,
+    ResponseTopic,
+    SubscriptionId,
+    MessageExpiryInterval,
+    ContentType,
+    DebugInfo,
+    ReturnCode,
+    PropertyVersion,
+    Version,
+    UserProperties
+};
+
+/*! The bit for `field` in a mask of properties, such as Properties::PresentMask(). */
+constexpr std::uint16_t propertyBit(PropertyField field) {
+    return static_cast<std::uint16_t>(1u << static_cast<unsigned>(field));
+}
+
+/*! Read-only view of a string property.  It is NUL-terminated, and valid until its Properties is next changed or
+ * destroyed.
+ */
+class PropertyString {
+public:
+    PropertyString(const char* data, std::size_t size) : _data(data), _size(size) {}
+
+    const char* data() const { return _data; }
+    const char* c_str() const { return _data; }
+    std::size_t size() const { return _size; }
+    std::size_t length() const { return _size; }
+    bool empty() const { return _size == 0; }
+    const char* begin() const { return _data; }
+    const char* end() const { return _data + _size; }
+    char operator[](std::size_t i) const { return _data[i]; }
+
+    std::string str() const { return std::string(_data, _size); }
+    operator std::string_view() const { return std::string_view(_data, _size); }
+    operator std::string() const { return str(); }
+
+private:
+    const char* _data;
+    std::size_t _size;
+};
+
+inline bool operator==(const PropertyString& a, const PropertyString& b) {
+    return std::string_view(a) == std::string_view(b);
+}
+inline bool operator==(const PropertyString& a, std::string_view b) { return std::string_view(a) == b; }
+inline bool operator==(std::string_view a, const PropertyString& b) { return a == std::string_view(b); }
+inline bool operator!=(const PropertyString& a, const PropertyString& b) { return !(a == b); }
+inline bool operator!=(const PropertyString& a, std::string_view b) { return !(a == b); }
+inline bool operator!=(std::string_view a, const PropertyString& b) { return !(a == b); }
+
+inline std::ostream& operator<<(std::ostream& os, const PropertyString& value) {
+    return os << std::string_view(value);
+}
+
+/*! Read-only view of a binary property, with the same lifetime as PropertyString. */
+class PropertyBytes {
+public:
+    PropertyBytes(const std::byte* data, std::size_t size) : _data(data), _size(size) {}
+    PropertyBytes(const std::vector<std::byte>& bytes) : _data(bytes.data()), _size(bytes.size()) {}
+    PropertyBytes(const utils::CorrelationId& id) : _data(id.data()), _size(id.size()) {}
+
+    const std::byte* data() const { return _data; }
+    std::size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    const std::byte* begin() const { return _data; }
+    const std::byte* end() const { return _data + _size; }
+    std::byte operator[](std::size_t i) const { return _data[i]; }
+
+    std::vector<std::byte> vec() const { return std::vector<std::byte>(_data, _data + _size); }
+    operator std::vector<std::byte>() const { return vec(); }
+
+private:
+    const std::byte* _data;
+    std::size_t _size;
+};
+
+bool operator==(const PropertyBytes& a, const PropertyBytes& b);
+inline bool operator==(const PropertyBytes& a, const std::vector<std::byte>& b) {
+    return a == PropertyBytes(b.data(), b.size());
+}
+inline bool operator==(const std::vector<std::byte>& a, const PropertyBytes& b) { return b == a; }
+inline bool operator!=(const PropertyBytes& a, const PropertyBytes& b) { return !(a == b); }
+inline bool operator!=(const PropertyBytes& a, const std::vector<std::byte>& b) { return !(a == b); }
+inline bool operator!=(const std::vector<std::byte>& a, const PropertyBytes& b) { return !(b == a); }
+
+namespace detail {
+
+// Lets `x->member` work where `*x` is a temporary, as with an iterator or a field of Properties.
+template <typename T>
+class PropertyArrow {
+public:
+    explicit PropertyArrow(T value) : _value(value) {}
+    const T* operator->() const { return &_value; }
+
+private:
+    T _value;
+};
+
+/**
+ * The data behind Properties: a presence bitmask, four integers, and one arena holding the string and binary
+ * values back to back in field order, each followed by a NUL.  The arena is an inline buffer until the values
+ * outgrow it.  The user properties are a single value, their entries packed as described at UserProperties.
+ */
+struct PropertyStorage {
+    static constexpr std::size_t kVariableFields = 6;
+    static constexpr std::size_t kInlineCapacity = 72;
+
+    PropertyStorage() noexcept {}
+    PropertyStorage(const PropertyStorage& other);
+    PropertyStorage(PropertyStorage&& other) noexcept;
+    PropertyStorage& operator=(const PropertyStorage& other);
+    PropertyStorage& operator=(PropertyStorage&& other) noexcept;
+    ~PropertyStorage();
+
+    bool Has(PropertyField field) const { return present & Bit(field); }
+
+    std::uint32_t Scalar(PropertyField field) const { return scalars[ScalarIndex(field)]; }
+    void SetScalar(PropertyField field, std::uint32_t value) {
+        scalars[ScalarIndex(field)] = value;
+        present |= Bit(field);
+    }
+
+    std::string_view Variable(PropertyField field) const {
+        std::size_t index = VariableIndex(field);
+        return std::string_view(Arena() + Offset(index), lengths[index]);
+    }
+    // \throw std::length_error if `size` exceeds 65535, the MQTT limit for string and binary properties.
+    void SetVariable(PropertyField field, const char* data, std::size_t size);
+
+    // Replaces `removeSize` bytes at `position` in the value of `field` with an uninitialized gap of `insertSize`
+    // bytes, setting the field first if needed, and returns the gap.
+    // \throw std::length_error if the value would exceed 65535 bytes.
+    char* Splice(PropertyField field, std::size_t position, std::size_t removeSize, std::size_t insertSize);
+
+    void Reset(PropertyField field);
+
+    // Unsets every field, keeping the arena.
+    void Clear() {
+        memset(scalars, 0, sizeof(scalars));
+        memset(lengths, 0, sizeof(lengths));
+        present = 0;
+    }
+
+    // Resizes a heap arena to the bytes in use, moving them back inline if they fit.
+    void ShrinkToFit();
+
+    const char* Arena() const { return heapCapacity ? heap : inlineBuffer; }
+    char* Arena() { return heapCapacity ? heap : inlineBuffer; }
+    std::size_t Capacity() const { return heapCapacity ? heapCapacity : kInlineCapacity; }
+    std::size_t Used() const { return Offset(kVariableFields); }
+
+    static constexpr std::uint16_t Bit(PropertyField field) { return propertyBit(field); }
+
+    std::uint32_t scalars[4] = {};
+    std::uint32_t heapCapacity = 0; // 0 while the arena is inlineBuffer.
+    std::uint16_t lengths[kVariableFields] = {};
+    std::uint16_t present = 0;
+    union {
+        char inlineBuffer[kInlineCapacity];
+        char* heap;
+    };
+
+private:
+    static constexpr std::size_t ScalarIndex(PropertyField field) {
+        switch (field) {
+        case PropertyField::SubscriptionId:
+            return 0;
+        case PropertyField::MessageExpiryInterval:
+            return 1;
+        case PropertyField::ReturnCode:
+            return 2;
+        default:
+            return 3;
+        }
+    }
+
+    static constexpr std::size_t VariableIndex(PropertyField field) {
+        switch (field) {
+        case PropertyField::CorrelationData:
+            return 0;
+        case PropertyField::ResponseTopic:
+            return 1;
+        case PropertyField::ContentType:
+            return 2;
+        case PropertyField::DebugInfo:
+            return 3;
+        case PropertyField::Version:
+            return 4;
+        default:
+            return 5;
+        }
+    }
+
+    static constexpr PropertyField kVariableOrder[kVariableFields] = {
+        PropertyField::CorrelationData, PropertyField::ResponseTopic, PropertyField::ContentType,
+        PropertyField::DebugInfo,       PropertyField::Version,       PropertyField::UserProperties};
+
+    // Arena offset of the variable field at `index`; with kVariableFields, the bytes in use.
+    std::size_t Offset(std::size_t index) const {
+        std::size_t offset = 0;
+        for (std::size_t i = 0; i < index; ++i) {
+            if (present & Bit(kVariableOrder[i])) {
+                offset += lengths[i] + 1u;
+            }
+        }
+        return offset;
+    }
+
+    void Grow(std::size_t capacity);
+};
+
+} // namespace detail
+
+/*! One user property.  Both strings are views into the Properties, valid until its user properties change. */
+struct UserPropertyEntry {
+    PropertyString name;
+    PropertyString value;
+};
+
+namespace detail {
+
+// Each packed user property is its name and then its value, each a native-endian 16-bit length, the bytes and a NUL.
+constexpr std::size_t kUserPropertyOverhead = 2 * (sizeof(std::uint16_t) + 1);
+
+inline std::uint16_t readPackedLength(const char* position) {
+    std::uint16_t length;
+    memcpy(&length, position, sizeof(length));
+    return length;
+}
+
+} // namespace detail
+
+class UserPropertyIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = UserPropertyEntry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = detail::PropertyArrow<UserPropertyEntry>;
+    using reference = UserPropertyEntry;
+
+    explicit UserPropertyIterator(const char* position) : _position(position) {}
+
+    UserPropertyEntry operator*() const {
+        std::uint16_t nameLength = detail::readPackedLength(_position);
+        const char* value = ValueField();
+        return UserPropertyEntry{PropertyString(_position + sizeof(std::uint16_t), nameLength),
+                                 PropertyString(value + sizeof(std::uint16_t), detail::readPackedLength(value))};
+    }
+    pointer operator->() const { return pointer(**this); }
+    UserPropertyIterator& operator++() {
+        const char* value = ValueField();
+        _position = value + sizeof(std::uint16_t) + detail::readPackedLength(value) + 1;
+        return *this;
+    }
+    UserPropertyIterator operator++(int) {
+        UserPropertyIterator previous = *this;
+        ++*this;
+        return previous;
+    }
+    bool operator==(const UserPropertyIterator& other) const { return _position == other._position; }
+    bool operator!=(const UserPropertyIterator& other) const { return _position != other._position; }
+
+    // Where the entry starts in the packed user properties.
+    const char* Position() const { return _position; }
+
+private:
+    const char* ValueField() const {
+        return _position + sizeof(std::uint16_t) + detail::readPackedLength(_position) + 1;
+    }
+
+    const char* _position;
+};
+
+/**
+ * @brief Read-only view of the MQTT v5 user properties other than those with their own accessor, such as DebugInfo.
+ *
+ * Entries are name/value pairs kept in the order they were added, as MQTT requires when forwarding, and a name may
+ * appear more than once.  They are packed into the same arena as the other string properties, so a few short
+ * entries, such as a trace ID and a tenant tag, take no allocation; lookups scan the entries, which is faster than a
+ * tree or hash map at that size.  A view is valid until its Properties is next changed or destroyed.
+ */
+class UserProperties {
+public:
+    using const_iterator = UserPropertyIterator;
+
+    UserProperties() = default;
+    explicit UserProperties(std::string_view packed) : _packed(packed) {}
+
+    const_iterator begin() const { return const_iterator(_packed.data()); }
+    const_iterator end() const { return const_iterator(_packed.data() + _packed.size()); }
+    bool Empty() const { return _packed.empty(); }
+    std::size_t Size() const { return static_cast<std::size_t>(std::distance(begin(), end())); }
+
+    /*! The value of the first entry named `name`, if any. */
+    std::optional<PropertyString> Find(std::string_view name) const;
+
+    /*! The packed entries, as described at detail::kUserPropertyOverhead. */
+    std::string_view Packed() const { return _packed; }
+
+private:
+    std::string_view _packed;
+};
+
+/*! Whether both hold the same entries in the same order. */
+inline bool operator==(const UserProperties& a, const UserProperties& b) { return a.Packed() == b.Packed(); }
+inline bool operator!=(const UserProperties& a, const UserProperties& b) { return !(a == b); }
+
+/**
+ * The public fields of Properties, kept so that code written when they were std::optional members still compiles.
+ * They support the same uses: testing, `*`, `->`, value(), value_or(), reset(), assignment from a value, an optional or
+ * std::nullopt, comparison, and conversion to the matching std::optional.  Strings and correlation data are returned
+ * as copies, so they stay valid however the Properties changes.  A field cannot be copied out on its own; convert it
+ * to a std::optional instead.  New code should prefer the Get and Set accessors, which do not allocate.
+ */
+template <typename T, PropertyField F>
+class ScalarProperty {
+public:
+    explicit ScalarProperty(detail::PropertyStorage& storage) : _storage(&storage) {}
+    ScalarProperty(const ScalarProperty&) = delete;
+
+    ScalarProperty& operator=(T value) {
+        _storage->SetScalar(F, static_cast<std::uint32_t>(value));
+        return *this;
+    }
+    ScalarProperty& operator=(std::nullopt_t) {
+        reset();
+        return *this;
+    }
+    ScalarProperty& operator=(const std::optional<T>& value) {
+        if (value) {
+            return *this = *value;
+        }
+        return *this = std::nullopt;
+    }
+    ScalarProperty& operator=(const ScalarProperty& other) { return *this = std::optional<T>(other); }
+
+    bool has_value() const { return _storage->Has(F); }
+    explicit operator bool() const { return has_value(); }
+    T operator*() const { return static_cast<T>(_storage->Scalar(F)); }
+    T value() const {
+        if (!has_value()) {
+            throw std::bad_optional_access();
+        }
+        return **this;
+    }
+    T value_or(T fallback) const { return has_value() ? **this : fallback; }
+    void reset() { _storage->Reset(F); }
+    operator std::optional<T>() const { return has_value() ? std::optional<T>(**this) : std::nullopt; }
+
+private:
+    detail::PropertyStorage* _storage;
+};
+
+template <PropertyField F>
+class StringProperty {
+public:
+    explicit StringProperty(detail::PropertyStorage& storage) : _storage(&storage) {}
+    StringProperty(const StringProperty&) = delete;
+
+    StringProperty& operator=(std::string_view value) {
+        _storage->SetVariable(F, value.data(), value.size());
+        return *this;
+    }
+    StringProperty& operator=(const char* value) { return *this = std::string_view(value); }
+    StringProperty& operator=(const std::string& value) { return *this = std::string_view(value); }
+    StringProperty& operator=(const PropertyString& value) { return *this = std::string_view(value); }
+    StringProperty& operator=(std::nullopt_t) {
+        reset();
+        return *this;
+    }
+    StringProperty& operator=(const std::optional<std::string>& value) {
+        if (value) {
+            return *this = std::string_view(*value);
+        }
+        return *this = std::nullopt;
+    }
+    StringProperty& operator=(const StringProperty& other) { return *this = std::optional<std::string>(other); }
+
+    bool has_value() const { return _storage->Has(F); }
+    explicit operator bool() const { return has_value(); }
+    std::string operator*() const { return std::string(_storage->Variable(F)); }
+    detail::PropertyArrow<std::string> operator->() const { return detail::PropertyArrow<std::string>(**this); }
+    std::string value() const {
+        if (!has_value()) {
+            throw std::bad_optional_access();
+        }
+        return **this;
+    }
+    std::string value_or(std::string_view fallback) const {
+        return std::string(has_value() ? _storage->Variable(F) : fallback);
+    }
+    void reset() { _storage->Reset(F); }
+    operator std::optional<std::string>() const {
+        return has_value() ? std::optional<std::string>(**this) : std::nullopt;
+    }
+
+private:
+    detail::PropertyStorage* _storage;
+};
+
+template <PropertyField F>
+class BytesProperty {
+public:
+    explicit BytesProperty(detail::PropertyStorage& storage) : _storage(&storage) {}
+    BytesProperty(const BytesProperty&) = delete;
+
+    BytesProperty& operator=(const PropertyBytes& value) {
+        _storage->SetVariable(F, reinterpret_cast<const char*>(value.data()), value.size());
+        return *this;
+    }
+    BytesProperty& operator=(const std::vector<std::byte>& value) { return *this = PropertyBytes(value); }
+    BytesProperty& operator=(const utils::CorrelationId& value) { return *this = PropertyBytes(value); }
+    BytesProperty& operator=(std::nullopt_t) {
+        reset();
+        return *this;
+    }
+    BytesProperty& operator=(const std::optional<std::vector<std::byte>>& value) {
+        if (value) {
+            return *this = *value;
+        }
+        return *this = std::nullopt;
+    }
+    BytesProperty& operator=(const BytesProperty& other) {
+        return *this = std::optional<std::vector<std::byte>>(other);
+    }
+
+    bool has_value() const { return _storage->Has(F); }
+    explicit operator bool() const { return has_value(); }
+    std::vector<std::byte> operator*() const {
+        std::string_view value = _storage->Variable(F);
+        const std::byte* data = reinterpret_cast<const std::byte*>(value.data());
+        return std::vector<std::byte>(data, data + value.size());
+    }
+    detail::PropertyArrow<std::vector<std::byte>> operator->() const {
+        return detail::PropertyArrow<std::vector<std::byte>>(**this);
+    }
+    std::vector<std::byte> value() const {
+        if (!has_value()) {
+            throw std::bad_optional_access();
+        }
+        return **this;
+    }
+    void reset() { _storage->Reset(F); }
+    operator std::optional<std::vector<std::byte>>() const {
+        return has_value() ? std::optional<std::vector<std::byte>>(**this) : std::nullopt;
+    }
+
+private:
+    detail::PropertyStorage* _storage;
+};
+
+// Comparisons behave like those of the std::optional each field replaces.
+
+template <typename T, PropertyField F, typename U>
+bool operator==(const ScalarProperty<T, F>& a, const U& b) {
+    return std::optional<T>(a) == b;
+}
+template <typename T, PropertyField F, typename U>
+bool operator!=(const ScalarProperty<T, F>& a, const U& b) {
+    return !(a == b);
+}
+
+template <PropertyField F, typename U>
+bool operator==(const StringProperty<F>& a, const U& b) {
+    return std::optional<std::string>(a) == b;
+}
+template <PropertyField F, typename U>
+bool operator!=(const StringProperty<F>& a, const U& b) {
+    return !(a == b);
+}
+
+template <PropertyField F, typename U>
+bool operator==(const BytesProperty<F>& a, const U& b) {
+    return std::optional<std::vector<std::byte>>(a) == b;
+}
+template <PropertyField F, typename U>
+bool operator!=(const BytesProperty<F>& a, const U& b) {
+    return !(a == b);
+}
+
+/**
+ * MQTT v5 message properties.
+ *
+ * Every field lives in one compact block: integers inline, and strings and correlation data in an inline arena
+ * that only moves to the heap when their combined size exceeds `kInlineCapacity`.  Setting the properties of a
+ * typical message does not allocate, and copying one is a single memcpy.
+ *
+ * Each field has a getter that returns nothing while it is unset, and a setter that unsets it when given
+ * std::nullopt.  String and binary getters return views into the arena, valid until the Properties is next changed
+ * or destroyed; copy them, e.g. with PropertyString::str(), to keep them longer.  The fields at the end give the same
+ * values the way the std::optional members of earlier versions did.
+ */
+class Properties {
+public:
+    static constexpr std::size_t kInlineCapacity = detail::PropertyStorage::kInlineCapacity;
+
+    Properties() noexcept {}
+    // The fields are bound to their own Properties, so only the storage is copied or moved.
+    Properties(const Properties& other) : _storage(other._storage) {}
+    Properties(Properties&& other) noexcept : _storage(std::move(other._storage)) {}
+    Properties& operator=(const Properties& other) {
+        _storage = other._storage;
+        return *this;
+    }
+    Properties& operator=(Properties&& other) noexcept {
+        _storage = std::move(other._storage);
+        return *this;
+    }
+
+    bool Has(PropertyField field) const { return _storage.Has(field); }
+
+    /*! The set fields, as a mask of propertyBit() values. */
+    std::uint16_t PresentMask() const { return _storage.present; }
+
+    /*! Unsets every field.  Unlike assigning `Properties()`, any heap arena is kept for reuse. */
+    void Clear() { _storage.Clear(); }
+
+    /*! Whether the string and binary values fit in the inline arena, so that no heap memory is held. */
+    bool IsInline() const { return _storage.heapCapacity == 0; }
+
+    /*! Bytes the arena can hold before it has to grow, inline or on the heap. */
+    std::size_t ArenaCapacity() const { return _storage.Capacity(); }
+
+    /*! Releases the heap arena's spare capacity, or the heap arena itself if the values now fit inline. */
+    void ShrinkToFit() { _storage.ShrinkToFit(); }
+
+    // String and binary setters throw std::length_error for a value over 65535 bytes, the MQTT limit.
+
+    std::optional<PropertyBytes> GetCorrelationData() const;
+    /*! The correlation data as a CorrelationId, or nothing if it is unset or is not 16 bytes long. */
+    std::optional<utils::CorrelationId> GetCorrelationId() const;
+    void SetCorrelationData(std::optional<PropertyBytes> value);
+
+    std::optional<PropertyString> GetResponseTopic() const { return String(PropertyField::ResponseTopic); }
+    void SetResponseTopic(std::optional<std::string_view> value) { SetString(PropertyField::ResponseTopic, value); }
+
+    // Ignored on publish.
+    std::optional<std::uint32_t> GetSubscriptionId() const { return Scalar(PropertyField::SubscriptionId); }
+    void SetSubscriptionId(std::optional<std::uint32_t> value) { SetScalar(PropertyField::SubscriptionId, value); }
+
+    std::optional<std::uint32_t> GetMessageExpiryInterval() const {
+        return Scalar(PropertyField::MessageExpiryInterval);
+    }
+    void SetMessageExpiryInterval(std::optional<std::uint32_t> value) {
+        SetScalar(PropertyField::MessageExpiryInterval, value);
+    }
+
+    std::optional<PropertyString> GetContentType() const { return String(PropertyField::ContentType); }
+    void SetContentType(std::optional<std::string_view> value) { SetString(PropertyField::ContentType, value); }
+
     // The following are User Properties.
-    std::optional<std::string> debugInfo; // Used to pass a human readable debug message back to the client.
-    std::optional<int> returnCode;        // Used to pass a numeric method return code back to the client.
-    std::optional<int> propertyVersion;   // Used to specify the modification count of a property.
-    std::optional<std::string> version;   // Used to specify the version of the method, property, or signal.
+    // Used to pass a human readable debug message back to the client.
+    std::optional<PropertyString> GetDebugInfo() const { return String(PropertyField::DebugInfo); }
+    void SetDebugInfo(std::optional<std::string_view> value) { SetString(PropertyField::DebugInfo, value); }
+
+    // Used to pass a numeric method return code back to the client.
+    std::optional<int> GetReturnCode() const { return Signed(PropertyField::ReturnCode); }
+    void SetReturnCode(std::optional<int> value) { SetSigned(PropertyField::ReturnCode, value); }
+
+    // Used to specify the modification count of a property.
+    std::optional<int> GetPropertyVersion() const { return Signed(PropertyField::PropertyVersion); }
+    void SetPropertyVersion(std::optional<int> value) { SetSigned(PropertyField::PropertyVersion, value); }
+
+    // Used to specify the version of the method, property, or signal.
+    std::optional<PropertyString> GetVersion() const { return String(PropertyField::Version); }
+    void SetVersion(std::optional<std::string_view> value) { SetString(PropertyField::Version, value); }
+
+    // Any other user properties, such as tracing or routing tags.  The packed entries are limited to 65535 bytes in
+    // total; the functions that add entries throw std::length_error beyond that.
+    UserProperties GetUserProperties() const;
+
+    /*! Replaces every user property with `entries`, which may view this Properties. */
+    void SetUserProperties(const UserProperties& entries);
+
+    /*! Appends an entry, even if one with the same name exists. */
+    void AddUserProperty(std::string_view name, std::string_view value);
+
+    /*! Makes `value` the only value for `name`: the first entry with the name is updated in place and any others are
+     * removed, or a new entry is appended.
+     */
+    void SetUserProperty(std::string_view name, std::string_view value);
+
+    /*! Removes every entry named `name`, returning how many there were. */
+    std::size_t EraseUserProperty(std::string_view name);
+
+    void ClearUserProperties() { _storage.Reset(PropertyField::UserProperties); }
+
+private:
+    std::optional<PropertyString> String(PropertyField field) const {
+        if (!Has(field)) {
+            return std::nullopt;
+        }
+        std::string_view value = _storage.Variable(field);
+        return PropertyString(value.data(), value.size());
+    }
+
+    void SetString(PropertyField field, std::optional<std::string_view> value) {
+        if (value) {
+            _storage.SetVariable(field, value->data(), value->size());
+        } else {
+            _storage.Reset(field);
+        }
+    }
+
+    std::optional<std::uint32_t> Scalar(PropertyField field) const {
+        return Has(field) ? std::optional<std::uint32_t>(_storage.Scalar(field)) : std::nullopt;
+    }
+
+    void SetScalar(PropertyField field, std::optional<std::uint32_t> value) {
+        if (value) {
+            _storage.SetScalar(field, *value);
+        } else {
+            _storage.Reset(field);
+        }
+    }
+
+    std::optional<int> Signed(PropertyField field) const {
+        return Has(field) ? std::optional<int>(static_cast<int>(_storage.Scalar(field))) : std::nullopt;
+    }
+
+    void SetSigned(PropertyField field, std::optional<int> value) {
+        SetScalar(field, value ? std::optional<std::uint32_t>(static_cast<std::uint32_t>(*value)) : std::nullopt);
+    }
+
+    // Writes an entry over the `removeSize` packed bytes at `position`.
+    void InsertUserProperty(std::size_t position, std::size_t removeSize, std::string_view name,
+                            std::string_view value);
+    std::size_t EraseUserPropertiesFrom(std::string_view name, std::size_t from);
+
+    detail::PropertyStorage _storage;
+
+public:
+    // Fields kept for source compatibility; see ScalarProperty.
+    BytesProperty<PropertyField::CorrelationData> correlationData{_storage};
+    StringProperty<PropertyField::ResponseTopic> responseTopic{_storage};
+    ScalarProperty<std::uint32_t, PropertyField::SubscriptionId> subscriptionId{_storage}; // Ignored on publish
+    ScalarProperty<std::uint32_t, PropertyField::MessageExpiryInterval> messageExpiryInterval{_storage};
+    StringProperty<PropertyField::ContentType> contentType{_storage};
+    StringProperty<PropertyField::DebugInfo> debugInfo{_storage};
+    ScalarProperty<int, PropertyField::ReturnCode> returnCode{_storage};
+    ScalarProperty<int, PropertyField::PropertyVersion> propertyVersion{_storage};
+    StringProperty<PropertyField::Version> version{_storage};
 };
 
+static_assert(sizeof(Properties) <= 192, "Properties should stay within three cache lines");
+
 } // namespace mqtt
-} // namespace stinger
\ No newline at end of file
+} // namespace stinger
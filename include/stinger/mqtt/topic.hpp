@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace stinger {
+namespace mqtt {
+
+/**
+ * @brief Builds an MQTT v5 shared subscription, `$share/<group>/<filter>`.
+ *
+ * The broker delivers each message matching `filter` to only one of the clients subscribed with the same group,
+ * which spreads requests across service replicas.
+ *
+ * @throws std::invalid_argument if `group` is empty or contains '/', '+' or '#'.
+ */
+std::string sharedSubscription(const std::string& group, const std::string& filter);
+
+/**
+ * @brief Returns true if the subscription is a `$share/<group>/<filter>` shared subscription.
+ */
+bool isSharedSubscription(std::string_view subscr);
+
+/**
+ * @brief Returns the topic filter of a subscription, with any `$share/<group>/` prefix removed.
+ */
+std::string_view subscriptionFilter(std::string_view subscr);
+
+/**
+ * @brief Returns true if `topic` matches the MQTT topic filter `filter`.
+ *
+ * `+` matches exactly one level and a trailing `#` matches any number of levels, including the parent level.
+ * Topics beginning with `$` are not matched by a filter that begins with a wildcard.  A `$share/<group>/` prefix on
+ * `filter` is not stripped; see subscriptionFilter().
+ */
+bool topicMatchesFilter(std::string_view topic, std::string_view filter);
+
+} // namespace mqtt
+} // namespace stinger
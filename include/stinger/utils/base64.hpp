@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace stinger {
+namespace utils {
+
+enum class Base64Alphabet : std::uint8_t {
+    Standard, // RFC 4648 section 4: A-Z a-z 0-9 + /
+    Url       // RFC 4648 section 5: A-Z a-z 0-9 - _
+};
+
+/*! The code that does the bulk of the work.  The fastest the CPU supports is picked on first use. */
+enum class Base64Kernel : std::uint8_t { Scalar, Ssse3, Avx2 };
+
+/*! The number of chars base64Encode() writes for `size` bytes. */
+constexpr std::size_t base64EncodedSize(std::size_t size, bool padded = true) {
+    return padded ? (size + 2) / 3 * 4 : size / 3 * 4 + (size % 3 == 0 ? 0 : size % 3 + 1);
+}
+
+/*! The number of bytes `encoded` decodes to, if it is valid: the exact room base64Decode() needs. */
+constexpr std::size_t base64DecodedSize(std::string_view encoded) {
+    std::size_t size = encoded.size();
+    if (size % 4 == 0) {
+        for (int i = 0; i < 2 && size > 0 && encoded[size - 1] == '='; ++i) {
+            --size;
+        }
+    }
+    return size / 4 * 3 + (size % 4 == 0 ? 0 : size % 4 - 1);
+}
+
+/*! Encodes `size` bytes to `out`, which needs room for base64EncodedSize(size, padded) chars, and returns the number
+ * written.  Nothing is NUL-terminated.
+ */
+std::size_t base64Encode(const unsigned char* data, std::size_t size, char* out,
+                         Base64Alphabet alphabet = Base64Alphabet::Standard, bool padded = true);
+
+/*! Strictly decodes `encoded` to `out`, which needs room for base64DecodedSize(encoded) bytes, setting `written` to
+ * the number of bytes written.  The input may be padded or not, but may not contain whitespace, characters outside
+ * `alphabet`, misplaced padding, or nonzero bits after the last byte.  Returns false if it does; `out` then holds
+ * garbage.
+ */
+bool base64Decode(std::string_view encoded, unsigned char* out, std::size_t& written,
+                  Base64Alphabet alphabet = Base64Alphabet::Standard);
+
+/*! The kernel in use. */
+Base64Kernel base64Kernel();
+
+/*! Switches every thread to `kernel`, e.g. to compare them in a benchmark.  Returns false, changing nothing, if the
+ * CPU does not support it.
+ */
+bool setBase64Kernel(Base64Kernel kernel);
+
+/**
+ * @brief Base64-encodes a byte stream fed in pieces.
+ *
+ * Only up to two bytes are held between calls, so a large blob can be encoded chunk by chunk, e.g. straight into a
+ * message payload, without ever holding all of it in memory.  The output is the same as base64Encode() of the whole
+ * stream.
+ */
+class Base64Encoder {
+public:
+    explicit Base64Encoder(Base64Alphabet alphabet = Base64Alphabet::Standard, bool padded = true);
+
+    /*! The most chars Update() writes for `size` bytes. */
+    static constexpr std::size_t MaxUpdateSize(std::size_t size) { return (size + 2) / 3 * 4; }
+
+    /*! The most chars Finish() writes. */
+    static constexpr std::size_t kMaxFinishSize = 4;
+
+    /*! Encodes `size` more bytes to `out`, which needs room for MaxUpdateSize(size) chars, and returns the number
+     * written.
+     */
+    std::size_t Update(const unsigned char* data, std::size_t size, char* out);
+
+    /*! Encodes `size` more bytes, appending them to `out`. */
+    void Update(const unsigned char* data, std::size_t size, std::string& out);
+
+    /*! Encodes the held bytes and any padding to `out`, which needs room for kMaxFinishSize chars, and returns the
+     * number written.  The encoder is then ready for a new stream.
+     */
+    std::size_t Finish(char* out);
+
+    /*! Appends the held bytes and any padding to `out`.  The encoder is then ready for a new stream. */
+    void Finish(std::string& out);
+
+private:
+    unsigned char _pending[2] = {};
+    std::uint8_t _pendingSize = 0;
+    Base64Alphabet _alphabet;
+    bool _padded;
+};
+
+/**
+ * @brief Strictly decodes base64 text fed in pieces.
+ *
+ * Chunks may split the text anywhere.  Only up to three chars are held between calls, so a large payload can be
+ * decoded as it arrives.  The text is checked as base64Decode() checks it; once a chunk is rejected, every later call
+ * fails until Reset().
+ */
+class Base64Decoder {
+public:
+    explicit Base64Decoder(Base64Alphabet alphabet = Base64Alphabet::Standard);
+
+    /*! The most bytes Update() writes for `size` chars. */
+    static constexpr std::size_t MaxUpdateSize(std::size_t size) { return (size + 3) / 4 * 3; }
+
+    /*! The most bytes Finish() writes. */
+    static constexpr std::size_t kMaxFinishSize = 2;
+
+    /*! Decodes more text to `out`, which needs room for MaxUpdateSize(chunk.size()) bytes, setting `written` to the
+     * number of bytes written.  Returns false if the text is malformed.
+     */
+    bool Update(std::string_view chunk, unsigned char* out, std::size_t& written);
+
+    /*! Decodes more text, appending the bytes to `out`.  Returns false if the text is malformed. */
+    bool Update(std::string_view chunk, std::string& out);
+
+    /*! Decodes the held chars to `out`, which needs room for kMaxFinishSize bytes, setting `written` to the number
+     * of bytes written.  Returns false if the text is malformed or ends mid-group.  The decoder is then ready for a
+     * new stream.
+     */
+    bool Finish(unsigned char* out, std::size_t& written);
+
+    /*! Decodes the held chars, appending the bytes to `out`.  The decoder is then ready for a new stream. */
+    bool Finish(std::string& out);
+
+    /*! Drops any held chars and error, ready for a new stream. */
+    void Reset();
+
+private:
+    bool Fail();
+
+    char _pending[4];
+    std::uint8_t _pendingSize = 0;
+    Base64Alphabet _alphabet;
+    bool _padded = false; // Padding was seen, so the text must end.
+    bool _failed = false;
+};
+
+} // namespace utils
+} // namespace stinger
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "stinger/mqtt/message.hpp"
+#include "stinger/utils/iconnection.hpp"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace stinger {
+namespace utils {
+
+/**
+ * @brief The message callbacks registered on a connection.
+ *
+ * The list is copied when a callback is added or removed, and `Invoke` only takes a reference to the current copy.
+ * Callbacks therefore run without any lock held, so they may publish, subscribe, or add and remove callbacks, and
+ * delivering a message does not copy any std::function.
+ */
+class MessageCallbackList {
+public:
+    typedef std::function<void(const stinger::mqtt::Message&)> Callback;
+
+    /*! Adds a callback.
+     * \return a handle for `Remove`; handles start at 1.
+     */
+    CallbackHandleType Add(const Callback& cb);
+
+    /*! Removes a callback.  A call to it already in progress on another thread still completes.
+     * \return false if no callback has that handle.
+     */
+    bool Remove(CallbackHandleType handle);
+
+    std::size_t Size() const;
+
+    /*! Calls every callback, in the order they were added.
+     * \return the number of callbacks called.
+     */
+    std::size_t Invoke(const stinger::mqtt::Message& message) const;
+
+private:
+    typedef std::vector<std::pair<CallbackHandleType, Callback>> List;
+
+    mutable std::mutex _mutex;
+    std::shared_ptr<const List> _list = std::make_shared<const List>();
+    CallbackHandleType _nextHandle = 1;
+};
+
+} // namespace utils
+} // namespace stinger
@@ -1,21 +1,56 @@
 #pragma once
 
 #include <chrono>
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace stinger {
 namespace utils {
 
+// Longest output of formatIsoTimestamp: "2023-12-01T15:30:45.123456789Z".
+constexpr std::size_t kIsoTimestampMaxLength = 30;
+
+// Parses an ISO 8601 / RFC 3339 timestamp such as "2023-12-01T15:30:45.123+02:00" into `out`.  The time, seconds,
+// fraction (kept to the clock's precision) and offset are optional; a missing offset means UTC, and a date alone
+// means midnight.  Returns false if `isoTimestamp` is malformed.  Does not allocate or throw.
+bool tryParseIsoTimestamp(std::string_view isoTimestamp, std::chrono::system_clock::time_point& out);
+
 // Utility function to convert ISO timestamp string to time_point
-std::chrono::time_point<std::chrono::system_clock> parseIsoTimestamp(const std::string& isoTimestamp);
+// \throw std::runtime_error if the timestamp is malformed.
+std::chrono::time_point<std::chrono::system_clock> parseIsoTimestamp(std::string_view isoTimestamp);
+
+// Writes `timePoint` in UTC as "YYYY-MM-DDThh:mm:ss[.fraction]Z" to `out`, which needs room for
+// kIsoTimestampMaxLength chars, with `fractionDigits` (at most 9) digits of the fraction, truncated.  Returns the end
+// of the output, which is not NUL-terminated, or nullptr if the year is outside 0000-9999.  Thread-safe.
+char* formatIsoTimestamp(const std::chrono::system_clock::time_point& timePoint, char* out,
+                         unsigned fractionDigits = 0);
 
 // Utility function to convert time_point to ISO timestamp string
 std::string timePointToIsoString(const std::chrono::time_point<std::chrono::system_clock>& timePoint);
 
+// Longest output of formatIsoDuration: "-P106751DT23H47M16.854775808S".
+constexpr std::size_t kIsoDurationMaxLength = 29;
+
+// Parses an ISO 8601 duration such as "P1DT2H30M" or "-PT0.000001S" into `out`.  Any of the Y, M, W, D, H, M and S
+// components may appear, in that order, and the last may have a fraction.  Years and months are their average
+// Gregorian lengths, as in std::chrono.  Returns false if `isoDuration` is malformed or longer than about 292 years.
+// Does not allocate or throw.
+bool tryParseIsoDuration(std::string_view isoDuration, std::chrono::nanoseconds& out);
+
+// Writes `duration` as days, hours, minutes and seconds, e.g. "P1DT2H30M" or "PT0.25S", to `out`, which needs room
+// for kIsoDurationMaxLength chars.  Returns the end of the output, which is not NUL-terminated.  Versions before this
+// function misread anything but seconds; see durationToIsoString.
+char* formatIsoDuration(std::chrono::nanoseconds duration, char* out);
+
+// Formats `duration`, rounded to nanoseconds, in seconds only, e.g. "PT5400S" or "-PT0.25S".  Versions before
+// formatIsoDuration only parse this form, so use this for values they may read, and formatIsoDuration otherwise.
+// \throw std::runtime_error if it does not fit in std::chrono::nanoseconds.
 std::string durationToIsoString(const std::chrono::duration<double>& duration);
 
-std::chrono::duration<double> parseIsoDuration(const std::string& isoDuration);
+// \throw std::runtime_error if the duration is malformed.
+std::chrono::duration<double> parseIsoDuration(std::string_view isoDuration);
 
 // Base64 encode binary data; takes a vector of unsigned bytes and returns std::string
 std::string base64Encode(const std::vector<unsigned char>& data);
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
 #include <map>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace stinger {
 namespace utils {
@@ -9,6 +15,9 @@ namespace utils {
 /**
  * @brief Replaces {token} placeholders in a template string with values from a map
  *
+ * Placeholders without a value are left as they are.  For a template used more than once, CompiledTemplate or
+ * StaticTemplate avoid parsing it on every call.
+ *
  * @param templateStr The template string containing {token} placeholders
  * @param values A map of token names to their replacement values
  * @return std::string The formatted string with all tokens replaced
@@ -23,5 +32,206 @@ namespace utils {
  */
 std::string format(const std::string& templateStr, const std::map<std::string, std::string>& values);
 
+/*! One piece of a parsed template: a run of literal text, or a placeholder whose name is the text between its
+ * braces.  Both refer to the template text by offset.
+ */
+struct TemplateSegment {
+    static constexpr std::uint32_t kLiteral = ~std::uint32_t{0};
+
+    std::uint32_t offset = 0;
+    std::uint32_t length = 0;
+    std::uint32_t placeholder = kLiteral; // Index of the placeholder's value, or kLiteral.
+};
+
+namespace detail {
+
+/*! Calls `visit(offset, length, isPlaceholder)` for each segment of `text`, in order.  A placeholder is a non-empty
+ * name in braces; any other brace is literal text.
+ */
+template <typename Visitor>
+constexpr void parseTemplate(std::string_view text, Visitor&& visit) {
+    std::size_t literalStart = 0;
+    std::size_t i = 0;
+    while (i < text.size()) {
+        std::size_t close = text[i] == '{' ? text.find_first_of("{}", i + 1) : std::string_view::npos;
+        if (close == std::string_view::npos || text[close] != '}' || close == i + 1) {
+            ++i;
+            continue;
+        }
+        if (i > literalStart) {
+            visit(literalStart, i - literalStart, false);
+        }
+        visit(i + 1, close - i - 1, true);
+        i = literalStart = close + 1;
+    }
+    if (text.size() > literalStart) {
+        visit(literalStart, text.size() - literalStart, false);
+    }
+}
+
+/*! The length of the result, or throws std::invalid_argument if `valueCount` does not match the placeholders. */
+std::size_t renderedSize(std::string_view text, const TemplateSegment* segments, std::size_t segmentCount,
+                         std::size_t placeholderCount, const std::string_view* values, std::size_t valueCount);
+
+char* renderTemplate(std::string_view text, const TemplateSegment* segments, std::size_t segmentCount,
+                     const std::string_view* values, char* out);
+
+bool matchTemplate(std::string_view text, const TemplateSegment* segments, std::size_t segmentCount,
+                   std::size_t placeholderCount, std::string_view topic, std::string_view* values,
+                   std::size_t valueCount);
+
+std::string templateFilter(std::string_view text, const TemplateSegment* segments, std::size_t segmentCount);
+
+} // namespace detail
+
+/**
+ * @brief A {token} template parsed once for repeated rendering.
+ *
+ * Each distinct placeholder name gets an index in order of first appearance; rendering takes one value per index and
+ * writes the result in a single pass, sized up front.  For a template known at compile time, StaticTemplate does the
+ * parsing during compilation.
+ *
+ * @example
+ * CompiledTemplate topic("{prefix}/{device}/signal/{name}");
+ * std::string result = topic.Render({"home", "lamp-1", "toggled"});
+ * // result == "home/lamp-1/signal/toggled"
+ */
+class CompiledTemplate {
+public:
+    explicit CompiledTemplate(std::string templateStr);
+
+    const std::string& Text() const { return _text; }
+    std::size_t PlaceholderCount() const { return _names.size(); }
+    std::string_view PlaceholderName(std::size_t index) const;
+
+    /*! The index of the value for placeholder `name`, or -1 if the template has no such placeholder. */
+    int PlaceholderIndex(std::string_view name) const;
+
+    /*! The length of the result for `values`, one per placeholder index.
+     * \throw std::invalid_argument if the number of values does not match PlaceholderCount().
+     */
+    std::size_t RenderedSize(const std::string_view* values, std::size_t count) const;
+
+    /*! Writes the result to `out`, which needs room for RenderedSize() chars.  Nothing is NUL-terminated.
+     * \return One past the last character written.
+     * \throw std::invalid_argument if the number of values does not match PlaceholderCount().
+     */
+    char* RenderTo(const std::string_view* values, std::size_t count, char* out) const;
+
+    /*! Replaces the contents of `out` with the result, reusing its memory. */
+    void Render(const std::string_view* values, std::size_t count, std::string& out) const;
+
+    std::string Render(const std::string_view* values, std::size_t count) const;
+    std::string Render(std::initializer_list<std::string_view> values) const;
+
+    /*! The inverse of Render() for an MQTT topic: checks that `topic` has the template's shape and points each of
+     * `values` at the part of `topic` that fills that placeholder.  A placeholder matches within one topic level,
+     * taking as little as lets the rest of the topic match, or the whole level if nothing literal follows it; a
+     * repeated placeholder must match the same text each time.  Nothing is allocated.  On failure `values` holds
+     * garbage.
+     * \throw std::invalid_argument if the number of values does not match PlaceholderCount().
+     */
+    bool Match(std::string_view topic, std::string_view* values, std::size_t count) const;
+
+    /*! The MQTT topic filter to subscribe with for topics Match() accepts: each level holding a placeholder becomes
+     * `+`.  It can be broader than Match(), e.g. for a placeholder that shares its level with literal text.
+     */
+    std::string SubscriptionFilter() const;
+
+private:
+    std::string _text;
+    std::vector<TemplateSegment> _segments;
+    std::vector<std::uint32_t> _names; // The segment that first names each placeholder.
+};
+
+/**
+ * @brief A {token} template parsed at compile time.
+ *
+ * Renders like CompiledTemplate, but the segments and placeholder indices are computed during compilation, so a
+ * generated topic costs one pass over its pieces and no setup.  `Size` is deduced from the string literal.
+ *
+ * @example
+ * constexpr StaticTemplate kTopic("{prefix}/{device}/signal/{name}");
+ * static_assert(kTopic.PlaceholderIndex("device") == 1);
+ * std::string result = kTopic.Render({"home", "lamp-1", "toggled"});
+ */
+template <std::size_t Size>
+class StaticTemplate {
+public:
+    constexpr explicit StaticTemplate(const char (&text)[Size]) : _text(text, Size - 1) {
+        detail::parseTemplate(_text, [this](std::size_t offset, std::size_t length, bool isPlaceholder) {
+            TemplateSegment& segment = _segments[_segmentCount++];
+            segment.offset = static_cast<std::uint32_t>(offset);
+            segment.length = static_cast<std::uint32_t>(length);
+            if (isPlaceholder) {
+                std::string_view name = _text.substr(offset, length);
+                int index = PlaceholderIndex(name);
+                if (index < 0) {
+                    index = static_cast<int>(_placeholderCount);
+                    _names[_placeholderCount++] = name;
+                }
+                segment.placeholder = static_cast<std::uint32_t>(index);
+            }
+        });
+    }
+
+    constexpr std::string_view Text() const { return _text; }
+    constexpr std::size_t PlaceholderCount() const { return _placeholderCount; }
+    constexpr std::string_view PlaceholderName(std::size_t index) const { return _names[index]; }
+
+    /*! The index of the value for placeholder `name`, or -1 if the template has no such placeholder. */
+    constexpr int PlaceholderIndex(std::string_view name) const {
+        for (std::size_t i = 0; i < _placeholderCount; ++i) {
+            if (_names[i] == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    /*! \see CompiledTemplate::RenderedSize */
+    std::size_t RenderedSize(const std::string_view* values, std::size_t count) const {
+        return detail::renderedSize(_text, _segments.data(), _segmentCount, _placeholderCount, values, count);
+    }
+
+    /*! \see CompiledTemplate::RenderTo */
+    char* RenderTo(const std::string_view* values, std::size_t count, char* out) const {
+        RenderedSize(values, count);
+        return detail::renderTemplate(_text, _segments.data(), _segmentCount, values, out);
+    }
+
+    /*! \see CompiledTemplate::Render */
+    void Render(const std::string_view* values, std::size_t count, std::string& out) const {
+        out.resize(RenderedSize(values, count));
+        detail::renderTemplate(_text, _segments.data(), _segmentCount, values, out.data());
+    }
+
+    std::string Render(const std::string_view* values, std::size_t count) const {
+        std::string out;
+        Render(values, count, out);
+        return out;
+    }
+
+    std::string Render(std::initializer_list<std::string_view> values) const {
+        return Render(values.begin(), values.size());
+    }
+
+    /*! \see CompiledTemplate::Match */
+    bool Match(std::string_view topic, std::string_view* values, std::size_t count) const {
+        return detail::matchTemplate(_text, _segments.data(), _segmentCount, _placeholderCount, topic, values, count);
+    }
+
+    /*! \see CompiledTemplate::SubscriptionFilter */
+    std::string SubscriptionFilter() const { return detail::templateFilter(_text, _segments.data(), _segmentCount); }
+
+private:
+    std::string_view _text;
+    // Each segment spans at least one char and each placeholder three, which bounds the counts.
+    std::array<TemplateSegment, Size> _segments{};
+    std::array<std::string_view, Size / 3 + 1> _names{};
+    std::size_t _segmentCount = 0;
+    std::size_t _placeholderCount = 0;
+};
+
 } // namespace utils
 } // namespace stinger
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 namespace stinger {
@@ -11,10 +14,13 @@ namespace utils {
  * Compute a fast, non-cryptographic hash of a single string.
  * Uses FNV-1a algorithm for speed and good distribution.
  *
+ * Kept for keys already stored under it; new code should prefer hashBytes() or Hasher, which are much faster on
+ * anything longer than a few bytes.
+ *
  * @param str String to hash
  * @return 64-bit hash value suitable for use as a map key
  */
-uint64_t hashString(const std::string& str);
+uint64_t hashString(std::string_view str);
 
 /**
  * Compute a fast, non-cryptographic hash of a vector of strings.
@@ -25,5 +31,142 @@ uint64_t hashString(const std::string& str);
  */
 uint64_t hashStrings(const std::vector<std::string>& strings);
 
+namespace detail {
+
+constexpr std::uint64_t kHashSecret[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL,
+                                          0x4d5a2da51de1aa47ULL};
+
+// The full 128-bit product of a and b, returned in a (low half) and b (high half).
+constexpr void multiply128(std::uint64_t& a, std::uint64_t& b) {
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    a = static_cast<std::uint64_t>(product);
+    b = static_cast<std::uint64_t>(product >> 64);
+#else
+    std::uint64_t aHigh = a >> 32, aLow = static_cast<std::uint32_t>(a);
+    std::uint64_t bHigh = b >> 32, bLow = static_cast<std::uint32_t>(b);
+    std::uint64_t high = aHigh * bHigh, middle0 = aHigh * bLow, middle1 = aLow * bHigh, low = aLow * bLow;
+    std::uint64_t carry = (low >> 32) + static_cast<std::uint32_t>(middle0) + static_cast<std::uint32_t>(middle1);
+    a = (carry << 32) | static_cast<std::uint32_t>(low);
+    b = high + (middle0 >> 32) + (middle1 >> 32) + (carry >> 32);
+#endif
+}
+
+constexpr std::uint64_t mix(std::uint64_t a, std::uint64_t b) {
+    multiply128(a, b);
+    return a ^ b;
+}
+
+// Little-endian loads written as shifts so that they work in constant expressions; optimizing compilers turn each
+// into a single load.
+constexpr std::uint64_t read32(const char* p) {
+    return static_cast<std::uint64_t>(static_cast<unsigned char>(p[0])) |
+           static_cast<std::uint64_t>(static_cast<unsigned char>(p[1])) << 8 |
+           static_cast<std::uint64_t>(static_cast<unsigned char>(p[2])) << 16 |
+           static_cast<std::uint64_t>(static_cast<unsigned char>(p[3])) << 24;
+}
+
+constexpr std::uint64_t read64(const char* p) {
+    return read32(p) | read32(p + 4) << 32;
+}
+
+// 1 to 3 bytes, each read once or more.
+constexpr std::uint64_t readSmall(const char* p, std::size_t size) {
+    return static_cast<std::uint64_t>(static_cast<unsigned char>(p[0])) << 16 |
+           static_cast<std::uint64_t>(static_cast<unsigned char>(p[size >> 1])) << 8 |
+           static_cast<unsigned char>(p[size - 1]);
+}
+
+} // namespace detail
+
+/**
+ * Compute a fast, non-cryptographic hash of `data`, after wyhash by Wang Yi.
+ *
+ * Each step folds 16 bytes into the state with one 64x64->128-bit multiply, and inputs of 16 bytes or less take a
+ * single step with no loop.  It is `constexpr`, so a topic literal can be hashed during compilation and the result
+ * compared with a hash computed at run time.  The values differ from hashString().
+ *
+ * @param data Bytes to hash
+ * @param seed Selects an independent hash function, e.g. to chain hashes
+ * @return 64-bit hash value suitable for use as a map key
+ */
+constexpr std::uint64_t hashBytes(std::string_view data, std::uint64_t seed = 0) {
+    using detail::kHashSecret;
+    const char* p = data.data();
+    std::size_t size = data.size();
+    seed ^= detail::mix(seed ^ kHashSecret[0], kHashSecret[1]);
+    std::uint64_t a = 0;
+    std::uint64_t b = 0;
+    if (size <= 16) {
+        if (size >= 4) {
+            // Two overlapping pairs of 4-byte reads cover 4 to 16 bytes.
+            std::size_t step = (size >> 3) << 2;
+            a = detail::read32(p) << 32 | detail::read32(p + step);
+            b = detail::read32(p + size - 4) << 32 | detail::read32(p + size - 4 - step);
+        } else if (size > 0) {
+            a = detail::readSmall(p, size);
+        }
+    } else {
+        std::size_t rest = size;
+        if (rest >= 48) {
+            // Three independent lanes keep the multipliers busy.
+            std::uint64_t lane1 = seed;
+            std::uint64_t lane2 = seed;
+            do {
+                seed = detail::mix(detail::read64(p) ^ kHashSecret[1], detail::read64(p + 8) ^ seed);
+                lane1 = detail::mix(detail::read64(p + 16) ^ kHashSecret[2], detail::read64(p + 24) ^ lane1);
+                lane2 = detail::mix(detail::read64(p + 32) ^ kHashSecret[3], detail::read64(p + 40) ^ lane2);
+                p += 48;
+                rest -= 48;
+            } while (rest >= 48);
+            seed ^= lane1 ^ lane2;
+        }
+        while (rest > 16) {
+            seed = detail::mix(detail::read64(p) ^ kHashSecret[1], detail::read64(p + 8) ^ seed);
+            p += 16;
+            rest -= 16;
+        }
+        a = detail::read64(p + rest - 16);
+        b = detail::read64(p + rest - 8);
+    }
+    a ^= kHashSecret[1];
+    b ^= seed;
+    detail::multiply128(a, b);
+    return detail::mix(a ^ kHashSecret[0] ^ size, b ^ kHashSecret[1]);
+}
+
+/**
+ * @brief Incrementally hashes a composite key with hashBytes().
+ *
+ * Feed it the parts of a key in order, e.g. a topic and a subscription ID, instead of building a container of strings
+ * for hashStrings().  Each part is chained into the state, so ("ab", "c") and ("a", "bc") hash differently.  Every
+ * member is `constexpr`.
+ *
+ * @example
+ * std::uint64_t key = Hasher().Add(topic).Add(subscriptionId).Value();
+ */
+class Hasher {
+public:
+    constexpr explicit Hasher(std::uint64_t seed = 0) : _state(seed) {}
+
+    constexpr Hasher& Add(std::string_view part) {
+        _state = hashBytes(part, _state);
+        return *this;
+    }
+
+    /*! Adds an integer or enum by value. */
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer> || std::is_enum_v<Integer>>>
+    constexpr Hasher& Add(Integer value) {
+        auto bits = static_cast<std::uint64_t>(value);
+        _state = detail::mix(_state ^ detail::kHashSecret[2], bits ^ detail::kHashSecret[3]);
+        return *this;
+    }
+
+    constexpr std::uint64_t Value() const { return _state; }
+
+private:
+    std::uint64_t _state;
+};
+
 } // namespace utils
 } // namespace stinger
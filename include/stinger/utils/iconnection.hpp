@@ -1,8 +1,12 @@
 
 #pragma once
+#include <functional>
 #include <future>
+#include <string>
+#include <vector>
 
 #include "stinger/mqtt/message.hpp"
+#include "stinger/mqtt/topic.hpp"
 
 namespace stinger {
 namespace utils {
@@ -14,6 +18,9 @@ namespace utils {
 typedef std::function<void(int, const char*)> LogFunctionType;
 typedef int CallbackHandleType;
 
+/*! Returned in place of a subscription identifier for a subscription that was refused and is not registered. */
+constexpr int kSubscribeFailed = -1;
+
 class IConnection {
 public:
     /*! Publish a message.
@@ -24,21 +31,62 @@ public:
 
     /*! Subscribe to a topic.
      * Implementation should queue up subscriptions when not connected.
-     * Returns a subscription identifier.
+     * Returns a subscription identifier, or kSubscribeFailed if the subscription could not be made.  A failed call
+     * takes no reference, so it must not be matched by an Unsubscribe.
      */
     virtual int Subscribe(const std::string& topic, int qos) = 0;
 
     virtual void Unsubscribe(const std::string& topic) = 0;
 
+    /*! Subscribe to several topics at once.
+     * Implementations should take any bookkeeping lock once and send as few SUBSCRIBE packets as possible.
+     * Returns a subscription identifier for each topic, in the same order as `topics`; kSubscribeFailed marks a
+     * topic that was not subscribed.
+     */
+    virtual std::vector<int> SubscribeMany(const std::vector<std::string>& topics, int qos) {
+        std::vector<int> subscriptionIds;
+        subscriptionIds.reserve(topics.size());
+        for (const auto& topic : topics) {
+            subscriptionIds.push_back(Subscribe(topic, qos));
+        }
+        return subscriptionIds;
+    }
+
+    /*! Unsubscribe from several topics at once.
+     * Implementations should take any bookkeeping lock once and send as few UNSUBSCRIBE packets as possible.
+     */
+    virtual void UnsubscribeMany(const std::vector<std::string>& topics) {
+        for (const auto& topic : topics) {
+            Unsubscribe(topic);
+        }
+    }
+
+    /*! Subscribe to a topic as a member of a shared subscription group.
+     * Each matching message is delivered to only one member of the group, so replicas of a service can split the
+     * load.  The subscription is reference counted under its full `$share/<group>/<topic>` name.
+     * Returns a subscription identifier.
+     */
+    virtual int SubscribeShared(const std::string& group, const std::string& topic, int qos) {
+        return Subscribe(stinger::mqtt::sharedSubscription(group, topic), qos);
+    }
+
+    virtual void UnsubscribeShared(const std::string& group, const std::string& topic) {
+        Unsubscribe(stinger::mqtt::sharedSubscription(group, topic));
+    }
+
     /*! Provide a callback to be called on an incoming message.
      * Implementation should accept this at any time, even when not connected.
+     * The message is only valid during the call, because implementations reuse it for the next one.  Keep a copy of
+     * it to use it afterwards, e.g. from another thread; do not keep a pointer or reference to it, or views of its
+     * properties.  A copy's buffers are sized to its contents.
      */
     virtual CallbackHandleType AddMessageCallback(const std::function<void(const stinger::mqtt::Message&)>& cb) = 0;
 
     virtual void RemoveMessageCallback(CallbackHandleType handle) = 0;
 
     /*! Utility for matching topics.
-     * This probably should be a wrapper around `mosquitto_topic_matches_sub` or similar
+     * This probably should be a wrapper around `mosquitto_topic_matches_sub` or similar.
+     * A `$share/<group>/` prefix on the subscription is ignored.
      */
     virtual bool TopicMatchesSubscription(const std::string& topic, const std::string& subscr) const = 0;
 
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "stinger/utils/iconnection.hpp"
+#include <cstdarg>
+
+namespace stinger {
+namespace utils {
+
+/**
+ * @brief The log function and level behind a connection's `Log()`.
+ */
+class Logger {
+public:
+    /*! Starts without a log function, at LOG_NOTICE. */
+    Logger();
+
+    void SetFunction(const LogFunctionType& logFunc);
+    void SetLevel(int level);
+
+    /*! Formats a message and passes it to the log function, if one is set and `level` is enabled.
+     * Messages longer than 255 bytes are truncated.
+     */
+    void Write(int level, const char* fmt, va_list args) const;
+
+private:
+    LogFunctionType _function;
+    int _level;
+};
+
+} // namespace utils
+} // namespace stinger
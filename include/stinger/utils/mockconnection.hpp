@@ -1,8 +1,10 @@
 #pragma once
 
 #include "stinger/mqtt/message.hpp"
+#include "stinger/utils/callbacklist.hpp"
 #include "stinger/utils/iconnection.hpp"
-#include <map>
+#include "stinger/utils/subscriptionregistry.hpp"
+#include <atomic>
 #include <mutex>
 #include <queue>
 #include <string>
@@ -29,6 +31,8 @@ public:
     virtual std::future<bool> Publish(const stinger::mqtt::Message& mqttMsg) override;
     virtual int Subscribe(const std::string& topic, int qos) override;
     virtual void Unsubscribe(const std::string& topic) override;
+    virtual std::vector<int> SubscribeMany(const std::vector<std::string>& topics, int qos) override;
+    virtual void UnsubscribeMany(const std::vector<std::string>& topics) override;
     virtual CallbackHandleType
     AddMessageCallback(const std::function<void(const stinger::mqtt::Message&)>& cb) override;
     virtual void RemoveMessageCallback(CallbackHandleType handle) override;
@@ -63,25 +67,18 @@ public:
     int GetSubscriptionQos(const std::string& topic) const;
 
 private:
-    struct Subscription {
-        std::string topic;
-        int qos;
-        int subscriptionId;
-    };
-
     std::string _clientId;
     mutable std::mutex _mutex;
 
     // Published messages
     std::vector<stinger::mqtt::Message> _publishedMessages;
 
-    // Subscriptions
-    std::map<std::string, Subscription> _subscriptions;
-    int _nextSubscriptionId;
+    // Subscriptions, reference counted like BrokerConnection's
+    SubscriptionRegistry _subscriptions;
+    std::atomic<int> _nextSubscriptionId;
 
     // Callbacks
-    std::map<CallbackHandleType, std::function<void(const stinger::mqtt::Message&)>> _callbacks;
-    CallbackHandleType _nextCallbackHandle;
+    MessageCallbackList _callbacks;
 };
 
 } // namespace utils
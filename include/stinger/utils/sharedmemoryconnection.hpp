@@ -0,0 +1,143 @@
+#pragma once
+
+#include "stinger/mqtt/message.hpp"
+#include "stinger/utils/callbacklist.hpp"
+#include "stinger/utils/iconnection.hpp"
+#include "stinger/utils/logger.hpp"
+#include "stinger/utils/subscriptionregistry.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace stinger {
+namespace utils {
+
+/**
+ * @brief IConnection between processes on the same host, through POSIX shared memory instead of a broker.
+ *
+ * Every connection created with the same `domain` maps one shared memory segment, which holds:
+ * - a table of connected clients,
+ * - a table of their subscriptions, and
+ * - a bounded inbox ring per client.
+ *
+ * Publish matches the topic against the subscription table without taking a lock.  It copies the serialized message
+ * into the inbox of each subscribed client and wakes that client with a futex.  Each connection drains its inbox on
+ * its own thread, which runs the message callbacks, as mosquitto's network thread does for BrokerConnection.
+ *
+ * Semantics follow BrokerConnection:
+ * - Topic wildcards, `$share/<group>/` subscriptions and all message properties are supported.
+ * - Subscriptions are reference counted.
+ * - A client does not receive its own publishes (No Local).
+ * - A client with overlapping subscriptions receives each message once, tagged with the oldest matching
+ *   subscription ID.
+ * - Messages are not retained.
+ * - No online status or will messages are published.
+ *
+ * Each inbox has 128 cells of about 4 KB, and a larger message takes as many consecutive cells as it needs.  A message
+ * larger than a whole inbox, see MaxMessageSize(), or that finds too few free cells is not delivered.  The returned
+ * future then resolves to false, so the caller can fall back to a BrokerConnection.
+ *
+ * Slots and subscriptions of processes that exit without closing their connection are reclaimed by the next
+ * connection that starts, and periodically by every connection.  Inbox cells that a publishing process reserved but
+ * never filled before it exited are skipped by their receiver.  Linux only.
+ */
+class SharedMemoryConnection : public IConnection {
+public:
+    /*! Joins the shared memory domain, creating its segment if needed.
+     * \param domain name of the segment shared by the communicating processes; may not contain '/'.
+     * \param clientId client ID reported by GetClientId().
+     * \throw std::invalid_argument if `domain` is empty or contains '/'.
+     * \throw std::runtime_error if the segment cannot be created or mapped, or every client slot is taken.
+     */
+    SharedMemoryConnection(const std::string& domain, const std::string& clientId);
+
+    virtual ~SharedMemoryConnection();
+
+    SharedMemoryConnection(const SharedMemoryConnection&) = delete;
+    SharedMemoryConnection& operator=(const SharedMemoryConnection&) = delete;
+
+    /*! Delivers a message to every other client with a matching subscription.
+     * \return a future that is already resolved: true if every matching client received the message.
+     */
+    virtual std::future<bool> Publish(const stinger::mqtt::Message& mqttMsg) override;
+
+    /*! Subscribe to a topic.
+     * \return the subscription ID, or kSubscribeFailed if the topic is longer than 256 bytes or the domain's table
+     * of 1024 subscriptions is full.
+     */
+    virtual int Subscribe(const std::string& topic, int qos) override;
+    virtual void Unsubscribe(const std::string& topic) override;
+    /*! Subscribe to several topics; the new ones share a subscription ID and fail together, as in Subscribe(). */
+    virtual std::vector<int> SubscribeMany(const std::vector<std::string>& topics, int qos) override;
+    virtual void UnsubscribeMany(const std::vector<std::string>& topics) override;
+    virtual CallbackHandleType
+    AddMessageCallback(const std::function<void(const stinger::mqtt::Message&)>& cb) override;
+    virtual void RemoveMessageCallback(CallbackHandleType handle) override;
+    virtual bool TopicMatchesSubscription(const std::string& topic, const std::string& subscr) const override;
+    virtual std::string GetClientId() const override;
+    virtual std::string GetLastWillTopic() const override;
+    virtual std::string GetOnlinePayload() const override;
+    virtual std::string GetOfflinePayload() const override;
+
+    virtual void SetLogFunction(const LogFunctionType& logFunc);
+    virtual void SetLogLevel(int level);
+    virtual void Log(int level, const char* fmt, ...) const override;
+
+    /*! Largest serialized message, topic and properties included, that fits in an empty inbox. */
+    static std::size_t MaxMessageSize();
+
+    /*! Removes the name of a domain's segment.  Connections that have it mapped keep working, but new connections
+     * create a fresh segment, so only call this once every process in the domain has stopped.
+     */
+    static void Unlink(const std::string& domain);
+
+private:
+    struct Segment;
+
+    // Adds and removes this client's entries in the shared subscription table.  Return false if the table is full.
+    bool AddSharedSubscription(std::string_view topic, int subscriptionId, int qos);
+    void RemoveSharedSubscription(std::string_view topic);
+
+    // Frees the slots and subscriptions of clients whose process has exited.  Caller holds the segment lock.
+    void ReclaimDeadClients();
+
+    // Copies a serialized message into the cells it needs in a client's inbox.  Returns false if there was no room,
+    // or if the receiver gave up waiting for it.
+    bool Enqueue(std::uint32_t slotIndex, std::uint32_t generation, std::int32_t subscriptionId,
+                 std::string_view encoded);
+
+    void ReceiveLoop();
+    void Dispatch(const stinger::mqtt::Message& message);
+
+    std::string _clientId;
+    std::uint32_t _pid;
+    int _fd = -1;
+    Segment* _segment = nullptr;
+    std::uint32_t _slot = 0;
+    std::uint32_t _generation = 0;
+
+    // Local reference counts and IDs; only subscriptions that reach a count of one touch the shared table.
+    SubscriptionRegistry _subscriptions;
+    std::atomic<int> _nextSubscriptionId{1};
+    std::atomic<std::uint32_t> _sharedRoundRobin{0};
+
+    mutable std::mutex _mutex;
+    MessageCallbackList _callbacks;
+
+    Logger _logger;
+
+    stinger::mqtt::Message _received{"", ""}; // Refilled for each inbound message on the receive thread.
+    std::string _assembled;                     // A message spanning several cells, gathered on the receive thread.
+    std::atomic<bool> _stopping{false};
+    std::thread _receiveThread;
+};
+
+} // namespace utils
+} // namespace stinger
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "stinger/utils/topictable.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace stinger {
+namespace utils {
+
+/**
+ * @brief Reference-counted registry of subscription topics.
+ *
+ * Topics are kept in a sharded open-addressing hash table.  Each shard has its own lock, probe table and interned
+ * topic storage, so subscribe/unsubscribe churn on different topics does not serialize on one lock, and lookups by
+ * `std::string_view` never allocate.
+ *
+ * The create/remove callbacks run with the affected shards locked.  This lets a connection send the matching
+ * SUBSCRIBE/UNSUBSCRIBE packet atomically with the bookkeeping change.  Callbacks must not call back into the
+ * registry, other than `AddPendingUnsubscribe`, and topic views passed to them are only valid for the duration of the
+ * call.  A connection that must not block other shards on network I/O can instead queue the packet from the callback
+ * and send it once the call returns.
+ */
+class SubscriptionRegistry {
+public:
+    struct Subscription {
+        int subscriptionId = 0;
+        int qos = 0;
+        int refCount = 0;
+        bool pending = false; // Registered, but not yet sent to the broker.
+    };
+
+    typedef std::pair<std::string_view, Subscription> Entry;
+
+    struct MemoryUsage {
+        std::size_t entries = 0;
+        std::size_t tableBytes = 0; // Probe tables.
+        std::size_t topicBytes = 0; // Interned topic storage, including space not yet reclaimed.
+        std::size_t totalBytes = 0;
+    };
+
+    /*! Called when a topic is first registered.
+     * `sub` arrives with its QoS and a reference count of 1; the callback fills in the subscription ID and whether
+     * the subscription is still pending.
+     */
+    typedef std::function<void(std::string_view topic, Subscription& sub)> CreateFunction;
+
+    /*! Called once for all topics first registered by an `AcquireMany` call; they all share `sub`. */
+    typedef std::function<void(const std::vector<std::string_view>& topics, Subscription& sub)> CreateManyFunction;
+
+    /*! Called when the reference count of a topic reaches zero, just before it is removed. */
+    typedef std::function<void(std::string_view topic, const Subscription& sub)> RemoveFunction;
+
+    /*! Called once with every topic removed by a `ReleaseMany` call. */
+    typedef std::function<void(const std::vector<Entry>& removed)> RemoveManyFunction;
+
+    typedef std::function<void(std::string_view topic, const Subscription& sub)> VisitFunction;
+
+    /*! Constructor.
+     * \param shardCount number of independently locked shards; rounded up to a power of two.
+     */
+    explicit SubscriptionRegistry(std::size_t shardCount = 16);
+
+    ~SubscriptionRegistry();
+
+    SubscriptionRegistry(const SubscriptionRegistry&) = delete;
+    SubscriptionRegistry& operator=(const SubscriptionRegistry&) = delete;
+
+    /*! Adds a reference to a topic, registering it if needed.
+     * \return the subscription after the reference was added.
+     */
+    Subscription Acquire(std::string_view topic, int qos, const CreateFunction& onCreate);
+
+    /*! Adds a reference to each topic while holding every affected shard lock once.
+     * Duplicate topics in `topics` each add a reference.
+     * \return the subscription of each topic, in the same order as `topics`.
+     */
+    std::vector<Subscription> AcquireMany(const std::vector<std::string>& topics, int qos,
+                                          const CreateManyFunction& onCreate);
+
+    /*! Drops a reference to a topic, removing it when the count reaches zero.
+     * \return the subscription after the reference was dropped, or nullopt if the topic was not registered.
+     */
+    std::optional<Subscription> Release(std::string_view topic, const RemoveFunction& onRemove);
+
+    /*! Drops a reference to each topic while holding every affected shard lock once.
+     * \return the result of each release, in the same order as `topics`.
+     */
+    std::vector<std::optional<Subscription>> ReleaseMany(const std::vector<std::string>& topics,
+                                                         const RemoveManyFunction& onRemove);
+
+    std::optional<Subscription> Find(std::string_view topic) const;
+
+    /*! Like `Find(std::string_view)`, but uses the hash precomputed by the global TopicTable.  Exact topics are
+     * interned there when first registered, so a message on one can be looked up with `Message::FindTopicId()`
+     * without adding every published topic to the table.
+     */
+    std::optional<Subscription> Find(TopicId topic) const;
+
+    /*! Finds the subscription that a message published on `topic` would be delivered through.
+     * An exact subscription wins.  Otherwise each wildcard or shared subscription is offered to `matches`, and the
+     * matching one with the lowest subscription ID is returned.
+     */
+    std::optional<Subscription> Match(std::string_view topic,
+                                      const std::function<bool(const std::string& subscr)>& matches) const;
+
+    /*! Like `Match(std::string_view, ...)`, but uses the hash precomputed by the global TopicTable. */
+    std::optional<Subscription> Match(TopicId topic,
+                                      const std::function<bool(const std::string& subscr)>& matches) const;
+
+    /*! Visits every registered topic.  Each shard is locked only while it is being visited. */
+    void ForEach(const VisitFunction& visit) const;
+
+    /*! Clears the pending flag of every pending subscription.
+     * `send` is called once with the previously pending subscriptions while all shards are locked, so that
+     * concurrent Acquire/Release calls are ordered after the packets it sends.
+     */
+    void TakePending(const std::function<void(const std::vector<Entry>& pending)>& send);
+
+    /*! Marks every subscription as pending, e.g. after the broker lost the session holding them.
+     * Pending unsubscribes are dropped, since the new session holds nothing to unsubscribe from.
+     */
+    void MarkAllPending();
+
+    /*! Marks one subscription as pending, e.g. after its SUBSCRIBE could not be sent.
+     * \return false if the topic is not registered.
+     */
+    bool MarkPending(std::string_view topic);
+
+    /*! Records an UNSUBSCRIBE that could not be sent because the connection was down.
+     * Only locks the pending list, so it may be called from a `Release` or `ReleaseMany` callback.
+     */
+    void AddPendingUnsubscribe(std::string_view topic);
+
+    /*! Clears the pending unsubscribes.
+     * `send` is called once with the topics that are not registered again, while all shards are locked, so that
+     * the UNSUBSCRIBE goes out before any SUBSCRIBE of the same topic made after this call.
+     */
+    void TakePendingUnsubscribes(const std::function<void(const std::vector<std::string>& topics)>& send);
+
+    std::size_t Size() const;
+
+    MemoryUsage GetMemoryUsage() const;
+
+private:
+    struct Shard;
+
+    std::size_t ShardIndex(std::uint64_t hash) const;
+
+    std::optional<Subscription> Find(std::string_view topic, std::uint64_t hash) const;
+    std::optional<Subscription> Match(std::string_view topic, std::uint64_t hash,
+                                      const std::function<bool(const std::string& subscr)>& matches) const;
+
+    // Interns an exact topic in the global TopicTable, or records a subscription that an exact lookup cannot find:
+    // a wildcard filter or $share/ subscription.
+    void AddTopic(std::string_view topic);
+    void RemovePattern(std::string_view topic);
+
+    std::unique_ptr<Shard[]> _shards;
+    std::size_t _shardCount;
+    mutable std::mutex _patternMutex;
+    std::vector<std::string> _patterns;
+    std::mutex _unsubscribeMutex; // Locked after shard mutexes.
+    std::vector<std::string> _pendingUnsubscribes;
+};
+
+} // namespace utils
+} // namespace stinger
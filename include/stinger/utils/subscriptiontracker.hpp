@@ -0,0 +1,83 @@
+#pragma once
+
+#include "stinger/mqtt/message.hpp"
+#include "stinger/utils/iconnection.hpp"
+#include "stinger/utils/subscriptionregistry.hpp"
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace stinger {
+namespace utils {
+
+/**
+ * @brief The subscription bookkeeping of a connection to an MQTT broker.
+ *
+ * Hands out subscription IDs, counts references to each topic in a SubscriptionRegistry, keeps subscriptions and
+ * unsubscribes made while disconnected until the next CONNACK, and finds the subscription a locally delivered message
+ * matches.  BrokerConnection and NativeConnection differ only in how they send packets, which they pass in.
+ *
+ * The send functions are called with the affected registry shards locked, so that a concurrent call on the same
+ * topic cannot overtake the packet.  They must not call back into the tracker, and must send nothing and return false
+ * when the connection is down; the topics are then sent after the next CONNACK instead.
+ */
+class SubscriptionTracker {
+public:
+    typedef SubscriptionRegistry::Subscription Subscription;
+    typedef std::function<bool(const std::vector<std::string_view>& topics, int subscriptionId, int qos)>
+        SendSubscribeFunction;
+    typedef std::function<bool(const std::vector<std::string_view>& topics)> SendUnsubscribeFunction;
+
+    /*! \param connection the connection whose Log() the tracker writes to. */
+    explicit SubscriptionTracker(const IConnection& connection);
+
+    SubscriptionTracker(const SubscriptionTracker&) = delete;
+    SubscriptionTracker& operator=(const SubscriptionTracker&) = delete;
+
+    /*! Adds a reference to `topic`.  A new topic gets the next subscription ID and is passed to `send`.
+     * \return the subscription after the reference was added.
+     */
+    Subscription Subscribe(const std::string& topic, int qos, const SendSubscribeFunction& send);
+
+    /*! Adds a reference to each topic.  All topics that are new in this call share one subscription ID and go to one
+     * `send` call, so they can go out in one SUBSCRIBE packet.
+     * \return the subscription ID of each topic, in the same order as `topics`.
+     */
+    std::vector<int> SubscribeMany(const std::vector<std::string>& topics, int qos, const SendSubscribeFunction& send);
+
+    /*! Drops a reference to `topic`.  When the last one is dropped, the topic is passed to `send`, unless its
+     * SUBSCRIBE was never sent.
+     * \return the subscription after the reference was dropped, or nullopt if the topic was not subscribed.
+     */
+    std::optional<Subscription> Unsubscribe(const std::string& topic, const SendUnsubscribeFunction& send);
+
+    /*! Drops a reference to each topic, passing all topics whose last reference was dropped to one `send` call. */
+    void UnsubscribeMany(const std::vector<std::string>& topics, const SendUnsubscribeFunction& send);
+
+    /*! Applies a CONNACK.  Without a session present, every subscription is sent again and the queued unsubscribes are
+     * dropped along with the session they were meant for.  Call `SendPending` next.
+     */
+    void Resume(bool sessionPresent);
+
+    /*! Sends the queued unsubscribes, then the pending subscriptions.  Subscriptions that share an ID and QoS were
+     * requested together, and go to one `subscribe` call.
+     */
+    void SendPending(const SendUnsubscribeFunction& unsubscribe, const SendSubscribeFunction& subscribe);
+
+    /*! Finds the non-shared subscription that a message published on this connection is delivered through locally. */
+    std::optional<Subscription> MatchLocal(const stinger::mqtt::Message& message) const;
+
+    /*! The registry, for a connection that learns after a send that the packet did not go out. */
+    SubscriptionRegistry& Registry() { return _registry; }
+
+private:
+    const IConnection& _connection;
+    SubscriptionRegistry _registry;
+    std::atomic<int> _nextSubscriptionId{1};
+};
+
+} // namespace utils
+} // namespace stinger
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace stinger {
+namespace utils {
+
+/*! Small integer standing for an interned topic string.  IDs are never reused, so equal IDs mean equal topics. */
+enum class TopicId : std::uint32_t {};
+
+constexpr TopicId kInvalidTopicId = TopicId{0};
+
+/**
+ * @brief Process-wide table of interned topic strings.
+ *
+ * Each distinct topic gets a stable TopicId and a precomputed hash.  Looking up a topic that is already interned,
+ * and mapping an ID back to its string or hash, take no locks and do not allocate; only adding a new topic locks.
+ *
+ * Entries are never removed, so only intern topics from a bounded set, such as those a service publishes or
+ * subscribes to, rather than arbitrary inbound topics.
+ */
+class TopicTable {
+public:
+    TopicTable();
+    ~TopicTable();
+
+    TopicTable(const TopicTable&) = delete;
+    TopicTable& operator=(const TopicTable&) = delete;
+
+    /*! The table shared by the whole process.  It is never destroyed, so IDs stay valid during static destruction. */
+    static TopicTable& Global();
+
+    /*! Returns the ID of `topic`, adding it to the table if needed. */
+    TopicId Intern(std::string_view topic);
+
+    /*! Returns the ID of `topic`, or kInvalidTopicId if it has not been interned. */
+    TopicId Find(std::string_view topic) const;
+
+    /*! The interned string, which stays valid for the lifetime of the table.  Empty for kInvalidTopicId. */
+    std::string_view Name(TopicId id) const;
+
+    /*! The FNV-1a hash of the topic, as `hashString` would compute it. */
+    std::uint64_t Hash(TopicId id) const;
+
+    std::size_t Size() const { return _size.load(std::memory_order_acquire); }
+
+private:
+    struct Entry {
+        std::string name;
+        std::uint64_t hash = 0;
+    };
+
+    // Open-addressing index of entry IDs.  A full copy is built whenever it grows, so readers never see it resized.
+    struct Index {
+        explicit Index(std::size_t capacity);
+        std::size_t mask;
+        std::unique_ptr<std::atomic<std::uint32_t>[]> slots; // 0 marks an empty slot.
+    };
+
+    // Entries live in chunks that double in size and never move: chunk k holds kFirstChunk << k entries.
+    static constexpr std::size_t kFirstChunk = 64;
+    static constexpr std::size_t kChunkCount = 26;
+
+    const Entry& EntryAt(std::uint32_t id) const;
+    Entry& AddEntry(std::uint32_t id);
+    void InsertIndex(Index& index, std::uint32_t id, std::uint64_t hash);
+    TopicId Lookup(const Index& index, std::string_view topic, std::uint64_t hash) const;
+
+    std::atomic<Entry*> _chunks[kChunkCount];
+    std::atomic<Index*> _index;
+    std::atomic<std::size_t> _size{0};
+
+    std::mutex _mutex; // Serializes Intern calls that add a topic.
+    std::vector<std::unique_ptr<Index>> _retired; // Indexes replaced by a larger one; readers may still hold them.
+};
+
+/*! Interns `topic` in the global table. */
+inline TopicId internTopic(std::string_view topic) {
+    return TopicTable::Global().Intern(topic);
+}
+
+} // namespace utils
+} // namespace stinger
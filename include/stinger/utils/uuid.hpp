@@ -1,48 +1,106 @@
-
 #pragma once
 
+#include <array>
 #include <cstddef>
-#include <iomanip>
-#include <random>
-#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace stinger {
 namespace utils {
 
-inline std::vector<std::byte> generate_uuid_bytes() {
-    static std::random_device rd;
-    static std::mt19937_64 eng(rd());
-    static std::uniform_int_distribution<uint64_t> dist;
+/**
+ * @brief A 16-byte UUID used as MQTT correlation data.
+ *
+ * Trivially copyable and free of heap memory, so it can be kept in pending-request tables and passed straight to
+ * `Properties::SetCorrelationData()`.  Generation uses a per-thread random engine, so it is safe and lock-free from
+ * any thread.
+ */
+struct CorrelationId {
+    static constexpr std::size_t kSize = 16;
+    static constexpr std::size_t kHexLength = 32;    // "0123456789abcdef0123456789abcdef"
+    static constexpr std::size_t kStringLength = 36; // "01234567-89ab-cdef-0123-456789abcdef"
 
-    std::vector<std::byte> uuid(16);
-    uint64_t part1 = dist(eng);
-    uint64_t part2 = dist(eng);
+    enum class Version : std::uint8_t { Random = 4, TimeOrdered = 7 };
 
-    // Copy first 8 bytes from part1
-    for (int i = 0; i < 8; ++i) {
-        uuid[i] = static_cast<std::byte>((part1 >> (i * 8)) & 0xFF);
-    }
+    std::array<std::byte, kSize> bytes{};
 
-    // Copy next 8 bytes from part2
-    for (int i = 0; i < 8; ++i) {
-        uuid[8 + i] = static_cast<std::byte>((part2 >> (i * 8)) & 0xFF);
-    }
+    /*! Generates an RFC 4122 version 4 (random) UUID. */
+    static CorrelationId Random();
+
+    /*! Generates an RFC 9562 version 7 UUID: a millisecond Unix timestamp followed by random bits.  IDs from one thread
+     * are strictly increasing, so they sort by creation time and index well in ordered containers.
+     */
+    static CorrelationId TimeOrdered();
+
+    /*! Fills `out` with `count` new IDs, amortizing the per-thread setup over the batch.
+     * \param out Destination for `count` IDs.
+     * \param count Number of IDs to generate.
+     * \param version Which variant to generate.
+     */
+    static void GenerateMany(CorrelationId* out, std::size_t count, Version version = Version::Random);
+
+    /*! Copies a 16-byte buffer.  Returns nothing if `size` is not 16, e.g. correlation data from another client. */
+    static std::optional<CorrelationId> FromBytes(const void* data, std::size_t size);
+
+    /*! Parses 32 hex digits, optionally in the dashed 8-4-4-4-12 form.  Either case is accepted. */
+    static std::optional<CorrelationId> Parse(std::string_view text);
+
+    /*! Writes 32 lowercase hex digits to `out`, which needs room for kHexLength chars.  Nothing is NUL-terminated.
+     * \return One past the last character written.
+     */
+    char* FormatHex(char* out) const;
+
+    /*! Writes the dashed 8-4-4-4-12 form to `out`, which needs room for kStringLength chars.
+     * \return One past the last character written.
+     */
+    char* Format(char* out) const;
 
-    return uuid;
+    std::string ToHex() const;
+    std::string ToString() const;
+
+    /*! The version nibble, e.g. 4 or 7. */
+    unsigned GetVersion() const { return static_cast<unsigned>(bytes[6]) >> 4; }
+
+    const std::byte* data() const { return bytes.data(); }
+    static constexpr std::size_t size() { return kSize; }
+
+    std::vector<std::byte> ToVector() const { return std::vector<std::byte>(bytes.begin(), bytes.end()); }
+};
+
+inline bool operator==(const CorrelationId& a, const CorrelationId& b) { return a.bytes == b.bytes; }
+inline bool operator!=(const CorrelationId& a, const CorrelationId& b) { return a.bytes != b.bytes; }
+inline bool operator<(const CorrelationId& a, const CorrelationId& b) {
+    return memcmp(a.bytes.data(), b.bytes.data(), CorrelationId::kSize) < 0;
 }
 
+/*! Deprecated: use `CorrelationId::Random()`, which does not allocate. */
+inline std::vector<std::byte> generate_uuid_bytes() {
+    return CorrelationId::Random().ToVector();
+}
+
+/*! Deprecated: use `CorrelationId::Random().ToHex()`.  Returns 32 lowercase hex digits. */
 inline std::string generate_uuid_string() {
-    static std::random_device rd;
-    static std::mt19937_64 eng(rd());
-    static std::uniform_int_distribution<uint64_t> dist;
-    std::ostringstream ss;
-    ss << std::hex << std::setfill('0');
-    ss << std::setw(16) << dist(eng);
-    ss << std::setw(16) << dist(eng);
-    return ss.str();
+    return CorrelationId::Random().ToHex();
 }
 
 } // namespace utils
-} // namespace stinger
\ No newline at end of file
+} // namespace stinger
+
+namespace std {
+template <>
+struct hash<stinger::utils::CorrelationId> {
+    std::size_t operator()(const stinger::utils::CorrelationId& id) const noexcept {
+        // The IDs are mostly random already; fold the two halves together.
+        std::uint64_t high;
+        std::uint64_t low;
+        memcpy(&high, id.bytes.data(), sizeof(high));
+        memcpy(&low, id.bytes.data() + sizeof(high), sizeof(low));
+        return static_cast<std::size_t>(high ^ (low * 0x9E3779B97F4A7C15ULL));
+    }
+};
+} // namespace std
@@ -0,0 +1,494 @@
+#include "stinger/utils/base64.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define STINGER_BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+namespace stinger {
+namespace utils {
+
+namespace {
+
+const char kStandardChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+const char kUrlChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+const std::uint8_t kInvalid = 0xFF;
+
+struct DecodeTable {
+    std::uint8_t values[256];
+};
+
+constexpr DecodeTable makeDecodeTable(const char* chars) {
+    DecodeTable table{};
+    for (auto& value : table.values) {
+        value = kInvalid;
+    }
+    for (std::uint8_t i = 0; i < 64; ++i) {
+        table.values[static_cast<unsigned char>(chars[i])] = i;
+    }
+    return table;
+}
+
+constexpr DecodeTable kStandardTable = makeDecodeTable(kStandardChars);
+constexpr DecodeTable kUrlTable = makeDecodeTable(kUrlChars);
+
+// Bulk kernels handle a prefix of whole blocks and return how much input they consumed; the scalar code finishes
+// the rest.  A decode kernel stops at the first block holding anything but alphabet chars, including padding, so
+// that the scalar code reports it.
+using EncodeBulk = std::size_t (*)(const unsigned char* in, std::size_t size, char* out, Base64Alphabet alphabet);
+using DecodeBulk = std::size_t (*)(const char* in, std::size_t size, unsigned char* out, Base64Alphabet alphabet);
+
+std::size_t encodeBulkScalar(const unsigned char*, std::size_t, char*, Base64Alphabet) {
+    return 0;
+}
+
+std::size_t decodeBulkScalar(const char*, std::size_t, unsigned char*, Base64Alphabet) {
+    return 0;
+}
+
+#ifdef STINGER_BASE64_X86
+
+// The SIMD kernels follow W. Muła and D. Lemire, "Faster Base64 Encoding and Decoding Using AVX2 Instructions"
+// (2018).  The AVX2 versions run the SSSE3 steps on both 128-bit lanes at once.
+
+// Spreads each 3 input bytes over 4 bytes holding one 6-bit index each.
+__attribute__((target("ssse3"))) inline __m128i encodeReshuffle(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    __m128i high = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+    __m128i low = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(high, low);
+}
+
+// Maps 6-bit indices to chars by adding an offset chosen by range: A-Z, a-z, 0-9, then the two alphabet-specific
+// chars.
+__attribute__((target("ssse3"))) inline __m128i encodeTranslate(__m128i indices, Base64Alphabet alphabet) {
+    char offset62 = alphabet == Base64Alphabet::Url ? '-' - 62 : '+' - 62;
+    char offset63 = alphabet == Base64Alphabet::Url ? '_' - 63 : '/' - 63;
+    __m128i offsets = _mm_setr_epi8('A', 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                    '0' - 52, '0' - 52, '0' - 52, '0' - 52, offset62, offset63, 0, 0);
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    range = _mm_sub_epi8(range, _mm_cmpgt_epi8(indices, _mm_set1_epi8(25)));
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+// Turns URL-alphabet chars into standard ones; a standard-only char makes the block invalid.
+__attribute__((target("ssse3"))) inline bool urlToStandard(__m128i& in) {
+    __m128i standardOnly = _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('+')), _mm_cmpeq_epi8(in, _mm_set1_epi8('/')));
+    __m128i dash = _mm_and_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('-')), _mm_set1_epi8('+' - '-'));
+    __m128i underscore = _mm_and_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('_')), _mm_set1_epi8('/' - '_'));
+    in = _mm_add_epi8(in, _mm_or_si128(dash, underscore));
+    return _mm_movemask_epi8(standardOnly) == 0;
+}
+
+// Maps 16 standard-alphabet chars to their 6-bit values, returning false if any is not in the alphabet.
+__attribute__((target("ssse3"))) inline bool decodeTranslate(__m128i& in) {
+    const __m128i lowLookup = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                            0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i highLookup = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                             0x10, 0x10, 0x10, 0x10);
+    const __m128i offsets = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i highNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), nibble);
+    __m128i lowNibbles = _mm_and_si128(in, nibble);
+    // Each valid char has no bit in common between the classes of its two nibbles.
+    __m128i invalid = _mm_and_si128(_mm_shuffle_epi8(lowLookup, lowNibbles), _mm_shuffle_epi8(highLookup, highNibbles));
+    if (_mm_movemask_epi8(_mm_cmpgt_epi8(invalid, _mm_setzero_si128())) != 0) {
+        return false;
+    }
+    __m128i slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+    in = _mm_add_epi8(in, _mm_shuffle_epi8(offsets, _mm_add_epi8(slash, highNibbles)));
+    return true;
+}
+
+// Packs 16 6-bit values into 12 bytes at the start of the result.
+__attribute__((target("ssse3"))) inline __m128i decodeReshuffle(__m128i values) {
+    __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+__attribute__((target("ssse3"))) std::size_t encodeBulkSsse3(const unsigned char* in, std::size_t size, char* out,
+                                                             Base64Alphabet alphabet) {
+    std::size_t done = 0;
+    // Each step reads 16 bytes but consumes 12.
+    for (; size - done >= 16; done += 12, out += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), encodeTranslate(encodeReshuffle(block), alphabet));
+    }
+    return done;
+}
+
+__attribute__((target("ssse3"))) std::size_t decodeBulkSsse3(const char* in, std::size_t size, unsigned char* out,
+                                                             Base64Alphabet alphabet) {
+    std::size_t done = 0;
+    // Each step writes 16 bytes but produces 12; with 32 chars left, at least 24 bytes of room remain.
+    for (; size - done >= 32; done += 16, out += 12) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+        if ((alphabet == Base64Alphabet::Url && !urlToStandard(block)) || !decodeTranslate(block)) {
+            break;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), decodeReshuffle(block));
+    }
+    return done;
+}
+
+__attribute__((target("avx2"))) std::size_t encodeBulkAvx2(const unsigned char* in, std::size_t size, char* out,
+                                                           Base64Alphabet alphabet) {
+    char offset62 = alphabet == Base64Alphabet::Url ? '-' - 62 : '+' - 62;
+    char offset63 = alphabet == Base64Alphabet::Url ? '_' - 63 : '/' - 63;
+    const __m256i offsets = _mm256_setr_epi8(
+        'A', 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, offset62, offset63, 0, 0, 'A', 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, offset62, offset63, 0, 0);
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10, 1, 0, 2, 1, 4, 3, 5, 4,
+                                            7, 6, 8, 7, 10, 9, 11, 10);
+    std::size_t done = 0;
+    // Each step reads 28 bytes, as two overlapping 16-byte loads, but consumes 24.
+    for (; size - done >= 32; done += 24, out += 32) {
+        __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+        __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done + 12));
+        __m256i block = _mm256_shuffle_epi8(_mm256_set_m128i(high, low), spread);
+        __m256i indices = _mm256_or_si256(
+            _mm256_mulhi_epu16(_mm256_and_si256(block, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040)),
+            _mm256_mullo_epi16(_mm256_and_si256(block, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010)));
+        __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        range = _mm256_sub_epi8(range, _mm256_cmpgt_epi8(indices, _mm256_set1_epi8(25)));
+        __m256i chars = _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, range));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), chars);
+    }
+    return done;
+}
+
+__attribute__((target("avx2"))) std::size_t decodeBulkAvx2(const char* in, std::size_t size, unsigned char* out,
+                                                           Base64Alphabet alphabet) {
+    const __m256i lowLookup = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                               0x1B, 0x1B, 0x1B, 0x1A, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                               0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i highLookup = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10,
+                                                0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04,
+                                                0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i offsets = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16, 19, 4,
+                                             -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10,
+                                          9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    std::size_t done = 0;
+    // Each step writes 32 bytes but produces 24; with 48 chars left, at least 33 bytes of room remain.
+    for (; size - done >= 48; done += 32, out += 24) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + done));
+        if (alphabet == Base64Alphabet::Url) {
+            __m256i standardOnly = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('+')),
+                                                   _mm256_cmpeq_epi8(block, _mm256_set1_epi8('/')));
+            if (_mm256_movemask_epi8(standardOnly) != 0) {
+                break;
+            }
+            __m256i dash =
+                _mm256_and_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('-')), _mm256_set1_epi8('+' - '-'));
+            __m256i underscore =
+                _mm256_and_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('_')), _mm256_set1_epi8('/' - '_'));
+            block = _mm256_add_epi8(block, _mm256_or_si256(dash, underscore));
+        }
+        __m256i highNibbles = _mm256_and_si256(_mm256_srli_epi32(block, 4), nibble);
+        __m256i lowNibbles = _mm256_and_si256(block, nibble);
+        __m256i invalid = _mm256_and_si256(_mm256_shuffle_epi8(lowLookup, lowNibbles),
+                                           _mm256_shuffle_epi8(highLookup, highNibbles));
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(invalid, _mm256_setzero_si256())) != 0) {
+            break;
+        }
+        __m256i slash = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('/'));
+        block = _mm256_add_epi8(block, _mm256_shuffle_epi8(offsets, _mm256_add_epi8(slash, highNibbles)));
+        __m256i pairs = _mm256_maddubs_epi16(block, _mm256_set1_epi32(0x01400140));
+        __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        __m256i packed = _mm256_shuffle_epi8(words, pack);
+        // Close the 4-byte gap between the lanes' 12-byte results.
+        packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+    }
+    return done;
+}
+
+#endif // STINGER_BASE64_X86
+
+struct Kernels {
+    EncodeBulk encode;
+    DecodeBulk decode;
+};
+
+bool supported(Base64Kernel kernel) {
+#ifdef STINGER_BASE64_X86
+    switch (kernel) {
+    case Base64Kernel::Avx2:
+        return __builtin_cpu_supports("avx2");
+    case Base64Kernel::Ssse3:
+        return __builtin_cpu_supports("ssse3");
+    default:
+        return true;
+    }
+#else
+    return kernel == Base64Kernel::Scalar;
+#endif
+}
+
+Kernels kernelsFor(Base64Kernel kernel) {
+#ifdef STINGER_BASE64_X86
+    switch (kernel) {
+    case Base64Kernel::Avx2:
+        return Kernels{encodeBulkAvx2, decodeBulkAvx2};
+    case Base64Kernel::Ssse3:
+        return Kernels{encodeBulkSsse3, decodeBulkSsse3};
+    default:
+        break;
+    }
+#endif
+    return Kernels{encodeBulkScalar, decodeBulkScalar};
+}
+
+Base64Kernel bestKernel() {
+#ifdef STINGER_BASE64_X86
+    // This may run from another translation unit's static initializer, before the CPU model is otherwise set up.
+    __builtin_cpu_init();
+#endif
+    if (supported(Base64Kernel::Avx2)) {
+        return Base64Kernel::Avx2;
+    }
+    return supported(Base64Kernel::Ssse3) ? Base64Kernel::Ssse3 : Base64Kernel::Scalar;
+}
+
+std::atomic<Base64Kernel>& activeKernel() {
+    static std::atomic<Base64Kernel> kernel(bestKernel());
+    return kernel;
+}
+
+} // namespace
+
+Base64Kernel base64Kernel() {
+    return activeKernel().load(std::memory_order_relaxed);
+}
+
+bool setBase64Kernel(Base64Kernel kernel) {
+    if (!supported(kernel)) {
+        return false;
+    }
+    activeKernel().store(kernel, std::memory_order_relaxed);
+    return true;
+}
+
+std::size_t base64Encode(const unsigned char* data, std::size_t size, char* out, Base64Alphabet alphabet,
+                         bool padded) {
+    const char* chars = alphabet == Base64Alphabet::Url ? kUrlChars : kStandardChars;
+    char* start = out;
+    std::size_t done = kernelsFor(base64Kernel()).encode(data, size, out, alphabet);
+    out += done / 3 * 4;
+    for (; size - done >= 3; done += 3) {
+        std::uint32_t group = (std::uint32_t{data[done]} << 16) | (std::uint32_t{data[done + 1]} << 8) | data[done + 2];
+        out[0] = chars[group >> 18];
+        out[1] = chars[(group >> 12) & 0x3F];
+        out[2] = chars[(group >> 6) & 0x3F];
+        out[3] = chars[group & 0x3F];
+        out += 4;
+    }
+    std::size_t rest = size - done;
+    if (rest > 0) {
+        std::uint32_t group = std::uint32_t{data[done]} << 16;
+        if (rest == 2) {
+            group |= std::uint32_t{data[done + 1]} << 8;
+        }
+        *out++ = chars[group >> 18];
+        *out++ = chars[(group >> 12) & 0x3F];
+        if (rest == 2) {
+            *out++ = chars[(group >> 6) & 0x3F];
+        }
+        if (padded) {
+            *out++ = '=';
+            if (rest == 1) {
+                *out++ = '=';
+            }
+        }
+    }
+    return static_cast<std::size_t>(out - start);
+}
+
+bool base64Decode(std::string_view encoded, unsigned char* out, std::size_t& written, Base64Alphabet alphabet) {
+    const std::uint8_t* table = alphabet == Base64Alphabet::Url ? kUrlTable.values : kStandardTable.values;
+    const char* in = encoded.data();
+    std::size_t size = encoded.size();
+    if (size % 4 == 0 && size > 0 && in[size - 1] == '=') {
+        size -= in[size - 2] == '=' ? 2 : 1;
+    }
+    if (size % 4 == 1) {
+        written = 0;
+        return false;
+    }
+    unsigned char* start = out;
+    std::size_t done = kernelsFor(base64Kernel()).decode(in, size, out, alphabet);
+    out += done / 4 * 3;
+    auto value = [&](std::size_t i) { return static_cast<std::uint32_t>(table[static_cast<unsigned char>(in[i])]); };
+    for (; size - done >= 4; done += 4) {
+        std::uint32_t a = value(done);
+        std::uint32_t b = value(done + 1);
+        std::uint32_t c = value(done + 2);
+        std::uint32_t d = value(done + 3);
+        if ((a | b | c | d) & 0x80) {
+            written = static_cast<std::size_t>(out - start);
+            return false;
+        }
+        std::uint32_t group = (a << 18) | (b << 12) | (c << 6) | d;
+        out[0] = static_cast<unsigned char>(group >> 16);
+        out[1] = static_cast<unsigned char>(group >> 8);
+        out[2] = static_cast<unsigned char>(group);
+        out += 3;
+    }
+    std::size_t rest = size - done;
+    if (rest > 0) {
+        std::uint32_t a = value(done);
+        std::uint32_t b = value(done + 1);
+        std::uint32_t c = rest == 3 ? value(done + 2) : 0;
+        // The unused low bits must be zero, so that each byte string has one encoding.
+        std::uint32_t unused = rest == 3 ? (c & 0x03) : (b & 0x0F);
+        if (((a | b | c) & 0x80) || unused != 0) {
+            written = static_cast<std::size_t>(out - start);
+            return false;
+        }
+        std::uint32_t group = (a << 18) | (b << 12) | (c << 6);
+        *out++ = static_cast<unsigned char>(group >> 16);
+        if (rest == 3) {
+            *out++ = static_cast<unsigned char>(group >> 8);
+        }
+    }
+    written = static_cast<std::size_t>(out - start);
+    return true;
+}
+
+Base64Encoder::Base64Encoder(Base64Alphabet alphabet, bool padded) : _alphabet(alphabet), _padded(padded) {}
+
+std::size_t Base64Encoder::Update(const unsigned char* data, std::size_t size, char* out) {
+    char* start = out;
+    if (_pendingSize > 0) {
+        unsigned char group[3] = {_pending[0], _pending[1]};
+        std::size_t taken = std::min<std::size_t>(3 - _pendingSize, size);
+        std::copy(data, data + taken, group + _pendingSize);
+        data += taken;
+        size -= taken;
+        if (_pendingSize + taken < 3) {
+            _pending[1] = group[1];
+            _pendingSize = static_cast<std::uint8_t>(_pendingSize + taken);
+            return 0;
+        }
+        out += base64Encode(group, 3, out, _alphabet);
+        _pendingSize = 0;
+    }
+    std::size_t whole = size / 3 * 3;
+    out += base64Encode(data, whole, out, _alphabet);
+    _pendingSize = static_cast<std::uint8_t>(size - whole);
+    std::copy(data + whole, data + size, _pending);
+    return static_cast<std::size_t>(out - start);
+}
+
+void Base64Encoder::Update(const unsigned char* data, std::size_t size, std::string& out) {
+    std::size_t used = out.size();
+    out.resize(used + MaxUpdateSize(size));
+    out.resize(used + Update(data, size, out.data() + used));
+}
+
+std::size_t Base64Encoder::Finish(char* out) {
+    std::size_t written = base64Encode(_pending, _pendingSize, out, _alphabet, _padded);
+    _pendingSize = 0;
+    return written;
+}
+
+void Base64Encoder::Finish(std::string& out) {
+    char tail[kMaxFinishSize];
+    out.append(tail, Finish(tail));
+}
+
+Base64Decoder::Base64Decoder(Base64Alphabet alphabet) : _alphabet(alphabet) {}
+
+bool Base64Decoder::Fail() {
+    _failed = true;
+    return false;
+}
+
+bool Base64Decoder::Update(std::string_view chunk, unsigned char* out, std::size_t& written) {
+    written = 0;
+    if (_failed) {
+        return false;
+    }
+    if (chunk.empty()) {
+        return true;
+    }
+    if (_padded) {
+        return Fail();
+    }
+    if (_pendingSize > 0) {
+        std::size_t taken = std::min<std::size_t>(4 - _pendingSize, chunk.size());
+        std::copy(chunk.begin(), chunk.begin() + taken, _pending + _pendingSize);
+        chunk.remove_prefix(taken);
+        _pendingSize = static_cast<std::uint8_t>(_pendingSize + taken);
+        if (_pendingSize < 4) {
+            return true;
+        }
+        _pendingSize = 0;
+        std::size_t groupWritten;
+        if (!base64Decode(std::string_view(_pending, 4), out, groupWritten, _alphabet)) {
+            return Fail();
+        }
+        written = groupWritten;
+        _padded = _pending[3] == '=';
+        if (_padded && !chunk.empty()) {
+            return Fail();
+        }
+    }
+    std::size_t whole = chunk.size() / 4 * 4;
+    if (whole > 0) {
+        std::size_t wholeWritten;
+        if (!base64Decode(chunk.substr(0, whole), out + written, wholeWritten, _alphabet)) {
+            return Fail();
+        }
+        written += wholeWritten;
+        _padded = chunk[whole - 1] == '=';
+        if (_padded && whole < chunk.size()) {
+            return Fail();
+        }
+    }
+    _pendingSize = static_cast<std::uint8_t>(chunk.size() - whole);
+    std::copy(chunk.begin() + whole, chunk.end(), _pending);
+    return true;
+}
+
+bool Base64Decoder::Update(std::string_view chunk, std::string& out) {
+    std::size_t used = out.size();
+    out.resize(used + MaxUpdateSize(chunk.size()));
+    std::size_t written;
+    bool ok = Update(chunk, reinterpret_cast<unsigned char*>(out.data() + used), written);
+    out.resize(used + written);
+    return ok;
+}
+
+bool Base64Decoder::Finish(unsigned char* out, std::size_t& written) {
+    written = 0;
+    bool ok = !_failed && (_pendingSize == 0 ||
+                           base64Decode(std::string_view(_pending, _pendingSize), out, written, _alphabet));
+    Reset();
+    return ok;
+}
+
+bool Base64Decoder::Finish(std::string& out) {
+    unsigned char tail[kMaxFinishSize];
+    std::size_t written;
+    bool ok = Finish(tail, written);
+    out.append(reinterpret_cast<const char*>(tail), written);
+    return ok;
+}
+
+void Base64Decoder::Reset() {
+    _pendingSize = 0;
+    _padded = false;
+    _failed = false;
+}
+
+} // namespace utils
+} // namespace stinger
@@ -0,0 +1,49 @@
+#include "stinger/utils/callbacklist.hpp"
+
+namespace stinger {
+namespace utils {
+
+CallbackHandleType MessageCallbackList::Add(const Callback& cb) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto list = std::make_shared<List>(*_list);
+    CallbackHandleType handle = _nextHandle++;
+    list->emplace_back(handle, cb);
+    _list = std::move(list);
+    return handle;
+}
+
+bool MessageCallbackList::Remove(CallbackHandleType handle) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto list = std::make_shared<List>();
+    list->reserve(_list->size());
+    for (const auto& entry : *_list) {
+        if (entry.first != handle) {
+            list->push_back(entry);
+        }
+    }
+    if (list->size() == _list->size()) {
+        return false;
+    }
+    _list = std::move(list);
+    return true;
+}
+
+std::size_t MessageCallbackList::Size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _list->size();
+}
+
+std::size_t MessageCallbackList::Invoke(const stinger::mqtt::Message& message) const {
+    std::shared_ptr<const List> list;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        list = _list;
+    }
+    for (const auto& entry : *list) {
+        entry.second(message);
+    }
+    return list->size();
+}
+
+} // namespace utils
+} // namespace stinger
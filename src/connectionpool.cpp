@@ -0,0 +1,144 @@
+#include "stinger/mqtt/connectionpool.hpp"
+#include "stinger/utils/hash.hpp"
+#include <algorithm>
+#include <cstdarg>
+#include <stdexcept>
+#include <string>
+#include <syslog.h>
+
+namespace stinger {
+namespace mqtt {
+
+ConnectionPool::ConnectionPool(const std::string& host, int port, const std::string& clientId, std::size_t size,
+                               const ConnectOptions& options) {
+    if (options.localDelivery) {
+        throw std::invalid_argument("ConnectionPool does not support ConnectOptions::localDelivery");
+    }
+    size = std::max<std::size_t>(1, size);
+    _members.reserve(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        std::string memberId = (i == 0) ? clientId : clientId + "-" + std::to_string(i);
+        ConnectOptions memberOptions = options;
+        if (size > 1) {
+            // No Local keeps the first member's own publishes away; the tag lets it drop those of the others.
+            memberOptions.originTag = clientId;
+        }
+        if (i > 0) {
+            memberOptions.onlineStatus = false;
+        }
+        _members.push_back(std::make_unique<BrokerConnection>(host, port, memberId, memberOptions));
+    }
+    // Only once `_members` is complete, since a member may receive a message before the next one is created.
+    for (auto& member : _members) {
+        member->AddMessageCallback([this](const Message& message) { Dispatch(message); });
+    }
+}
+
+ConnectionPool::~ConnectionPool() {
+    _members.clear();
+}
+
+std::future<bool> ConnectionPool::Publish(const Message& message) {
+    return _members[MemberForTopic(message.topic)]->Publish(message);
+}
+
+int ConnectionPool::Subscribe(const std::string& topic, int qos) {
+    return _members.front()->Subscribe(topic, qos);
+}
+
+void ConnectionPool::Unsubscribe(const std::string& topic) {
+    _members.front()->Unsubscribe(topic);
+}
+
+std::vector<int> ConnectionPool::SubscribeMany(const std::vector<std::string>& topics, int qos) {
+    return _members.front()->SubscribeMany(topics, qos);
+}
+
+void ConnectionPool::UnsubscribeMany(const std::vector<std::string>& topics) {
+    _members.front()->UnsubscribeMany(topics);
+}
+
+utils::CallbackHandleType ConnectionPool::AddMessageCallback(const std::function<void(const Message&)>& cb) {
+    utils::CallbackHandleType handle = _messageCallbacks.Add(cb);
+    Log(LOG_DEBUG, "Message callback set with handle %d", handle);
+    return handle;
+}
+
+void ConnectionPool::RemoveMessageCallback(utils::CallbackHandleType handle) {
+    if (handle > 0) {
+        if (_messageCallbacks.Remove(handle)) {
+            Log(LOG_DEBUG, "Removed message callback with handle %d", handle);
+        } else {
+            Log(LOG_WARNING, "No message callback found with handle %d", handle);
+        }
+    }
+}
+
+void ConnectionPool::Dispatch(const Message& message) {
+    _messageCallbacks.Invoke(message);
+}
+
+bool ConnectionPool::TopicMatchesSubscription(const std::string& topic, const std::string& subscr) const {
+    return _members.front()->TopicMatchesSubscription(topic, subscr);
+}
+
+std::string ConnectionPool::GetClientId() const {
+    return _members.front()->GetClientId();
+}
+
+std::string ConnectionPool::GetLastWillTopic() const {
+    return _members.front()->GetLastWillTopic();
+}
+
+std::string ConnectionPool::GetOnlinePayload() const {
+    return _members.front()->GetOnlinePayload();
+}
+
+std::string ConnectionPool::GetOfflinePayload() const {
+    return _members.front()->GetOfflinePayload();
+}
+
+bool ConnectionPool::IsConnected() const {
+    for (const auto& member : _members) {
+        if (!member->IsConnected()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ConnectionPool::SetLogFunction(const utils::LogFunctionType& logFunc) {
+    _logger.SetFunction(logFunc);
+    for (auto& member : _members) {
+        member->SetLogFunction(logFunc);
+    }
+}
+
+void ConnectionPool::SetLogLevel(int level) {
+    _logger.SetLevel(level);
+    for (auto& member : _members) {
+        member->SetLogLevel(level);
+    }
+}
+
+void ConnectionPool::Log(int level, const char* fmt, ...) const {
+    va_list args;
+    va_start(args, fmt);
+    _logger.Write(level, fmt, args);
+    va_end(args);
+}
+
+std::size_t ConnectionPool::Size() const {
+    return _members.size();
+}
+
+BrokerConnection& ConnectionPool::GetMember(std::size_t index) {
+    return *_members.at(index);
+}
+
+std::size_t ConnectionPool::MemberForTopic(const std::string& topic) const {
+    return static_cast<std::size_t>(utils::hashString(topic) % _members.size());
+}
+
+} // namespace mqtt
+} // namespace stinger
@@ -0,0 +1,293 @@
+#include "stinger/mqtt/connectionreactor.hpp"
+#include "stinger/mqtt/brokerconnection.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace stinger {
+namespace mqtt {
+
+namespace {
+
+// One turn of the wheel takes a second, which is how often every connection's LoopMisc runs.  Connections are
+// spread over the slots so that their housekeeping does not all land in the same tick.
+const std::size_t kWheelSlots = 10;
+const std::chrono::milliseconds kWheelTick(100);
+const int kMaxEvents = 256;
+// epoll data of the worker's wakeup eventfd; connection IDs start at 1.
+const std::uint64_t kWakeId = 0;
+
+epoll_event makeEvent(std::uint64_t id, bool wantWrite) {
+    epoll_event event = {};
+    event.events = EPOLLIN | (wantWrite ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    event.data.u64 = id;
+    return event;
+}
+
+} // namespace
+
+struct ConnectionReactor::Worker {
+    struct Entry {
+        BrokerConnection* connection = nullptr;
+        int fd = -1;
+        bool wantWrite = false;
+        std::size_t slot = 0;
+    };
+
+    Worker();
+    ~Worker();
+
+    void Add(std::uint64_t id, BrokerConnection* connection);
+    void Remove(std::uint64_t id);
+    void Stop();
+
+    // Called from any thread when a connection has queued outbound packets.
+    void MarkDirty(std::uint64_t id);
+
+    void Run();
+    void Wake();
+
+    // Brings the epoll registration of a connection in line with its current socket and write interest.
+    void Refresh(std::uint64_t id, Entry& entry);
+
+    int epollFd = -1;
+    int wakeFd = -1;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    // Held while the worker drives its connections, and by Add/Remove.
+    std::mutex mutex;
+    std::unordered_map<std::uint64_t, Entry> entries;
+    std::vector<std::vector<std::uint64_t>> wheel;
+    std::size_t nextSlot = 0;
+
+    std::mutex dirtyMutex;
+    std::vector<std::uint64_t> dirty;
+};
+
+ConnectionReactor::Worker::Worker() : wheel(kWheelSlots) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        throw std::runtime_error("ConnectionReactor: epoll_create1 failed");
+    }
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        close(epollFd);
+        throw std::runtime_error("ConnectionReactor: eventfd failed");
+    }
+    epoll_event event = makeEvent(kWakeId, false);
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+    thread = std::thread(&Worker::Run, this);
+}
+
+ConnectionReactor::Worker::~Worker() {
+    Stop();
+    close(wakeFd);
+    close(epollFd);
+}
+
+void ConnectionReactor::Worker::Stop() {
+    stopping = true;
+    Wake();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void ConnectionReactor::Worker::Add(std::uint64_t id, BrokerConnection* connection) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry& entry = entries[id];
+    entry.connection = connection;
+    entry.slot = id % kWheelSlots;
+    wheel[entry.slot].push_back(id);
+    connection->SetLoopWakeupFunction([this, id]() { MarkDirty(id); });
+    Refresh(id, entry);
+}
+
+void ConnectionReactor::Worker::Remove(std::uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(id);
+    if (found == entries.end()) {
+        return;
+    }
+    Entry& entry = found->second;
+    if (entry.fd != -1) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, entry.fd, NULL);
+    }
+    auto& slot = wheel[entry.slot];
+    slot.erase(std::find(slot.begin(), slot.end(), id));
+    entry.connection->SetLoopWakeupFunction(std::function<void()>());
+    // A stale ID left in `dirty` is skipped, since IDs are never reused.
+    entries.erase(found);
+}
+
+void ConnectionReactor::Worker::MarkDirty(std::uint64_t id) {
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> lock(dirtyMutex);
+        wasEmpty = dirty.empty();
+        dirty.push_back(id);
+    }
+    if (wasEmpty) {
+        Wake();
+    }
+}
+
+void ConnectionReactor::Worker::Wake() {
+    std::uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written; // Only fails when the counter is already non-zero, which wakes the worker anyway.
+}
+
+void ConnectionReactor::Worker::Refresh(std::uint64_t id, Entry& entry) {
+    auto interest = entry.connection->GetLoopInterest();
+    // A connection closes its socket (fd -1) in one Loop* call and opens a new one in a later LoopMisc, and every
+    // Loop* call is followed by a refresh, so a reused descriptor number is always seen as a new socket.
+    if (interest.fd != entry.fd) {
+        if (entry.fd != -1) {
+            // Fails harmlessly if closing the socket already dropped the registration.
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, entry.fd, NULL);
+        }
+        entry.fd = interest.fd;
+        entry.wantWrite = interest.wantWrite;
+        if (entry.fd != -1) {
+            epoll_event event = makeEvent(id, entry.wantWrite);
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, entry.fd, &event);
+        }
+    } else if (entry.fd != -1 && interest.wantWrite != entry.wantWrite) {
+        entry.wantWrite = interest.wantWrite;
+        epoll_event event = makeEvent(id, entry.wantWrite);
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, entry.fd, &event);
+    }
+}
+
+void ConnectionReactor::Worker::Run() {
+    epoll_event events[kMaxEvents];
+    auto nextTick = std::chrono::steady_clock::now() + kWheelTick;
+    std::vector<std::uint64_t> woken;
+    while (!stopping) {
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(nextTick - std::chrono::steady_clock::now());
+        int count = epoll_wait(epollFd, events, kMaxEvents, std::max<int>(0, static_cast<int>(wait.count())));
+        if (count < 0) {
+            if (errno != EINTR) {
+                break;
+            }
+            count = 0;
+        }
+        if (stopping) {
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < count; ++i) {
+            if (events[i].data.u64 == kWakeId) {
+                std::uint64_t value;
+                ssize_t bytesRead = read(wakeFd, &value, sizeof(value));
+                (void)bytesRead;
+                continue;
+            }
+            // Looked up by ID rather than pointer: the connection may have been removed since epoll_wait returned.
+            auto found = entries.find(events[i].data.u64);
+            if (found == entries.end()) {
+                continue;
+            }
+            Entry& entry = found->second;
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                entry.connection->LoopRead();
+            }
+            if (events[i].events & EPOLLOUT) {
+                entry.connection->LoopWrite();
+            }
+            Refresh(found->first, entry);
+        }
+
+        {
+            std::lock_guard<std::mutex> dirtyLock(dirtyMutex);
+            woken.swap(dirty);
+        }
+        for (auto id : woken) {
+            auto found = entries.find(id);
+            if (found != entries.end()) {
+                Refresh(id, found->second);
+            }
+        }
+        woken.clear();
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - nextTick > kWheelTick * kWheelSlots) {
+            // Fell more than a turn behind; don't run every slot several times to catch up.
+            nextTick = now;
+        }
+        while (now >= nextTick) {
+            for (auto id : wheel[nextSlot]) {
+                Entry& entry = entries[id];
+                entry.connection->LoopMisc();
+                Refresh(id, entry);
+            }
+            nextSlot = (nextSlot + 1) % kWheelSlots;
+            nextTick += kWheelTick;
+        }
+    }
+}
+
+ConnectionReactor::ConnectionReactor(std::size_t threadCount) {
+    threadCount = std::max<std::size_t>(1, threadCount);
+    _workers.reserve(threadCount);
+    for (std::size_t i = 0; i < threadCount; ++i) {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+}
+
+ConnectionReactor::~ConnectionReactor() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& worker : _workers) {
+        worker->Stop();
+    }
+    for (auto& entry : _connections) {
+        entry.first->SetLoopWakeupFunction(std::function<void()>());
+    }
+}
+
+void ConnectionReactor::Add(BrokerConnection& connection) {
+    if (!connection.GetConnectOptions().externalLoop) {
+        throw std::invalid_argument("ConnectionReactor needs a connection created with ConnectOptions::externalLoop");
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_connections.count(&connection) != 0) {
+        throw std::invalid_argument("Connection was already added to the ConnectionReactor");
+    }
+    Worker* worker = _workers[_nextWorker++ % _workers.size()].get();
+    std::uint64_t id = _nextId++;
+    _connections[&connection] = std::make_pair(worker, id);
+    worker->Add(id, &connection);
+}
+
+void ConnectionReactor::Remove(BrokerConnection& connection) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _connections.find(&connection);
+    if (found == _connections.end()) {
+        return;
+    }
+    found->second.first->Remove(found->second.second);
+    _connections.erase(found);
+}
+
+std::size_t ConnectionReactor::Size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _connections.size();
+}
+
+std::size_t ConnectionReactor::ThreadCount() const {
+    return _workers.size();
+}
+
+} // namespace mqtt
+} // namespace stinger
@@ -1,162 +1,445 @@
 #include <stinger/utils/conversions.hpp>
+#include <stinger/utils/base64.hpp>
 
+#include <algorithm>
 #include <cctype>
-#include <ctime>
-#include <iomanip>
-#include <sstream>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
 #include <stdexcept>
 
 namespace stinger {
 namespace utils {
 
-// Utility function to convert ISO timestamp string to time_point
-std::chrono::time_point<std::chrono::system_clock> parseIsoTimestamp(const std::string& isoTimestamp) {
-    std::tm tm = {};
-    std::istringstream ss(isoTimestamp);
+namespace {
 
-    // Parse ISO 8601 format (e.g., "2023-12-01T15:30:45Z" or "2023-12-01T15:30:45.123Z")
-    ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
-
-    if (ss.fail()) {
-        throw std::runtime_error("Failed to parse ISO timestamp: " + isoTimestamp);
-    }
-
-    // Convert to time_t treating the parsed fields as UTC, not local time.
-    // timegm() is the UTC-aware counterpart of mktime(); the 'Z' suffix in ISO
-    // 8601 mandates UTC, so mktime() (which uses the local timezone) is wrong.
-    std::time_t time = timegm(&tm);
-    return std::chrono::system_clock::from_time_t(time);
+// Days since 1970-01-01 of a proleptic Gregorian date, and back; H. Hinnant's days_from_civil and civil_from_days.
+std::int64_t daysFromCivil(std::int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    const std::int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const auto yearOfEra = static_cast<unsigned>(year - era * 400);
+    const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<std::int64_t>(dayOfEra) - 719468;
 }
 
-// Utility function to convert time_point to ISO timestamp string
-std::string timePointToIsoString(const std::chrono::time_point<std::chrono::system_clock>& timePoint) {
-    std::time_t time = std::chrono::system_clock::to_time_t(timePoint);
-    std::tm* tm = std::gmtime(&time);
-
-    std::ostringstream ss;
-    ss << std::put_time(tm, "%Y-%m-%dT%H:%M:%SZ");
-    return ss.str();
+void civilFromDays(std::int64_t days, std::int64_t& year, unsigned& month, unsigned& day) {
+    days += 719468;
+    const std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const auto dayOfEra = static_cast<unsigned>(days - era * 146097);
+    const unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const unsigned shiftedMonth = (5 * dayOfYear + 2) / 153; // March is 0.
+    day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+    month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+    year = static_cast<std::int64_t>(yearOfEra) + era * 400 + (month <= 2);
 }
 
-std::string durationToIsoString(const std::chrono::duration<double>& duration) {
-    using namespace std::chrono;
-    auto secs = duration_cast<seconds>(duration);
-    auto millis = duration_cast<milliseconds>(duration - secs);
+unsigned daysInMonth(unsigned year, unsigned month) {
+    static const unsigned char kDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    return month == 2 && leap ? 29 : kDays[month - 1];
+}
 
-    std::ostringstream ss;
-    ss << "PT";
-    ss << secs.count();
-    if (millis.count() > 0) {
-        ss << "." << std::setw(3) << std::setfill('0') << millis.count();
+// Reads exactly `count` decimal digits at `pos`.
+bool readDigits(std::string_view text, std::size_t& pos, std::size_t count, unsigned& value) {
+    if (text.size() - pos < count) {
+        return false;
     }
-    ss << "S";
-    return ss.str();
+    unsigned result = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        auto digit = static_cast<unsigned>(text[pos + i] - '0');
+        if (digit > 9) {
+            return false;
+        }
+        result = result * 10 + digit;
+    }
+    pos += count;
+    value = result;
+    return true;
 }
 
-std::chrono::duration<double> parseIsoDuration(const std::string& isoDuration) {
-    // Only supports simple "PTnS" or "PTn.mS" (seconds, optional milliseconds)
-    if (isoDuration.size() < 3 || isoDuration.substr(0, 2) != "PT" || isoDuration.back() != 'S') {
-        throw std::runtime_error("Unsupported ISO 8601 duration format: " + isoDuration);
+bool skip(std::string_view text, std::size_t& pos, char expected) {
+    if (pos < text.size() && text[pos] == expected) {
+        ++pos;
+        return true;
     }
-    std::string numberPart = isoDuration.substr(2, isoDuration.size() - 3); // between PT and S
-    double seconds = 0.0;
-    try {
-        seconds = std::stod(numberPart);
-    } catch (const std::exception&) {
-        throw std::runtime_error("Failed to parse ISO 8601 duration: " + isoDuration);
+    return false;
+}
+
+// Writes `value` as exactly `count` digits, keeping the low ones.
+char* putDigits(char* out, std::uint64_t value, unsigned count) {
+    for (unsigned i = count; i > 0; --i) {
+        out[i - 1] = static_cast<char>('0' + value % 10);
+        value /= 10;
     }
-    return std::chrono::duration<double>(seconds);
+    return out + count;
 }
 
-// Simple base64 implementation
-static const std::string b64_chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+} // namespace
 
-static inline bool is_base64(unsigned char c) {
-    return (std::isalnum(c) || (c == '+') || (c == '/'));
-}
+bool tryParseIsoTimestamp(std::string_view text, std::chrono::system_clock::time_point& out) {
+    using namespace std::chrono;
+    std::size_t pos = 0;
+    unsigned year, month, day;
+    if (!readDigits(text, pos, 4, year) || !skip(text, pos, '-') || !readDigits(text, pos, 2, month) ||
+        !skip(text, pos, '-') || !readDigits(text, pos, 2, day)) {
+        return false;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month)) {
+        return false;
+    }
 
-std::string base64Encode(const std::vector<unsigned char>& bytes_to_encode) {
-    std::string ret;
-    int i = 0;
-    unsigned char char_array_3[3];
-    unsigned char char_array_4[4];
+    unsigned hour = 0;
+    unsigned minute = 0;
+    unsigned second = 0;
+    std::int64_t nanoseconds = 0;
+    std::int64_t offsetSeconds = 0;
+    if (pos < text.size()) {
+        char separator = text[pos++];
+        if (separator != 'T' && separator != 't' && separator != ' ') {
+            return false;
+        }
+        if (!readDigits(text, pos, 2, hour) || !skip(text, pos, ':') || !readDigits(text, pos, 2, minute)) {
+            return false;
+        }
+        if (skip(text, pos, ':')) {
+            if (!readDigits(text, pos, 2, second)) {
+                return false;
+            }
+            if (skip(text, pos, '.') || skip(text, pos, ',')) {
+                std::size_t start = pos;
+                std::int64_t scale = 100000000;
+                for (; pos < text.size() && static_cast<unsigned>(text[pos] - '0') <= 9; ++pos) {
+                    nanoseconds += (text[pos] - '0') * scale; // Digits past nanoseconds are dropped.
+                    scale /= 10;
+                }
+                if (pos == start) {
+                    return false;
+                }
+            }
+        }
+        // A second of 60 is a leap second, which counts as the first second of the next minute.
+        if (hour > 23 || minute > 59 || second > 60) {
+            return false;
+        }
+        if (pos < text.size()) {
+            char zone = text[pos++];
+            if (zone == '+' || zone == '-') {
+                unsigned offsetHours;
+                unsigned offsetMinutes = 0;
+                if (!readDigits(text, pos, 2, offsetHours)) {
+                    return false;
+                }
+                if ((skip(text, pos, ':') || pos < text.size()) && !readDigits(text, pos, 2, offsetMinutes)) {
+                    return false;
+                }
+                if (offsetHours > 23 || offsetMinutes > 59) {
+                    return false;
+                }
+                offsetSeconds = static_cast<std::int64_t>(offsetHours * 3600 + offsetMinutes * 60);
+                if (zone == '-') {
+                    offsetSeconds = -offsetSeconds;
+                }
+            } else if (zone != 'Z' && zone != 'z') {
+                return false;
+            }
+            if (pos != text.size()) {
+                return false;
+            }
+        }
+    }
 
-    size_t in_len = bytes_to_encode.size();
-    size_t pos = 0;
+    std::int64_t total = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - offsetSeconds;
+    // The clock may not reach every year that can be written, e.g. 1677-2262 for a nanosecond clock.
+    constexpr auto kMaxSeconds = duration_cast<seconds>(system_clock::duration::max()).count();
+    if (total >= kMaxSeconds || total <= -kMaxSeconds) {
+        return false;
+    }
+    out = system_clock::time_point(duration_cast<system_clock::duration>(seconds(total)) +
+                                   duration_cast<system_clock::duration>(std::chrono::nanoseconds(nanoseconds)));
+    return true;
+}
 
-    while (in_len--) {
-        char_array_3[i++] = bytes_to_encode[pos++];
-        if (i == 3) {
-            char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-            char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-            char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-            char_array_4[3] = char_array_3[2] & 0x3f;
+std::chrono::time_point<std::chrono::system_clock> parseIsoTimestamp(std::string_view isoTimestamp) {
+    std::chrono::system_clock::time_point timePoint;
+    if (!tryParseIsoTimestamp(isoTimestamp, timePoint)) {
+        throw std::runtime_error("Failed to parse ISO timestamp: " + std::string(isoTimestamp));
+    }
+    return timePoint;
+}
 
-            for (i = 0; (i < 4); i++)
-                ret += b64_chars[char_array_4[i]];
-            i = 0;
+char* formatIsoTimestamp(const std::chrono::system_clock::time_point& timePoint, char* out, unsigned fractionDigits) {
+    using namespace std::chrono;
+    auto sinceEpoch = timePoint.time_since_epoch();
+    auto wholeSeconds = floor<seconds>(sinceEpoch);
+    auto nanoseconds = duration_cast<std::chrono::nanoseconds>(sinceEpoch - wholeSeconds).count();
+    std::int64_t total = wholeSeconds.count();
+    std::int64_t days = (total >= 0 ? total : total - 86399) / 86400;
+    auto secondOfDay = static_cast<unsigned>(total - days * 86400);
+
+    std::int64_t year;
+    unsigned month, day;
+    civilFromDays(days, year, month, day);
+    if (year < 0 || year > 9999) {
+        return nullptr;
+    }
+    out = putDigits(out, static_cast<std::uint64_t>(year), 4);
+    *out++ = '-';
+    out = putDigits(out, month, 2);
+    *out++ = '-';
+    out = putDigits(out, day, 2);
+    *out++ = 'T';
+    out = putDigits(out, secondOfDay / 3600, 2);
+    *out++ = ':';
+    out = putDigits(out, secondOfDay / 60 % 60, 2);
+    *out++ = ':';
+    out = putDigits(out, secondOfDay % 60, 2);
+    if (fractionDigits > 0) {
+        fractionDigits = std::min(fractionDigits, 9u);
+        std::uint64_t divisor = 1;
+        for (unsigned i = fractionDigits; i < 9; ++i) {
+            divisor *= 10;
         }
+        *out++ = '.';
+        out = putDigits(out, static_cast<std::uint64_t>(nanoseconds) / divisor, fractionDigits);
     }
+    *out++ = 'Z';
+    return out;
+}
 
-    if (i) {
-        for (int j = i; j < 3; j++)
-            char_array_3[j] = '\0';
+// Utility function to convert time_point to ISO timestamp string
+std::string timePointToIsoString(const std::chrono::time_point<std::chrono::system_clock>& timePoint) {
+    char buffer[kIsoTimestampMaxLength];
+    char* end = formatIsoTimestamp(timePoint, buffer);
+    if (end == nullptr) {
+        throw std::runtime_error("Time point is outside the years 0000-9999");
+    }
+    return std::string(buffer, end);
+}
 
-        char_array_4[0] = (char_array_3[0] & 0xfc) >> 2;
-        char_array_4[1] = ((char_array_3[0] & 0x03) << 4) + ((char_array_3[1] & 0xf0) >> 4);
-        char_array_4[2] = ((char_array_3[1] & 0x0f) << 2) + ((char_array_3[2] & 0xc0) >> 6);
-        char_array_4[3] = char_array_3[2] & 0x3f;
+namespace {
 
-        for (int j = 0; (j < i + 1); j++)
-            ret += b64_chars[char_array_4[j]];
+struct DurationUnit {
+    char designator;
+    bool timePart; // After the 'T'.
+    std::uint64_t seconds;
+};
 
-        while ((i++ < 3))
-            ret += '=';
-    }
+// In the order they must appear.  A year is 365.2425 days and a month a twelfth of that, as in std::chrono.
+const DurationUnit kDurationUnits[] = {{'Y', false, 31556952}, {'M', false, 2629746}, {'W', false, 604800},
+                                       {'D', false, 86400},    {'H', true, 3600},     {'M', true, 60},
+                                       {'S', true, 1}};
 
-    return ret;
+const std::uint64_t kNanosecondsPerSecond = 1000000000;
+
+char* putNumber(char* out, std::uint64_t value) {
+    return std::to_chars(out, out + 20, value).ptr;
 }
 
-std::vector<unsigned char> base64Decode(const std::string& encoded_string) {
-    int in_len = encoded_string.size();
-    int i = 0;
-    int in_ = 0;
-    unsigned char char_array_4[4], char_array_3[3];
-    std::vector<unsigned char> ret;
+} // namespace
+
+bool tryParseIsoDuration(std::string_view text, std::chrono::nanoseconds& out) {
+    std::size_t pos = 0;
+    bool negative = skip(text, pos, '-');
+    if (!negative) {
+        skip(text, pos, '+');
+    }
+    if (!skip(text, pos, 'P')) {
+        return false;
+    }
+    // The magnitude, in nanoseconds, may reach 2^63 only when negative.
+    const std::uint64_t limit = static_cast<std::uint64_t>(INT64_MAX) + (negative ? 1 : 0);
+    std::uint64_t total = 0;
+    std::size_t nextUnit = 0;
+    bool timePart = false;
+    bool anyComponent = false;
+    bool fractionSeen = false;
+    while (pos < text.size()) {
+        if (skip(text, pos, 'T')) {
+            if (timePart || pos == text.size()) {
+                return false;
+            }
+            timePart = true;
+            continue;
+        }
+        if (fractionSeen) {
+            return false; // Only the last component may have a fraction.
+        }
+        std::uint64_t whole = 0;
+        auto parsed = std::from_chars(text.data() + pos, text.data() + text.size(), whole);
+        if (parsed.ec != std::errc()) {
+            return false;
+        }
+        pos = static_cast<std::size_t>(parsed.ptr - text.data());
+        std::uint64_t fraction = 0; // Billionths of the unit.
+        if (skip(text, pos, '.') || skip(text, pos, ',')) {
+            std::size_t start = pos;
+            std::uint64_t scale = kNanosecondsPerSecond / 10;
+            for (; pos < text.size() && static_cast<unsigned>(text[pos] - '0') <= 9; ++pos) {
+                fraction += static_cast<std::uint64_t>(text[pos] - '0') * scale; // Digits past the ninth are dropped.
+                scale /= 10;
+            }
+            if (pos == start) {
+                return false;
+            }
+            fractionSeen = true;
+        }
+        if (pos == text.size()) {
+            return false;
+        }
+        char designator = text[pos++];
+        while (nextUnit < std::size(kDurationUnits) && (kDurationUnits[nextUnit].designator != designator ||
+                                                        kDurationUnits[nextUnit].timePart != timePart)) {
+            ++nextUnit;
+        }
+        if (nextUnit == std::size(kDurationUnits)) {
+            return false;
+        }
+        const DurationUnit& unit = kDurationUnits[nextUnit++];
+        std::uint64_t unitNanoseconds = unit.seconds * kNanosecondsPerSecond;
+        if (whole > limit / unitNanoseconds) {
+            return false;
+        }
+        // Both terms are at most `limit`, below 2^63, so the sum cannot wrap.
+        std::uint64_t amount = whole * unitNanoseconds + fraction * unit.seconds;
+        if (amount > limit - total) {
+            return false;
+        }
+        total += amount;
+        anyComponent = true;
+    }
+    if (!anyComponent) {
+        return false;
+    }
+    if (negative && total > 0) {
+        // Written so that a magnitude of 2^63 becomes INT64_MIN without overflowing.
+        out = std::chrono::nanoseconds(-static_cast<std::int64_t>(total - 1) - 1);
+    } else {
+        out = std::chrono::nanoseconds(static_cast<std::int64_t>(total));
+    }
+    return true;
+}
 
-    while (in_len-- && (encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-        char_array_4[i++] = encoded_string[in_];
-        in_++;
-        if (i == 4) {
-            for (i = 0; i < 4; i++)
-                char_array_4[i] = b64_chars.find(char_array_4[i]);
+namespace {
 
-            char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-            char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-            char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+// Writes the sign and returns the magnitude of `duration`, in nanoseconds.
+std::uint64_t putSign(char*& out, std::chrono::nanoseconds duration) {
+    std::int64_t count = duration.count();
+    if (count < 0) {
+        *out++ = '-';
+        return 0 - static_cast<std::uint64_t>(count);
+    }
+    return static_cast<std::uint64_t>(count);
+}
 
-            for (i = 0; (i < 3); i++)
-                ret.push_back(char_array_3[i]);
-            i = 0;
+// Writes an S component, with the fraction trimmed of trailing zeros.
+char* putSeconds(char* out, std::uint64_t seconds, std::uint64_t nanoseconds) {
+    out = putNumber(out, seconds);
+    if (nanoseconds > 0) {
+        *out++ = '.';
+        unsigned digits = 9;
+        while (nanoseconds % 10 == 0) {
+            nanoseconds /= 10;
+            --digits;
         }
+        out = putDigits(out, nanoseconds, digits);
     }
+    *out++ = 'S';
+    return out;
+}
 
-    if (i) {
-        for (int j = i; j < 4; j++)
-            char_array_4[j] = 0;
+} // namespace
+
+char* formatIsoDuration(std::chrono::nanoseconds duration, char* out) {
+    std::uint64_t magnitude = putSign(out, duration);
+    *out++ = 'P';
+    std::uint64_t nanoseconds = magnitude % kNanosecondsPerSecond;
+    std::uint64_t seconds = magnitude / kNanosecondsPerSecond;
+    std::uint64_t days = seconds / 86400;
+    std::uint64_t hours = seconds / 3600 % 24;
+    std::uint64_t minutes = seconds / 60 % 60;
+    seconds %= 60;
+    if (days > 0) {
+        out = putNumber(out, days);
+        *out++ = 'D';
+    }
+    if (hours == 0 && minutes == 0 && seconds == 0 && nanoseconds == 0 && days > 0) {
+        return out;
+    }
+    *out++ = 'T';
+    if (hours > 0) {
+        out = putNumber(out, hours);
+        *out++ = 'H';
+    }
+    if (minutes > 0) {
+        out = putNumber(out, minutes);
+        *out++ = 'M';
+    }
+    if (seconds > 0 || nanoseconds > 0 || (hours == 0 && minutes == 0)) {
+        out = putSeconds(out, seconds, nanoseconds);
+    }
+    return out;
+}
 
-        for (int j = 0; j < 4; j++)
-            char_array_4[j] = b64_chars.find(char_array_4[j]);
+std::string durationToIsoString(const std::chrono::duration<double>& duration) {
+    // Also rejects NaN.
+    if (!(std::abs(duration.count()) < 9.2e9)) {
+        throw std::runtime_error("Duration is too long to format: " + std::to_string(duration.count()) + " s");
+    }
+    // Seconds only: peers on versions before formatIsoDuration read the number between "PT" and "S" as seconds.
+    char buffer[kIsoDurationMaxLength];
+    char* out = buffer;
+    std::uint64_t magnitude = putSign(out, std::chrono::round<std::chrono::nanoseconds>(duration));
+    *out++ = 'P';
+    *out++ = 'T';
+    out = putSeconds(out, magnitude / kNanosecondsPerSecond, magnitude % kNanosecondsPerSecond);
+    return std::string(buffer, out);
+}
+
+std::chrono::duration<double> parseIsoDuration(std::string_view isoDuration) {
+    std::chrono::nanoseconds duration;
+    if (!tryParseIsoDuration(isoDuration, duration)) {
+        throw std::runtime_error("Failed to parse ISO 8601 duration: " + std::string(isoDuration));
+    }
+    return duration;
+}
 
-        char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-        char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-        char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+std::string base64Encode(const std::vector<unsigned char>& data) {
+    std::string encoded(base64EncodedSize(data.size()), '\0');
+    base64Encode(data.data(), data.size(), encoded.data());
+    return encoded;
+}
 
-        for (int j = 0; (j < i - 1); j++)
-            ret.push_back(char_array_3[j]);
+std::vector<unsigned char> base64Decode(const std::string& encoded) {
+    std::vector<unsigned char> decoded(base64DecodedSize(encoded));
+    std::size_t written;
+    if (base64Decode(encoded, decoded.data(), written)) {
+        decoded.resize(written);
+        return decoded;
     }
 
-    return ret;
+    // Leniently decode the chars before the first that is not in the alphabet, ignoring a trailing lone char and
+    // any nonzero bits after the last byte.
+    auto end = std::find_if(encoded.begin(), encoded.end(), [](unsigned char c) {
+        return !std::isalnum(c) && c != '+' && c != '/';
+    });
+    std::size_t valid = static_cast<std::size_t>(end - encoded.begin());
+    std::size_t whole = valid / 4 * 4;
+    std::size_t rest = valid - whole;
+    decoded.resize(whole / 4 * 3 + (rest >= 2 ? rest - 1 : 0));
+    base64Decode(std::string_view(encoded.data(), whole), decoded.data(), written);
+    if (rest >= 2) {
+        // Zero-valued chars complete the group without adding bits.
+        char group[4] = {'A', 'A', 'A', 'A'};
+        std::copy(encoded.begin() + whole, end, group);
+        unsigned char bytes[3];
+        std::size_t groupWritten;
+        base64Decode(std::string_view(group, 4), bytes, groupWritten);
+        std::copy(bytes, bytes + rest - 1, decoded.begin() + written);
+    }
+    return decoded;
 }
 
 } // namespace utils
@@ -1,24 +1,223 @@
 #include "stinger/utils/format.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
 
 namespace stinger {
 namespace utils {
 
 std::string format(const std::string& templateStr, const std::map<std::string, std::string>& values) {
-    std::string result = templateStr;
+    std::string result;
+    result.reserve(templateStr.size());
+    std::string_view text(templateStr);
+    // One pass over the template, so values are never themselves searched for tokens.
+    detail::parseTemplate(text, [&](std::size_t offset, std::size_t length, bool isPlaceholder) {
+        if (isPlaceholder) {
+            auto found = values.find(std::string(text.substr(offset, length)));
+            if (found != values.end()) {
+                result += found->second;
+                return;
+            }
+            // Keep the braces of a placeholder without a value.
+            --offset;
+            length += 2;
+        }
+        result.append(text.data() + offset, length);
+    });
+    return result;
+}
+
+namespace detail {
 
-    // Iterate through all key-value pairs in the map
-    for (const auto& [key, value] : values) {
-        std::string token = "{" + key + "}";
-        size_t pos = 0;
+std::size_t renderedSize(std::string_view text, const TemplateSegment* segments, std::size_t segmentCount,
+                         std::size_t placeholderCount, const std::string_view* values, std::size_t valueCount) {
+    if (valueCount != placeholderCount) {
+        throw std::invalid_argument("Template " + std::string(text) + " needs " + std::to_string(placeholderCount) +
+                                    " values, got " + std::to_string(valueCount));
+    }
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < segmentCount; ++i) {
+        const TemplateSegment& segment = segments[i];
+        size += segment.placeholder == TemplateSegment::kLiteral ? segment.length : values[segment.placeholder].size();
+    }
+    return size;
+}
+
+char* renderTemplate(std::string_view text, const TemplateSegment* segments, std::size_t segmentCount,
+                     const std::string_view* values, char* out) {
+    for (std::size_t i = 0; i < segmentCount; ++i) {
+        const TemplateSegment& segment = segments[i];
+        std::string_view piece = segment.placeholder == TemplateSegment::kLiteral
+                                     ? text.substr(segment.offset, segment.length)
+                                     : values[segment.placeholder];
+        out += piece.copy(out, piece.size());
+    }
+    return out;
+}
+
+namespace {
+
+// Binds a placeholder, or checks a repeated one against its earlier value.
+bool bindValue(std::string_view& slot, std::string_view value) {
+    if (slot.data() != nullptr && slot != value) {
+        return false;
+    }
+    slot = value;
+    return true;
+}
 
-        // Replace all occurrences of the token in the string
-        while ((pos = result.find(token, pos)) != std::string::npos) {
-            result.replace(pos, token.length(), value);
-            pos += value.length();
+// Matches segments[first..] against topic[pos..], with placeholders below `bound` already bound.  A placeholder
+// followed by literal text in its level tries each place that text occurs, shortest value first.  Placeholders are
+// numbered in order of first appearance, so a failed attempt is undone by unbinding those from `bound` up.
+bool matchSegments(std::string_view text, const TemplateSegment* segments, std::size_t first, std::size_t segmentCount,
+                   std::string_view topic, std::size_t pos, std::string_view* values, std::size_t bound,
+                   std::size_t placeholderCount) {
+    for (std::size_t i = first; i < segmentCount; ++i) {
+        const TemplateSegment& segment = segments[i];
+        if (segment.placeholder == TemplateSegment::kLiteral) {
+            std::string_view literal = text.substr(segment.offset, segment.length);
+            if (topic.compare(pos, literal.size(), literal) != 0) {
+                return false;
+            }
+            pos += literal.size();
+            continue;
+        }
+        std::size_t levelEnd = std::min(topic.find('/', pos), topic.size());
+        std::string_view sameLevel;
+        if (i + 1 < segmentCount && segments[i + 1].placeholder == TemplateSegment::kLiteral) {
+            std::string_view next = text.substr(segments[i + 1].offset, segments[i + 1].length);
+            sameLevel = next.substr(0, next.find('/'));
+        }
+        std::string_view& slot = values[segment.placeholder];
+        bound = std::max<std::size_t>(bound, segment.placeholder + 1);
+        if (sameLevel.empty()) {
+            if (!bindValue(slot, topic.substr(pos, levelEnd - pos))) {
+                return false;
+            }
+            pos = levelEnd;
+            continue;
+        }
+        std::string_view saved = slot;
+        for (std::size_t end = topic.find(sameLevel, pos); end < levelEnd; end = topic.find(sameLevel, end + 1)) {
+            if (bindValue(slot, topic.substr(pos, end - pos)) &&
+                matchSegments(text, segments, i + 1, segmentCount, topic, end, values, bound, placeholderCount)) {
+                return true;
+            }
+            slot = saved;
+            std::fill(values + bound, values + placeholderCount, std::string_view());
         }
+        return false;
     }
+    return pos == topic.size();
+}
 
-    return result;
+} // namespace
+
+bool matchTemplate(std::string_view text, const TemplateSegment* segments, std::size_t segmentCount,
+                   std::size_t placeholderCount, std::string_view topic, std::string_view* values,
+                   std::size_t valueCount) {
+    if (valueCount != placeholderCount) {
+        throw std::invalid_argument("Template " + std::string(text) + " has " + std::to_string(placeholderCount) +
+                                    " placeholders, got room for " + std::to_string(valueCount));
+    }
+    // A value with a null data pointer has not been matched yet.
+    std::fill(values, values + valueCount, std::string_view());
+    return matchSegments(text, segments, 0, segmentCount, topic, 0, values, 0, placeholderCount);
+}
+
+std::string templateFilter(std::string_view text, const TemplateSegment* segments, std::size_t segmentCount) {
+    std::string filter;
+    filter.reserve(text.size());
+    std::size_t levelStart = 0;
+    bool wildcard = false;
+    auto endLevel = [&] {
+        if (wildcard) {
+            filter.resize(levelStart);
+            filter += '+';
+        }
+    };
+    for (std::size_t i = 0; i < segmentCount; ++i) {
+        const TemplateSegment& segment = segments[i];
+        if (segment.placeholder != TemplateSegment::kLiteral) {
+            wildcard = true;
+            continue;
+        }
+        for (char c : text.substr(segment.offset, segment.length)) {
+            if (c == '/') {
+                endLevel();
+                levelStart = filter.size() + 1;
+                wildcard = false;
+            }
+            filter += c;
+        }
+    }
+    endLevel();
+    return filter;
+}
+
+} // namespace detail
+
+CompiledTemplate::CompiledTemplate(std::string templateStr) : _text(std::move(templateStr)) {
+    detail::parseTemplate(_text, [this](std::size_t offset, std::size_t length, bool isPlaceholder) {
+        TemplateSegment segment;
+        segment.offset = static_cast<std::uint32_t>(offset);
+        segment.length = static_cast<std::uint32_t>(length);
+        if (isPlaceholder) {
+            int index = PlaceholderIndex(std::string_view(_text).substr(offset, length));
+            if (index < 0) {
+                index = static_cast<int>(_names.size());
+                _names.push_back(static_cast<std::uint32_t>(_segments.size()));
+            }
+            segment.placeholder = static_cast<std::uint32_t>(index);
+        }
+        _segments.push_back(segment);
+    });
+}
+
+std::string_view CompiledTemplate::PlaceholderName(std::size_t index) const {
+    const TemplateSegment& segment = _segments[_names[index]];
+    return std::string_view(_text).substr(segment.offset, segment.length);
+}
+
+int CompiledTemplate::PlaceholderIndex(std::string_view name) const {
+    for (std::size_t i = 0; i < _names.size(); ++i) {
+        if (PlaceholderName(i) == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+std::size_t CompiledTemplate::RenderedSize(const std::string_view* values, std::size_t count) const {
+    return detail::renderedSize(_text, _segments.data(), _segments.size(), _names.size(), values, count);
+}
+
+char* CompiledTemplate::RenderTo(const std::string_view* values, std::size_t count, char* out) const {
+    RenderedSize(values, count);
+    return detail::renderTemplate(_text, _segments.data(), _segments.size(), values, out);
+}
+
+void CompiledTemplate::Render(const std::string_view* values, std::size_t count, std::string& out) const {
+    out.resize(RenderedSize(values, count));
+    detail::renderTemplate(_text, _segments.data(), _segments.size(), values, out.data());
+}
+
+std::string CompiledTemplate::Render(const std::string_view* values, std::size_t count) const {
+    std::string out;
+    Render(values, count, out);
+    return out;
+}
+
+std::string CompiledTemplate::Render(std::initializer_list<std::string_view> values) const {
+    return Render(values.begin(), values.size());
+}
+
+bool CompiledTemplate::Match(std::string_view topic, std::string_view* values, std::size_t count) const {
+    return detail::matchTemplate(_text, _segments.data(), _segments.size(), _names.size(), topic, values, count);
+}
+
+std::string CompiledTemplate::SubscriptionFilter() const {
+    return detail::templateFilter(_text, _segments.data(), _segments.size());
 }
 
 } // namespace utils
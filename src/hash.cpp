@@ -3,7 +3,7 @@
 namespace stinger {
 namespace utils {
 
-uint64_t hashString(const std::string& str) {
+uint64_t hashString(std::string_view str) {
     constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
     constexpr uint64_t FNV_PRIME = 1099511628211ULL;
 
@@ -0,0 +1,27 @@
+#include "stinger/utils/logger.hpp"
+#include <cstdio>
+#include <syslog.h>
+
+namespace stinger {
+namespace utils {
+
+Logger::Logger() : _level(LOG_NOTICE) {}
+
+void Logger::SetFunction(const LogFunctionType& logFunc) {
+    _function = logFunc;
+}
+
+void Logger::SetLevel(int level) {
+    _level = level;
+}
+
+void Logger::Write(int level, const char* fmt, va_list args) const {
+    if (_function && (level <= _level)) {
+        char buf[256];
+        vsnprintf(buf, sizeof(buf), fmt, args);
+        _function(level, buf);
+    }
+}
+
+} // namespace utils
+} // namespace stinger
@@ -1,5 +1,6 @@
 #include "stinger/utils/mockconnection.hpp"
 #include "stinger/mqtt/message.hpp"
+#include "stinger/mqtt/topic.hpp"
 #include <algorithm>
 #include <cstdarg>
 #include <iostream>
@@ -8,7 +9,7 @@ namespace stinger {
 namespace utils {
 
 MockConnection::MockConnection(const std::string& clientId)
-    : _clientId(clientId), _nextSubscriptionId(1), _nextCallbackHandle(1) {}
+    : _clientId(clientId), _nextSubscriptionId(1) {}
 
 MockConnection::~MockConnection() {}
 
@@ -23,38 +24,47 @@ std::future<bool> MockConnection::Publish(const stinger::mqtt::Message& mqttMsg)
 }
 
 int MockConnection::Subscribe(const std::string& topic, int qos) {
-    std::lock_guard<std::mutex> lock(_mutex);
-
-    int subscriptionId = _nextSubscriptionId++;
-    Subscription sub;
-    sub.topic = topic;
-    sub.qos = qos;
-    sub.subscriptionId = subscriptionId;
-
-    _subscriptions[topic] = sub;
-    return subscriptionId;
+    auto sub = _subscriptions.Acquire(
+        topic, qos, [this](std::string_view, SubscriptionRegistry::Subscription& created) {
+            created.subscriptionId = _nextSubscriptionId++;
+        });
+    return sub.subscriptionId;
 }
 
 void MockConnection::Unsubscribe(const std::string& topic) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    _subscriptions.erase(topic);
+    _subscriptions.Release(topic, nullptr);
+}
+
+std::vector<int> MockConnection::SubscribeMany(const std::vector<std::string>& topics, int qos) {
+    // Mirror BrokerConnection: a batch is one SUBSCRIBE packet, so every new topic in it shares one subscription ID.
+    auto subs = _subscriptions.AcquireMany(
+        topics, qos, [this](const std::vector<std::string_view>&, SubscriptionRegistry::Subscription& created) {
+            created.subscriptionId = _nextSubscriptionId++;
+        });
+    std::vector<int> subscriptionIds;
+    subscriptionIds.reserve(subs.size());
+    for (const auto& sub : subs) {
+        subscriptionIds.push_back(sub.subscriptionId);
+    }
+    return subscriptionIds;
+}
+
+void MockConnection::UnsubscribeMany(const std::vector<std::string>& topics) {
+    _subscriptions.ReleaseMany(topics, nullptr);
 }
 
 CallbackHandleType MockConnection::AddMessageCallback(const std::function<void(const stinger::mqtt::Message&)>& cb) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    CallbackHandleType handle = _nextCallbackHandle++;
-    _callbacks[handle] = cb;
-    return handle;
+    return _callbacks.Add(cb);
 }
 
 void MockConnection::RemoveMessageCallback(CallbackHandleType handle) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    _callbacks.erase(handle);
+    _callbacks.Remove(handle);
 }
 
-bool MockConnection::TopicMatchesSubscription(const std::string& topic, const std::string& subscr) const {
+bool MockConnection::TopicMatchesSubscription(const std::string& topic, const std::string& subscriptionTopic) const {
     // Simple implementation - for more complex matching, use mosquitto_topic_matches_sub
-    // This handles basic wildcards: + (single level) and # (multi level)
+    // This handles basic wildcards: + (single level) and # (multi level), and ignores a $share/<group>/ prefix
+    const std::string subscr(stinger::mqtt::subscriptionFilter(subscriptionTopic));
 
     if (subscr == "#") {
         return true; // Match everything
@@ -133,30 +143,18 @@ void MockConnection::SimulateIncomingMessage(const stinger::mqtt::Message& msg)
     // lock, then release it before invoking them.  Callbacks commonly call back into
     // the connection (e.g. a server handler publishing a response), and holding the
     // (non-recursive) mutex during the callback would deadlock.
-    bool matched = false;
-    stinger::mqtt::Message callbackMsg = msg;
-    std::vector<std::function<void(const stinger::mqtt::Message&)>> callbacks;
-    {
-        std::lock_guard<std::mutex> lock(_mutex);
-        for (const auto& [topic, sub] : _subscriptions) {
-            if (TopicMatchesSubscription(msg.topic, sub.topic)) {
-                callbackMsg.properties.subscriptionId = sub.subscriptionId;
-                for (const auto& [handle, callback] : _callbacks) {
-                    callbacks.push_back(callback);
-                }
-                matched = true;
-                break;
-            }
-        }
-    }
-
-    if (!matched) {
+    // An exact subscription wins; otherwise use the oldest matching wildcard subscription.
+    auto matches = [&](const std::string& subscr) { return TopicMatchesSubscription(msg.topic, subscr); };
+    TopicId id = msg.FindTopicId();
+    auto sub = id != kInvalidTopicId ? _subscriptions.Match(id, matches) : _subscriptions.Match(msg.topic, matches);
+    int subscriptionId = sub ? sub->subscriptionId : 0;
+    if (subscriptionId == 0) {
         return;
     }
 
-    for (const auto& callback : callbacks) {
-        callback(callbackMsg);
-    }
+    stinger::mqtt::Message callbackMsg = msg;
+    callbackMsg.properties.SetSubscriptionId(subscriptionId);
+    _callbacks.Invoke(callbackMsg);
 }
 
 std::vector<stinger::mqtt::Message> MockConnection::GetPublishedMessages() const {
@@ -167,7 +165,6 @@ std::vector<stinger::mqtt::Message> MockConnection::GetPublishedMessages() const
 std::vector<stinger::mqtt::Message> MockConnection::GetPublishedMessages(const std::string& topic) const {
     std::lock_guard<std::mutex> lock(_mutex);
     std::vector<stinger::mqtt::Message> result;
-
     for (const auto& msg : _publishedMessages) {
         if (msg.topic == topic) {
             result.push_back(msg);
@@ -183,26 +180,21 @@ void MockConnection::ClearPublishedMessages() {
 }
 
 std::vector<std::string> MockConnection::GetSubscriptions() const {
-    std::lock_guard<std::mutex> lock(_mutex);
     std::vector<std::string> result;
-
-    for (const auto& [topic, sub] : _subscriptions) {
-        result.push_back(topic);
-    }
-
+    _subscriptions.ForEach(
+        [&](std::string_view topic, const SubscriptionRegistry::Subscription&) { result.emplace_back(topic); });
+    std::sort(result.begin(), result.end());
     return result;
 }
 
 bool MockConnection::IsSubscribed(const std::string& topic) const {
-    std::lock_guard<std::mutex> lock(_mutex);
-    return _subscriptions.find(topic) != _subscriptions.end();
+    return _subscriptions.Find(topic).has_value();
 }
 
 int MockConnection::GetSubscriptionQos(const std::string& topic) const {
-    std::lock_guard<std::mutex> lock(_mutex);
-    auto it = _subscriptions.find(topic);
-    if (it != _subscriptions.end()) {
-        return it->second.qos;
+    auto sub = _subscriptions.Find(topic);
+    if (sub) {
+        return sub->qos;
     }
     return -1; // Not subscribed
 }
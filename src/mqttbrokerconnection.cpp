@@ -1,14 +1,20 @@
 #include "stinger/mqtt/brokerconnection.hpp"
+#include "stinger/mqtt/topic.hpp"
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
 #include <chrono>
 #include <cstdarg>
 #include <cstring>
 #include <iostream>
 #include <mosquitto.h>
 #include <mqtt_protocol.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <sys/socket.h>
 #include <syslog.h>
 #include <thread>
 
@@ -17,18 +23,101 @@ using namespace std;
 namespace stinger {
 namespace mqtt {
 
+typedef utils::SubscriptionRegistry::Subscription RegisteredSubscription;
+typedef utils::SubscriptionRegistry::Entry RegistryEntry;
+
 const int kReconnectDelaySeconds = 1;
+const int kConnackSessionPresent = 0x01;
 const int kReconnectDelayMaxSeconds = 30;
 
+namespace {
+
+void addUserProperty(mosquitto_property** propList, UserProperty property, const char* value) {
+    mosquitto_property_add_string_pair(propList, MQTT_PROP_USER_PROPERTY, userPropertyName(property).data(), value);
+}
+
+// Adds the properties in `Fields`, a MessageSchema mask, to a publish property list.
+template <std::uint16_t Fields>
+void addProperties(mosquitto_property** propList, const Properties& props) {
+    if constexpr (Fields & propertyBit(PropertyField::ContentType)) {
+        if (auto contentType = props.GetContentType()) {
+            mosquitto_property_add_string(propList, MQTT_PROP_CONTENT_TYPE, contentType->c_str());
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::CorrelationData)) {
+        if (auto correlationData = props.GetCorrelationData()) {
+            mosquitto_property_add_binary(propList, MQTT_PROP_CORRELATION_DATA,
+                                          static_cast<const void*>(correlationData->data()),
+                                          correlationData->size());
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::ResponseTopic)) {
+        if (auto responseTopic = props.GetResponseTopic()) {
+            mosquitto_property_add_string(propList, MQTT_PROP_RESPONSE_TOPIC, responseTopic->c_str());
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::MessageExpiryInterval)) {
+        if (auto messageExpiryInterval = props.GetMessageExpiryInterval()) {
+            mosquitto_property_add_int32(propList, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, *messageExpiryInterval);
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::DebugInfo)) {
+        if (auto debugInfo = props.GetDebugInfo()) {
+            addUserProperty(propList, UserProperty::DebugInfo, debugInfo->c_str());
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::ReturnCode)) {
+        if (auto returnCode = props.GetReturnCode()) {
+            addUserProperty(propList, UserProperty::ReturnCode, std::to_string(*returnCode).c_str());
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::PropertyVersion)) {
+        if (auto propertyVersion = props.GetPropertyVersion()) {
+            addUserProperty(propList, UserProperty::PropertyVersion, std::to_string(*propertyVersion).c_str());
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::Version)) {
+        if (auto version = props.GetVersion()) {
+            addUserProperty(propList, UserProperty::Version, version->c_str());
+        }
+    }
+}
+
+// The caller frees the list with mosquitto_property_free_all().
+mosquitto_property* buildPropertyList(const Message& message, const std::optional<std::string>& originTag) {
+    mosquitto_property* propList = NULL;
+    visitMessageSchema(message.kind, message.properties.PresentMask(), [&](auto schema) {
+        addProperties<decltype(schema)::kProperties>(&propList, message.properties);
+    });
+    for (const UserPropertyEntry& entry : message.properties.GetUserProperties()) {
+        mosquitto_property_add_string_pair(&propList, MQTT_PROP_USER_PROPERTY, entry.name.c_str(),
+                                           entry.value.c_str());
+    }
+    if (originTag) {
+        mosquitto_property_add_string_pair(&propList, MQTT_PROP_USER_PROPERTY, kOriginTagProperty, originTag->c_str());
+    }
+    return propList;
+}
+
+} // namespace
+
 BrokerConnection::BrokerConnection(const std::string& host, int port, const std::string& clientId)
-    : _mosq(NULL), _host(host), _port(port), _clientId(clientId), _logLevel(LOG_NOTICE) {
+    : BrokerConnection(host, port, clientId, ConnectOptions()) {}
+
+BrokerConnection::BrokerConnection(const std::string& host, int port, const std::string& clientId,
+                                   const ConnectOptions& options)
+    : _clientId(clientId), _mosq(NULL), _host(host), _port(port), _options(options), _subscriptions(*this) {
     std::lock_guard<std::mutex> lock(_mutex);
 
     if (mosquitto_lib_init() != MOSQ_ERR_SUCCESS) {
         throw std::runtime_error("Mosquitto lib init problem");
     };
+    _connectedFuture = _connectedPromise.get_future().share();
     _mosq = mosquitto_new(_clientId.c_str(), false, (void*)this);
     mosquitto_int_option(_mosq, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
+    if (_options.tcpNoDelay) {
+        mosquitto_int_option(_mosq, MOSQ_OPT_TCP_NODELAY, 1);
+    }
     ConfigureReconnectDelay();
 
     mosquitto_log_callback_set(_mosq, [](struct mosquitto* mosq, void* user, int level, const char* str) {
@@ -50,59 +139,33 @@ BrokerConnection::BrokerConnection(const std::string& host, int port, const std:
                     thisClient->Log(LOG_INFO, "Connect reason: %s", reasonString);
                     free(reasonString);
                 }
+            } else if (mosquitto_property_identifier(prop) == MQTT_PROP_SHARED_SUB_AVAILABLE) {
+                uint8_t available = 1;
+                if (mosquitto_property_read_byte(prop, MQTT_PROP_SHARED_SUB_AVAILABLE, &available, false) &&
+                    !available) {
+                    thisClient->Log(LOG_WARNING, "Broker does not support shared subscriptions");
+                }
             }
         }
 
+        if (rc != 0) {
+            thisClient->Log(LOG_ERR, "Connection to %s refused with reason code: %d", thisClient->_host.c_str(), rc);
+            return;
+        }
+
+        thisClient->ApplySocketOptions();
+
         std::lock_guard<std::mutex> lock(thisClient->_mutex);
+        thisClient->_subscriptions.Resume(flags & kConnackSessionPresent);
+        // Subscribe() only sends while connected, so everything made before this point is pending and everything
+        // made after it is sent directly: each subscription goes out exactly once.
         thisClient->_connected = true;
-        while (!thisClient->_subscriptions.empty()) {
-            auto sub = thisClient->_subscriptions.front();
-            thisClient->Log(LOG_INFO, "Delayed Subscribing to %s as %d", sub.topic.c_str(), sub.subscriptionId);
-            mosquitto_property* propList = NULL;
-            mosquitto_property_add_varint(&propList, MQTT_PROP_SUBSCRIPTION_IDENTIFIER, sub.subscriptionId);
-            int rc = mosquitto_subscribe_v5(mosq, NULL, sub.topic.c_str(), sub.qos, MQTT_SUB_OPT_NO_LOCAL, propList);
-            mosquitto_property_free_all(&propList);
-            thisClient->_subscriptions.pop();
-        }
+        thisClient->SendPendingSubscriptions();
         while (!thisClient->_msgQueue.empty()) {
             PendingPublish& pending = thisClient->_msgQueue.front();
             Message& msg = pending.message;
             thisClient->Log(LOG_INFO, "Publishing queued message to %s", msg.topic.c_str());
-            mosquitto_property* propList = NULL;
-            if (msg.properties.contentType) {
-                mosquitto_property_add_string(&propList, MQTT_PROP_CONTENT_TYPE, msg.properties.contentType->c_str());
-            }
-            if (msg.properties.correlationData) {
-                mosquitto_property_add_binary(&propList, MQTT_PROP_CORRELATION_DATA,
-                                              static_cast<const void*>(msg.properties.correlationData->data()),
-                                              msg.properties.correlationData->size());
-            }
-            if (msg.properties.responseTopic) {
-                mosquitto_property_add_string(&propList, MQTT_PROP_RESPONSE_TOPIC,
-                                              msg.properties.responseTopic->c_str());
-            }
-            if (msg.properties.messageExpiryInterval) {
-                mosquitto_property_add_int32(&propList, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL,
-                                             *msg.properties.messageExpiryInterval);
-            }
-            if (msg.properties.debugInfo) {
-                mosquitto_property_add_string_pair(&propList, MQTT_PROP_USER_PROPERTY, "DebugInfo",
-                                                   msg.properties.debugInfo->c_str());
-            }
-            if (msg.properties.returnCode) {
-                std::string returnCodeStr = std::to_string(static_cast<int>(*msg.properties.returnCode));
-                mosquitto_property_add_string_pair(&propList, MQTT_PROP_USER_PROPERTY, "ReturnCode",
-                                                   returnCodeStr.c_str());
-            }
-            if (msg.properties.propertyVersion) {
-                std::string propertyVersionStr = std::to_string(*msg.properties.propertyVersion);
-                mosquitto_property_add_string_pair(&propList, MQTT_PROP_USER_PROPERTY, "PropertyVersion",
-                                                   propertyVersionStr.c_str());
-            }
-            if (msg.properties.version) {
-                mosquitto_property_add_string_pair(&propList, MQTT_PROP_USER_PROPERTY, "Version",
-                                                   msg.properties.version->c_str());
-            }
+            mosquitto_property* propList = buildPropertyList(msg, thisClient->_options.originTag);
             int mid;
             mosquitto_publish_v5(mosq, &mid, msg.topic.c_str(), msg.payload.size(), msg.payload.c_str(), msg.qos,
                                  msg.retain, propList);
@@ -111,18 +174,11 @@ BrokerConnection::BrokerConnection(const std::string& host, int port, const std:
             thisClient->_msgQueue.pop();
         }
 
-        { // Send online message
-            auto onlineTopic = thisClient->GetLastWillTopic();
-            int mid;
-            mosquitto_property* propList = NULL;
-            mosquitto_property_add_string(&propList, MQTT_PROP_CONTENT_TYPE, "application/json");
-#ifdef STINGER_ONLINE_PUBLISH_THREAD
-            mosquitto_property_add_int32(&propList, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, 10 * 60);
-#endif
-            std::string onlinePayload = thisClient->GetOnlinePayload();
-            mosquitto_publish_v5(mosq, &mid, onlineTopic.c_str(), onlinePayload.size(), onlinePayload.c_str(), 1, true,
-                                 propList);
-            mosquitto_property_free_all(&propList);
+        thisClient->PublishOnlineMessage();
+        thisClient->_reconnectAttempts = 0;
+        if (!thisClient->_connectedPromiseSet) {
+            thisClient->_connectedPromise.set_value(true);
+            thisClient->_connectedPromiseSet = true;
         }
     });
 
@@ -148,11 +204,16 @@ BrokerConnection::BrokerConnection(const std::string& host, int port, const std:
     mosquitto_message_v5_callback_set(_mosq, [](struct mosquitto* mosq, void* user,
                                                 const struct mosquitto_message* mmsg, const mosquitto_property* props) {
         BrokerConnection* thisClient = static_cast<BrokerConnection*>(user);
-        thisClient->Log(LOG_DEBUG, "Forwarding message (%s) to %zu callbacks", mmsg->topic,
-                        thisClient->_messageCallbacks.size());
-        std::string topic(mmsg->topic);
-        std::string payload(static_cast<char*>(mmsg->payload), mmsg->payloadlen);
-        mqtt::Properties mqttProps;
+        // Only this loop's thread receives, so one message is refilled each time to avoid allocating.
+        Message& msg = thisClient->_received;
+        msg.Recycle();
+        msg.topic.assign(mmsg->topic);
+        msg.payload.assign(static_cast<char*>(mmsg->payload), mmsg->payloadlen);
+        msg.qos = mmsg->qos;
+        msg.retain = mmsg->retain;
+        mqtt::Properties& mqttProps = msg.properties;
+        const std::optional<std::string>& originTag = thisClient->_options.originTag;
+        bool echo = false;
         const mosquitto_property* prop;
         for (prop = props; prop != NULL; prop = mosquitto_property_next(prop)) {
             if (mosquitto_property_identifier(prop) == MQTT_PROP_CORRELATION_DATA) {
@@ -160,35 +221,44 @@ BrokerConnection::BrokerConnection(const std::string& host, int port, const std:
                 uint16_t correlation_data_len;
                 if (mosquitto_property_read_binary(prop, MQTT_PROP_CORRELATION_DATA, &correlation_data,
                                                    &correlation_data_len, false)) {
-                    std::vector<std::byte> correlationVec;
-                    correlationVec.reserve(correlation_data_len);
-                    uint8_t* bytePtr = static_cast<uint8_t*>(correlation_data);
-                    for (uint16_t i = 0; i < correlation_data_len; ++i) {
-                        correlationVec.push_back(static_cast<std::byte>(bytePtr[i]));
-                    }
-                    mqttProps.correlationData = correlationVec;
+                    mqttProps.SetCorrelationData(
+                        mqtt::PropertyBytes(static_cast<const std::byte*>(correlation_data), correlation_data_len));
                     free(correlation_data);
                 }
             } else if (mosquitto_property_identifier(prop) == MQTT_PROP_RESPONSE_TOPIC) {
                 char* responseTopic = NULL;
                 if (mosquitto_property_read_string(prop, MQTT_PROP_RESPONSE_TOPIC, &responseTopic, false)) {
-                    mqttProps.responseTopic = std::string(responseTopic);
+                    mqttProps.SetResponseTopic(responseTopic);
                     free(responseTopic);
                 }
             } else if (mosquitto_property_identifier(prop) == MQTT_PROP_USER_PROPERTY) {
                 char* name = NULL;
                 char* value = NULL;
                 if (mosquitto_property_read_string_pair(prop, MQTT_PROP_USER_PROPERTY, &name, &value, false)) {
-                    if (strcmp(name, "ReturnCode") == 0) {
-                        int returnValueInt = std::stoi(value);
-                        mqttProps.returnCode = returnValueInt;
-                    } else if (strcmp(name, "PropertyVersion") == 0) {
-                        int propertyVersionInt = std::stoi(value);
-                        mqttProps.propertyVersion = propertyVersionInt;
-                    } else if (strcmp(name, "DebugInfo") == 0) {
-                        mqttProps.debugInfo = std::string(value);
-                    } else if (strcmp(name, "Version") == 0) {
-                        mqttProps.version = std::string(value);
+                    switch (userPropertyFromName(name)) {
+                    case UserProperty::ReturnCode:
+                        mqttProps.SetReturnCode(parseUserPropertyInt(value));
+                        break;
+                    case UserProperty::PropertyVersion:
+                        mqttProps.SetPropertyVersion(parseUserPropertyInt(value));
+                        break;
+                    case UserProperty::DebugInfo:
+                        mqttProps.SetDebugInfo(value);
+                        break;
+                    case UserProperty::Version:
+                        mqttProps.SetVersion(value);
+                        break;
+                    default:
+                        if (strcmp(name, kOriginTagProperty) == 0) {
+                            echo = echo || (originTag && originTag->compare(value) == 0);
+                            break;
+                        }
+                        try {
+                            mqttProps.AddUserProperty(name, value);
+                        } catch (const std::length_error&) {
+                            // More than Properties can hold; keep the rest of the message.
+                        }
+                        break;
                     }
                     free(name);
                     free(value);
@@ -196,29 +266,29 @@ BrokerConnection::BrokerConnection(const std::string& host, int port, const std:
             } else if (mosquitto_property_identifier(prop) == MQTT_PROP_SUBSCRIPTION_IDENTIFIER) {
                 uint32_t subscriptionId;
                 if (mosquitto_property_read_varint(prop, MQTT_PROP_SUBSCRIPTION_IDENTIFIER, &subscriptionId, false)) {
-                    mqttProps.subscriptionId = subscriptionId;
+                    mqttProps.SetSubscriptionId(subscriptionId);
                 }
             } else if (mosquitto_property_identifier(prop) == MQTT_PROP_CONTENT_TYPE) {
                 char* contentType = NULL;
                 if (mosquitto_property_read_string(prop, MQTT_PROP_CONTENT_TYPE, &contentType, false)) {
-                    mqttProps.contentType = std::string(contentType);
+                    mqttProps.SetContentType(contentType);
                     free(contentType);
                 }
             } else if (mosquitto_property_identifier(prop) == MQTT_PROP_MESSAGE_EXPIRY_INTERVAL) {
                 uint32_t messageExpiryInterval;
                 if (mosquitto_property_read_int32(prop, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, &messageExpiryInterval,
                                                   false)) {
-                    mqttProps.messageExpiryInterval = messageExpiryInterval;
+                    mqttProps.SetMessageExpiryInterval(messageExpiryInterval);
                 }
             }
         }
-        auto msg = Message(topic, payload, mmsg->qos, mmsg->retain, mqttProps);
-        for (const auto& entry : thisClient->_messageCallbacks) {
-            thisClient->Log(LOG_DEBUG, "Calling callback (handle=%d) for topic: %s", static_cast<int>(entry.first),
-                            topic.c_str());
-            const auto& cb = entry.second;
-            cb(msg);
+        if (echo) {
+            thisClient->Log(LOG_DEBUG, "Dropping echo of own message on %s", mmsg->topic);
+            return;
         }
+        thisClient->Log(LOG_DEBUG, "Forwarding message (%s) to %zu callbacks", mmsg->topic,
+                        thisClient->_messageCallbacks.Size());
+        thisClient->_messageCallbacks.Invoke(msg);
     });
 
     mosquitto_publish_v5_callback_set(
@@ -232,8 +302,35 @@ BrokerConnection::BrokerConnection(const std::string& host, int port, const std:
             thisClient->Log(LOG_DEBUG, "Publish completed for mid=%d, reason_code=%d", mid, reason_code);
         });
 
-    Connect();
-    mosquitto_loop_start(_mosq);
+    if (_options.externalLoop) {
+        // Packets queued from other threads are left for LoopWrite instead of being written on the calling thread.
+        mosquitto_threaded_set(_mosq, true);
+    }
+
+    if (_options.asyncConnect) {
+        _connectPending = true;
+        _connectThread = std::thread([this]() {
+            Connect();
+            {
+                // The connect callback takes _mutex, so messages queued until now are flushed when CONNACK arrives.
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_options.externalLoop) {
+                    mosquitto_loop_start(_mosq);
+                }
+                _connectPending = false;
+            }
+            WakeLoop();
+        });
+    } else {
+        Connect();
+        if (!_options.externalLoop) {
+            mosquitto_loop_start(_mosq);
+        }
+    }
+
+    if (_options.externalLoop) {
+        return;
+    }
 
 #ifdef STINGER_ONLINE_PUBLISH_THREAD
     _onlinePublishThread = std::thread([this]() {
@@ -243,14 +340,7 @@ BrokerConnection::BrokerConnection(const std::string& host, int port, const std:
             if (_stopOnlinePublish)
                 break;
             if (_connected) {
-                auto topic = GetLastWillTopic();
-                auto payload = GetOnlinePayload();
-                int mid;
-                mosquitto_property* propList = NULL;
-                mosquitto_property_add_string(&propList, MQTT_PROP_CONTENT_TYPE, "application/json");
-                mosquitto_property_add_int32(&propList, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, 10 * 60);
-                mosquitto_publish_v5(_mosq, &mid, topic.c_str(), payload.size(), payload.c_str(), 1, true, propList);
-                mosquitto_property_free_all(&propList);
+                PublishOnlineMessage();
             }
         }
     });
@@ -258,92 +348,231 @@ BrokerConnection::BrokerConnection(const std::string& host, int port, const std:
 }
 
 BrokerConnection::~BrokerConnection() {
+    if (_connectThread.joinable()) {
+        _connectThread.join();
+    }
+
 #ifdef STINGER_ONLINE_PUBLISH_THREAD
-    _stopOnlinePublish = true;
-    _onlinePublishCv.notify_one();
-    _onlinePublishThread.join();
+    if (_onlinePublishThread.joinable()) {
+        _stopOnlinePublish = true;
+        _onlinePublishCv.notify_one();
+        _onlinePublishThread.join();
+    }
 #endif
 
     std::lock_guard<std::mutex> lock(_mutex);
-    mosquitto_loop_stop(_mosq, true);
-    mosquitto_disconnect(_mosq);
+    if (!_connectedPromiseSet) {
+        _connectedPromise.set_value(false);
+        _connectedPromiseSet = true;
+    }
+    if (_options.externalLoop) {
+        // Nothing else will write the DISCONNECT packet; without it the broker publishes the will message.
+        mosquitto_disconnect(_mosq);
+        mosquitto_loop_write(_mosq, 1);
+    } else {
+        mosquitto_loop_stop(_mosq, true);
+        mosquitto_disconnect(_mosq);
+    }
     mosquitto_destroy(_mosq);
     mosquitto_lib_cleanup();
 }
 
-void BrokerConnection::ConfigureReconnectDelay() {
-    mosquitto_reconnect_delay_set(_mosq, kReconnectDelaySeconds, kReconnectDelayMaxSeconds,
-                                  false /* use incremental backoff */);
-}
-
-void BrokerConnection::Connect() {
+void BrokerConnection::PublishOnlineMessage() {
+    if (!_options.onlineStatus) {
+        return;
+    }
     auto onlineTopic = GetLastWillTopic();
+    int mid;
     mosquitto_property* propList = NULL;
     mosquitto_property_add_string(&propList, MQTT_PROP_CONTENT_TYPE, "application/json");
-    // Set message expiry interval for LWT to 24 hours (in seconds)
-    mosquitto_property_add_int32(&propList, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, 24 * 60 * 60);
-    std::string offlinePayload = GetOfflinePayload();
-    int will_rc = mosquitto_will_set_v5(_mosq, onlineTopic.c_str(), offlinePayload.size(), offlinePayload.c_str(),
-                                        1,    // qos
-                                        true, // retain
-                                        propList);
-
-    // If will_set failed, free the properties we created. On success the
-    // mosquitto library takes ownership of the property list, so do not free it.
-    if (will_rc != MOSQ_ERR_SUCCESS) {
-        Log(LOG_ERR, "Failed to set will message: %d", will_rc);
-        if (propList) {
-            mosquitto_property_free_all(&propList);
-            propList = NULL;
+#ifdef STINGER_ONLINE_PUBLISH_THREAD
+    mosquitto_property_add_int32(&propList, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, 10 * 60);
+    if (_options.externalLoop) {
+        _nextOnlinePublish = std::chrono::steady_clock::now() + std::chrono::minutes(5);
+    }
+#endif
+    std::string onlinePayload = GetOnlinePayload();
+    mosquitto_publish_v5(_mosq, &mid, onlineTopic.c_str(), onlinePayload.size(), onlinePayload.c_str(), 1, true,
+                         propList);
+    mosquitto_property_free_all(&propList);
+}
+
+BrokerConnection::LoopInterest BrokerConnection::GetLoopInterest() const {
+    LoopInterest interest;
+    if (_connectPending) {
+        return interest;
+    }
+    interest.fd = mosquitto_socket(_mosq);
+    interest.wantWrite = interest.fd != -1 && mosquitto_want_write(_mosq);
+    return interest;
+}
+
+void BrokerConnection::LoopRead() {
+    int rc = mosquitto_loop_read(_mosq, 1);
+    if (rc != MOSQ_ERR_SUCCESS && rc != MOSQ_ERR_NO_CONN) {
+        Log(LOG_DEBUG, "Read from %s failed: rc=%d", _host.c_str(), rc);
+    }
+}
+
+void BrokerConnection::LoopWrite() {
+    int rc = mosquitto_loop_write(_mosq, 1);
+    if (rc != MOSQ_ERR_SUCCESS && rc != MOSQ_ERR_NO_CONN) {
+        Log(LOG_DEBUG, "Write to %s failed: rc=%d", _host.c_str(), rc);
+    }
+}
+
+void BrokerConnection::LoopMisc() {
+    if (_connectPending) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (mosquitto_socket(_mosq) != -1) {
+        mosquitto_loop_misc(_mosq);
+#ifdef STINGER_ONLINE_PUBLISH_THREAD
+        if (_connected && now >= _nextOnlinePublish) {
+            PublishOnlineMessage();
         }
+#endif
+        return;
     }
 
-    int rc = mosquitto_connect_bind_v5(_mosq, _host.c_str(), _port, 120, NULL, NULL);
+    if (now < _nextReconnect) {
+        return;
+    }
+    // Same incremental backoff that ConfigureReconnectDelay() asks of mosquitto's own network thread.
+    ++_reconnectAttempts;
+    int delay = std::min(kReconnectDelaySeconds * _reconnectAttempts, kReconnectDelayMaxSeconds);
+    _nextReconnect = now + std::chrono::seconds(delay);
+    int rc = mosquitto_reconnect_async(_mosq);
     if (rc != MOSQ_ERR_SUCCESS) {
-        Log(LOG_ERR, "Failed to connect to MQTT broker: %d", rc);
+        Log(LOG_WARNING, "Reconnect to %s failed: rc=%d; retrying in %d s", _host.c_str(), rc, delay);
     }
 }
 
-std::future<bool> BrokerConnection::Publish(const Message& message) {
-    int mid;
-    mosquitto_property* propList = NULL;
-    if (message.properties.contentType) {
-        mosquitto_property_add_string(&propList, MQTT_PROP_CONTENT_TYPE, message.properties.contentType->c_str());
+void BrokerConnection::ApplySocketOptions() {
+    int fd = mosquitto_socket(_mosq);
+    if (fd < 0) {
+        return;
+    }
+    // mosquitto offers no hook before connect(), so larger buffers cannot raise the TCP window scale negotiated in
+    // the handshake; they still allow more data to be queued on the socket.
+    if (_options.sendBufferSize) {
+        int size = *_options.sendBufferSize;
+        if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) != 0) {
+            Log(LOG_WARNING, "Failed to set send buffer size to %d: %s", size, strerror(errno));
+        }
+    }
+    if (_options.receiveBufferSize) {
+        int size = *_options.receiveBufferSize;
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0) {
+            Log(LOG_WARNING, "Failed to set receive buffer size to %d: %s", size, strerror(errno));
+        }
     }
-    if (message.properties.correlationData) {
-        mosquitto_property_add_binary(&propList, MQTT_PROP_CORRELATION_DATA,
-                                      static_cast<const void*>(message.properties.correlationData->data()),
-                                      message.properties.correlationData->size());
+
+    if (_options.networkThreadCpu && !_options.externalLoop && !_affinityApplied) {
+        // The connect callback runs on mosquitto's network thread, which has no other hook for setting its affinity.
+        _affinityApplied = true;
+#ifdef __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(*_options.networkThreadCpu, &cpus);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (rc != 0) {
+            Log(LOG_WARNING, "Failed to pin network thread to CPU %d: %s", *_options.networkThreadCpu, strerror(rc));
+        }
+#else
+        Log(LOG_WARNING, "Network thread CPU affinity is not supported on this platform");
+#endif
+    }
+}
+
+void BrokerConnection::SetLoopWakeupFunction(const std::function<void()>& wakeup) {
+    std::lock_guard<std::mutex> lock(_loopWakeupMutex);
+    _loopWakeup = wakeup;
+}
+
+void BrokerConnection::WakeLoop() {
+    std::lock_guard<std::mutex> lock(_loopWakeupMutex);
+    if (_loopWakeup) {
+        _loopWakeup();
     }
-    if (message.properties.responseTopic) {
-        mosquitto_property_add_string(&propList, MQTT_PROP_RESPONSE_TOPIC, message.properties.responseTopic->c_str());
+}
+
+void BrokerConnection::ConfigureReconnectDelay() {
+    mosquitto_reconnect_delay_set(_mosq, kReconnectDelaySeconds, kReconnectDelayMaxSeconds,
+                                  false /* use incremental backoff */);
+}
+
+void BrokerConnection::Connect() {
+    if (_options.onlineStatus) {
+        auto onlineTopic = BrokerConnection::GetLastWillTopic();
+        mosquitto_property* propList = NULL;
+        mosquitto_property_add_string(&propList, MQTT_PROP_CONTENT_TYPE, "application/json");
+        // Set message expiry interval for LWT to 24 hours (in seconds)
+        mosquitto_property_add_int32(&propList, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL, 24 * 60 * 60);
+        std::string offlinePayload = BrokerConnection::GetOfflinePayload();
+        int will_rc = mosquitto_will_set_v5(_mosq, onlineTopic.c_str(), offlinePayload.size(),
+                                            offlinePayload.c_str(),
+                                            1,    // qos
+                                            true, // retain
+                                            propList);
+
+        // If will_set failed, free the properties we created. On success the
+        // mosquitto library takes ownership of the property list, so do not free it.
+        if (will_rc != MOSQ_ERR_SUCCESS) {
+            Log(LOG_ERR, "Failed to set will message: %d", will_rc);
+            if (propList) {
+                mosquitto_property_free_all(&propList);
+                propList = NULL;
+            }
+        }
     }
-    if (message.properties.messageExpiryInterval) {
-        mosquitto_property_add_int32(&propList, MQTT_PROP_MESSAGE_EXPIRY_INTERVAL,
-                                     *message.properties.messageExpiryInterval);
+
+    mosquitto_property* connectProps = NULL;
+    if (_options.sessionExpiryInterval) {
+        mosquitto_property_add_int32(&connectProps, MQTT_PROP_SESSION_EXPIRY_INTERVAL, *_options.sessionExpiryInterval);
     }
-    if (message.properties.debugInfo) {
-        mosquitto_property_add_string_pair(&propList, MQTT_PROP_USER_PROPERTY, "DebugInfo",
-                                           message.properties.debugInfo->c_str());
+    if (_options.receiveMaximum) {
+        mosquitto_property_add_int16(&connectProps, MQTT_PROP_RECEIVE_MAXIMUM, *_options.receiveMaximum);
     }
-    if (message.properties.returnCode) {
-        std::string returnCodeStr = std::to_string(static_cast<int>(*message.properties.returnCode));
-        mosquitto_property_add_string_pair(&propList, MQTT_PROP_USER_PROPERTY, "ReturnCode", returnCodeStr.c_str());
+    if (_options.maximumPacketSize) {
+        mosquitto_property_add_int32(&connectProps, MQTT_PROP_MAXIMUM_PACKET_SIZE, *_options.maximumPacketSize);
     }
-    if (message.properties.propertyVersion) {
-        std::string propertyVersionStr = std::to_string(static_cast<int>(*message.properties.propertyVersion));
-        mosquitto_property_add_string_pair(&propList, MQTT_PROP_USER_PROPERTY, "PropertyVersion",
-                                           propertyVersionStr.c_str());
+
+    // mosquitto keeps its own copy of the CONNECT properties and reuses them when it reconnects.
+    int rc = mosquitto_connect_bind_v5(_mosq, _host.c_str(), _port, _options.keepAliveSeconds, NULL, connectProps);
+    mosquitto_property_free_all(&connectProps);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        Log(LOG_ERR, "Failed to connect to MQTT broker: %d", rc);
     }
-    if (message.properties.version) {
-        mosquitto_property_add_string_pair(&propList, MQTT_PROP_USER_PROPERTY, "Version",
-                                           message.properties.version->c_str());
+}
+
+std::future<bool> BrokerConnection::Publish(const Message& message) {
+    if (_connectPending) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        // Checked again under the lock, which the connect thread holds while it starts the network loop.
+        if (_connectPending) {
+            Log(LOG_DEBUG, "Delayed published queued to: %s", message.topic.c_str());
+            auto pending = PendingPublish(message);
+            auto future = pending.GetFuture();
+            _msgQueue.push(pending);
+            lock.unlock();
+            if (_options.localDelivery) {
+                DeliverLocally(message);
+            }
+            return future;
+        }
     }
+    int mid;
+    mosquitto_property* propList = buildPropertyList(message, _options.originTag);
     int rc = mosquitto_publish_v5(_mosq, &mid, message.topic.c_str(), message.payload.size(), message.payload.c_str(),
                                   message.qos, message.retain, propList);
     if (propList) {
         mosquitto_property_free_all(&propList);
     }
+    if (_options.localDelivery && (rc == MOSQ_ERR_SUCCESS || rc == MOSQ_ERR_NO_CONN)) {
+        DeliverLocally(message);
+    }
     if (rc == MOSQ_ERR_NO_CONN) {
         Log(LOG_DEBUG, "Delayed published queued to: %s", message.topic.c_str());
         std::lock_guard<std::mutex> lock(_mutex);
@@ -355,8 +584,11 @@ std::future<bool> BrokerConnection::Publish(const Message& message) {
         Log(LOG_INFO, "Published to: %s | %s", message.topic.c_str(), message.payload.c_str());
         auto pPromise = std::make_shared<std::promise<bool>>();
         auto future = pPromise->get_future();
-        std::lock_guard<std::mutex> lock(_mutex);
-        _sendMessages[mid] = std::move(pPromise);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _sendMessages[mid] = std::move(pPromise);
+        }
+        WakeLoop();
         return future;
     } else {
         Log(LOG_ERR, "Failed to publish to %s: rc=%d", message.topic.c_str(), rc);
@@ -364,84 +596,258 @@ std::future<bool> BrokerConnection::Publish(const Message& message) {
     throw std::runtime_error("Unhandled rc");
 }
 
-int BrokerConnection::Subscribe(const std::string& topic, int qos) {
-    std::lock_guard<std::mutex> lock(_mutex);
+namespace {
+
+// MQTT v5 forbids the No Local option on shared subscriptions.
+int SubscribeOptions(std::string_view topic) {
+    return isSharedSubscription(topic) ? 0 : MQTT_SUB_OPT_NO_LOCAL;
+}
+
+} // namespace
 
-    // Check if we already have a subscription for this topic
-    auto it = _subscriptionRefCounts.find(topic);
-    if (it != _subscriptionRefCounts.end()) {
-        // Topic already subscribed - increment reference count
-        it->second.first++;
-        Log(LOG_DEBUG, "Incremented subscription count for %s to %d", topic.c_str(), it->second.first);
-        return it->second.second; // Return existing subscription ID
+std::shared_ptr<BrokerConnection::SubscriptionOp>
+BrokerConnection::QueueSubscriptionOp(bool subscribe, const std::vector<std::string_view>& topics, int subscriptionId,
+                                      int qos) {
+    if (!_connected) {
+        // Sent after CONNACK, once the broker has said whether it kept our session.
+        return nullptr;
     }
+    auto op = std::make_shared<SubscriptionOp>();
+    op->subscribe = subscribe;
+    op->topics.assign(topics.begin(), topics.end());
+    op->subscriptionId = subscriptionId;
+    op->qos = qos;
+    std::lock_guard<std::mutex> lock(_subscriptionOpsMutex);
+    _subscriptionOps.push_back(op);
+    return op;
+}
 
-    // New subscription - create it
-    int subscriptionId = _nextSubscriptionId++;
-    mosquitto_property* propList = NULL;
-    mosquitto_property_add_varint(&propList, MQTT_PROP_SUBSCRIPTION_IDENTIFIER, subscriptionId);
-    int rc = mosquitto_subscribe_v5(_mosq, NULL, topic.c_str(), qos, MQTT_SUB_OPT_NO_LOCAL, propList);
-    mosquitto_property_free_all(&propList);
+void BrokerConnection::SendSubscriptionOps() {
+    std::lock_guard<std::mutex> sendLock(_subscriptionSendMutex);
+    while (true) {
+        std::shared_ptr<SubscriptionOp> op;
+        {
+            std::lock_guard<std::mutex> lock(_subscriptionOpsMutex);
+            if (_subscriptionOps.empty()) {
+                break;
+            }
+            op = std::move(_subscriptionOps.front());
+            _subscriptionOps.pop_front();
+        }
+        if (op->subscribe) {
+            op->rc = SendSubscribe(op->topics, op->subscriptionId, op->qos);
+            continue;
+        }
+        std::vector<char*> topicPtrs;
+        topicPtrs.reserve(op->topics.size());
+        for (auto& topic : op->topics) {
+            topicPtrs.push_back(&topic[0]);
+        }
+        op->rc =
+            mosquitto_unsubscribe_multiple(_mosq, NULL, static_cast<int>(topicPtrs.size()), topicPtrs.data(), NULL);
+        if (op->rc == MOSQ_ERR_NO_CONN) {
+            // A resumed session would still hold these, so send them after the next CONNACK.
+            Log(LOG_DEBUG, "Unsubscribe queued for %zu topics", op->topics.size());
+            for (const auto& topic : op->topics) {
+                _subscriptions.Registry().AddPendingUnsubscribe(topic);
+            }
+        } else if (op->rc != MOSQ_ERR_SUCCESS) {
+            Log(LOG_WARNING, "Failed to unsubscribe from %zu topics: rc=%d", topicPtrs.size(), op->rc);
+        }
+    }
+}
 
-    if (rc == MOSQ_ERR_NO_CONN) {
-        Log(LOG_DEBUG, "Subscription %d queued for: %s", subscriptionId, topic.c_str());
-        BrokerConnection::MqttSubscription sub(topic, qos, subscriptionId);
-        _subscriptions.push(sub);
-        // Store ref count as 1 for queued subscription
-        _subscriptionRefCounts[topic] = std::make_pair(1, subscriptionId);
-    } else if (rc == MOSQ_ERR_SUCCESS) {
-        Log(LOG_INFO, "Online Subscribed to %s as %d", topic.c_str(), subscriptionId);
-        // Store ref count as 1 for active subscription
-        _subscriptionRefCounts[topic] = std::make_pair(1, subscriptionId);
+void BrokerConnection::SendPendingSubscriptions() {
+    std::vector<std::shared_ptr<SubscriptionOp>> ops;
+    _subscriptions.SendPending(
+        [&](const std::vector<std::string_view>& topics) {
+            return QueueSubscriptionOp(false, topics, 0, 0) != nullptr;
+        },
+        [&](const std::vector<std::string_view>& topics, int subscriptionId, int qos) {
+            auto op = QueueSubscriptionOp(true, topics, subscriptionId, qos);
+            if (op) {
+                ops.push_back(op);
+            }
+            return op != nullptr;
+        });
+    SendSubscriptionOps();
+    for (const auto& op : ops) {
+        if (!CheckSubscribeSent(*op)) {
+            // The caller already has the ID, so there is no one to report to.
+            Log(LOG_ERR, "Dropped delayed subscription %d for %zu topics", op->subscriptionId, op->topics.size());
+        }
     }
+}
 
-    return subscriptionId;
+bool BrokerConnection::CheckSubscribeSent(const SubscriptionOp& op) {
+    if (op.rc == MOSQ_ERR_SUCCESS) {
+        if (op.topics.size() == 1) {
+            Log(LOG_INFO, "Online Subscribed to %s as %d", op.topics.front().c_str(), op.subscriptionId);
+        } else {
+            Log(LOG_INFO, "Online Subscribed to %zu topics as %d", op.topics.size(), op.subscriptionId);
+        }
+        return true;
+    }
+    if (op.rc != MOSQ_ERR_NO_CONN) {
+        Log(LOG_ERR, "Failed to subscribe to %zu topics as %d: rc=%d", op.topics.size(), op.subscriptionId, op.rc);
+        return false;
+    }
+    // The connection dropped after the op was queued.  The caller still holds a reference, so the entries exist,
+    // and the next CONNACK sends them.
+    Log(LOG_DEBUG, "Subscription %d queued for %zu topics", op.subscriptionId, op.topics.size());
+    for (const auto& topic : op.topics) {
+        _subscriptions.Registry().MarkPending(topic);
+    }
+    return true;
 }
 
-void BrokerConnection::Unsubscribe(const std::string& topic) {
-    std::lock_guard<std::mutex> lock(_mutex);
+int BrokerConnection::SendSubscribe(std::vector<std::string>& topics, int subscriptionId, int qos) {
+    std::vector<char*> plainTopics;
+    std::vector<char*> sharedTopics;
+    for (auto& topic : topics) {
+        (isSharedSubscription(topic) ? sharedTopics : plainTopics).push_back(&topic[0]);
+    }
+
+    int result = MOSQ_ERR_SUCCESS;
+    for (auto* group : {&plainTopics, &sharedTopics}) {
+        if (group->empty()) {
+            continue;
+        }
+        mosquitto_property* propList = NULL;
+        mosquitto_property_add_varint(&propList, MQTT_PROP_SUBSCRIPTION_IDENTIFIER, subscriptionId);
+        int rc = mosquitto_subscribe_multiple(_mosq, NULL, static_cast<int>(group->size()), group->data(), qos,
+                                              SubscribeOptions(group->front()), propList);
+        mosquitto_property_free_all(&propList);
+        if (rc != MOSQ_ERR_SUCCESS && result == MOSQ_ERR_SUCCESS) {
+            result = rc;
+        }
+    }
+    return result;
+}
 
-    auto it = _subscriptionRefCounts.find(topic);
-    if (it == _subscriptionRefCounts.end()) {
-        Log(LOG_WARNING, "Attempted to unsubscribe from topic %s that was never subscribed", topic.c_str());
+void BrokerConnection::DeliverLocally(const Message& message) {
+    auto sub = _subscriptions.MatchLocal(message);
+    if (!sub) {
         return;
     }
 
-    // Decrement reference count
-    it->second.first--;
+    Message localMsg(message);
+    localMsg.properties.SetSubscriptionId(sub->subscriptionId);
+    Log(LOG_DEBUG, "Delivering %s locally to %zu callbacks", message.topic.c_str(), _messageCallbacks.Size());
+    _messageCallbacks.Invoke(localMsg);
+}
 
-    if (it->second.first > 0) {
-        // Still have active references - just decrement
-        Log(LOG_DEBUG, "Decremented subscription count for %s to %d", topic.c_str(), it->second.first);
-        return;
+// New subscriptions and final unsubscribes queue their packets while the registry shard is locked, so that a
+// concurrent call on the same topic queues its packet after them, and send them once the shard is unlocked.
+
+int BrokerConnection::Subscribe(const std::string& topic, int qos) {
+    std::shared_ptr<SubscriptionOp> op;
+    auto sub = _subscriptions.Subscribe(topic, qos, [&](const std::vector<std::string_view>& topics, int id, int q) {
+        op = QueueSubscriptionOp(true, topics, id, q);
+        return op != nullptr;
+    });
+
+    if (op) {
+        SendSubscriptionOps();
+        if (!CheckSubscribeSent(*op)) {
+            utils::SubscriptionRegistry& registry = _subscriptions.Registry();
+            auto left = registry.Release(topic, [](std::string_view, const RegisteredSubscription&) {});
+            if (left && left->refCount > 0) {
+                // Another caller took a reference meanwhile and was given the ID, so try again on the next connect.
+                registry.MarkPending(topic);
+            }
+            return utils::kSubscribeFailed;
+        }
+        if (op->rc == MOSQ_ERR_NO_CONN && _connected) {
+            // The connection came back before the entry was marked pending, so the CONNACK handler missed it.
+            SendPendingSubscriptions();
+        }
     }
+    if (sub.refCount == 1) {
+        WakeLoop();
+    }
+    return sub.subscriptionId;
+}
 
-    // Reference count reached 0 - perform actual unsubscription
-    Log(LOG_DEBUG, "Unsubscribing from %s (ref count reached 0)", topic.c_str());
-    int rc = mosquitto_unsubscribe(_mosq, NULL, topic.c_str());
+void BrokerConnection::Unsubscribe(const std::string& topic) {
+    std::shared_ptr<SubscriptionOp> op;
+    auto sub = _subscriptions.Unsubscribe(topic, [&](const std::vector<std::string_view>& topics) {
+        op = QueueSubscriptionOp(false, topics, 0, 0);
+        return op != nullptr;
+    });
 
-    if (rc != MOSQ_ERR_SUCCESS) {
-        Log(LOG_WARNING, "Failed to unsubscribe from %s: rc=%d", topic.c_str(), rc);
+    if (op) {
+        SendSubscriptionOps();
+        if (op->rc == MOSQ_ERR_NO_CONN && _connected) {
+            // The connection came back before the unsubscribe was queued again, so the CONNACK handler missed it.
+            SendPendingSubscriptions();
+        }
+    }
+    if (sub && sub->refCount == 0) {
+        WakeLoop();
     }
+}
 
-    // Remove from tracking map
-    _subscriptionRefCounts.erase(it);
+std::vector<int> BrokerConnection::SubscribeMany(const std::vector<std::string>& topics, int qos) {
+    std::shared_ptr<SubscriptionOp> op;
+    auto subscriptionIds =
+        _subscriptions.SubscribeMany(topics, qos, [&](const std::vector<std::string_view>& newTopics, int id, int q) {
+            op = QueueSubscriptionOp(true, newTopics, id, q);
+            return op != nullptr;
+        });
+
+    if (op) {
+        SendSubscriptionOps();
+        if (!CheckSubscribeSent(*op)) {
+            // Drop every reference this call took on the topics it created, duplicates included.
+            std::vector<std::string> failed;
+            for (std::size_t i = 0; i < topics.size(); ++i) {
+                if (subscriptionIds[i] == op->subscriptionId) {
+                    failed.push_back(topics[i]);
+                    subscriptionIds[i] = utils::kSubscribeFailed;
+                }
+            }
+            utils::SubscriptionRegistry& registry = _subscriptions.Registry();
+            auto left = registry.ReleaseMany(failed, [](const std::vector<RegistryEntry>&) {});
+            for (std::size_t i = 0; i < failed.size(); ++i) {
+                if (left[i] && left[i]->refCount > 0) {
+                    registry.MarkPending(failed[i]);
+                }
+            }
+        }
+        if (op->rc == MOSQ_ERR_NO_CONN && _connected) {
+            SendPendingSubscriptions();
+        }
+    }
+    WakeLoop();
+    return subscriptionIds;
+}
+
+void BrokerConnection::UnsubscribeMany(const std::vector<std::string>& topics) {
+    std::shared_ptr<SubscriptionOp> op;
+    _subscriptions.UnsubscribeMany(topics, [&](const std::vector<std::string_view>& removedTopics) {
+        op = QueueSubscriptionOp(false, removedTopics, 0, 0);
+        return op != nullptr;
+    });
+
+    if (op) {
+        SendSubscriptionOps();
+        if (op->rc == MOSQ_ERR_NO_CONN && _connected) {
+            SendPendingSubscriptions();
+        }
+    }
+    WakeLoop();
 }
 
 utils::CallbackHandleType BrokerConnection::AddMessageCallback(const std::function<void(const Message&)>& cb) {
-    std::lock_guard<std::mutex> lock(_mutex);
-    utils::CallbackHandleType handle = _nextCallbackHandle++;
-    _messageCallbacks[handle] = cb;
+    utils::CallbackHandleType handle = _messageCallbacks.Add(cb);
     Log(LOG_DEBUG, "Message callback set with handle %d", handle);
     return handle;
 }
 
 void BrokerConnection::RemoveMessageCallback(utils::CallbackHandleType handle) {
     if (handle > 0) {
-        std::lock_guard<std::mutex> lock(_mutex);
-        auto found = _messageCallbacks.find(handle);
-        if (found != _messageCallbacks.end()) {
-            _messageCallbacks.erase(found);
+        if (_messageCallbacks.Remove(handle)) {
             Log(LOG_DEBUG, "Removed message callback with handle %d", handle);
         } else {
             Log(LOG_WARNING, "No message callback found with handle %d", handle);
@@ -451,7 +857,12 @@ void BrokerConnection::RemoveMessageCallback(utils::CallbackHandleType handle) {
 
 bool BrokerConnection::TopicMatchesSubscription(const std::string& topic, const std::string& subscr) const {
     bool result;
-    int rc = mosquitto_topic_matches_sub(subscr.c_str(), topic.c_str(), &result);
+    int rc;
+    if (isSharedSubscription(subscr)) {
+        rc = mosquitto_topic_matches_sub(std::string(subscriptionFilter(subscr)).c_str(), topic.c_str(), &result);
+    } else {
+        rc = mosquitto_topic_matches_sub(subscr.c_str(), topic.c_str(), &result);
+    }
     if (rc != MOSQ_ERR_SUCCESS) {
         throw std::runtime_error("Mosquitto error");
     }
@@ -478,24 +889,27 @@ bool BrokerConnection::IsConnected() const {
     return _connected;
 }
 
+const ConnectOptions& BrokerConnection::GetConnectOptions() const {
+    return _options;
+}
+
+std::shared_future<bool> BrokerConnection::GetConnectedFuture() const {
+    return _connectedFuture;
+}
+
 void BrokerConnection::SetLogFunction(const utils::LogFunctionType& logFunc) {
-    _logger = logFunc;
+    _logger.SetFunction(logFunc);
 }
 
 void BrokerConnection::SetLogLevel(int level) {
-    _logLevel = level;
+    _logger.SetLevel(level);
 }
 
 void BrokerConnection::Log(int level, const char* fmt, ...) const {
-    if (_logger && (level <= _logLevel)) {
-        va_list args;
-        va_start(args, fmt);
-        char buf[256];
-        vsnprintf(buf, sizeof(buf), fmt, args);
-        std::string msg(buf);
-        va_end(args);
-        _logger(level, msg.c_str());
-    }
+    va_list args;
+    va_start(args, fmt);
+    _logger.Write(level, fmt, args);
+    va_end(args);
 }
 
 } // namespace mqtt
@@ -3,99 +3,179 @@
 namespace stinger {
 namespace mqtt {
 
+namespace {
+
+template <MessageKind Kind>
+Message make(const std::string& topic, const std::string& payload, const Properties& props) {
+    Message message(topic, payload, MessageSchema<Kind>::kQos, MessageSchema<Kind>::kRetain, props);
+    message.kind = Kind;
+    return message;
+}
+
+} // namespace
+
 Message::Message(const std::string& topic, const std::string& payload, unsigned qos, bool retain,
                  const Properties& props)
     : topic(topic), payload(payload), qos(qos), retain(retain), properties(props) {}
 
-Message::Message(const Message& other)
-    : topic(other.topic), payload(other.payload), qos(other.qos), retain(other.retain), properties(other.properties) {}
+Message::Message(const Message& other) = default;
+Message::Message(Message&& other) noexcept = default;
+Message& Message::operator=(const Message& other) = default;
+Message& Message::operator=(Message&& other) noexcept = default;
+
+MessageTopic& MessageTopic::operator=(const MessageTopic& other) {
+    _name = other._name;
+    _id.store(other._id.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return *this;
+}
+
+MessageTopic& MessageTopic::operator=(MessageTopic&& other) noexcept {
+    _name = std::move(other._name);
+    _id.store(other._id.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    return *this;
+}
+
+utils::TopicId MessageTopic::Intern() const {
+    utils::TopicId id = _id.load(std::memory_order_relaxed);
+    if (id == utils::kInvalidTopicId) {
+        id = utils::TopicTable::Global().Intern(_name);
+        _id.store(id, std::memory_order_relaxed);
+    }
+    return id;
+}
+
+utils::TopicId MessageTopic::Find() const {
+    utils::TopicId id = _id.load(std::memory_order_relaxed);
+    if (id == utils::kInvalidTopicId) {
+        id = utils::TopicTable::Global().Find(_name);
+        _id.store(id, std::memory_order_relaxed);
+    }
+    return id;
+}
+
+void Message::Recycle() {
+    // Keep buffers for typical messages, but don't hold on to one outsized message forever.
+    constexpr std::size_t kMaxRetainedCapacity = 64 * 1024;
+    topic.clear();
+    if (payload.capacity() > kMaxRetainedCapacity) {
+        std::string().swap(payload);
+    } else {
+        payload.clear();
+    }
+    qos = 0;
+    retain = false;
+    properties.Clear();
+    if (properties.ArenaCapacity() > kMaxRetainedCapacity) {
+        properties.ShrinkToFit();
+    }
+    kind = MessageKind::Generic;
+}
 
 Message Message::Signal(const std::string& topic, const std::string& payload) {
     Properties props;
-    props.contentType = "application/json";
-    return Message(topic, payload, 2, false, props);
+    props.SetContentType("application/json");
+    return make<MessageKind::Signal>(topic, payload, props);
 }
 
 Message Message::PropertyValue(const std::string& topic, const std::string& payload, int propertyVersion) {
     Properties props;
-    props.contentType = "application/json";
-    props.propertyVersion = propertyVersion;
-    return Message(topic, payload, 1, true, props);
+    props.SetContentType("application/json");
+    props.SetPropertyVersion(propertyVersion);
+    return make<MessageKind::PropertyValue>(topic, payload, props);
 }
 
 Message Message::PropertyUpdateRequest(const std::string& topic, const std::string& payload, int propertyVersion,
                                        const std::vector<std::byte>& correlationData,
                                        const std::string& responseTopic) {
     Properties props;
-    props.contentType = "application/json";
-    props.propertyVersion = propertyVersion;
-    props.correlationData = correlationData;
-    props.responseTopic = responseTopic;
-    return Message(topic, payload, 1, false, props);
+    props.SetContentType("application/json");
+    props.SetPropertyVersion(propertyVersion);
+    props.SetCorrelationData(correlationData);
+    props.SetResponseTopic(responseTopic);
+    return make<MessageKind::PropertyUpdateRequest>(topic, payload, props);
+}
+
+Message Message::PropertyUpdateRequest(const std::string& topic, const std::string& payload, int propertyVersion,
+                                       const utils::CorrelationId& correlationId, const std::string& responseTopic) {
+    Properties props;
+    props.SetContentType("application/json");
+    props.SetPropertyVersion(propertyVersion);
+    props.SetCorrelationData(correlationId);
+    props.SetResponseTopic(responseTopic);
+    return make<MessageKind::PropertyUpdateRequest>(topic, payload, props);
 }
 
 Message Message::PropertyUpdateResponse(const std::string& topic, const std::string& payload, int propertyVersion,
                                         const std::optional<std::vector<std::byte>>& correlationData,
                                         stinger::error::MethodReturnCode returnCode, const std::string& debugMessage) {
     Properties props;
-    props.contentType = "application/json";
-    props.propertyVersion = propertyVersion;
-    props.correlationData = correlationData;
-    props.returnCode = static_cast<int>(returnCode);
-    props.debugInfo = debugMessage;
-    return Message(topic, payload, 1, false, props);
+    props.SetContentType("application/json");
+    props.SetPropertyVersion(propertyVersion);
+    props.SetCorrelationData(correlationData);
+    props.SetReturnCode(static_cast<int>(returnCode));
+    props.SetDebugInfo(debugMessage);
+    return make<MessageKind::PropertyUpdateResponse>(topic, payload, props);
 }
 
 Message Message::PropertyUpdateResponse(const std::string& topic, const std::string& payload, int propertyVersion,
                                         const std::optional<std::vector<std::byte>>& correlationData,
                                         stinger::error::MethodReturnCode returnCode) {
     Properties props;
-    props.contentType = "application/json";
-    props.propertyVersion = propertyVersion;
-    props.correlationData = correlationData;
-    props.returnCode = static_cast<int>(returnCode);
-    return Message(topic, payload, 1, false, props);
+    props.SetContentType("application/json");
+    props.SetPropertyVersion(propertyVersion);
+    props.SetCorrelationData(correlationData);
+    props.SetReturnCode(static_cast<int>(returnCode));
+    return make<MessageKind::PropertyUpdateResponse>(topic, payload, props);
 }
 
 Message Message::MethodRequest(const std::string& topic, const std::string& payload,
                                const std::vector<std::byte>& correlationData, const std::string& responseTopic) {
     Properties props;
-    props.contentType = "application/json";
-    props.correlationData = correlationData;
-    props.responseTopic = responseTopic;
-    return Message(topic, payload, 2, false, props);
+    props.SetContentType("application/json");
+    props.SetCorrelationData(correlationData);
+    props.SetResponseTopic(responseTopic);
+    return make<MessageKind::MethodRequest>(topic, payload, props);
+}
+
+Message Message::MethodRequest(const std::string& topic, const std::string& payload,
+                               const utils::CorrelationId& correlationId, const std::string& responseTopic) {
+    Properties props;
+    props.SetContentType("application/json");
+    props.SetCorrelationData(correlationId);
+    props.SetResponseTopic(responseTopic);
+    return make<MessageKind::MethodRequest>(topic, payload, props);
 }
 
 Message Message::MethodResponse(const std::string& topic, const std::string& payload,
                                 const std::optional<std::vector<std::byte>>& correlationData,
                                 stinger::error::MethodReturnCode returnCode, const std::string& debugMessage) {
     Properties props;
-    props.contentType = "application/json";
-    props.correlationData = correlationData;
-    props.returnCode = static_cast<int>(returnCode);
-    props.debugInfo = debugMessage;
-    return Message(topic, payload, 1, false, props);
+    props.SetContentType("application/json");
+    props.SetCorrelationData(correlationData);
+    props.SetReturnCode(static_cast<int>(returnCode));
+    props.SetDebugInfo(debugMessage);
+    return make<MessageKind::MethodResponse>(topic, payload, props);
 }
 
 Message Message::MethodResponse(const std::string& topic, const std::string& payload,
                                 const std::optional<std::vector<std::byte>>& correlationData,
                                 stinger::error::MethodReturnCode returnCode) {
     Properties props;
-    props.contentType = "application/json";
-    props.correlationData = correlationData;
-    props.returnCode = static_cast<int>(returnCode);
-    return Message(topic, payload, 1, false, props);
+    props.SetContentType("application/json");
+    props.SetCorrelationData(correlationData);
+    props.SetReturnCode(static_cast<int>(returnCode));
+    return make<MessageKind::MethodResponse>(topic, payload, props);
 }
 
 Message Message::ServiceOnline(const std::string& topic, const std::string& payload, int messageExpiryInterval) {
     Properties props;
-    props.contentType = "application/json";
-    props.messageExpiryInterval = messageExpiryInterval;
-    return Message(topic, payload, 1, true, props);
+    props.SetContentType("application/json");
+    props.SetMessageExpiryInterval(messageExpiryInterval);
+    return make<MessageKind::ServiceOnline>(topic, payload, props);
 }
 
 Message Message::ServiceOffline(const std::string& topic) {
-    return Message(topic, "", 1, true, Properties());
+    return make<MessageKind::ServiceOffline>(topic, "", Properties());
 }
 
 } // namespace mqtt
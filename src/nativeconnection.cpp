@@ -0,0 +1,841 @@
+#include "stinger/mqtt/nativeconnection.hpp"
+#include "stinger/mqtt/packetcodec.hpp"
+#include "stinger/mqtt/topic.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <syslog.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace stinger {
+namespace mqtt {
+
+namespace {
+
+const int kReconnectDelaySeconds = 1;
+const int kReconnectDelayMaxSeconds = 30;
+const int kConnectTimeoutSeconds = 30;
+const int kMaxEvents = 16;
+const std::size_t kReadChunk = 64 * 1024;
+// Once this much of the outbound buffer has been sent while more is still queued behind it, the sent part is dropped
+// so that a socket that never quite catches up does not grow the buffer forever.
+const std::size_t kOutboundCompactBytes = 64 * 1024;
+const std::uint8_t kReasonCodeFailure = 0x80;
+
+// A topic that cannot be encoded is rejected before the registry counts a reference to it.
+void checkTopicSize(const std::string& topic) {
+    if (topic.size() > kMaxStringSize) {
+        throw std::length_error("Topic is longer than 65535 bytes");
+    }
+}
+
+} // namespace
+
+NativeConnection::NativeConnection(const std::string& host, int port, const std::string& clientId,
+                                   const ConnectOptions& options)
+    : _host(host), _port(port), _clientId(clientId), _options(options), _subscriptions(*this) {
+    if (_options.externalLoop) {
+        throw std::invalid_argument("NativeConnection does not support externalLoop");
+    }
+    if (_clientId.size() > kMaxStringSize) {
+        throw std::length_error("Client ID is longer than 65535 bytes");
+    }
+    _connectedFuture = _connectedPromise.get_future().share();
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd < 0) {
+        throw std::runtime_error("Failed to create epoll instance: "s + strerror(errno));
+    }
+    _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeFd < 0) {
+        int err = errno;
+        close(_epollFd);
+        throw std::runtime_error("Failed to create eventfd: "s + strerror(err));
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = _wakeFd;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakeFd, &ev);
+
+    _ioThread = std::thread([this]() { Run(); });
+}
+
+NativeConnection::~NativeConnection() {
+    _stopping = true;
+    {
+        // Best effort: without a DISCONNECT the broker publishes the will message.
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_state == State::Connected) {
+            encodeDisconnect(_outbound);
+            FlushLocked();
+        }
+    }
+    std::uint64_t one = 1;
+    if (write(_wakeFd, &one, sizeof(one)) < 0) {
+        Log(LOG_WARNING, "Failed to wake I/O thread: %s", strerror(errno));
+    }
+    _ioThread.join();
+
+    if (_fd >= 0) {
+        close(_fd);
+    }
+    close(_wakeFd);
+    close(_epollFd);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& entry : _inflight) {
+        if (entry.second.promise) {
+            entry.second.promise->set_value(false);
+        }
+    }
+    for (auto& pending : _sendQueue) {
+        if (pending.promise) {
+            pending.promise->set_value(false);
+        }
+    }
+    if (!_connectedPromiseSet) {
+        _connectedPromise.set_value(false);
+        _connectedPromiseSet = true;
+    }
+}
+
+void NativeConnection::Run() {
+    if (_options.networkThreadCpu) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(*_options.networkThreadCpu, &cpus);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (rc != 0) {
+            Log(LOG_WARNING, "Failed to pin I/O thread to CPU %d: %s", *_options.networkThreadCpu, strerror(rc));
+        }
+    }
+
+    epoll_event events[kMaxEvents];
+    while (!_stopping) {
+        auto now = std::chrono::steady_clock::now();
+        int timeoutMs = 1000;
+        if (_fd < 0) {
+            if (now >= _nextReconnect) {
+                StartConnect();
+            } else {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(_nextReconnect - now).count();
+                timeoutMs = static_cast<int>(std::min<long long>(wait + 1, timeoutMs));
+            }
+        }
+
+        int n = epoll_wait(_epollFd, events, kMaxEvents, timeoutMs);
+        if (n < 0 && errno != EINTR) {
+            Log(LOG_ERR, "epoll_wait failed: %s", strerror(errno));
+        }
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd == _wakeFd) {
+                std::uint64_t value;
+                while (read(_wakeFd, &value, sizeof(value)) > 0) {
+                }
+                continue;
+            }
+            // A socket closed earlier in this batch may leave stale events behind.
+            if (events[i].data.fd != _fd) {
+                continue;
+            }
+            if (_state == State::Connecting) {
+                FinishConnect();
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                ReadSocket();
+            }
+            if (_fd >= 0 && (events[i].events & EPOLLOUT)) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                FlushLocked();
+            }
+        }
+
+        now = std::chrono::steady_clock::now();
+        if (_fd < 0) {
+            continue;
+        }
+        if (_state != State::Connected) {
+            if (now >= _connectDeadline) {
+                CloseSocket("timed out waiting for the broker");
+            }
+            continue;
+        }
+        if (_keepAliveSeconds > 0) {
+            auto keepAlive = std::chrono::seconds(_keepAliveSeconds);
+            if (now - _lastReceive >= keepAlive + keepAlive / 2) {
+                CloseSocket("keepalive timeout");
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (now - _lastSend >= keepAlive) {
+                encodePingreq(_outbound);
+                FlushLocked();
+            }
+        }
+#ifdef STINGER_ONLINE_PUBLISH_THREAD
+        if (now >= _nextOnlinePublish) {
+            _nextOnlinePublish = now + std::chrono::minutes(5);
+            std::lock_guard<std::mutex> lock(_mutex);
+            _sendQueue.push_back(PendingPublish{OnlineMessage(), nullptr});
+            DrainSendQueueLocked();
+            FlushLocked();
+        }
+#endif
+    }
+}
+
+int NativeConnection::OpenSocket() {
+    if (_port == 0) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (_host.size() >= sizeof(addr.sun_path)) {
+            Log(LOG_ERR, "Unix socket path is too long: %s", _host.c_str());
+            return -1;
+        }
+        memcpy(addr.sun_path, _host.c_str(), _host.size() + 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        ApplySocketOptions(fd, false);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 || errno == EINPROGRESS) {
+            return fd;
+        }
+        Log(LOG_WARNING, "Failed to connect to %s: %s", _host.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    int rc = getaddrinfo(_host.c_str(), std::to_string(_port).c_str(), &hints, &addresses);
+    if (rc != 0) {
+        Log(LOG_ERR, "Failed to resolve %s: %s", _host.c_str(), gai_strerror(rc));
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* address = addresses; address != nullptr; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        // Buffer sizes set before connect() also let the kernel pick a larger TCP window scale.
+        ApplySocketOptions(fd, true);
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0 || errno == EINPROGRESS) {
+            break;
+        }
+        Log(LOG_DEBUG, "Failed to connect to an address of %s: %s", _host.c_str(), strerror(errno));
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+void NativeConnection::ApplySocketOptions(int fd, bool tcp) {
+    if (tcp && _options.tcpNoDelay) {
+        int one = 1;
+        if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0) {
+            Log(LOG_WARNING, "Failed to set TCP_NODELAY: %s", strerror(errno));
+        }
+    }
+    if (_options.sendBufferSize) {
+        int size = *_options.sendBufferSize;
+        if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) != 0) {
+            Log(LOG_WARNING, "Failed to set send buffer size to %d: %s", size, strerror(errno));
+        }
+    }
+    if (_options.receiveBufferSize) {
+        int size = *_options.receiveBufferSize;
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) != 0) {
+            Log(LOG_WARNING, "Failed to set receive buffer size to %d: %s", size, strerror(errno));
+        }
+    }
+}
+
+void NativeConnection::StartConnect() {
+    int fd = OpenSocket();
+    if (fd < 0) {
+        CloseSocket("no usable address");
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _fd = fd;
+    _state = State::Connecting;
+    _wantWrite = true;
+    _connectDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(kConnectTimeoutSeconds);
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT;
+    ev.data.fd = fd;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+void NativeConnection::FinishConnect() {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+        err = errno;
+    }
+    if (err != 0) {
+        CloseSocket(strerror(err));
+        return;
+    }
+
+    Message will(GetLastWillTopic(), GetOfflinePayload(), 1, true);
+    will.properties.SetContentType("application/json");
+    will.properties.SetMessageExpiryInterval(24 * 60 * 60);
+
+    _keepAliveSeconds = _options.keepAliveSeconds;
+    _lastReceive = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _state = State::AwaitingConnack;
+    SetWantWriteLocked(false);
+    encodeConnect(_outbound, _clientId, _options, false, &will);
+    FlushLocked();
+}
+
+void NativeConnection::CloseSocket(const char* reason) {
+    bool wasConnected = false;
+    std::vector<std::string> unacknowledgedUnsubscribes;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_fd >= 0) {
+            epoll_ctl(_epollFd, EPOLL_CTL_DEL, _fd, nullptr);
+            close(_fd);
+        }
+        _fd = -1;
+        wasConnected = _state == State::Connected;
+        _state = State::Disconnected;
+        _connected = false;
+        _wantWrite = false;
+        _outbound.clear();
+        _outboundSent = 0;
+        for (auto& entry : _subscribeAcks) {
+            for (auto& topic : entry.second) {
+                unacknowledgedUnsubscribes.push_back(std::move(topic));
+            }
+        }
+        _subscribeAcks.clear();
+    }
+    // The broker may not have seen these.  Unsubscribing again is harmless, so resend them if the session resumes.
+    for (const auto& topic : unacknowledgedUnsubscribes) {
+        _subscriptions.Registry().AddPendingUnsubscribe(topic);
+    }
+    _inboundLength = 0;
+    if (_stopping) {
+        return;
+    }
+
+    ++_reconnectAttempts;
+    int delay = std::min(kReconnectDelaySeconds * _reconnectAttempts, kReconnectDelayMaxSeconds);
+    _nextReconnect = std::chrono::steady_clock::now() + std::chrono::seconds(delay);
+    Log(LOG_WARNING, "%s %s: %s; retrying in %d s", wasConnected ? "Disconnected from" : "Failed to connect to",
+        _host.c_str(), reason, delay);
+}
+
+void NativeConnection::ReadSocket() {
+    if (_inbound.size() - _inboundLength < kReadChunk) {
+        _inbound.resize(_inboundLength + kReadChunk);
+    }
+    ssize_t n = recv(_fd, &_inbound[_inboundLength], _inbound.size() - _inboundLength, 0);
+    if (n == 0) {
+        CloseSocket("connection closed by the broker");
+        return;
+    }
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            CloseSocket(strerror(errno));
+        }
+        return;
+    }
+    _inboundLength += static_cast<std::size_t>(n);
+    _lastReceive = std::chrono::steady_clock::now();
+
+    // Parse every complete packet in place.  Whatever is left is the start of a packet still in transit.
+    std::string_view data(_inbound.data(), _inboundLength);
+    std::size_t offset = 0;
+    while (_fd >= 0) {
+        FixedHeader header;
+        DecodeStatus status = decodeFixedHeader(data.substr(offset), header);
+        if (status == DecodeStatus::Incomplete) {
+            break;
+        }
+        if (status == DecodeStatus::Malformed ||
+            (_options.maximumPacketSize && header.Size() > *_options.maximumPacketSize)) {
+            CloseSocket("malformed or oversized packet");
+            return;
+        }
+        if (data.size() - offset < header.Size()) {
+            break;
+        }
+        HandlePacket(header, data.substr(offset + header.headerSize, header.remainingLength));
+        offset += header.Size();
+    }
+    if (_fd < 0) {
+        return;
+    }
+    if (offset > 0) {
+        memmove(&_inbound[0], &_inbound[offset], _inboundLength - offset);
+        _inboundLength -= offset;
+    }
+}
+
+void NativeConnection::HandlePacket(const FixedHeader& header, std::string_view body) {
+    switch (header.type) {
+    case PacketType::Connack: {
+        ConnackView connack;
+        if (_state != State::AwaitingConnack || !decodeConnack(body, connack)) {
+            CloseSocket("unexpected CONNACK");
+            return;
+        }
+        HandleConnack(connack);
+        break;
+    }
+    case PacketType::Publish: {
+        PublishView publish;
+        if (!decodePublish(header.flags, body, publish)) {
+            CloseSocket("malformed PUBLISH");
+            return;
+        }
+        // A QoS 2 message is delivered when it first arrives; a retransmission before PUBREL is only acknowledged.
+        bool deliver = publish.qos < 2 || _inboundQos2.insert(publish.packetId).second;
+        if (deliver) {
+            publish.ToMessage(_received);
+            Dispatch(_received);
+        }
+        if (publish.qos > 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            encodeAck(_outbound, publish.qos == 1 ? PacketType::Puback : PacketType::Pubrec, publish.packetId);
+            FlushLocked();
+        }
+        break;
+    }
+    case PacketType::Puback:
+    case PacketType::Pubrec:
+    case PacketType::Pubcomp: {
+        AckView ack;
+        if (!decodeAck(header.type, body, ack)) {
+            CloseSocket("malformed acknowledgement");
+            return;
+        }
+        bool failed = ack.FirstReasonCode() >= kReasonCodeFailure;
+        if (failed) {
+            Log(LOG_WARNING, "Broker rejected publish %u with reason code %d", ack.packetId, ack.FirstReasonCode());
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto found = _inflight.find(ack.packetId);
+        if (header.type == PacketType::Pubrec && !failed) {
+            if (found != _inflight.end()) {
+                found->second.released = true;
+            }
+            encodeAck(_outbound, PacketType::Pubrel, ack.packetId);
+            FlushLocked();
+            break;
+        }
+        if (found == _inflight.end()) {
+            break;
+        }
+        if (found->second.promise) {
+            found->second.promise->set_value(!failed);
+        }
+        _inflight.erase(found);
+        // The broker's receive maximum may have been holding messages back.
+        DrainSendQueueLocked();
+        FlushLocked();
+        break;
+    }
+    case PacketType::Pubrel: {
+        AckView ack;
+        if (!decodeAck(header.type, body, ack)) {
+            CloseSocket("malformed PUBREL");
+            return;
+        }
+        _inboundQos2.erase(ack.packetId);
+        std::lock_guard<std::mutex> lock(_mutex);
+        encodeAck(_outbound, PacketType::Pubcomp, ack.packetId);
+        FlushLocked();
+        break;
+    }
+    case PacketType::Suback:
+    case PacketType::Unsuback: {
+        AckView ack;
+        if (!decodeAck(header.type, body, ack)) {
+            CloseSocket("malformed subscription acknowledgement");
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _subscribeAcks.erase(ack.packetId);
+        }
+        for (char reasonCode : ack.reasonCodes) {
+            if (static_cast<std::uint8_t>(reasonCode) >= kReasonCodeFailure) {
+                Log(LOG_ERR, "Broker rejected a topic in %s %u with reason code %d",
+                    header.type == PacketType::Suback ? "SUBSCRIBE" : "UNSUBSCRIBE", ack.packetId,
+                    static_cast<std::uint8_t>(reasonCode));
+            }
+        }
+        break;
+    }
+    case PacketType::Pingresp:
+        break;
+    case PacketType::Disconnect: {
+        std::uint8_t reasonCode = 0;
+        decodeDisconnect(body, reasonCode);
+        Log(LOG_WARNING, "Broker disconnected with reason code: %d", reasonCode);
+        CloseSocket("disconnected by the broker");
+        break;
+    }
+    default:
+        CloseSocket("unexpected packet type");
+        break;
+    }
+}
+
+void NativeConnection::HandleConnack(const ConnackView& connack) {
+    if (connack.reasonString) {
+        Log(LOG_INFO, "Connect reason: %.*s", static_cast<int>(connack.reasonString->size()),
+            connack.reasonString->data());
+    }
+    if (!connack.sharedSubscriptionAvailable) {
+        Log(LOG_WARNING, "Broker does not support shared subscriptions");
+    }
+    if (connack.reasonCode != 0) {
+        Log(LOG_ERR, "Connection to %s refused with reason code: %d", _host.c_str(), connack.reasonCode);
+        CloseSocket("connection refused");
+        return;
+    }
+    if (connack.serverKeepAlive) {
+        _keepAliveSeconds = *connack.serverKeepAlive;
+    }
+    Log(LOG_INFO, "Connected to %s", _host.c_str());
+
+    _subscriptions.Resume(connack.sessionPresent);
+    if (!connack.sessionPresent) {
+        // The broker has no session for us, so any QoS 2 exchanges it used to hold are gone.
+        _inboundQos2.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _state = State::Connected;
+        _connected = true;
+        _serverReceiveMaximum = connack.receiveMaximum.value_or(65535);
+    }
+
+    // Subscribe() only sends while connected, so everything made before this point is pending and everything made
+    // after it is sent directly: each subscription goes out exactly once.
+    _subscriptions.SendPending([this](const std::vector<std::string_view>& topics) { return SendUnsubscribe(topics); },
+                               [this](const std::vector<std::string_view>& topics, int subscriptionId, int qos) {
+                                   return SendSubscribe(topics, subscriptionId, qos);
+                               });
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Retransmit unacknowledged QoS 1/2 publishes in the order they were first sent.
+    std::vector<std::pair<const std::uint16_t, Inflight>*> unacknowledged;
+    for (auto& entry : _inflight) {
+        unacknowledged.push_back(&entry);
+    }
+    std::sort(unacknowledged.begin(), unacknowledged.end(),
+              [](const auto* a, const auto* b) { return a->second.sequence < b->second.sequence; });
+    for (auto* entry : unacknowledged) {
+        if (entry->second.released && connack.sessionPresent) {
+            encodeAck(_outbound, PacketType::Pubrel, entry->first);
+        } else {
+            entry->second.released = false;
+            encodePublish(_outbound, entry->second.message, entry->first, connack.sessionPresent);
+        }
+    }
+    _sendQueue.push_back(PendingPublish{OnlineMessage(), nullptr});
+    DrainSendQueueLocked();
+    FlushLocked();
+#ifdef STINGER_ONLINE_PUBLISH_THREAD
+    _nextOnlinePublish = std::chrono::steady_clock::now() + std::chrono::minutes(5);
+#endif
+    _reconnectAttempts = 0;
+    if (!_connectedPromiseSet) {
+        _connectedPromise.set_value(true);
+        _connectedPromiseSet = true;
+    }
+}
+
+Message NativeConnection::OnlineMessage() const {
+    Message online(GetLastWillTopic(), GetOnlinePayload(), 1, true);
+    online.properties.SetContentType("application/json");
+#ifdef STINGER_ONLINE_PUBLISH_THREAD
+    online.properties.SetMessageExpiryInterval(10 * 60);
+#endif
+    return online;
+}
+
+void NativeConnection::SendPublishLocked(const Message& message, const std::shared_ptr<std::promise<bool>>& promise) {
+    if (message.qos == 0) {
+        encodePublish(_outbound, message, 0);
+        if (promise) {
+            promise->set_value(true);
+        }
+        return;
+    }
+    std::uint16_t packetId = NextPacketIdLocked();
+    encodePublish(_outbound, message, packetId);
+    _inflight.emplace(packetId, Inflight{message, promise, _nextSequence++, false});
+}
+
+void NativeConnection::DrainSendQueueLocked() {
+    while (_state == State::Connected && !_sendQueue.empty()) {
+        const PendingPublish& pending = _sendQueue.front();
+        if (pending.message.qos > 0 && _inflight.size() >= _serverReceiveMaximum) {
+            break;
+        }
+        Log(LOG_DEBUG, "Publishing queued message to %s", pending.message.topic.c_str());
+        SendPublishLocked(pending.message, pending.promise);
+        _sendQueue.pop_front();
+    }
+}
+
+void NativeConnection::SendSubscribeLocked(const std::vector<std::string_view>& topics, int subscriptionId, int qos) {
+    std::uint16_t packetId = NextPacketIdLocked();
+    encodeSubscribe(_outbound, packetId, topics, qos, subscriptionId);
+    _subscribeAcks[packetId];
+    FlushLocked();
+}
+
+void NativeConnection::SendUnsubscribeLocked(const std::vector<std::string_view>& topics) {
+    std::uint16_t packetId = NextPacketIdLocked();
+    encodeUnsubscribe(_outbound, packetId, topics);
+    _subscribeAcks[packetId].assign(topics.begin(), topics.end());
+    FlushLocked();
+}
+
+std::uint16_t NativeConnection::NextPacketIdLocked() {
+    do {
+        if (++_lastPacketId == 0) {
+            _lastPacketId = 1;
+        }
+    } while (_inflight.count(_lastPacketId) || _subscribeAcks.count(_lastPacketId));
+    return _lastPacketId;
+}
+
+void NativeConnection::FlushLocked() {
+    if (_fd < 0 || _state == State::Connecting || _state == State::Disconnected) {
+        return;
+    }
+    bool sent = false;
+    while (_outboundSent < _outbound.size()) {
+        ssize_t n = send(_fd, _outbound.data() + _outboundSent, _outbound.size() - _outboundSent,
+                         MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            _outboundSent += static_cast<std::size_t>(n);
+            sent = true;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            // EAGAIN waits for EPOLLOUT.  Any other error is reported to the I/O thread as EPOLLERR or EPOLLHUP, and
+            // it closes the socket.
+            break;
+        }
+    }
+    if (sent) {
+        _lastSend = std::chrono::steady_clock::now();
+    }
+    if (_outboundSent == _outbound.size()) {
+        _outbound.clear();
+        _outboundSent = 0;
+        SetWantWriteLocked(false);
+        return;
+    }
+    if (_outboundSent >= kOutboundCompactBytes) {
+        _outbound.erase(0, _outboundSent);
+        _outboundSent = 0;
+    }
+    SetWantWriteLocked(true);
+}
+
+void NativeConnection::SetWantWriteLocked(bool wantWrite) {
+    if (_fd < 0 || wantWrite == _wantWrite) {
+        return;
+    }
+    _wantWrite = wantWrite;
+    epoll_event ev{};
+    ev.events = wantWrite ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.fd = _fd;
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, _fd, &ev);
+}
+
+std::future<bool> NativeConnection::Publish(const Message& message) {
+    if (message.qos > 2) {
+        throw std::invalid_argument("QoS must be 0, 1 or 2");
+    }
+    auto promise = std::make_shared<std::promise<bool>>();
+    auto future = promise->get_future();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // Anything still queued goes first, so that messages leave in the order they were published.
+        if (_state == State::Connected && _sendQueue.empty() &&
+            (message.qos == 0 || _inflight.size() < _serverReceiveMaximum)) {
+            SendPublishLocked(message, promise);
+            FlushLocked();
+        } else {
+            // Encoding throws for a message that does not fit in a packet; do that here, not on the I/O thread.
+            publishPacketSize(message);
+            Log(LOG_DEBUG, "Delayed published queued to: %s", message.topic.c_str());
+            _sendQueue.push_back(PendingPublish{message, promise});
+        }
+    }
+    if (_options.localDelivery) {
+        DeliverLocally(message);
+    }
+    return future;
+}
+
+// The tracker calls these with the registry shards of `topics` locked, so that a concurrent call on the same topic
+// cannot overtake the packet.
+
+bool NativeConnection::SendSubscribe(const std::vector<std::string_view>& topics, int subscriptionId, int qos) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_state != State::Connected) {
+        return false;
+    }
+    SendSubscribeLocked(topics, subscriptionId, qos);
+    if (topics.size() == 1) {
+        Log(LOG_INFO, "Online Subscribed to %.*s as %d", static_cast<int>(topics.front().size()), topics.front().data(),
+            subscriptionId);
+    } else {
+        Log(LOG_INFO, "Online Subscribed to %zu topics as %d", topics.size(), subscriptionId);
+    }
+    return true;
+}
+
+bool NativeConnection::SendUnsubscribe(const std::vector<std::string_view>& topics) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_state != State::Connected) {
+        return false;
+    }
+    SendUnsubscribeLocked(topics);
+    return true;
+}
+
+int NativeConnection::Subscribe(const std::string& topic, int qos) {
+    checkTopicSize(topic);
+    auto send = [this](const std::vector<std::string_view>& topics, int subscriptionId, int q) {
+        return SendSubscribe(topics, subscriptionId, q);
+    };
+    return _subscriptions.Subscribe(topic, qos, send).subscriptionId;
+}
+
+void NativeConnection::Unsubscribe(const std::string& topic) {
+    _subscriptions.Unsubscribe(topic, [this](const std::vector<std::string_view>& topics) {
+        return SendUnsubscribe(topics);
+    });
+}
+
+std::vector<int> NativeConnection::SubscribeMany(const std::vector<std::string>& topics, int qos) {
+    for (const auto& topic : topics) {
+        checkTopicSize(topic);
+    }
+    auto send = [this](const std::vector<std::string_view>& newTopics, int subscriptionId, int q) {
+        return SendSubscribe(newTopics, subscriptionId, q);
+    };
+    return _subscriptions.SubscribeMany(topics, qos, send);
+}
+
+void NativeConnection::UnsubscribeMany(const std::vector<std::string>& topics) {
+    _subscriptions.UnsubscribeMany(topics, [this](const std::vector<std::string_view>& removedTopics) {
+        return SendUnsubscribe(removedTopics);
+    });
+}
+
+void NativeConnection::Dispatch(const Message& message) {
+    Log(LOG_DEBUG, "Forwarding message (%s) to %zu callbacks", message.topic.c_str(), _messageCallbacks.Size());
+    _messageCallbacks.Invoke(message);
+}
+
+void NativeConnection::DeliverLocally(const Message& message) {
+    auto sub = _subscriptions.MatchLocal(message);
+    if (!sub) {
+        return;
+    }
+    Message localMsg(message);
+    localMsg.properties.SetSubscriptionId(sub->subscriptionId);
+    Dispatch(localMsg);
+}
+
+utils::CallbackHandleType NativeConnection::AddMessageCallback(const std::function<void(const Message&)>& cb) {
+    utils::CallbackHandleType handle = _messageCallbacks.Add(cb);
+    Log(LOG_DEBUG, "Message callback set with handle %d", handle);
+    return handle;
+}
+
+void NativeConnection::RemoveMessageCallback(utils::CallbackHandleType handle) {
+    if (handle > 0) {
+        if (_messageCallbacks.Remove(handle)) {
+            Log(LOG_DEBUG, "Removed message callback with handle %d", handle);
+        } else {
+            Log(LOG_WARNING, "No message callback found with handle %d", handle);
+        }
+    }
+}
+
+bool NativeConnection::TopicMatchesSubscription(const std::string& topic, const std::string& subscr) const {
+    return topicMatchesFilter(topic, subscriptionFilter(subscr));
+}
+
+std::string NativeConnection::GetClientId() const {
+    return _clientId;
+}
+
+std::string NativeConnection::GetLastWillTopic() const {
+    return "client/"s + _clientId + "/online";
+}
+
+std::string NativeConnection::GetOnlinePayload() const {
+    return "{\"status\":\"online\"}"s;
+}
+
+std::string NativeConnection::GetOfflinePayload() const {
+    return "{\"status\":\"offline\"}"s;
+}
+
+bool NativeConnection::IsConnected() const {
+    return _connected;
+}
+
+const ConnectOptions& NativeConnection::GetConnectOptions() const {
+    return _options;
+}
+
+std::shared_future<bool> NativeConnection::GetConnectedFuture() const {
+    return _connectedFuture;
+}
+
+void NativeConnection::SetLogFunction(const utils::LogFunctionType& logFunc) {
+    _logger.SetFunction(logFunc);
+}
+
+void NativeConnection::SetLogLevel(int level) {
+    _logger.SetLevel(level);
+}
+
+void NativeConnection::Log(int level, const char* fmt, ...) const {
+    va_list args;
+    va_start(args, fmt);
+    _logger.Write(level, fmt, args);
+    va_end(args);
+}
+
+} // namespace mqtt
+} // namespace stinger
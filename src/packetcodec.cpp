@@ -0,0 +1,694 @@
+#include "stinger/mqtt/packetcodec.hpp"
+#include "stinger/mqtt/topic.hpp"
+#include <stdexcept>
+
+namespace stinger {
+namespace mqtt {
+
+namespace {
+
+// Property identifiers (MQTT v5 section 2.2.2.2).
+const std::uint8_t kPropPayloadFormat = 0x01;
+const std::uint8_t kPropMessageExpiry = 0x02;
+const std::uint8_t kPropContentType = 0x03;
+const std::uint8_t kPropResponseTopic = 0x08;
+const std::uint8_t kPropCorrelationData = 0x09;
+const std::uint8_t kPropSubscriptionId = 0x0B;
+const std::uint8_t kPropSessionExpiry = 0x11;
+const std::uint8_t kPropAssignedClientId = 0x12;
+const std::uint8_t kPropServerKeepAlive = 0x13;
+const std::uint8_t kPropAuthMethod = 0x15;
+const std::uint8_t kPropAuthData = 0x16;
+const std::uint8_t kPropRequestProblemInfo = 0x17;
+const std::uint8_t kPropWillDelay = 0x18;
+const std::uint8_t kPropRequestResponseInfo = 0x19;
+const std::uint8_t kPropResponseInfo = 0x1A;
+const std::uint8_t kPropServerReference = 0x1C;
+const std::uint8_t kPropReasonString = 0x1F;
+const std::uint8_t kPropReceiveMaximum = 0x21;
+const std::uint8_t kPropTopicAliasMaximum = 0x22;
+const std::uint8_t kPropTopicAlias = 0x23;
+const std::uint8_t kPropMaximumQos = 0x24;
+const std::uint8_t kPropRetainAvailable = 0x25;
+const std::uint8_t kPropUserProperty = 0x26;
+const std::uint8_t kPropMaximumPacketSize = 0x27;
+const std::uint8_t kPropWildcardSubAvailable = 0x28;
+const std::uint8_t kPropSubIdAvailable = 0x29;
+const std::uint8_t kPropSharedSubAvailable = 0x2A;
+
+// Packets are written in two passes over the same body function: one into a SizeSink to learn the remaining length,
+// which precedes the body, and one into the output.  This avoids a scratch buffer and a copy of the payload.
+class SizeSink {
+public:
+    void Byte(std::uint8_t) { ++_size; }
+    void Bytes(const void*, std::size_t n) { _size += n; }
+    std::size_t Size() const { return _size; }
+
+private:
+    std::size_t _size = 0;
+};
+
+class StringSink {
+public:
+    explicit StringSink(std::string& out) : _out(out) {}
+    void Byte(std::uint8_t b) { _out.push_back(static_cast<char>(b)); }
+    void Bytes(const void* data, std::size_t n) { _out.append(static_cast<const char*>(data), n); }
+
+private:
+    std::string& _out;
+};
+
+template <typename Sink>
+void putU16(Sink& sink, std::uint16_t value) {
+    sink.Byte(static_cast<std::uint8_t>(value >> 8));
+    sink.Byte(static_cast<std::uint8_t>(value));
+}
+
+template <typename Sink>
+void putU32(Sink& sink, std::uint32_t value) {
+    putU16(sink, static_cast<std::uint16_t>(value >> 16));
+    putU16(sink, static_cast<std::uint16_t>(value));
+}
+
+template <typename Sink>
+void putVarint(Sink& sink, std::size_t value) {
+    do {
+        std::uint8_t byte = value & 0x7F;
+        value >>= 7;
+        sink.Byte(value ? (byte | 0x80) : byte);
+    } while (value);
+}
+
+template <typename Sink>
+void putString(Sink& sink, std::string_view value) {
+    if (value.size() > kMaxStringSize) {
+        // Its length prefix would wrap, and the broker would misparse the rest of the packet.
+        throw std::length_error("MQTT string of " + std::to_string(value.size()) + " bytes is longer than 65535");
+    }
+    putU16(sink, static_cast<std::uint16_t>(value.size()));
+    sink.Bytes(value.data(), value.size());
+}
+
+template <typename Sink>
+void putStringProperty(Sink& sink, std::uint8_t id, std::string_view value) {
+    sink.Byte(id);
+    putString(sink, value);
+}
+
+template <typename Sink>
+void putUserProperty(Sink& sink, std::string_view name, std::string_view value) {
+    sink.Byte(kPropUserProperty);
+    putString(sink, name);
+    putString(sink, value);
+}
+
+template <typename Sink>
+void putIntUserProperty(Sink& sink, std::string_view name, int value) {
+    char buf[16];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    putUserProperty(sink, name, std::string_view(buf, result.ptr - buf));
+}
+
+// Writes a property block: its length followed by whatever `props` writes.
+template <typename Sink, typename Props>
+void putProperties(Sink& sink, const Props& props) {
+    SizeSink size;
+    props(size);
+    putVarint(sink, size.Size());
+    props(sink);
+}
+
+template <typename Body>
+void emitPacket(std::string& out, std::uint8_t firstByte, const Body& body) {
+    SizeSink size;
+    body(size);
+    out.reserve(out.size() + 5 + size.Size());
+    StringSink sink(out);
+    sink.Byte(firstByte);
+    putVarint(sink, size.Size());
+    body(sink);
+}
+
+// Writes the properties in `Fields`, a MessageSchema mask.  Properties outside it are not even tested for.
+template <std::uint16_t Fields, typename Sink>
+void putMessageProperties(Sink& sink, const Properties& props) {
+    if constexpr (Fields & propertyBit(PropertyField::ContentType)) {
+        if (auto contentType = props.GetContentType()) {
+            putStringProperty(sink, kPropContentType, *contentType);
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::CorrelationData)) {
+        if (auto correlationData = props.GetCorrelationData()) {
+            sink.Byte(kPropCorrelationData);
+            putU16(sink, static_cast<std::uint16_t>(correlationData->size()));
+            sink.Bytes(correlationData->data(), correlationData->size());
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::ResponseTopic)) {
+        if (auto responseTopic = props.GetResponseTopic()) {
+            putStringProperty(sink, kPropResponseTopic, *responseTopic);
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::MessageExpiryInterval)) {
+        if (auto messageExpiryInterval = props.GetMessageExpiryInterval()) {
+            sink.Byte(kPropMessageExpiry);
+            putU32(sink, *messageExpiryInterval);
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::DebugInfo)) {
+        if (auto debugInfo = props.GetDebugInfo()) {
+            putUserProperty(sink, userPropertyName(UserProperty::DebugInfo), *debugInfo);
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::ReturnCode)) {
+        if (auto returnCode = props.GetReturnCode()) {
+            putIntUserProperty(sink, userPropertyName(UserProperty::ReturnCode), *returnCode);
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::PropertyVersion)) {
+        if (auto propertyVersion = props.GetPropertyVersion()) {
+            putIntUserProperty(sink, userPropertyName(UserProperty::PropertyVersion), *propertyVersion);
+        }
+    }
+    if constexpr (Fields & propertyBit(PropertyField::Version)) {
+        if (auto version = props.GetVersion()) {
+            putUserProperty(sink, userPropertyName(UserProperty::Version), *version);
+        }
+    }
+    for (const UserPropertyEntry& entry : props.GetUserProperties()) {
+        putUserProperty(sink, entry.name, entry.value);
+    }
+}
+
+template <typename Sink>
+void putMessageProperties(Sink& sink, const Message& message) {
+    visitMessageSchema(message.kind, message.properties.PresentMask(), [&](auto schema) {
+        putMessageProperties<decltype(schema)::kProperties>(sink, message.properties);
+    });
+}
+
+/** Bounds-checked reader over a packet body.  Any overrun sets the failed flag and yields zero values. */
+class Reader {
+public:
+    explicit Reader(std::string_view data) : _data(data) {}
+
+    bool Failed() const { return _failed; }
+    bool AtEnd() const { return _pos >= _data.size(); }
+    std::size_t Remaining() const { return _data.size() - _pos; }
+
+    std::uint8_t Byte() {
+        if (!Require(1)) {
+            return 0;
+        }
+        return static_cast<std::uint8_t>(_data[_pos++]);
+    }
+
+    std::uint16_t U16() {
+        std::uint16_t high = Byte();
+        return static_cast<std::uint16_t>((high << 8) | Byte());
+    }
+
+    std::uint32_t U32() {
+        std::uint32_t high = U16();
+        return (high << 16) | U16();
+    }
+
+    std::uint32_t Varint() {
+        std::uint32_t value = 0;
+        for (int shift = 0; shift < 28; shift += 7) {
+            std::uint8_t byte = Byte();
+            value |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        _failed = true;
+        return 0;
+    }
+
+    std::string_view Bytes(std::size_t n) {
+        if (!Require(n)) {
+            return std::string_view();
+        }
+        std::string_view result = _data.substr(_pos, n);
+        _pos += n;
+        return result;
+    }
+
+    // A two-byte length followed by that many bytes; used for both UTF-8 strings and binary data.
+    std::string_view String() { return Bytes(U16()); }
+
+    std::string_view Rest() { return Bytes(Remaining()); }
+
+private:
+    bool Require(std::size_t n) {
+        if (_failed || Remaining() < n) {
+            _failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    std::string_view _data;
+    std::size_t _pos = 0;
+    bool _failed = false;
+};
+
+struct PropertyValue {
+    std::uint32_t integer = 0;
+    std::string_view string;
+    std::string_view value; // Second string of a user property.
+};
+
+// Reads the length-prefixed property block without parsing it.
+bool readPropertyBlock(Reader& reader, std::string_view& block) {
+    std::uint32_t length = reader.Varint();
+    if (reader.Failed() || length > reader.Remaining()) {
+        return false;
+    }
+    block = reader.Bytes(length);
+    return true;
+}
+
+// Calls `handle(id, value)` for each property in `block`.  Returns false if it is malformed.
+template <typename Handler>
+bool parseProperties(std::string_view block, const Handler& handle) {
+    Reader props(block);
+    while (!props.AtEnd()) {
+        std::uint8_t id = static_cast<std::uint8_t>(props.Varint());
+        PropertyValue value;
+        switch (id) {
+        case kPropPayloadFormat:
+        case kPropRequestProblemInfo:
+        case kPropRequestResponseInfo:
+        case kPropMaximumQos:
+        case kPropRetainAvailable:
+        case kPropWildcardSubAvailable:
+        case kPropSubIdAvailable:
+        case kPropSharedSubAvailable:
+            value.integer = props.Byte();
+            break;
+        case kPropServerKeepAlive:
+        case kPropReceiveMaximum:
+        case kPropTopicAliasMaximum:
+        case kPropTopicAlias:
+            value.integer = props.U16();
+            break;
+        case kPropMessageExpiry:
+        case kPropSessionExpiry:
+        case kPropWillDelay:
+        case kPropMaximumPacketSize:
+            value.integer = props.U32();
+            break;
+        case kPropSubscriptionId:
+            value.integer = props.Varint();
+            break;
+        case kPropContentType:
+        case kPropResponseTopic:
+        case kPropCorrelationData:
+        case kPropAssignedClientId:
+        case kPropAuthMethod:
+        case kPropAuthData:
+        case kPropResponseInfo:
+        case kPropServerReference:
+        case kPropReasonString:
+            value.string = props.String();
+            break;
+        case kPropUserProperty:
+            value.string = props.String();
+            value.value = props.String();
+            break;
+        default:
+            return false;
+        }
+        if (props.Failed()) {
+            return false;
+        }
+        handle(id, value);
+    }
+    return true;
+}
+
+// Reads a property block, calling `handle(id, value)` for each property.  Returns false if it is malformed.
+template <typename Handler>
+bool readProperties(Reader& reader, const Handler& handle) {
+    std::string_view block;
+    return readPropertyBlock(reader, block) && parseProperties(block, handle);
+}
+
+// Calls `handle(name, value)` for each user property in a block already known to be well formed.
+template <typename Handler>
+void forEachUserProperty(std::string_view block, const Handler& handle) {
+    parseProperties(block, [&](std::uint8_t id, const PropertyValue& value) {
+        if (id == kPropUserProperty) {
+            handle(value.string, value.value);
+        }
+    });
+}
+
+template <typename Sink>
+void putPublishBody(Sink& sink, const Message& message, std::uint16_t packetId) {
+    putString(sink, message.topic);
+    if (message.qos > 0) {
+        putU16(sink, packetId);
+    }
+    putProperties(sink, [&](auto& props) { putMessageProperties(props, message); });
+    sink.Bytes(message.payload.data(), message.payload.size());
+}
+
+} // namespace
+
+Message PublishView::ToMessage() const {
+    Message message("", "");
+    ToMessage(message);
+    return message;
+}
+
+void PublishView::ToMessage(Message& out) const {
+    out.Recycle();
+    out.topic.assign(topic.data(), topic.size());
+    out.payload.assign(payload.data(), payload.size());
+    out.qos = qos;
+    out.retain = retain;
+    Properties& props = out.properties;
+    if (correlationData) {
+        props.SetCorrelationData(
+            PropertyBytes(reinterpret_cast<const std::byte*>(correlationData->data()), correlationData->size()));
+    }
+    if (responseTopic) {
+        props.SetResponseTopic(*responseTopic);
+    }
+    props.SetSubscriptionId(subscriptionId);
+    props.SetMessageExpiryInterval(messageExpiryInterval);
+    if (contentType) {
+        props.SetContentType(*contentType);
+    }
+    if (debugInfo) {
+        props.SetDebugInfo(*debugInfo);
+    }
+    if (returnCode) {
+        props.SetReturnCode(parseUserPropertyInt(*returnCode));
+    }
+    if (propertyVersion) {
+        props.SetPropertyVersion(parseUserPropertyInt(*propertyVersion));
+    }
+    if (version) {
+        props.SetVersion(*version);
+    }
+    if (otherUserProperties) {
+        forEachUserProperty(propertyBlock, [&](std::string_view name, std::string_view value) {
+            if (userPropertyFromName(name) == UserProperty::Unknown && name != std::string_view(kOriginTagProperty)) {
+                try {
+                    props.AddUserProperty(name, value);
+                } catch (const std::length_error&) {
+                    // More than Properties can hold; keep the rest of the message.
+                }
+            }
+        });
+    }
+}
+
+std::optional<std::string_view> PublishView::FindUserProperty(std::string_view name) const {
+    std::optional<std::string_view> found;
+    forEachUserProperty(propertyBlock, [&](std::string_view entryName, std::string_view value) {
+        if (!found && entryName == name) {
+            found = value;
+        }
+    });
+    return found;
+}
+
+void encodeConnect(std::string& out, const std::string& clientId, const ConnectOptions& options, bool cleanStart,
+                   const Message* will) {
+    std::uint8_t flags = cleanStart ? 0x02 : 0x00;
+    if (will) {
+        flags |= 0x04 | static_cast<std::uint8_t>((will->qos & 0x03) << 3) | (will->retain ? 0x20 : 0x00);
+    }
+    emitPacket(out, 0x10, [&](auto& sink) {
+        putString(sink, "MQTT");
+        sink.Byte(5);
+        sink.Byte(flags);
+        putU16(sink, static_cast<std::uint16_t>(options.keepAliveSeconds));
+        putProperties(sink, [&](auto& props) {
+            if (options.sessionExpiryInterval) {
+                props.Byte(kPropSessionExpiry);
+                putU32(props, *options.sessionExpiryInterval);
+            }
+            if (options.receiveMaximum) {
+                props.Byte(kPropReceiveMaximum);
+                putU16(props, *options.receiveMaximum);
+            }
+            if (options.maximumPacketSize) {
+                props.Byte(kPropMaximumPacketSize);
+                putU32(props, *options.maximumPacketSize);
+            }
+        });
+        putString(sink, clientId);
+        if (will) {
+            putProperties(sink, [&](auto& props) {
+                putMessageProperties<MessageSchema<MessageKind::Generic>::kProperties>(props, will->properties);
+            });
+            putString(sink, will->topic);
+            putString(sink, will->payload);
+        }
+    });
+}
+
+void encodePublish(std::string& out, const Message& message, std::uint16_t packetId, bool dup) {
+    std::uint8_t firstByte = 0x30 | static_cast<std::uint8_t>((message.qos & 0x03) << 1);
+    if (dup) {
+        firstByte |= 0x08;
+    }
+    if (message.retain) {
+        firstByte |= 0x01;
+    }
+    emitPacket(out, firstByte, [&](auto& sink) { putPublishBody(sink, message, packetId); });
+}
+
+std::size_t publishPacketSize(const Message& message) {
+    SizeSink body;
+    putPublishBody(body, message, 0);
+    SizeSink header;
+    header.Byte(0);
+    putVarint(header, body.Size());
+    return header.Size() + body.Size();
+}
+
+void encodeSubscribe(std::string& out, std::uint16_t packetId, const std::vector<std::string_view>& topics, int qos,
+                     int subscriptionId) {
+    emitPacket(out, 0x82, [&](auto& sink) {
+        putU16(sink, packetId);
+        putProperties(sink, [&](auto& props) {
+            if (subscriptionId > 0) {
+                props.Byte(kPropSubscriptionId);
+                putVarint(props, static_cast<std::size_t>(subscriptionId));
+            }
+        });
+        for (std::string_view topic : topics) {
+            putString(sink, topic);
+            std::uint8_t options = static_cast<std::uint8_t>(qos & 0x03);
+            // MQTT v5 forbids the No Local option on shared subscriptions.
+            if (!isSharedSubscription(topic)) {
+                options |= kSubscribeNoLocal;
+            }
+            sink.Byte(options);
+        }
+    });
+}
+
+void encodeUnsubscribe(std::string& out, std::uint16_t packetId, const std::vector<std::string_view>& topics) {
+    emitPacket(out, 0xA2, [&](auto& sink) {
+        putU16(sink, packetId);
+        putVarint(sink, 0);
+        for (std::string_view topic : topics) {
+            putString(sink, topic);
+        }
+    });
+}
+
+void encodeAck(std::string& out, PacketType type, std::uint16_t packetId, std::uint8_t reasonCode) {
+    // PUBREL is the only acknowledgement whose fixed header flags are not zero.
+    std::uint8_t firstByte = static_cast<std::uint8_t>(static_cast<std::uint8_t>(type) << 4);
+    if (type == PacketType::Pubrel) {
+        firstByte |= 0x02;
+    }
+    emitPacket(out, firstByte, [&](auto& sink) {
+        putU16(sink, packetId);
+        // A success reason code with no properties may be omitted.
+        if (reasonCode != 0) {
+            sink.Byte(reasonCode);
+        }
+    });
+}
+
+void encodePingreq(std::string& out) {
+    out.push_back(static_cast<char>(0xC0));
+    out.push_back(0);
+}
+
+void encodeDisconnect(std::string& out, std::uint8_t reasonCode) {
+    emitPacket(out, 0xE0, [&](auto& sink) {
+        if (reasonCode != 0) {
+            sink.Byte(reasonCode);
+        }
+    });
+}
+
+DecodeStatus decodeFixedHeader(std::string_view data, FixedHeader& header) {
+    if (data.empty()) {
+        return DecodeStatus::Incomplete;
+    }
+    std::uint8_t first = static_cast<std::uint8_t>(data[0]);
+    if ((first >> 4) == 0) {
+        return DecodeStatus::Malformed;
+    }
+    std::size_t length = 0;
+    for (std::size_t i = 1; i <= 4; ++i) {
+        if (i >= data.size()) {
+            return DecodeStatus::Incomplete;
+        }
+        std::uint8_t byte = static_cast<std::uint8_t>(data[i]);
+        length |= static_cast<std::size_t>(byte & 0x7F) << (7 * (i - 1));
+        if (!(byte & 0x80)) {
+            header.type = static_cast<PacketType>(first >> 4);
+            header.flags = first & 0x0F;
+            header.headerSize = i + 1;
+            header.remainingLength = length;
+            return DecodeStatus::Complete;
+        }
+    }
+    return DecodeStatus::Malformed;
+}
+
+bool decodePublish(std::uint8_t flags, std::string_view body, PublishView& out) {
+    out = PublishView();
+    out.qos = (flags >> 1) & 0x03;
+    out.retain = flags & 0x01;
+    out.dup = flags & 0x08;
+    if (out.qos > 2) {
+        return false;
+    }
+    Reader reader(body);
+    out.topic = reader.String();
+    if (out.qos > 0) {
+        out.packetId = reader.U16();
+    }
+    bool ok = readPropertyBlock(reader, out.propertyBlock);
+    ok = ok && parseProperties(out.propertyBlock, [&](std::uint8_t id, const PropertyValue& value) {
+        switch (id) {
+        case kPropMessageExpiry:
+            out.messageExpiryInterval = value.integer;
+            break;
+        case kPropContentType:
+            out.contentType = value.string;
+            break;
+        case kPropResponseTopic:
+            out.responseTopic = value.string;
+            break;
+        case kPropCorrelationData:
+            out.correlationData = value.string;
+            break;
+        case kPropSubscriptionId:
+            if (!out.subscriptionId) {
+                out.subscriptionId = value.integer;
+            }
+            break;
+        case kPropUserProperty:
+            switch (userPropertyFromName(value.string)) {
+            case UserProperty::DebugInfo:
+                out.debugInfo = value.value;
+                break;
+            case UserProperty::ReturnCode:
+                out.returnCode = value.value;
+                break;
+            case UserProperty::PropertyVersion:
+                out.propertyVersion = value.value;
+                break;
+            case UserProperty::Version:
+                out.version = value.value;
+                break;
+            default:
+                out.otherUserProperties = true;
+                break;
+            }
+            break;
+        default:
+            break;
+        }
+    });
+    out.payload = reader.Rest();
+    return ok && !reader.Failed();
+}
+
+bool decodeConnack(std::string_view body, ConnackView& out) {
+    out = ConnackView();
+    Reader reader(body);
+    out.sessionPresent = reader.Byte() & 0x01;
+    out.reasonCode = reader.Byte();
+    if (reader.Failed()) {
+        return false;
+    }
+    if (reader.AtEnd()) {
+        return true;
+    }
+    bool ok = readProperties(reader, [&](std::uint8_t id, const PropertyValue& value) {
+        switch (id) {
+        case kPropReceiveMaximum:
+            out.receiveMaximum = static_cast<std::uint16_t>(value.integer);
+            break;
+        case kPropServerKeepAlive:
+            out.serverKeepAlive = static_cast<std::uint16_t>(value.integer);
+            break;
+        case kPropSharedSubAvailable:
+            out.sharedSubscriptionAvailable = value.integer != 0;
+            break;
+        case kPropReasonString:
+            out.reasonString = value.string;
+            break;
+        default:
+            break;
+        }
+    });
+    return ok && !reader.Failed();
+}
+
+bool decodeAck(PacketType type, std::string_view body, AckView& out) {
+    out = AckView();
+    Reader reader(body);
+    out.packetId = reader.U16();
+    if (reader.Failed()) {
+        return false;
+    }
+    bool multiple = type == PacketType::Suback || type == PacketType::Unsuback;
+    if (!multiple) {
+        // Publish acknowledgements may end after the packet ID (success) or after the reason code.
+        if (!reader.AtEnd()) {
+            out.reasonCodes = reader.Bytes(1);
+            if (!reader.AtEnd() && !readProperties(reader, [](std::uint8_t, const PropertyValue&) {})) {
+                return false;
+            }
+        }
+        return !reader.Failed();
+    }
+    if (!readProperties(reader, [](std::uint8_t, const PropertyValue&) {})) {
+        return false;
+    }
+    out.reasonCodes = reader.Rest();
+    return !reader.Failed() && !out.reasonCodes.empty();
+}
+
+bool decodeDisconnect(std::string_view body, std::uint8_t& reasonCode) {
+    reasonCode = 0;
+    if (body.empty()) {
+        return true;
+    }
+    Reader reader(body);
+    reasonCode = reader.Byte();
+    if (!reader.AtEnd() && !readProperties(reader, [](std::uint8_t, const PropertyValue&) {})) {
+        return false;
+    }
+    return !reader.Failed();
+}
+
+} // namespace mqtt
+} // namespace stinger
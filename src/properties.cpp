@@ -0,0 +1,319 @@
+#include "stinger/mqtt/properties.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace stinger {
+namespace mqtt {
+
+bool operator==(const PropertyBytes& a, const PropertyBytes& b) {
+    return a.size() == b.size() && (a.size() == 0 || memcmp(a.data(), b.data(), a.size()) == 0);
+}
+
+namespace detail {
+
+PropertyStorage::PropertyStorage(const PropertyStorage& other) : PropertyStorage() {
+    *this = other;
+}
+
+PropertyStorage::PropertyStorage(PropertyStorage&& other) noexcept : PropertyStorage() {
+    *this = std::move(other);
+}
+
+PropertyStorage& PropertyStorage::operator=(const PropertyStorage& other) {
+    if (this == &other) {
+        return *this;
+    }
+    std::size_t used = other.Used();
+    if (used > Capacity()) {
+        // Nothing needs keeping, so allocate before touching any state in case it throws.
+        char* arena = new char[used];
+        if (heapCapacity) {
+            delete[] heap;
+        }
+        heap = arena;
+        heapCapacity = static_cast<std::uint32_t>(used);
+    }
+    memcpy(Arena(), other.Arena(), used);
+    memcpy(scalars, other.scalars, sizeof(scalars));
+    memcpy(lengths, other.lengths, sizeof(lengths));
+    present = other.present;
+    return *this;
+}
+
+PropertyStorage& PropertyStorage::operator=(PropertyStorage&& other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+    if (!other.heapCapacity) {
+        // Inline values are copied; there is nothing to steal.
+        memcpy(Arena(), other.inlineBuffer, other.Used());
+    } else {
+        if (heapCapacity) {
+            delete[] heap;
+        }
+        heap = other.heap;
+        heapCapacity = other.heapCapacity;
+        other.heapCapacity = 0;
+    }
+    memcpy(scalars, other.scalars, sizeof(scalars));
+    memcpy(lengths, other.lengths, sizeof(lengths));
+    present = other.present;
+    memset(other.lengths, 0, sizeof(other.lengths));
+    other.present = 0;
+    return *this;
+}
+
+PropertyStorage::~PropertyStorage() {
+    if (heapCapacity) {
+        delete[] heap;
+    }
+}
+
+void PropertyStorage::SetVariable(PropertyField field, const char* data, std::size_t size) {
+    if (size > UINT16_MAX) {
+        throw std::length_error("MQTT string and binary properties are limited to 65535 bytes");
+    }
+    std::size_t index = VariableIndex(field);
+    std::size_t offset = Offset(index);
+    std::size_t oldSize = Has(field) ? lengths[index] + 1u : 0;
+    std::size_t newSize = size + 1;
+    std::size_t used = Used();
+    std::size_t tail = used - offset - oldSize;
+
+    // The value may be a view of this arena, e.g. `props.SetDebugInfo(props.GetContentType())`.
+    std::string copy;
+    if (size > 0 && data >= Arena() && data < Arena() + used) {
+        copy.assign(data, size);
+        data = copy.data();
+    }
+
+    if (used - oldSize + newSize > Capacity()) {
+        Grow(std::max(used - oldSize + newSize, 2 * Capacity()));
+    }
+    char* arena = Arena();
+    memmove(arena + offset + newSize, arena + offset + oldSize, tail);
+    if (size > 0) {
+        memcpy(arena + offset, data, size);
+    }
+    arena[offset + size] = '\0';
+    lengths[index] = static_cast<std::uint16_t>(size);
+    present |= Bit(field);
+}
+
+char* PropertyStorage::Splice(PropertyField field, std::size_t position, std::size_t removeSize,
+                             std::size_t insertSize) {
+    std::size_t index = VariableIndex(field);
+    std::size_t length = Has(field) ? lengths[index] : 0;
+    if (length - removeSize + insertSize > UINT16_MAX) {
+        throw std::length_error("MQTT string and binary properties are limited to 65535 bytes");
+    }
+    if (!Has(field)) {
+        SetVariable(field, nullptr, 0);
+    }
+    std::size_t start = Offset(index) + position;
+    std::size_t used = Used();
+    if (used - removeSize + insertSize > Capacity()) {
+        Grow(std::max(used - removeSize + insertSize, 2 * Capacity()));
+    }
+    char* arena = Arena();
+    memmove(arena + start + insertSize, arena + start + removeSize, used - start - removeSize);
+    lengths[index] = static_cast<std::uint16_t>(length - removeSize + insertSize);
+    return arena + start;
+}
+
+void PropertyStorage::Reset(PropertyField field) {
+    if (!Has(field)) {
+        return;
+    }
+    switch (field) {
+    case PropertyField::SubscriptionId:
+    case PropertyField::MessageExpiryInterval:
+    case PropertyField::ReturnCode:
+    case PropertyField::PropertyVersion:
+        scalars[ScalarIndex(field)] = 0;
+        break;
+    default: {
+        std::size_t index = VariableIndex(field);
+        std::size_t offset = Offset(index);
+        std::size_t size = lengths[index] + 1u;
+        char* arena = Arena();
+        memmove(arena + offset, arena + offset + size, Used() - offset - size);
+        lengths[index] = 0;
+        break;
+    }
+    }
+    present &= static_cast<std::uint16_t>(~Bit(field));
+}
+
+void PropertyStorage::ShrinkToFit() {
+    std::size_t used = Used();
+    if (!heapCapacity || used == heapCapacity) {
+        return;
+    }
+    char* old = heap;
+    if (used <= kInlineCapacity) {
+        // `heap` shares its storage with inlineBuffer, which is why the pointer was saved first.
+        heapCapacity = 0;
+        memcpy(inlineBuffer, old, used);
+    } else {
+        heap = new char[used];
+        memcpy(heap, old, used);
+        heapCapacity = static_cast<std::uint32_t>(used);
+    }
+    delete[] old;
+}
+
+void PropertyStorage::Grow(std::size_t capacity) {
+    char* arena = new char[capacity];
+    memcpy(arena, Arena(), Used());
+    if (heapCapacity) {
+        delete[] heap;
+    }
+    heap = arena;
+    heapCapacity = static_cast<std::uint32_t>(capacity);
+}
+
+} // namespace detail
+
+namespace {
+
+constexpr PropertyField kUserProperties = PropertyField::UserProperties;
+
+char* putPacked(char* out, std::string_view value) {
+    auto length = static_cast<std::uint16_t>(value.size());
+    memcpy(out, &length, sizeof(length));
+    out += sizeof(length);
+    if (!value.empty()) {
+        memcpy(out, value.data(), value.size());
+    }
+    out[value.size()] = '\0';
+    return out + value.size() + 1;
+}
+
+// `value`, or a copy of it in `copy` if it views the arena, which the next change may move.
+std::string_view unaliased(const detail::PropertyStorage& storage, std::string_view value, std::string& copy) {
+    if (!value.empty() && value.data() >= storage.Arena() && value.data() < storage.Arena() + storage.Used()) {
+        copy.assign(value.data(), value.size());
+        return copy;
+    }
+    return value;
+}
+
+} // namespace
+
+std::optional<PropertyString> UserProperties::Find(std::string_view name) const {
+    for (const UserPropertyEntry& entry : *this) {
+        if (entry.name == name) {
+            return entry.value;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<PropertyBytes> Properties::GetCorrelationData() const {
+    if (!Has(PropertyField::CorrelationData)) {
+        return std::nullopt;
+    }
+    std::string_view value = _storage.Variable(PropertyField::CorrelationData);
+    return PropertyBytes(reinterpret_cast<const std::byte*>(value.data()), value.size());
+}
+
+std::optional<utils::CorrelationId> Properties::GetCorrelationId() const {
+    if (!Has(PropertyField::CorrelationData)) {
+        return std::nullopt;
+    }
+    std::string_view value = _storage.Variable(PropertyField::CorrelationData);
+    return utils::CorrelationId::FromBytes(value.data(), value.size());
+}
+
+void Properties::SetCorrelationData(std::optional<PropertyBytes> value) {
+    if (value) {
+        _storage.SetVariable(PropertyField::CorrelationData, reinterpret_cast<const char*>(value->data()),
+                             value->size());
+    } else {
+        _storage.Reset(PropertyField::CorrelationData);
+    }
+}
+
+UserProperties Properties::GetUserProperties() const {
+    return UserProperties(_storage.Variable(kUserProperties));
+}
+
+void Properties::SetUserProperties(const UserProperties& entries) {
+    if (entries.Empty()) {
+        _storage.Reset(kUserProperties);
+    } else {
+        _storage.SetVariable(kUserProperties, entries.Packed().data(), entries.Packed().size());
+    }
+}
+
+void Properties::InsertUserProperty(std::size_t position, std::size_t removeSize, std::string_view name,
+                                    std::string_view value) {
+    if (name.size() > UINT16_MAX || value.size() > UINT16_MAX) {
+        throw std::length_error("MQTT user property names and values are limited to 65535 bytes");
+    }
+    std::string nameCopy;
+    std::string valueCopy;
+    name = unaliased(_storage, name, nameCopy);
+    value = unaliased(_storage, value, valueCopy);
+    char* out = _storage.Splice(kUserProperties, position, removeSize,
+                                name.size() + value.size() + detail::kUserPropertyOverhead);
+    putPacked(putPacked(out, name), value);
+}
+
+std::size_t Properties::EraseUserPropertiesFrom(std::string_view name, std::size_t from) {
+    if (!Has(kUserProperties)) {
+        return 0;
+    }
+    std::size_t erased = 0;
+    std::string_view packed = _storage.Variable(kUserProperties);
+    std::size_t position = from;
+    while (position < packed.size()) {
+        UserPropertyIterator entry(packed.data() + position);
+        auto size = static_cast<std::size_t>(std::next(entry).Position() - entry.Position());
+        if (entry->name == name) {
+            // Removing never grows the arena, so `packed` only needs its new length.
+            _storage.Splice(kUserProperties, position, size, 0);
+            packed = _storage.Variable(kUserProperties);
+            ++erased;
+        } else {
+            position += size;
+        }
+    }
+    if (packed.empty()) {
+        _storage.Reset(kUserProperties);
+    }
+    return erased;
+}
+
+void Properties::AddUserProperty(std::string_view name, std::string_view value) {
+    InsertUserProperty(_storage.Variable(kUserProperties).size(), 0, name, value);
+}
+
+void Properties::SetUserProperty(std::string_view name, std::string_view value) {
+    std::string nameCopy;
+    std::string valueCopy;
+    name = unaliased(_storage, name, nameCopy);
+    value = unaliased(_storage, value, valueCopy);
+    UserProperties entries = GetUserProperties();
+    for (auto entry = entries.begin(); entry != entries.end(); ++entry) {
+        if (entry->name == name) {
+            auto position = static_cast<std::size_t>(entry.Position() - entries.Packed().data());
+            auto size = static_cast<std::size_t>(std::next(entry).Position() - entry.Position());
+            // Later duplicates go first, which leaves this entry where it is.
+            EraseUserPropertiesFrom(name, position + size);
+            InsertUserProperty(position, size, name, value);
+            return;
+        }
+    }
+    AddUserProperty(name, value);
+}
+
+std::size_t Properties::EraseUserProperty(std::string_view name) {
+    std::string copy;
+    return EraseUserPropertiesFrom(unaliased(_storage, name, copy), 0);
+}
+
+} // namespace mqtt
+} // namespace stinger
@@ -0,0 +1,922 @@
+#include "stinger/utils/sharedmemoryconnection.hpp"
+#include "stinger/mqtt/topic.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdarg>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <syslog.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace stinger {
+namespace utils {
+
+namespace {
+
+const std::uint32_t kSegmentMagic = 0x53544753; // "STGS"
+const std::uint32_t kSegmentVersion = 3;
+const std::uint32_t kSegmentReady = 1;
+const std::size_t kMaxClients = 64;
+const std::size_t kMaxSubscriptions = 1024;
+const std::size_t kMaxTopicLength = 256;
+const std::size_t kMaxClientIdLength = 64;
+const std::size_t kInboxCells = 128; // Power of two.
+const std::size_t kCellSize = 4096;
+const std::chrono::seconds kOpenTimeout(1);
+const std::chrono::seconds kReclaimInterval(1);
+const long kReceiveWaitNanoseconds = 100 * 1000 * 1000;
+// How long the receiver waits on a reserved or claimed inbox cell before checking whether its producer is still alive.
+const std::chrono::milliseconds kStaleCheckDelay(100);
+
+// Bits of the presence word at the start of a serialized message.
+const std::uint16_t kHasCorrelationData = 1 << 0;
+const std::uint16_t kHasResponseTopic = 1 << 1;
+const std::uint16_t kHasMessageExpiryInterval = 1 << 2;
+const std::uint16_t kHasContentType = 1 << 3;
+const std::uint16_t kHasDebugInfo = 1 << 4;
+const std::uint16_t kHasReturnCode = 1 << 5;
+const std::uint16_t kHasPropertyVersion = 1 << 6;
+const std::uint16_t kHasVersion = 1 << 7;
+const std::uint16_t kHasUserProperties = 1 << 8; // Written last, so older readers just skip them.
+
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex words must be plain 32-bit words");
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared memory atomics must be lock-free");
+
+struct ClientSlot {
+    std::atomic<std::uint32_t> pid;        // 0 while the slot is free.
+    std::atomic<std::uint32_t> generation; // Bumped whenever the slot is claimed; older inbox cells are dropped.
+    std::atomic<std::uint32_t> wakeSeq;    // Futex word, bumped after every enqueue.
+    std::atomic<std::uint32_t> sleeping;   // Set while the owner waits on wakeSeq.
+    char clientId[kMaxClientIdLength];
+    alignas(64) std::atomic<std::uint64_t> enqueuePos;
+    alignas(64) std::atomic<std::uint64_t> dequeuePos; // Only written by the owner.
+};
+
+// Written under the segment lock, read without it.  `seq` is odd while an entry is being written.
+struct SubscriptionEntry {
+    std::atomic<std::uint32_t> seq;
+    std::uint32_t active;
+    std::uint32_t slot;
+    std::uint32_t generation;
+    std::int32_t subscriptionId;
+    std::int32_t qos;
+    std::uint32_t topicLength;
+    char topic[kMaxTopicLength];
+};
+
+// One slot of a bounded multi-producer inbox ring (Vyukov's queue).  `sequence` equals the enqueue position when the
+// cell is free, and that position plus one once its message is published.  It is stored minus the cell's index, so a
+// zero-filled segment holds empty rings without touching every page.
+//
+// A message larger than one cell takes several consecutive cells, reserved with one step of the enqueue position.
+// The producer publishes the first cell last, so the receiver finds the whole message once it sees the first; a later
+// cell seen on its own was left by a producer that stopped part way, and is skipped.
+//
+// Before a producer moves the enqueue position, it claims the first cell by setting `producer` from 0 to its PID, and
+// then records its PID in the other cells.  Every reserved cell therefore names its producer, and the receiver only
+// revokes the reservations of processes that have exited.
+struct Cell {
+    std::atomic<std::uint64_t> sequence;
+    std::atomic<std::uint32_t> producer; // PID of the process claiming or filling the cell; 0 while it is free.
+    std::uint32_t generation;
+    std::int32_t subscriptionId;
+    std::uint32_t length;    // In the first cell of a message: the length of the whole message.
+    std::uint32_t cellCount; // In the first cell of a message: the cells it spans.  0 in the others.
+    char data[kCellSize - 28];
+};
+
+static_assert(sizeof(Cell) == kCellSize, "inbox cells should fill whole pages");
+
+struct EntrySnapshot {
+    std::uint32_t slot;
+    std::uint32_t generation;
+    std::int32_t subscriptionId;
+    std::uint32_t topicLength;
+    char topic[kMaxTopicLength];
+};
+
+// The ring position that a cell's `sequence` encodes; see Cell.
+std::uint64_t sequenceOf(const Cell& cell, std::uint64_t pos) {
+    return cell.sequence.load(std::memory_order_acquire) + (pos & (kInboxCells - 1));
+}
+
+// The value of `sequence` that marks the cell at ring position `pos` as free for that position.
+std::uint64_t freeSequence(std::uint64_t pos) {
+    return pos - (pos & (kInboxCells - 1));
+}
+
+// EPERM means the process exists but belongs to someone else.
+bool processExists(std::uint32_t pid) {
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+}
+
+void futexWait(std::atomic<std::uint32_t>* word, std::uint32_t expected) {
+    timespec timeout = {0, kReceiveWaitNanoseconds};
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAIT, expected, &timeout, NULL, 0);
+}
+
+void futexWake(std::atomic<std::uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+void beginWrite(SubscriptionEntry& entry) {
+    entry.seq.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void endWrite(SubscriptionEntry& entry) {
+    entry.seq.fetch_add(1, std::memory_order_release);
+}
+
+// Takes a consistent copy of an entry.  Returns false if it is not active.
+bool readEntry(const SubscriptionEntry& entry, EntrySnapshot& snapshot) {
+    while (true) {
+        std::uint32_t before = entry.seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        bool active = entry.active != 0;
+        snapshot.slot = entry.slot;
+        snapshot.generation = entry.generation;
+        snapshot.subscriptionId = entry.subscriptionId;
+        snapshot.topicLength = std::min<std::uint32_t>(entry.topicLength, kMaxTopicLength);
+        if (active) {
+            memcpy(snapshot.topic, entry.topic, snapshot.topicLength);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.seq.load(std::memory_order_relaxed) == before) {
+            return active;
+        }
+    }
+}
+
+// Locks the process-shared segment mutex.  It is robust, so a process that dies while holding it does not wedge the
+// others; every table update leaves the tables usable if it is cut short.
+class SegmentLock {
+public:
+    explicit SegmentLock(pthread_mutex_t* mutex) : _mutex(mutex) {
+        if (pthread_mutex_lock(_mutex) == EOWNERDEAD) {
+            pthread_mutex_consistent(_mutex);
+        }
+    }
+    ~SegmentLock() { pthread_mutex_unlock(_mutex); }
+
+private:
+    pthread_mutex_t* _mutex;
+};
+
+class Writer {
+public:
+    explicit Writer(std::string& out) : _out(out) {}
+    template <typename T> void Value(T value) { _out.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void Bytes(const void* data, std::size_t size) {
+        Value(static_cast<std::uint32_t>(size));
+        _out.append(static_cast<const char*>(data), size);
+    }
+    void String(std::string_view str) { Bytes(str.data(), str.size()); }
+
+private:
+    std::string& _out;
+};
+
+class Reader {
+public:
+    Reader(const char* data, std::size_t size) : _data(data), _size(size) {}
+    template <typename T> T Value() {
+        T value{};
+        if (Take(sizeof(T))) {
+            memcpy(&value, _data + _pos - sizeof(T), sizeof(T));
+        }
+        return value;
+    }
+    // Points into the buffer being read.
+    std::string_view View() {
+        std::uint32_t size = Value<std::uint32_t>();
+        if (!Take(size)) {
+            return std::string_view();
+        }
+        return std::string_view(_data + _pos - size, size);
+    }
+    bool Ok() const { return _ok; }
+
+private:
+    bool Take(std::size_t size) {
+        if (!_ok || _size - _pos < size) {
+            _ok = false;
+            return false;
+        }
+        _pos += size;
+        return true;
+    }
+
+    const char* _data;
+    std::size_t _size;
+    std::size_t _pos = 0;
+    bool _ok = true;
+};
+
+std::string encodeMessage(const mqtt::Message& message) {
+    const mqtt::Properties& props = message.properties;
+    std::uint16_t presence = 0;
+    presence |= props.Has(mqtt::PropertyField::CorrelationData) ? kHasCorrelationData : 0;
+    presence |= props.Has(mqtt::PropertyField::ResponseTopic) ? kHasResponseTopic : 0;
+    presence |= props.Has(mqtt::PropertyField::MessageExpiryInterval) ? kHasMessageExpiryInterval : 0;
+    presence |= props.Has(mqtt::PropertyField::ContentType) ? kHasContentType : 0;
+    presence |= props.Has(mqtt::PropertyField::DebugInfo) ? kHasDebugInfo : 0;
+    presence |= props.Has(mqtt::PropertyField::ReturnCode) ? kHasReturnCode : 0;
+    presence |= props.Has(mqtt::PropertyField::PropertyVersion) ? kHasPropertyVersion : 0;
+    presence |= props.Has(mqtt::PropertyField::Version) ? kHasVersion : 0;
+    presence |= props.Has(mqtt::PropertyField::UserProperties) ? kHasUserProperties : 0;
+
+    std::string out;
+    out.reserve(16 + message.topic.size() + message.payload.size());
+    Writer writer(out);
+    writer.Value(static_cast<std::uint8_t>(message.qos));
+    writer.Value(static_cast<std::uint8_t>(message.retain));
+    writer.Value(presence);
+    writer.String(message.topic);
+    writer.String(message.payload);
+    if (auto correlationData = props.GetCorrelationData()) {
+        writer.Bytes(correlationData->data(), correlationData->size());
+    }
+    if (auto responseTopic = props.GetResponseTopic()) {
+        writer.String(*responseTopic);
+    }
+    if (auto messageExpiryInterval = props.GetMessageExpiryInterval()) {
+        writer.Value(static_cast<std::uint32_t>(*messageExpiryInterval));
+    }
+    if (auto contentType = props.GetContentType()) {
+        writer.String(*contentType);
+    }
+    if (auto debugInfo = props.GetDebugInfo()) {
+        writer.String(*debugInfo);
+    }
+    if (auto returnCode = props.GetReturnCode()) {
+        writer.Value(static_cast<std::int32_t>(*returnCode));
+    }
+    if (auto propertyVersion = props.GetPropertyVersion()) {
+        writer.Value(static_cast<std::int32_t>(*propertyVersion));
+    }
+    if (auto version = props.GetVersion()) {
+        writer.String(*version);
+    }
+    if (presence & kHasUserProperties) {
+        mqtt::UserProperties userProperties = props.GetUserProperties();
+        writer.Value(static_cast<std::uint32_t>(userProperties.Size()));
+        for (const mqtt::UserPropertyEntry& entry : userProperties) {
+            writer.String(entry.name);
+            writer.String(entry.value);
+        }
+    }
+    return out;
+}
+
+// Decodes into `out`, reusing its buffers.  Returns false if the data is malformed.
+bool decodeMessage(const char* data, std::size_t size, mqtt::Message& out) {
+    Reader reader(data, size);
+    out.Recycle();
+    out.qos = reader.Value<std::uint8_t>();
+    out.retain = reader.Value<std::uint8_t>() != 0;
+    std::uint16_t presence = reader.Value<std::uint16_t>();
+    std::string_view topic = reader.View();
+    out.topic.assign(topic.data(), topic.size());
+    std::string_view payload = reader.View();
+    out.payload.assign(payload.data(), payload.size());
+    mqtt::Properties& props = out.properties;
+    if (presence & kHasCorrelationData) {
+        std::string_view bytes = reader.View();
+        props.SetCorrelationData(
+            mqtt::PropertyBytes(reinterpret_cast<const std::byte*>(bytes.data()), bytes.size()));
+    }
+    if (presence & kHasResponseTopic) {
+        props.SetResponseTopic(reader.View());
+    }
+    if (presence & kHasMessageExpiryInterval) {
+        props.SetMessageExpiryInterval(reader.Value<std::uint32_t>());
+    }
+    if (presence & kHasContentType) {
+        props.SetContentType(reader.View());
+    }
+    if (presence & kHasDebugInfo) {
+        props.SetDebugInfo(reader.View());
+    }
+    if (presence & kHasReturnCode) {
+        props.SetReturnCode(reader.Value<std::int32_t>());
+    }
+    if (presence & kHasPropertyVersion) {
+        props.SetPropertyVersion(reader.Value<std::int32_t>());
+    }
+    if (presence & kHasVersion) {
+        props.SetVersion(reader.View());
+    }
+    if (presence & kHasUserProperties) {
+        std::uint32_t count = reader.Value<std::uint32_t>();
+        for (std::uint32_t i = 0; i < count && reader.Ok(); ++i) {
+            std::string_view name = reader.View();
+            std::string_view value = reader.View();
+            if (reader.Ok()) {
+                try {
+                    props.AddUserProperty(name, value);
+                } catch (const std::length_error&) {
+                    return false;
+                }
+            }
+        }
+    }
+    return reader.Ok();
+}
+
+std::string segmentName(const std::string& domain) {
+    return "/stinger." + domain;
+}
+
+} // namespace
+
+struct SharedMemoryConnection::Segment {
+    std::atomic<std::uint32_t> state;
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t size;
+    pthread_mutex_t lock; // Guards slot claims and subscription table writes.
+    std::atomic<std::uint32_t> subscriptionHighWater; // Entries at or above this index have never been used.
+    ClientSlot clients[kMaxClients];
+    SubscriptionEntry subscriptions[kMaxSubscriptions];
+    Cell inboxes[kMaxClients][kInboxCells];
+};
+
+SharedMemoryConnection::SharedMemoryConnection(const std::string& domain, const std::string& clientId)
+    : _clientId(clientId), _pid(static_cast<std::uint32_t>(getpid())) {
+    if (domain.empty() || domain.find('/') != std::string::npos) {
+        throw std::invalid_argument("Invalid shared memory domain: " + domain);
+    }
+    std::string name = segmentName(domain);
+
+    // Only processes of the same user may join a domain.
+    bool created = true;
+    _fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (_fd < 0 && errno == EEXIST) {
+        created = false;
+        _fd = shm_open(name.c_str(), O_RDWR, 0);
+    }
+    if (_fd < 0) {
+        throw std::runtime_error("Failed to open shared memory segment " + name + ": " + strerror(errno));
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + kOpenTimeout;
+    if (created) {
+        if (ftruncate(_fd, sizeof(Segment)) != 0) {
+            close(_fd);
+            shm_unlink(name.c_str());
+            throw std::runtime_error("Failed to size shared memory segment " + name + ": " + strerror(errno));
+        }
+    } else {
+        // The creator sizes the segment right after creating it.
+        struct stat st;
+        while (fstat(_fd, &st) == 0 && static_cast<std::size_t>(st.st_size) < sizeof(Segment)) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                close(_fd);
+                throw std::runtime_error("Shared memory segment " + name + " was never initialized");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void* addr = mmap(NULL, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (addr == MAP_FAILED) {
+        close(_fd);
+        throw std::runtime_error("Failed to map shared memory segment " + name + ": " + strerror(errno));
+    }
+    _segment = static_cast<Segment*>(addr);
+
+    if (created) {
+        // A new segment is zero-filled, which is the initial state of every atomic and table entry.
+        _segment->magic = kSegmentMagic;
+        _segment->version = kSegmentVersion;
+        _segment->size = sizeof(Segment);
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&_segment->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        _segment->state.store(kSegmentReady, std::memory_order_release);
+    } else {
+        while (_segment->state.load(std::memory_order_acquire) != kSegmentReady) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                munmap(_segment, sizeof(Segment));
+                close(_fd);
+                throw std::runtime_error("Shared memory segment " + name + " was never initialized");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (_segment->magic != kSegmentMagic || _segment->version != kSegmentVersion ||
+            _segment->size != sizeof(Segment)) {
+            munmap(_segment, sizeof(Segment));
+            close(_fd);
+            throw std::runtime_error("Shared memory segment " + name + " has an incompatible layout");
+        }
+    }
+
+    bool claimed = false;
+    {
+        SegmentLock lock(&_segment->lock);
+        ReclaimDeadClients();
+        for (std::uint32_t i = 0; i < kMaxClients && !claimed; ++i) {
+            ClientSlot& slot = _segment->clients[i];
+            if (slot.pid.load(std::memory_order_acquire) != 0) {
+                continue;
+            }
+            _slot = i;
+            _generation = slot.generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+            std::size_t idLength = std::min(clientId.size(), kMaxClientIdLength - 1);
+            memcpy(slot.clientId, clientId.data(), idLength);
+            slot.clientId[idLength] = '\0';
+            slot.pid.store(_pid, std::memory_order_release);
+            claimed = true;
+        }
+    }
+    if (!claimed) {
+        munmap(_segment, sizeof(Segment));
+        close(_fd);
+        throw std::runtime_error("No free client slot in shared memory segment " + name);
+    }
+
+    _receiveThread = std::thread(&SharedMemoryConnection::ReceiveLoop, this);
+}
+
+SharedMemoryConnection::~SharedMemoryConnection() {
+    ClientSlot& slot = _segment->clients[_slot];
+    _stopping = true;
+    slot.wakeSeq.fetch_add(1);
+    futexWake(&slot.wakeSeq);
+    _receiveThread.join();
+
+    {
+        SegmentLock lock(&_segment->lock);
+        std::uint32_t count = _segment->subscriptionHighWater.load(std::memory_order_relaxed);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            SubscriptionEntry& entry = _segment->subscriptions[i];
+            if (entry.active && entry.slot == _slot && entry.generation == _generation) {
+                beginWrite(entry);
+                entry.active = 0;
+                endWrite(entry);
+            }
+        }
+        slot.pid.store(0, std::memory_order_release);
+    }
+    munmap(_segment, sizeof(Segment));
+    close(_fd);
+}
+
+void SharedMemoryConnection::ReclaimDeadClients() {
+    for (std::uint32_t i = 0; i < kMaxClients; ++i) {
+        ClientSlot& slot = _segment->clients[i];
+        std::uint32_t pid = slot.pid.load(std::memory_order_acquire);
+        if (pid == 0 || processExists(pid)) {
+            continue;
+        }
+        Log(LOG_NOTICE, "Reclaiming shared memory slot %u of exited process %u", i, pid);
+        std::uint32_t count = _segment->subscriptionHighWater.load(std::memory_order_relaxed);
+        for (std::uint32_t j = 0; j < count; ++j) {
+            SubscriptionEntry& entry = _segment->subscriptions[j];
+            if (entry.active && entry.slot == i) {
+                beginWrite(entry);
+                entry.active = 0;
+                endWrite(entry);
+            }
+        }
+        slot.pid.store(0, std::memory_order_release);
+    }
+}
+
+bool SharedMemoryConnection::AddSharedSubscription(std::string_view topic, int subscriptionId, int qos) {
+    if (topic.size() > kMaxTopicLength) {
+        Log(LOG_ERR, "Subscription topic is longer than %zu bytes: %.*s", kMaxTopicLength,
+            static_cast<int>(topic.size()), topic.data());
+        return false;
+    }
+    SegmentLock lock(&_segment->lock);
+    for (std::uint32_t i = 0; i < kMaxSubscriptions; ++i) {
+        SubscriptionEntry& entry = _segment->subscriptions[i];
+        if (entry.active) {
+            continue;
+        }
+        beginWrite(entry);
+        entry.slot = _slot;
+        entry.generation = _generation;
+        entry.subscriptionId = subscriptionId;
+        entry.qos = qos;
+        entry.topicLength = static_cast<std::uint32_t>(topic.size());
+        memcpy(entry.topic, topic.data(), topic.size());
+        entry.active = 1;
+        endWrite(entry);
+        if (_segment->subscriptionHighWater.load(std::memory_order_relaxed) <= i) {
+            _segment->subscriptionHighWater.store(i + 1, std::memory_order_release);
+        }
+        return true;
+    }
+    Log(LOG_ERR, "Shared memory subscription table is full");
+    return false;
+}
+
+void SharedMemoryConnection::RemoveSharedSubscription(std::string_view topic) {
+    SegmentLock lock(&_segment->lock);
+    std::uint32_t count = _segment->subscriptionHighWater.load(std::memory_order_relaxed);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        SubscriptionEntry& entry = _segment->subscriptions[i];
+        if (entry.active && entry.slot == _slot && entry.generation == _generation &&
+            std::string_view(entry.topic, entry.topicLength) == topic) {
+            beginWrite(entry);
+            entry.active = 0;
+            endWrite(entry);
+            return;
+        }
+    }
+}
+
+std::future<bool> SharedMemoryConnection::Publish(const stinger::mqtt::Message& mqttMsg) {
+    std::promise<bool> result;
+    auto future = result.get_future();
+    std::string encoded = encodeMessage(mqttMsg);
+    if (encoded.size() > MaxMessageSize()) {
+        Log(LOG_ERR, "Message on %s is too large for shared memory (%zu bytes)", mqttMsg.topic.c_str(),
+            encoded.size());
+        result.set_value(false);
+        return future;
+    }
+
+    struct Recipient {
+        std::uint32_t slot;
+        std::uint32_t generation;
+        std::int32_t subscriptionId;
+    };
+    std::vector<Recipient> recipients;
+    std::vector<std::pair<std::string, std::vector<Recipient>>> sharedGroups;
+    EntrySnapshot snapshot;
+    std::uint32_t count = _segment->subscriptionHighWater.load(std::memory_order_acquire);
+    for (std::uint32_t i = 0; i < count; ++i) {
+        if (!readEntry(_segment->subscriptions[i], snapshot)) {
+            continue;
+        }
+        std::string_view subscr(snapshot.topic, snapshot.topicLength);
+        Recipient recipient = {snapshot.slot, snapshot.generation, snapshot.subscriptionId};
+        if (mqtt::isSharedSubscription(subscr)) {
+            // No Local does not apply to shared subscriptions.
+            if (!mqtt::topicMatchesFilter(mqttMsg.topic, mqtt::subscriptionFilter(subscr))) {
+                continue;
+            }
+            auto group = std::find_if(sharedGroups.begin(), sharedGroups.end(),
+                                      [&](const auto& existing) { return existing.first == subscr; });
+            if (group == sharedGroups.end()) {
+                sharedGroups.emplace_back(std::string(subscr), std::vector<Recipient>());
+                group = sharedGroups.end() - 1;
+            }
+            group->second.push_back(recipient);
+            continue;
+        }
+        if ((snapshot.slot == _slot && snapshot.generation == _generation) ||
+            !mqtt::topicMatchesFilter(mqttMsg.topic, subscr)) {
+            continue;
+        }
+        auto existing = std::find_if(recipients.begin(), recipients.end(),
+                                     [&](const Recipient& r) { return r.slot == recipient.slot; });
+        if (existing == recipients.end()) {
+            recipients.push_back(recipient);
+        } else if (recipient.subscriptionId < existing->subscriptionId) {
+            *existing = recipient;
+        }
+    }
+    for (const auto& group : sharedGroups) {
+        std::uint32_t pick = _sharedRoundRobin.fetch_add(1, std::memory_order_relaxed);
+        recipients.push_back(group.second[pick % group.second.size()]);
+    }
+
+    bool delivered = true;
+    for (const auto& recipient : recipients) {
+        ClientSlot& slot = _segment->clients[recipient.slot];
+        if (slot.generation.load(std::memory_order_acquire) != recipient.generation) {
+            continue; // The subscriber has gone; its entry is about to be reclaimed.
+        }
+        if (!Enqueue(recipient.slot, recipient.generation, recipient.subscriptionId, encoded)) {
+            Log(LOG_WARNING, "Inbox of shared memory client %s is full; dropping message on %s", slot.clientId,
+                mqttMsg.topic.c_str());
+            delivered = false;
+            continue;
+        }
+        slot.wakeSeq.fetch_add(1);
+        if (slot.sleeping.load()) {
+            futexWake(&slot.wakeSeq);
+        }
+    }
+    result.set_value(delivered);
+    return future;
+}
+
+bool SharedMemoryConnection::Enqueue(std::uint32_t slotIndex, std::uint32_t generation, std::int32_t subscriptionId,
+                                     std::string_view encoded) {
+    ClientSlot& slot = _segment->clients[slotIndex];
+    Cell* cells = _segment->inboxes[slotIndex];
+    const std::size_t cellData = sizeof(Cell::data);
+    std::uint64_t count = std::max<std::uint64_t>(1, (encoded.size() + cellData - 1) / cellData);
+
+    // Cells are freed in ring order, so when the first and last cells needed are free, so is every cell between them.
+    std::uint64_t pos;
+    while (true) {
+        pos = slot.enqueuePos.load(std::memory_order_acquire);
+        Cell& first = cells[pos & (kInboxCells - 1)];
+        std::int64_t diff = static_cast<std::int64_t>(sequenceOf(first, pos) - pos);
+        if (diff == 0) {
+            std::uint64_t last = pos + count - 1;
+            diff = static_cast<std::int64_t>(sequenceOf(cells[last & (kInboxCells - 1)], last) - last);
+        }
+        if (diff < 0) {
+            return false;
+        }
+        if (diff > 0) {
+            continue;
+        }
+        std::uint32_t unclaimed = 0;
+        if (!first.producer.compare_exchange_strong(unclaimed, _pid, std::memory_order_acq_rel)) {
+            // Another producer is between its claim and moving the enqueue position on.
+            sched_yield();
+            continue;
+        }
+        // The claim only holds if the cell is still the free one at the enqueue position; this producer may have read
+        // the position before someone else filled the cell and the receiver freed it again.
+        if (slot.enqueuePos.load(std::memory_order_acquire) == pos && sequenceOf(first, pos) == pos) {
+            break;
+        }
+        first.producer.store(0, std::memory_order_release);
+    }
+    for (std::uint64_t i = 1; i < count; ++i) {
+        cells[(pos + i) & (kInboxCells - 1)].producer.store(_pid, std::memory_order_relaxed);
+    }
+    // Other producers wait for the claim on the first cell, so only this one moves the position on from `pos`.
+    slot.enqueuePos.store(pos + count, std::memory_order_release);
+
+    for (std::uint64_t i = 0; i < count; ++i) {
+        Cell& cell = cells[(pos + i) & (kInboxCells - 1)];
+        cell.generation = generation;
+        cell.subscriptionId = subscriptionId;
+        cell.length = static_cast<std::uint32_t>(encoded.size());
+        cell.cellCount = i == 0 ? static_cast<std::uint32_t>(count) : 0;
+        std::size_t offset = i * cellData;
+        memcpy(cell.data, encoded.data() + offset, std::min(cellData, encoded.size() - offset));
+    }
+    // First cell last.  The receiver only revokes the reservations of producers that have exited, so every cell still
+    // holds the reserved sequence.
+    for (std::uint64_t i = count; i-- > 0;) {
+        cells[(pos + i) & (kInboxCells - 1)].sequence.store(freeSequence(pos + i) + 1, std::memory_order_release);
+    }
+    return true;
+}
+
+void SharedMemoryConnection::ReceiveLoop() {
+    ClientSlot& slot = _segment->clients[_slot];
+    Cell* cells = _segment->inboxes[_slot];
+    auto nextReclaim = std::chrono::steady_clock::now() + kReclaimInterval;
+    std::uint64_t stalledPos = ~std::uint64_t{0};
+    std::chrono::steady_clock::time_point stalledSince;
+    while (!_stopping) {
+        std::uint64_t pos = slot.dequeuePos.load(std::memory_order_relaxed);
+        Cell& cell = cells[pos & (kInboxCells - 1)];
+        if (sequenceOf(cell, pos) == pos + 1) {
+            std::uint64_t count = 1;
+            std::size_t length = 0;
+            if (cell.cellCount > 0 && cell.cellCount <= kInboxCells) {
+                count = cell.cellCount;
+                for (std::uint64_t i = 1; i < count; ++i) {
+                    if (sequenceOf(cells[(pos + i) & (kInboxCells - 1)], pos + i) != pos + i + 1) {
+                        count = 1; // Cannot happen with a well-behaved producer; skip just this cell.
+                        break;
+                    }
+                }
+                if (count == cell.cellCount) {
+                    length = std::min<std::size_t>(cell.length, count * sizeof(cell.data));
+                }
+            }
+
+            bool received = false;
+            // Cells addressed to a previous owner of this slot are skipped, as are stray cells.
+            if (length > 0 && cell.generation == _generation) {
+                const char* data = cell.data;
+                if (count > 1) {
+                    _assembled.clear();
+                    for (std::uint64_t i = 0; i < count; ++i) {
+                        std::size_t offset = i * sizeof(cell.data);
+                        _assembled.append(cells[(pos + i) & (kInboxCells - 1)].data,
+                                          std::min(sizeof(cell.data), length - offset));
+                    }
+                    data = _assembled.data();
+                }
+                received = decodeMessage(data, length, _received);
+                if (received) {
+                    _received.properties.SetSubscriptionId(cell.subscriptionId);
+                } else {
+                    Log(LOG_ERR, "Dropping malformed shared memory message");
+                }
+            }
+            for (std::uint64_t i = 0; i < count; ++i) {
+                Cell& freed = cells[(pos + i) & (kInboxCells - 1)];
+                freed.producer.store(0, std::memory_order_relaxed);
+                freed.sequence.store(freeSequence(pos + i) + kInboxCells, std::memory_order_release);
+            }
+            slot.dequeuePos.store(pos + count, std::memory_order_relaxed);
+            if (received) {
+                Dispatch(_received);
+            }
+            continue;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        bool reserved = slot.enqueuePos.load(std::memory_order_acquire) != pos;
+        std::uint32_t producer = cell.producer.load(std::memory_order_acquire);
+        if (producer != 0) {
+            // A producer has reserved the cell but not published it yet, or has claimed it and not yet moved the
+            // enqueue position on.  If it died in between, the inbox would stay wedged behind the cell, so revoke the
+            // reservation or drop the claim.  A live producer is never revoked, however long it takes, since it
+            // would go on to write into the cell after the ring had reused it.
+            if (stalledPos != pos) {
+                stalledPos = pos;
+                stalledSince = now;
+            }
+            if (now - stalledSince >= kStaleCheckDelay && !processExists(producer)) {
+                if (!reserved) {
+                    cell.producer.compare_exchange_strong(producer, 0, std::memory_order_acq_rel);
+                } else {
+                    Log(LOG_WARNING, "Skipping shared memory inbox cell abandoned by process %u", producer);
+                    cell.producer.store(0, std::memory_order_relaxed);
+                    cell.sequence.store(freeSequence(pos) + kInboxCells, std::memory_order_release);
+                    slot.dequeuePos.store(pos + 1, std::memory_order_relaxed);
+                    continue;
+                }
+            }
+        }
+
+        if (now >= nextReclaim) {
+            SegmentLock lock(&_segment->lock);
+            ReclaimDeadClients();
+            nextReclaim = now + kReclaimInterval;
+        }
+
+        // Announce the wait before re-checking the inbox, so a producer either sees `sleeping` or its message is
+        // seen here.
+        slot.sleeping.store(1);
+        std::uint32_t wake = slot.wakeSeq.load();
+        if (!_stopping && sequenceOf(cell, pos) != pos + 1) {
+            futexWait(&slot.wakeSeq, wake);
+        }
+        slot.sleeping.store(0);
+    }
+}
+
+void SharedMemoryConnection::Dispatch(const stinger::mqtt::Message& message) {
+    _callbacks.Invoke(message);
+}
+
+// A subscription whose shared table entry could not be added is registered with `pending` set, so that every caller
+// that takes a reference to it sees the failure and drops that reference again.
+
+int SharedMemoryConnection::Subscribe(const std::string& topic, int qos) {
+    auto sub = _subscriptions.Acquire(topic, qos, [&](std::string_view, SubscriptionRegistry::Subscription& created) {
+        created.subscriptionId = _nextSubscriptionId++;
+        created.pending = !AddSharedSubscription(topic, created.subscriptionId, qos);
+        if (!created.pending) {
+            Log(LOG_INFO, "Subscribed to %s as %d", topic.c_str(), created.subscriptionId);
+        }
+    });
+    if (sub.pending) {
+        _subscriptions.Release(topic, [](std::string_view, const SubscriptionRegistry::Subscription&) {});
+        return kSubscribeFailed;
+    }
+    if (sub.refCount > 1) {
+        Log(LOG_DEBUG, "Incremented subscription count for %s to %d", topic.c_str(), sub.refCount);
+    }
+    return sub.subscriptionId;
+}
+
+void SharedMemoryConnection::Unsubscribe(const std::string& topic) {
+    auto sub = _subscriptions.Release(topic, [&](std::string_view, const SubscriptionRegistry::Subscription&) {
+        Log(LOG_DEBUG, "Unsubscribing from %s (ref count reached 0)", topic.c_str());
+        RemoveSharedSubscription(topic);
+    });
+    if (!sub) {
+        Log(LOG_WARNING, "Attempted to unsubscribe from topic %s that was never subscribed", topic.c_str());
+    }
+}
+
+std::vector<int> SharedMemoryConnection::SubscribeMany(const std::vector<std::string>& topics, int qos) {
+    // The new topics share one subscription ID, so they succeed or fail together.
+    auto onCreate = [&](const std::vector<std::string_view>& newTopics, SubscriptionRegistry::Subscription& created) {
+        created.subscriptionId = _nextSubscriptionId++;
+        for (std::size_t i = 0; i < newTopics.size(); ++i) {
+            if (!AddSharedSubscription(newTopics[i], created.subscriptionId, qos)) {
+                while (i-- > 0) {
+                    RemoveSharedSubscription(newTopics[i]);
+                }
+                created.pending = true;
+                return;
+            }
+        }
+    };
+    auto subs = _subscriptions.AcquireMany(topics, qos, onCreate);
+
+    std::vector<int> subscriptionIds;
+    std::vector<std::string> failed;
+    subscriptionIds.reserve(subs.size());
+    for (std::size_t i = 0; i < subs.size(); ++i) {
+        if (subs[i].pending) {
+            failed.push_back(topics[i]);
+            subscriptionIds.push_back(kSubscribeFailed);
+        } else {
+            subscriptionIds.push_back(subs[i].subscriptionId);
+        }
+    }
+    if (!failed.empty()) {
+        _subscriptions.ReleaseMany(failed, [](const std::vector<SubscriptionRegistry::Entry>&) {});
+    }
+    return subscriptionIds;
+}
+
+void SharedMemoryConnection::UnsubscribeMany(const std::vector<std::string>& topics) {
+    auto subs = _subscriptions.ReleaseMany(topics, [&](const std::vector<SubscriptionRegistry::Entry>& removed) {
+        for (const auto& entry : removed) {
+            RemoveSharedSubscription(entry.first);
+        }
+    });
+    for (std::size_t i = 0; i < topics.size(); ++i) {
+        if (!subs[i]) {
+            Log(LOG_WARNING, "Attempted to unsubscribe from topic %s that was never subscribed", topics[i].c_str());
+        }
+    }
+}
+
+CallbackHandleType
+SharedMemoryConnection::AddMessageCallback(const std::function<void(const stinger::mqtt::Message&)>& cb) {
+    return _callbacks.Add(cb);
+}
+
+void SharedMemoryConnection::RemoveMessageCallback(CallbackHandleType handle) {
+    if (!_callbacks.Remove(handle)) {
+        Log(LOG_WARNING, "No message callback found with handle %d", handle);
+    }
+}
+
+bool SharedMemoryConnection::TopicMatchesSubscription(const std::string& topic, const std::string& subscr) const {
+    return mqtt::topicMatchesFilter(topic, mqtt::subscriptionFilter(subscr));
+}
+
+std::string SharedMemoryConnection::GetClientId() const {
+    return _clientId;
+}
+
+std::string SharedMemoryConnection::GetLastWillTopic() const {
+    return "client/"s + _clientId + "/online";
+}
+
+std::string SharedMemoryConnection::GetOnlinePayload() const {
+    return "{\"status\":\"online\"}"s;
+}
+
+std::string SharedMemoryConnection::GetOfflinePayload() const {
+    return "{\"status\":\"offline\"}"s;
+}
+
+void SharedMemoryConnection::SetLogFunction(const LogFunctionType& logFunc) {
+    _logger.SetFunction(logFunc);
+}
+
+void SharedMemoryConnection::SetLogLevel(int level) {
+    _logger.SetLevel(level);
+}
+
+void SharedMemoryConnection::Log(int level, const char* fmt, ...) const {
+    va_list args;
+    va_start(args, fmt);
+    _logger.Write(level, fmt, args);
+    va_end(args);
+}
+
+std::size_t SharedMemoryConnection::MaxMessageSize() {
+    return kInboxCells * sizeof(Cell::data);
+}
+
+void SharedMemoryConnection::Unlink(const std::string& domain) {
+    shm_unlink(segmentName(domain).c_str());
+}
+
+} // namespace utils
+} // namespace stinger
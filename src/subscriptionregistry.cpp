@@ -0,0 +1,504 @@
+#include "stinger/utils/subscriptionregistry.hpp"
+#include "stinger/utils/hash.hpp"
+#include "stinger/utils/topictable.hpp"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace stinger {
+namespace utils {
+
+namespace {
+
+const std::size_t kInitialSlots = 16;
+const std::size_t kCompactThresholdBytes = 4096;
+
+// A hash of 0 is reserved to mark empty slots.
+std::uint64_t SlotHash(std::uint64_t hash) {
+    return hash == 0 ? 1 : hash;
+}
+
+// FNV-1a, the same hash TopicTable precomputes.
+std::uint64_t HashTopic(std::string_view topic) {
+    return SlotHash(hashString(topic));
+}
+
+bool IsPattern(std::string_view topic) {
+    return topic.find_first_of("+#") != std::string_view::npos || topic.substr(0, 7) == "$share/";
+}
+
+struct Slot {
+    std::uint64_t hash = 0;
+    std::uint32_t topicOffset = 0;
+    std::uint32_t topicLength = 0;
+    SubscriptionRegistry::Subscription sub;
+};
+
+} // namespace
+
+struct SubscriptionRegistry::Shard {
+    mutable std::mutex mutex;
+    std::vector<Slot> slots; // Power-of-two sized, linear probing.
+    std::size_t count = 0;
+    std::vector<char> topics; // Interned topic bytes; slots refer to them by offset.
+    std::size_t deadTopicBytes = 0;
+
+    std::string_view TopicAt(const Slot& slot) const {
+        return std::string_view(topics.data() + slot.topicOffset, slot.topicLength);
+    }
+
+    // Returns the index of the slot holding `topic`, or the empty slot where it would be inserted.
+    std::size_t Probe(std::string_view topic, std::uint64_t hash) const {
+        std::size_t mask = slots.size() - 1;
+        std::size_t i = hash & mask;
+        while (slots[i].hash != 0) {
+            if (slots[i].hash == hash && TopicAt(slots[i]) == topic) {
+                return i;
+            }
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    Slot* Find(std::string_view topic, std::uint64_t hash) {
+        if (count == 0) {
+            return nullptr;
+        }
+        std::size_t i = Probe(topic, hash);
+        return slots[i].hash != 0 ? &slots[i] : nullptr;
+    }
+
+    void Grow() {
+        std::vector<Slot> old(slots.empty() ? kInitialSlots : slots.size() * 2);
+        old.swap(slots);
+        std::size_t mask = slots.size() - 1;
+        for (const Slot& slot : old) {
+            if (slot.hash == 0) {
+                continue;
+            }
+            std::size_t i = slot.hash & mask;
+            while (slots[i].hash != 0) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+    }
+
+    // Inserts a topic known not to be present.
+    Slot& Insert(std::string_view topic, std::uint64_t hash) {
+        if (slots.empty() || (count + 1) * 10 > slots.size() * 7) {
+            Grow();
+        }
+        std::size_t i = Probe(topic, hash);
+        Slot& slot = slots[i];
+        slot.hash = hash;
+        slot.topicOffset = static_cast<std::uint32_t>(topics.size());
+        slot.topicLength = static_cast<std::uint32_t>(topic.size());
+        slot.sub = Subscription();
+        topics.insert(topics.end(), topic.begin(), topic.end());
+        count++;
+        return slot;
+    }
+
+    // Backward-shift deletion keeps probe sequences intact without tombstones.
+    void Erase(Slot* slot) {
+        deadTopicBytes += slot->topicLength;
+        std::size_t mask = slots.size() - 1;
+        std::size_t i = static_cast<std::size_t>(slot - slots.data());
+        std::size_t j = i;
+        while (true) {
+            j = (j + 1) & mask;
+            if (slots[j].hash == 0) {
+                break;
+            }
+            std::size_t home = slots[j].hash & mask;
+            bool homeBetween = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+            if (homeBetween) {
+                continue;
+            }
+            slots[i] = slots[j];
+            i = j;
+        }
+        slots[i].hash = 0;
+        count--;
+        if (deadTopicBytes > kCompactThresholdBytes && deadTopicBytes * 2 > topics.size()) {
+            CompactTopics();
+        }
+    }
+
+    void CompactTopics() {
+        std::vector<char> live;
+        live.reserve(topics.size() - deadTopicBytes);
+        for (Slot& slot : slots) {
+            if (slot.hash == 0) {
+                continue;
+            }
+            std::uint32_t offset = static_cast<std::uint32_t>(live.size());
+            live.insert(live.end(), topics.begin() + slot.topicOffset,
+                        topics.begin() + slot.topicOffset + slot.topicLength);
+            slot.topicOffset = offset;
+        }
+        topics.swap(live);
+        deadTopicBytes = 0;
+    }
+
+    Subscription& AddReference(std::string_view topic, std::uint64_t hash, int qos, bool& created) {
+        Slot* slot = Find(topic, hash);
+        created = (slot == nullptr);
+        if (created) {
+            slot = &Insert(topic, hash);
+            slot->sub.qos = qos;
+        }
+        slot->sub.refCount++;
+        return slot->sub;
+    }
+};
+
+SubscriptionRegistry::SubscriptionRegistry(std::size_t shardCount) : _shardCount(1) {
+    while (_shardCount < shardCount) {
+        _shardCount <<= 1;
+    }
+    _shards.reset(new Shard[_shardCount]);
+}
+
+SubscriptionRegistry::~SubscriptionRegistry() = default;
+
+std::size_t SubscriptionRegistry::ShardIndex(std::uint64_t hash) const {
+    // The low bits pick the probe slot, so use the high bits to pick the shard.
+    return static_cast<std::size_t>(hash >> 40) & (_shardCount - 1);
+}
+
+SubscriptionRegistry::Subscription SubscriptionRegistry::Acquire(std::string_view topic, int qos,
+                                                                 const CreateFunction& onCreate) {
+    std::uint64_t hash = HashTopic(topic);
+    Shard& shard = _shards[ShardIndex(hash)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    bool created;
+    Subscription& sub = shard.AddReference(topic, hash, qos, created);
+    if (created) {
+        AddTopic(topic);
+        if (onCreate) {
+            onCreate(topic, sub);
+        }
+    }
+    return sub;
+}
+
+std::vector<SubscriptionRegistry::Subscription>
+SubscriptionRegistry::AcquireMany(const std::vector<std::string>& topics, int qos,
+                                  const CreateManyFunction& onCreate) {
+    std::vector<std::uint64_t> hashes;
+    hashes.reserve(topics.size());
+    std::vector<bool> touched(_shardCount, false);
+    for (const auto& topic : topics) {
+        hashes.push_back(HashTopic(topic));
+        touched[ShardIndex(hashes.back())] = true;
+    }
+
+    // Locking in shard order keeps concurrent batches from deadlocking.
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (std::size_t i = 0; i < _shardCount; ++i) {
+        if (touched[i]) {
+            locks.emplace_back(_shards[i].mutex);
+        }
+    }
+
+    std::vector<std::size_t> createdIndices;
+    std::vector<std::string_view> createdTopics;
+    for (std::size_t i = 0; i < topics.size(); ++i) {
+        bool created;
+        _shards[ShardIndex(hashes[i])].AddReference(topics[i], hashes[i], qos, created);
+        if (created) {
+            AddTopic(topics[i]);
+            createdIndices.push_back(i);
+            createdTopics.push_back(topics[i]);
+        }
+    }
+
+    if (!createdTopics.empty()) {
+        Subscription shared;
+        shared.qos = qos;
+        shared.refCount = 1;
+        if (onCreate) {
+            onCreate(createdTopics, shared);
+        }
+        for (std::size_t i : createdIndices) {
+            // Slots may have moved while later topics were inserted, so look them up again.
+            Subscription& sub = _shards[ShardIndex(hashes[i])].Find(topics[i], hashes[i])->sub;
+            sub.subscriptionId = shared.subscriptionId;
+            sub.pending = shared.pending;
+        }
+    }
+
+    std::vector<Subscription> result;
+    result.reserve(topics.size());
+    for (std::size_t i = 0; i < topics.size(); ++i) {
+        result.push_back(_shards[ShardIndex(hashes[i])].Find(topics[i], hashes[i])->sub);
+    }
+    return result;
+}
+
+std::optional<SubscriptionRegistry::Subscription> SubscriptionRegistry::Release(std::string_view topic,
+                                                                                const RemoveFunction& onRemove) {
+    std::uint64_t hash = HashTopic(topic);
+    Shard& shard = _shards[ShardIndex(hash)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    Slot* slot = shard.Find(topic, hash);
+    if (slot == nullptr) {
+        return std::nullopt;
+    }
+    slot->sub.refCount--;
+    Subscription sub = slot->sub;
+    if (sub.refCount <= 0) {
+        if (onRemove) {
+            onRemove(topic, sub);
+        }
+        shard.Erase(slot);
+        RemovePattern(topic);
+    }
+    return sub;
+}
+
+std::vector<std::optional<SubscriptionRegistry::Subscription>>
+SubscriptionRegistry::ReleaseMany(const std::vector<std::string>& topics, const RemoveManyFunction& onRemove) {
+    std::vector<std::uint64_t> hashes;
+    hashes.reserve(topics.size());
+    std::vector<bool> touched(_shardCount, false);
+    for (const auto& topic : topics) {
+        hashes.push_back(HashTopic(topic));
+        touched[ShardIndex(hashes.back())] = true;
+    }
+
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (std::size_t i = 0; i < _shardCount; ++i) {
+        if (touched[i]) {
+            locks.emplace_back(_shards[i].mutex);
+        }
+    }
+
+    std::vector<std::optional<Subscription>> result;
+    result.reserve(topics.size());
+    std::vector<Entry> removed;
+    for (std::size_t i = 0; i < topics.size(); ++i) {
+        Shard& shard = _shards[ShardIndex(hashes[i])];
+        Slot* slot = shard.Find(topics[i], hashes[i]);
+        if (slot == nullptr) {
+            result.push_back(std::nullopt);
+            continue;
+        }
+        slot->sub.refCount--;
+        result.push_back(slot->sub);
+        if (slot->sub.refCount <= 0) {
+            removed.emplace_back(topics[i], slot->sub);
+            shard.Erase(slot);
+            RemovePattern(topics[i]);
+        }
+    }
+
+    if (!removed.empty() && onRemove) {
+        onRemove(removed);
+    }
+    return result;
+}
+
+std::optional<SubscriptionRegistry::Subscription> SubscriptionRegistry::Find(std::string_view topic) const {
+    return Find(topic, HashTopic(topic));
+}
+
+std::optional<SubscriptionRegistry::Subscription> SubscriptionRegistry::Find(TopicId topic) const {
+    const TopicTable& table = TopicTable::Global();
+    return Find(table.Name(topic), SlotHash(table.Hash(topic)));
+}
+
+std::optional<SubscriptionRegistry::Subscription> SubscriptionRegistry::Find(std::string_view topic,
+                                                                             std::uint64_t hash) const {
+    Shard& shard = _shards[ShardIndex(hash)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    Slot* slot = shard.Find(topic, hash);
+    if (slot == nullptr) {
+        return std::nullopt;
+    }
+    return slot->sub;
+}
+
+std::optional<SubscriptionRegistry::Subscription>
+SubscriptionRegistry::Match(std::string_view topic,
+                            const std::function<bool(const std::string& subscr)>& matches) const {
+    return Match(topic, HashTopic(topic), matches);
+}
+
+std::optional<SubscriptionRegistry::Subscription>
+SubscriptionRegistry::Match(TopicId topic, const std::function<bool(const std::string& subscr)>& matches) const {
+    const TopicTable& table = TopicTable::Global();
+    return Match(table.Name(topic), SlotHash(table.Hash(topic)), matches);
+}
+
+std::optional<SubscriptionRegistry::Subscription>
+SubscriptionRegistry::Match(std::string_view topic, std::uint64_t hash,
+                            const std::function<bool(const std::string& subscr)>& matches) const {
+    auto exact = Find(topic, hash);
+    if (exact) {
+        return exact;
+    }
+
+    std::vector<std::string> candidates;
+    {
+        std::lock_guard<std::mutex> lock(_patternMutex);
+        for (const auto& pattern : _patterns) {
+            if (matches(pattern)) {
+                candidates.push_back(pattern);
+            }
+        }
+    }
+
+    std::optional<Subscription> best;
+    for (const auto& candidate : candidates) {
+        auto sub = Find(candidate);
+        if (sub && (!best || sub->subscriptionId < best->subscriptionId)) {
+            best = sub;
+        }
+    }
+    return best;
+}
+
+void SubscriptionRegistry::ForEach(const VisitFunction& visit) const {
+    for (std::size_t i = 0; i < _shardCount; ++i) {
+        const Shard& shard = _shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const Slot& slot : shard.slots) {
+            if (slot.hash != 0) {
+                visit(shard.TopicAt(slot), slot.sub);
+            }
+        }
+    }
+}
+
+void SubscriptionRegistry::TakePending(const std::function<void(const std::vector<Entry>& pending)>& send) {
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(_shardCount);
+    for (std::size_t i = 0; i < _shardCount; ++i) {
+        locks.emplace_back(_shards[i].mutex);
+    }
+
+    std::vector<Entry> pending;
+    for (std::size_t i = 0; i < _shardCount; ++i) {
+        Shard& shard = _shards[i];
+        for (Slot& slot : shard.slots) {
+            if (slot.hash != 0 && slot.sub.pending) {
+                slot.sub.pending = false;
+                pending.emplace_back(shard.TopicAt(slot), slot.sub);
+            }
+        }
+    }
+
+    if (!pending.empty()) {
+        send(pending);
+    }
+}
+
+void SubscriptionRegistry::MarkAllPending() {
+    {
+        std::lock_guard<std::mutex> lock(_unsubscribeMutex);
+        _pendingUnsubscribes.clear();
+    }
+    for (std::size_t i = 0; i < _shardCount; ++i) {
+        Shard& shard = _shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (Slot& slot : shard.slots) {
+            if (slot.hash != 0) {
+                slot.sub.pending = true;
+            }
+        }
+    }
+}
+
+bool SubscriptionRegistry::MarkPending(std::string_view topic) {
+    std::uint64_t hash = HashTopic(topic);
+    Shard& shard = _shards[ShardIndex(hash)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    Slot* slot = shard.Find(topic, hash);
+    if (slot == nullptr) {
+        return false;
+    }
+    slot->sub.pending = true;
+    return true;
+}
+
+void SubscriptionRegistry::AddPendingUnsubscribe(std::string_view topic) {
+    std::lock_guard<std::mutex> lock(_unsubscribeMutex);
+    if (std::find(_pendingUnsubscribes.begin(), _pendingUnsubscribes.end(), topic) == _pendingUnsubscribes.end()) {
+        _pendingUnsubscribes.emplace_back(topic);
+    }
+}
+
+void SubscriptionRegistry::TakePendingUnsubscribes(
+    const std::function<void(const std::vector<std::string>& topics)>& send) {
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(_shardCount + 1);
+    for (std::size_t i = 0; i < _shardCount; ++i) {
+        locks.emplace_back(_shards[i].mutex);
+    }
+    locks.emplace_back(_unsubscribeMutex);
+
+    std::vector<std::string> topics;
+    topics.swap(_pendingUnsubscribes);
+    // A topic subscribed to again is pending too, and its SUBSCRIBE replaces whatever the session still holds.
+    topics.erase(std::remove_if(topics.begin(), topics.end(),
+                                [&](const std::string& topic) {
+                                    std::uint64_t hash = HashTopic(topic);
+                                    return _shards[ShardIndex(hash)].Find(topic, hash) != nullptr;
+                                }),
+                 topics.end());
+
+    if (!topics.empty()) {
+        send(topics);
+    }
+}
+
+void SubscriptionRegistry::AddTopic(std::string_view topic) {
+    if (IsPattern(topic)) {
+        std::lock_guard<std::mutex> lock(_patternMutex);
+        _patterns.emplace_back(topic);
+    } else {
+        internTopic(topic);
+    }
+}
+
+void SubscriptionRegistry::RemovePattern(std::string_view topic) {
+    if (IsPattern(topic)) {
+        std::lock_guard<std::mutex> lock(_patternMutex);
+        auto found = std::find(_patterns.begin(), _patterns.end(), topic);
+        if (found != _patterns.end()) {
+            _patterns.erase(found);
+        }
+    }
+}
+
+std::size_t SubscriptionRegistry::Size() const {
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < _shardCount; ++i) {
+        std::lock_guard<std::mutex> lock(_shards[i].mutex);
+        size += _shards[i].count;
+    }
+    return size;
+}
+
+SubscriptionRegistry::MemoryUsage SubscriptionRegistry::GetMemoryUsage() const {
+    MemoryUsage usage;
+    for (std::size_t i = 0; i < _shardCount; ++i) {
+        const Shard& shard = _shards[i];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        usage.entries += shard.count;
+        usage.tableBytes += shard.slots.capacity() * sizeof(Slot);
+        usage.topicBytes += shard.topics.capacity();
+    }
+    usage.totalBytes = sizeof(*this) + _shardCount * sizeof(Shard) + usage.tableBytes + usage.topicBytes;
+    return usage;
+}
+
+} // namespace utils
+} // namespace stinger
@@ -0,0 +1,152 @@
+#include "stinger/utils/subscriptiontracker.hpp"
+#include "stinger/mqtt/topic.hpp"
+#include <map>
+#include <syslog.h>
+#include <utility>
+
+namespace stinger {
+namespace utils {
+
+SubscriptionTracker::SubscriptionTracker(const IConnection& connection) : _connection(connection) {}
+
+SubscriptionTracker::Subscription SubscriptionTracker::Subscribe(const std::string& topic, int qos,
+                                                                 const SendSubscribeFunction& send) {
+    auto sub = _registry.Acquire(topic, qos, [&](std::string_view, Subscription& created) {
+        created.subscriptionId = _nextSubscriptionId++;
+        if (!send({topic}, created.subscriptionId, qos)) {
+            // Sent after CONNACK, once the broker has said whether it kept our session.
+            _connection.Log(LOG_DEBUG, "Subscription %d queued for: %s", created.subscriptionId, topic.c_str());
+            created.pending = true;
+        }
+    });
+    if (sub.refCount > 1) {
+        _connection.Log(LOG_DEBUG, "Incremented subscription count for %s to %d", topic.c_str(), sub.refCount);
+    }
+    return sub;
+}
+
+std::vector<int> SubscriptionTracker::SubscribeMany(const std::vector<std::string>& topics, int qos,
+                                                    const SendSubscribeFunction& send) {
+    auto onCreate = [&](const std::vector<std::string_view>& newTopics, Subscription& created) {
+        created.subscriptionId = _nextSubscriptionId++;
+        if (!send(newTopics, created.subscriptionId, qos)) {
+            _connection.Log(LOG_DEBUG, "Subscription %d queued for %zu topics", created.subscriptionId,
+                            newTopics.size());
+            created.pending = true;
+        }
+    };
+    auto subs = _registry.AcquireMany(topics, qos, onCreate);
+
+    std::vector<int> subscriptionIds;
+    subscriptionIds.reserve(subs.size());
+    for (const auto& sub : subs) {
+        subscriptionIds.push_back(sub.subscriptionId);
+    }
+    return subscriptionIds;
+}
+
+std::optional<SubscriptionTracker::Subscription>
+SubscriptionTracker::Unsubscribe(const std::string& topic, const SendUnsubscribeFunction& send) {
+    auto sub = _registry.Release(topic, [&](std::string_view, const Subscription& removed) {
+        if (removed.pending) {
+            _connection.Log(LOG_DEBUG, "Dropping queued subscription to %s", topic.c_str());
+            return;
+        }
+        // Reference count reached 0 - perform actual unsubscription
+        _connection.Log(LOG_DEBUG, "Unsubscribing from %s (ref count reached 0)", topic.c_str());
+        if (!send({topic})) {
+            // A resumed session would still hold the subscription.
+            _connection.Log(LOG_DEBUG, "Unsubscribe from %s queued", topic.c_str());
+            _registry.AddPendingUnsubscribe(topic);
+        }
+    });
+
+    if (!sub) {
+        _connection.Log(LOG_WARNING, "Attempted to unsubscribe from topic %s that was never subscribed", topic.c_str());
+    } else if (sub->refCount > 0) {
+        _connection.Log(LOG_DEBUG, "Decremented subscription count for %s to %d", topic.c_str(), sub->refCount);
+    }
+    return sub;
+}
+
+void SubscriptionTracker::UnsubscribeMany(const std::vector<std::string>& topics, const SendUnsubscribeFunction& send) {
+    auto subs = _registry.ReleaseMany(topics, [&](const std::vector<SubscriptionRegistry::Entry>& removed) {
+        std::vector<std::string_view> removedTopics;
+        for (const auto& entry : removed) {
+            if (!entry.second.pending) {
+                _connection.Log(LOG_DEBUG, "Unsubscribing from %.*s (ref count reached 0)",
+                                static_cast<int>(entry.first.size()), entry.first.data());
+                removedTopics.push_back(entry.first);
+            }
+        }
+        if (!removedTopics.empty() && !send(removedTopics)) {
+            _connection.Log(LOG_DEBUG, "Unsubscribe queued for %zu topics", removedTopics.size());
+            for (auto topic : removedTopics) {
+                _registry.AddPendingUnsubscribe(topic);
+            }
+        }
+    });
+
+    for (std::size_t i = 0; i < topics.size(); ++i) {
+        if (!subs[i]) {
+            _connection.Log(LOG_WARNING, "Attempted to unsubscribe from topic %s that was never subscribed",
+                            topics[i].c_str());
+        }
+    }
+}
+
+void SubscriptionTracker::Resume(bool sessionPresent) {
+    if (sessionPresent) {
+        _connection.Log(LOG_INFO, "Resumed existing session; keeping %zu subscriptions", _registry.Size());
+    } else {
+        // The broker has no session for us, so any subscriptions it used to hold are gone.
+        _registry.MarkAllPending();
+    }
+}
+
+void SubscriptionTracker::SendPending(const SendUnsubscribeFunction& unsubscribe,
+                                      const SendSubscribeFunction& subscribe) {
+    // Topics whose packets could not be sent after all are queued again once the registry is unlocked.
+    std::vector<std::string> unsent;
+    _registry.TakePendingUnsubscribes([&](const std::vector<std::string>& topics) {
+        _connection.Log(LOG_INFO, "Delayed Unsubscribing from %zu topics", topics.size());
+        if (!unsubscribe(std::vector<std::string_view>(topics.begin(), topics.end()))) {
+            unsent = topics;
+        }
+    });
+    for (const auto& topic : unsent) {
+        _registry.AddPendingUnsubscribe(topic);
+    }
+
+    unsent.clear();
+    _registry.TakePending([&](const std::vector<SubscriptionRegistry::Entry>& pending) {
+        std::map<std::pair<int, int>, std::vector<std::string_view>> batches;
+        for (const auto& entry : pending) {
+            _connection.Log(LOG_INFO, "Delayed Subscribing to %.*s as %d", static_cast<int>(entry.first.size()),
+                            entry.first.data(), entry.second.subscriptionId);
+            batches[std::make_pair(entry.second.subscriptionId, entry.second.qos)].push_back(entry.first);
+        }
+        for (const auto& batch : batches) {
+            if (!subscribe(batch.second, batch.first.first, batch.first.second)) {
+                unsent.insert(unsent.end(), batch.second.begin(), batch.second.end());
+            }
+        }
+    });
+    for (const auto& topic : unsent) {
+        _registry.MarkPending(topic);
+    }
+}
+
+std::optional<SubscriptionTracker::Subscription>
+SubscriptionTracker::MatchLocal(const stinger::mqtt::Message& message) const {
+    auto matches = [&](const std::string& subscr) {
+        // The broker hands each shared-subscription message to a single group member, possibly in another process.
+        return !mqtt::isSharedSubscription(subscr) && mqtt::topicMatchesFilter(message.topic, subscr);
+    };
+    // A topic nothing subscribes to exactly is usually not interned, and is not added here.
+    TopicId id = message.FindTopicId();
+    return id != kInvalidTopicId ? _registry.Match(id, matches) : _registry.Match(message.topic, matches);
+}
+
+} // namespace utils
+} // namespace stinger
@@ -0,0 +1,65 @@
+#include "stinger/mqtt/topic.hpp"
+#include <stdexcept>
+
+namespace stinger {
+namespace mqtt {
+
+namespace {
+const std::string_view kSharePrefix = "$share/";
+}
+
+std::string sharedSubscription(const std::string& group, const std::string& filter) {
+    if (group.empty() || group.find_first_of("/+#") != std::string::npos) {
+        throw std::invalid_argument("Invalid shared subscription group: " + group);
+    }
+    return std::string(kSharePrefix) + group + "/" + filter;
+}
+
+bool isSharedSubscription(std::string_view subscr) {
+    if (subscr.substr(0, kSharePrefix.size()) != kSharePrefix) {
+        return false;
+    }
+    // A group name must be followed by a filter.
+    size_t groupEnd = subscr.find('/', kSharePrefix.size());
+    return groupEnd != std::string_view::npos && groupEnd > kSharePrefix.size() && groupEnd + 1 < subscr.size();
+}
+
+std::string_view subscriptionFilter(std::string_view subscr) {
+    if (!isSharedSubscription(subscr)) {
+        return subscr;
+    }
+    return subscr.substr(subscr.find('/', kSharePrefix.size()) + 1);
+}
+
+bool topicMatchesFilter(std::string_view topic, std::string_view filter) {
+    if (!topic.empty() && topic[0] == '$' && !filter.empty() && (filter[0] == '+' || filter[0] == '#')) {
+        return false;
+    }
+    size_t t = 0;
+    size_t f = 0;
+    while (true) {
+        size_t filterEnd = filter.find('/', f);
+        // npos - f is still past the end, so the last level runs to the end of the string.
+        std::string_view filterLevel = filter.substr(f, filterEnd - f);
+        if (filterLevel == "#") {
+            return filterEnd == std::string_view::npos;
+        }
+        size_t topicEnd = topic.find('/', t);
+        std::string_view topicLevel = topic.substr(t, topicEnd - t);
+        if (filterLevel != "+" && filterLevel != topicLevel) {
+            return false;
+        }
+        if (filterEnd == std::string_view::npos) {
+            return topicEnd == std::string_view::npos;
+        }
+        if (topicEnd == std::string_view::npos) {
+            // The topic has no more levels, so only a trailing "/#" can still match.
+            return filter.substr(filterEnd + 1) == "#";
+        }
+        f = filterEnd + 1;
+        t = topicEnd + 1;
+    }
+}
+
+} // namespace mqtt
+} // namespace stinger
@@ -0,0 +1,152 @@
+#include "stinger/utils/topictable.hpp"
+#include "stinger/utils/hash.hpp"
+#include <stdexcept>
+
+namespace stinger {
+namespace utils {
+
+namespace {
+
+const std::size_t kInitialIndexSlots = 256;
+
+// Chunk holding entry `index` (0-based), and the first index in that chunk.
+std::size_t chunkOf(std::size_t index, std::size_t firstChunk, std::size_t& chunkStart) {
+    std::size_t chunk = 0;
+    std::size_t start = 0;
+    while (index - start >= (firstChunk << chunk)) {
+        start += firstChunk << chunk;
+        ++chunk;
+    }
+    chunkStart = start;
+    return chunk;
+}
+
+} // namespace
+
+TopicTable::Index::Index(std::size_t capacity) : mask(capacity - 1), slots(new std::atomic<std::uint32_t>[capacity]) {
+    for (std::size_t i = 0; i < capacity; ++i) {
+        slots[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+TopicTable::TopicTable() : _index(new Index(kInitialIndexSlots)) {
+    for (auto& chunk : _chunks) {
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+TopicTable::~TopicTable() {
+    for (auto& chunk : _chunks) {
+        delete[] chunk.load(std::memory_order_relaxed);
+    }
+    delete _index.load(std::memory_order_relaxed);
+}
+
+TopicTable& TopicTable::Global() {
+    static TopicTable* table = new TopicTable();
+    return *table;
+}
+
+const TopicTable::Entry& TopicTable::EntryAt(std::uint32_t id) const {
+    std::size_t chunkStart;
+    std::size_t chunk = chunkOf(id - 1, kFirstChunk, chunkStart);
+    return _chunks[chunk].load(std::memory_order_acquire)[id - 1 - chunkStart];
+}
+
+TopicTable::Entry& TopicTable::AddEntry(std::uint32_t id) {
+    std::size_t chunkStart;
+    std::size_t chunk = chunkOf(id - 1, kFirstChunk, chunkStart);
+    if (chunk >= kChunkCount) {
+        throw std::length_error("Topic table is full");
+    }
+    Entry* entries = _chunks[chunk].load(std::memory_order_relaxed);
+    if (entries == nullptr) {
+        entries = new Entry[kFirstChunk << chunk];
+        _chunks[chunk].store(entries, std::memory_order_release);
+    }
+    return entries[id - 1 - chunkStart];
+}
+
+void TopicTable::InsertIndex(Index& index, std::uint32_t id, std::uint64_t hash) {
+    std::size_t i = hash & index.mask;
+    while (index.slots[i].load(std::memory_order_relaxed) != 0) {
+        i = (i + 1) & index.mask;
+    }
+    // Publishes the entry, which was filled in before this store.
+    index.slots[i].store(id, std::memory_order_release);
+}
+
+TopicId TopicTable::Lookup(const Index& index, std::string_view topic, std::uint64_t hash) const {
+    std::size_t i = hash & index.mask;
+    for (;;) {
+        std::uint32_t id = index.slots[i].load(std::memory_order_acquire);
+        if (id == 0) {
+            return kInvalidTopicId;
+        }
+        const Entry& entry = EntryAt(id);
+        if (entry.hash == hash && entry.name == topic) {
+            return static_cast<TopicId>(id);
+        }
+        i = (i + 1) & index.mask;
+    }
+}
+
+TopicId TopicTable::Find(std::string_view topic) const {
+    return Lookup(*_index.load(std::memory_order_acquire), topic, hashString(topic));
+}
+
+TopicId TopicTable::Intern(std::string_view topic) {
+    std::uint64_t hash = hashString(topic);
+    TopicId found = Lookup(*_index.load(std::memory_order_acquire), topic, hash);
+    if (found != kInvalidTopicId) {
+        return found;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    Index* index = _index.load(std::memory_order_relaxed);
+    // Another thread may have added it since the unlocked lookup.
+    found = Lookup(*index, topic, hash);
+    if (found != kInvalidTopicId) {
+        return found;
+    }
+
+    std::size_t size = _size.load(std::memory_order_relaxed);
+    auto id = static_cast<std::uint32_t>(size + 1);
+    Entry& entry = AddEntry(id);
+    entry.name.assign(topic.data(), topic.size());
+    entry.hash = hash;
+
+    // Keep the index at most half full.  Readers still probing the old one find every topic added before the switch.
+    if ((size + 1) * 2 > index->mask + 1) {
+        auto grown = std::make_unique<Index>((index->mask + 1) * 2);
+        for (std::uint32_t existing = 1; existing <= size; ++existing) {
+            InsertIndex(*grown, existing, EntryAt(existing).hash);
+        }
+        _retired.emplace_back(index);
+        index = grown.release();
+        _index.store(index, std::memory_order_release);
+    }
+    // Count the entry before it can be found, so that Name() accepts any ID a lookup returns.
+    _size.store(size + 1, std::memory_order_release);
+    InsertIndex(*index, id, hash);
+    return static_cast<TopicId>(id);
+}
+
+std::string_view TopicTable::Name(TopicId id) const {
+    auto raw = static_cast<std::uint32_t>(id);
+    if (raw == 0 || raw > _size.load(std::memory_order_acquire)) {
+        return std::string_view();
+    }
+    return EntryAt(raw).name;
+}
+
+std::uint64_t TopicTable::Hash(TopicId id) const {
+    auto raw = static_cast<std::uint32_t>(id);
+    if (raw == 0 || raw > _size.load(std::memory_order_acquire)) {
+        return 0;
+    }
+    return EntryAt(raw).hash;
+}
+
+} // namespace utils
+} // namespace stinger
@@ -0,0 +1,199 @@
+#include "stinger/utils/uuid.hpp"
+#include <chrono>
+#include <random>
+#include <thread>
+
+namespace stinger {
+namespace utils {
+
+namespace {
+
+const char kHexDigits[] = "0123456789abcdef";
+
+std::uint64_t splitmix64(std::uint64_t& state) {
+    std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+std::uint64_t rotl(std::uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// xoshiro256++, one per thread.  Seeded from std::random_device, so each thread draws from the OS once.
+class Generator {
+public:
+    Generator() {
+        std::random_device device;
+        std::uint64_t seed = (static_cast<std::uint64_t>(device()) << 32) ^ device();
+        seed ^= std::hash<std::thread::id>()(std::this_thread::get_id());
+        seed ^= static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        for (auto& word : _state) {
+            word = splitmix64(seed);
+        }
+    }
+
+    std::uint64_t Next() {
+        std::uint64_t result = rotl(_state[0] + _state[3], 23) + _state[0];
+        std::uint64_t t = _state[1] << 17;
+        _state[2] ^= _state[0];
+        _state[3] ^= _state[1];
+        _state[1] ^= _state[2];
+        _state[0] ^= _state[3];
+        _state[2] ^= t;
+        _state[3] = rotl(_state[3], 45);
+        return result;
+    }
+
+    // The last version 7 timestamp and the 12-bit counter stored after it, which keep IDs from this thread
+    // increasing even within one millisecond.
+    std::uint64_t lastMillis = 0;
+    unsigned counter = 0;
+
+private:
+    std::uint64_t _state[4];
+};
+
+Generator& generator() {
+    thread_local Generator instance;
+    return instance;
+}
+
+void fillRandom(Generator& gen, std::byte* out) {
+    std::uint64_t words[2] = {gen.Next(), gen.Next()};
+    memcpy(out, words, sizeof(words));
+}
+
+void setVersion(CorrelationId& id, unsigned version) {
+    id.bytes[6] = static_cast<std::byte>((static_cast<unsigned>(id.bytes[6]) & 0x0F) | (version << 4));
+    // RFC 4122 variant: the top two bits of byte 8 are 10.
+    id.bytes[8] = static_cast<std::byte>((static_cast<unsigned>(id.bytes[8]) & 0x3F) | 0x80);
+}
+
+CorrelationId random(Generator& gen) {
+    CorrelationId id;
+    fillRandom(gen, id.bytes.data());
+    setVersion(id, 4);
+    return id;
+}
+
+CorrelationId timeOrdered(Generator& gen) {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    auto millis = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+    if (millis > gen.lastMillis) {
+        gen.lastMillis = millis;
+        // Start low in the counter range so a burst within one millisecond rarely has to borrow the next one.
+        gen.counter = static_cast<unsigned>(gen.Next() & 0x1FF);
+    } else if (++gen.counter > 0xFFF) {
+        ++gen.lastMillis;
+        gen.counter = 0;
+    }
+
+    CorrelationId id;
+    fillRandom(gen, id.bytes.data());
+    for (int i = 0; i < 6; ++i) {
+        id.bytes[i] = static_cast<std::byte>(gen.lastMillis >> (40 - 8 * i));
+    }
+    id.bytes[6] = static_cast<std::byte>(gen.counter >> 8);
+    id.bytes[7] = static_cast<std::byte>(gen.counter);
+    setVersion(id, 7);
+    return id;
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+} // namespace
+
+CorrelationId CorrelationId::Random() {
+    return random(generator());
+}
+
+CorrelationId CorrelationId::TimeOrdered() {
+    return timeOrdered(generator());
+}
+
+void CorrelationId::GenerateMany(CorrelationId* out, std::size_t count, Version version) {
+    Generator& gen = generator();
+    for (std::size_t i = 0; i < count; ++i) {
+        out[i] = version == Version::TimeOrdered ? timeOrdered(gen) : random(gen);
+    }
+}
+
+std::optional<CorrelationId> CorrelationId::FromBytes(const void* data, std::size_t size) {
+    if (size != kSize) {
+        return std::nullopt;
+    }
+    CorrelationId id;
+    memcpy(id.bytes.data(), data, kSize);
+    return id;
+}
+
+std::optional<CorrelationId> CorrelationId::Parse(std::string_view text) {
+    bool dashed = text.size() == kStringLength;
+    if (!dashed && text.size() != kHexLength) {
+        return std::nullopt;
+    }
+    CorrelationId id;
+    std::size_t pos = 0;
+    for (std::size_t i = 0; i < kSize; ++i) {
+        if (dashed && (i == 4 || i == 6 || i == 8 || i == 10)) {
+            if (text[pos++] != '-') {
+                return std::nullopt;
+            }
+        }
+        int high = hexValue(text[pos]);
+        int low = hexValue(text[pos + 1]);
+        if (high < 0 || low < 0) {
+            return std::nullopt;
+        }
+        id.bytes[i] = static_cast<std::byte>((high << 4) | low);
+        pos += 2;
+    }
+    return id;
+}
+
+char* CorrelationId::FormatHex(char* out) const {
+    for (std::byte b : bytes) {
+        *out++ = kHexDigits[static_cast<unsigned>(b) >> 4];
+        *out++ = kHexDigits[static_cast<unsigned>(b) & 0x0F];
+    }
+    return out;
+}
+
+char* CorrelationId::Format(char* out) const {
+    for (std::size_t i = 0; i < kSize; ++i) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            *out++ = '-';
+        }
+        *out++ = kHexDigits[static_cast<unsigned>(bytes[i]) >> 4];
+        *out++ = kHexDigits[static_cast<unsigned>(bytes[i]) & 0x0F];
+    }
+    return out;
+}
+
+std::string CorrelationId::ToHex() const {
+    std::string out(kHexLength, '\0');
+    FormatHex(&out[0]);
+    return out;
+}
+
+std::string CorrelationId::ToString() const {
+    std::string out(kStringLength, '\0');
+    Format(&out[0]);
+    return out;
+}
+
+} // namespace utils
+} // namespace stinger
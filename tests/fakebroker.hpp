@@ -0,0 +1,225 @@
+#pragma once
+
+// A scripted MQTT v5 broker for connection tests.  It accepts one client at a time on a loopback TCP port, hands the
+// test each packet the client sends, and sends whatever the test tells it to.  Linux only.
+
+#include "stinger/mqtt/packetcodec.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace stinger {
+namespace test {
+
+struct BrokerPacket {
+    mqtt::PacketType type = mqtt::PacketType::Connect;
+    std::uint8_t flags = 0;
+    std::string body;
+
+    // The packet identifier of a PUBLISH with QoS > 0, an acknowledgement, SUBSCRIBE or UNSUBSCRIBE.
+    std::uint16_t PacketId() const {
+        std::size_t offset = 0;
+        if (type == mqtt::PacketType::Publish) {
+            offset = 2 + ((std::uint8_t(body[0]) << 8) | std::uint8_t(body[1]));
+        }
+        return static_cast<std::uint16_t>((std::uint8_t(body[offset]) << 8) | std::uint8_t(body[offset + 1]));
+    }
+
+    // The topic filters of a SUBSCRIBE or UNSUBSCRIBE.
+    std::vector<std::string> Topics() const {
+        std::size_t pos = 2;
+        std::size_t propertyLength = 0;
+        for (int shift = 0;; shift += 7) {
+            std::uint8_t byte = static_cast<std::uint8_t>(body[pos++]);
+            propertyLength |= std::size_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        pos += propertyLength;
+
+        std::vector<std::string> topics;
+        while (pos + 2 <= body.size()) {
+            std::size_t length = (std::uint8_t(body[pos]) << 8) | std::uint8_t(body[pos + 1]);
+            topics.push_back(body.substr(pos + 2, length));
+            pos += 2 + length + (type == mqtt::PacketType::Subscribe ? 1 : 0);
+        }
+        return topics;
+    }
+
+    mqtt::PublishView Publish() const {
+        mqtt::PublishView view;
+        if (!mqtt::decodePublish(flags, body, view)) {
+            throw std::runtime_error("malformed PUBLISH");
+        }
+        return view;
+    }
+};
+
+class FakeBroker {
+public:
+    FakeBroker() {
+        _listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(addr);
+        if (_listener < 0 || ::bind(_listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(_listener, 4) != 0 || ::getsockname(_listener, reinterpret_cast<sockaddr*>(&addr), &length) != 0) {
+            throw std::runtime_error("cannot listen on loopback");
+        }
+        _port = ntohs(addr.sin_port);
+    }
+
+    ~FakeBroker() {
+        Drop();
+        ::close(_listener);
+    }
+
+    FakeBroker(const FakeBroker&) = delete;
+    FakeBroker& operator=(const FakeBroker&) = delete;
+
+    int Port() const { return _port; }
+
+    // Accepts the next connection, dropping the current one.
+    bool Accept(std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+        Drop();
+        pollfd pfd = {_listener, POLLIN, 0};
+        if (::poll(&pfd, 1, static_cast<int>(timeout.count())) != 1) {
+            return false;
+        }
+        _client = ::accept(_listener, nullptr, nullptr);
+        return _client >= 0;
+    }
+
+    // Accepts a connection, reads its CONNECT and answers it.
+    bool AcceptSession(bool sessionPresent, std::optional<std::uint16_t> receiveMaximum = std::nullopt) {
+        BrokerPacket connect;
+        if (!Accept() || !Read(connect) || connect.type != mqtt::PacketType::Connect) {
+            return false;
+        }
+        SendConnack(sessionPresent, receiveMaximum);
+        return true;
+    }
+
+    // Closes the client connection without a DISCONNECT, as a broker that went away would.
+    void Drop() {
+        if (_client >= 0) {
+            ::close(_client);
+            _client = -1;
+        }
+        _buffer.clear();
+    }
+
+    // Reads the next packet from the client.  Returns false on timeout or when the client closes the connection.
+    bool Read(BrokerPacket& packet, std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (true) {
+            mqtt::FixedHeader header;
+            if (mqtt::decodeFixedHeader(_buffer, header) == mqtt::DecodeStatus::Complete &&
+                _buffer.size() >= header.Size()) {
+                packet.type = header.type;
+                packet.flags = header.flags;
+                packet.body = _buffer.substr(header.headerSize, header.remainingLength);
+                _buffer.erase(0, header.Size());
+                return true;
+            }
+            auto left =
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            pollfd pfd = {_client, POLLIN, 0};
+            if (_client < 0 || left.count() <= 0 || ::poll(&pfd, 1, static_cast<int>(left.count())) != 1) {
+                return false;
+            }
+            char chunk[4096];
+            ssize_t n = ::recv(_client, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                return false;
+            }
+            _buffer.append(chunk, static_cast<std::size_t>(n));
+        }
+    }
+
+    // Reads packets until one of `type` arrives, skipping keepalive pings.  Any other packet fails the read.
+    bool Expect(mqtt::PacketType type, BrokerPacket& packet,
+                std::chrono::milliseconds timeout = std::chrono::seconds(5)) {
+        while (Read(packet, timeout)) {
+            if (packet.type == mqtt::PacketType::Pingreq) {
+                SendPingresp();
+                continue;
+            }
+            return packet.type == type;
+        }
+        return false;
+    }
+
+    void Send(const std::string& bytes) {
+        std::size_t sent = 0;
+        while (sent < bytes.size()) {
+            ssize_t n = ::send(_client, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return;
+            }
+            sent += static_cast<std::size_t>(n);
+        }
+    }
+
+    void SendConnack(bool sessionPresent, std::optional<std::uint16_t> receiveMaximum = std::nullopt) {
+        std::string packet = {char(0x20), 0, char(sessionPresent ? 1 : 0), 0};
+        if (receiveMaximum) {
+            packet += {3, 0x21, char(*receiveMaximum >> 8), char(*receiveMaximum & 0xFF)};
+        } else {
+            packet += char(0);
+        }
+        packet[1] = static_cast<char>(packet.size() - 2);
+        Send(packet);
+    }
+
+    void SendSuback(const BrokerPacket& subscribe) { SendSubscribeAck(0x90, subscribe); }
+    void SendUnsuback(const BrokerPacket& unsubscribe) { SendSubscribeAck(0xB0, unsubscribe); }
+
+    void SendAck(mqtt::PacketType type, std::uint16_t packetId) {
+        std::string packet;
+        mqtt::encodeAck(packet, type, packetId);
+        Send(packet);
+    }
+
+    void SendPublish(const mqtt::Message& message, std::uint16_t packetId = 0) {
+        std::string packet;
+        mqtt::encodePublish(packet, message, packetId);
+        Send(packet);
+    }
+
+    void SendPingresp() { Send(std::string{char(0xD0), 0}); }
+
+private:
+    // One success reason code per topic, which grants QoS 0 in a SUBACK.
+    void SendSubscribeAck(char type, const BrokerPacket& request) {
+        std::uint16_t packetId = request.PacketId();
+        std::string packet = {type, 0, char(packetId >> 8), char(packetId & 0xFF), 0};
+        std::size_t topics = request.Topics().size();
+        for (std::size_t i = 0; i < topics; ++i) {
+            packet += char(0);
+        }
+        packet[1] = static_cast<char>(packet.size() - 2);
+        Send(packet);
+    }
+
+    int _listener = -1;
+    int _client = -1;
+    int _port = 0;
+    std::string _buffer;
+};
+
+} // namespace test
+} // namespace stinger
@@ -0,0 +1,213 @@
+#include "stinger/utils/base64.hpp"
+#include "stinger/utils/conversions.hpp"
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using namespace stinger::utils;
+
+namespace {
+
+// Byte-at-a-time reference encoding.
+std::string referenceEncode(const std::vector<unsigned char>& data, Base64Alphabet alphabet, bool padded) {
+    const char* chars = alphabet == Base64Alphabet::Url
+                            ? "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
+                            : "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string encoded;
+    unsigned bits = 0;
+    int count = 0;
+    for (unsigned char byte : data) {
+        bits = (bits << 8) | byte;
+        count += 8;
+        while (count >= 6) {
+            count -= 6;
+            encoded += chars[(bits >> count) & 0x3F];
+        }
+    }
+    if (count > 0) {
+        encoded += chars[(bits << (6 - count)) & 0x3F];
+    }
+    while (padded && encoded.size() % 4 != 0) {
+        encoded += '=';
+    }
+    return encoded;
+}
+
+std::vector<unsigned char> testBytes(std::size_t size) {
+    std::vector<unsigned char> data(size);
+    unsigned state = 12345;
+    for (auto& byte : data) {
+        state = state * 1103515245 + 12345;
+        byte = static_cast<unsigned char>(state >> 16);
+    }
+    return data;
+}
+
+class Base64Test : public ::testing::Test {
+protected:
+    void SetUp() override { _saved = base64Kernel(); }
+    void TearDown() override { setBase64Kernel(_saved); }
+
+    // The kernels this CPU can run.
+    static std::vector<Base64Kernel> Kernels() {
+        std::vector<Base64Kernel> kernels;
+        Base64Kernel saved = base64Kernel();
+        for (Base64Kernel kernel : {Base64Kernel::Scalar, Base64Kernel::Ssse3, Base64Kernel::Avx2}) {
+            if (setBase64Kernel(kernel)) {
+                kernels.push_back(kernel);
+            }
+        }
+        setBase64Kernel(saved);
+        return kernels;
+    }
+
+private:
+    Base64Kernel _saved;
+};
+
+} // namespace
+
+TEST_F(Base64Test, ScalarKernelIsAlwaysAvailable) {
+    EXPECT_TRUE(setBase64Kernel(Base64Kernel::Scalar));
+    EXPECT_EQ(base64Kernel(), Base64Kernel::Scalar);
+}
+
+TEST_F(Base64Test, RoundTripsEverySizeWithEveryKernel) {
+    for (Base64Kernel kernel : Kernels()) {
+        ASSERT_TRUE(setBase64Kernel(kernel));
+        for (std::size_t size = 0; size < 200; ++size) {
+            std::vector<unsigned char> data = testBytes(size);
+            for (Base64Alphabet alphabet : {Base64Alphabet::Standard, Base64Alphabet::Url}) {
+                for (bool padded : {true, false}) {
+                    std::string expected = referenceEncode(data, alphabet, padded);
+                    std::string encoded(base64EncodedSize(size, padded), '\0');
+                    ASSERT_EQ(base64Encode(data.data(), size, encoded.data(), alphabet, padded), encoded.size());
+                    ASSERT_EQ(encoded, expected) << "kernel " << static_cast<int>(kernel) << " size " << size;
+
+                    std::vector<unsigned char> decoded(base64DecodedSize(encoded));
+                    std::size_t written = 0;
+                    ASSERT_TRUE(base64Decode(encoded, decoded.data(), written, alphabet)) << encoded;
+                    ASSERT_EQ(written, size);
+                    ASSERT_EQ(decoded, data);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(Base64Test, StrictDecodeRejectsMalformedInput) {
+    // Long enough that the bad char lands in a block a SIMD kernel handles.
+    std::string valid = referenceEncode(testBytes(96), Base64Alphabet::Standard, true);
+    for (Base64Kernel kernel : Kernels()) {
+        ASSERT_TRUE(setBase64Kernel(kernel));
+        std::vector<unsigned char> out(base64DecodedSize(valid) + 3);
+        std::size_t written;
+        for (std::size_t position : {std::size_t(0), std::size_t(5), std::size_t(40), valid.size() - 2}) {
+            for (char bad : {' ', '\n', '=', '-', '_', '\x80', '*'}) {
+                std::string encoded = valid;
+                encoded[position] = bad;
+                EXPECT_FALSE(base64Decode(encoded, out.data(), written)) << position << " " << int(bad);
+            }
+        }
+        std::string url = referenceEncode(testBytes(96), Base64Alphabet::Url, false);
+        std::string withSlash = url;
+        withSlash[40] = '/';
+        EXPECT_FALSE(base64Decode(withSlash, out.data(), written, Base64Alphabet::Url));
+
+        EXPECT_FALSE(base64Decode("QUJD=", out.data(), written));
+        EXPECT_FALSE(base64Decode("Q===", out.data(), written));
+        EXPECT_FALSE(base64Decode("QQ=", out.data(), written));
+        EXPECT_FALSE(base64Decode("QUJDR", out.data(), written));
+        // Nonzero bits after the last byte.
+        EXPECT_FALSE(base64Decode("QR==", out.data(), written));
+        EXPECT_FALSE(base64Decode("QUJ", out.data(), written));
+        EXPECT_TRUE(base64Decode("QUI", out.data(), written));
+        EXPECT_EQ(written, 2u);
+    }
+}
+
+TEST_F(Base64Test, LegacyDecodeStaysLenient) {
+    EXPECT_EQ(base64Decode(std::string("QUJD")), (std::vector<unsigned char>{'A', 'B', 'C'}));
+    EXPECT_EQ(base64Decode(std::string("QR==")), (std::vector<unsigned char>{'A'}));
+    EXPECT_EQ(base64Decode(std::string("QUJD RA==")), (std::vector<unsigned char>{'A', 'B', 'C'}));
+    EXPECT_EQ(base64Decode(std::string("QUJDR")), (std::vector<unsigned char>{'A', 'B', 'C'}));
+    EXPECT_EQ(base64Decode(std::string("QUJDRE!")), (std::vector<unsigned char>{'A', 'B', 'C', 'D'}));
+    EXPECT_EQ(base64Decode(std::string("")), std::vector<unsigned char>());
+
+    std::vector<unsigned char> data = testBytes(1000);
+    EXPECT_EQ(base64Encode(data), referenceEncode(data, Base64Alphabet::Standard, true));
+    EXPECT_EQ(base64Decode(base64Encode(data)), data);
+}
+
+TEST_F(Base64Test, StreamingMatchesOneShotForAnySplit) {
+    std::vector<unsigned char> data = testBytes(100);
+    for (bool padded : {true, false}) {
+        std::string expected = referenceEncode(data, Base64Alphabet::Url, padded);
+        for (std::size_t chunk = 1; chunk <= data.size(); ++chunk) {
+            Base64Encoder encoder(Base64Alphabet::Url, padded);
+            std::string encoded = "prefix:";
+            for (std::size_t i = 0; i < data.size(); i += chunk) {
+                encoder.Update(data.data() + i, std::min(chunk, data.size() - i), encoded);
+            }
+            encoder.Finish(encoded);
+            ASSERT_EQ(encoded, "prefix:" + expected) << chunk;
+
+            Base64Decoder decoder(Base64Alphabet::Url);
+            std::string decoded;
+            std::string_view text(expected);
+            for (std::size_t i = 0; i < text.size(); i += chunk) {
+                ASSERT_TRUE(decoder.Update(text.substr(i, chunk), decoded)) << chunk;
+            }
+            ASSERT_TRUE(decoder.Finish(decoded));
+            ASSERT_EQ(decoded, std::string(data.begin(), data.end())) << chunk;
+        }
+    }
+}
+
+TEST_F(Base64Test, StreamingWritesToCallerBuffers) {
+    std::vector<unsigned char> data = testBytes(10);
+    Base64Encoder encoder;
+    char text[Base64Encoder::MaxUpdateSize(7) + Base64Encoder::MaxUpdateSize(3) + Base64Encoder::kMaxFinishSize];
+    std::size_t size = encoder.Update(data.data(), 7, text);
+    EXPECT_EQ(size, 8u);
+    size += encoder.Update(data.data() + 7, 3, text + size);
+    size += encoder.Finish(text + size);
+    EXPECT_EQ(std::string(text, size), referenceEncode(data, Base64Alphabet::Standard, true));
+
+    Base64Decoder decoder;
+    unsigned char bytes[Base64Decoder::MaxUpdateSize(5) + Base64Decoder::MaxUpdateSize(11)];
+    std::size_t written;
+    ASSERT_TRUE(decoder.Update(std::string_view(text, 5), bytes, written));
+    EXPECT_EQ(written, 3u);
+    std::size_t total = written;
+    ASSERT_TRUE(decoder.Update(std::string_view(text + 5, size - 5), bytes + total, written));
+    total += written;
+    ASSERT_TRUE(decoder.Finish(bytes + total, written));
+    EXPECT_EQ(written, 0u);
+    EXPECT_EQ(std::vector<unsigned char>(bytes, bytes + total), data);
+}
+
+TEST_F(Base64Test, StreamingDecoderRejectsMalformedText) {
+    Base64Decoder decoder;
+    std::string out;
+    // Text after padding, split across chunks.
+    EXPECT_TRUE(decoder.Update("QUJDRA=", out));
+    EXPECT_TRUE(decoder.Update("=", out));
+    EXPECT_FALSE(decoder.Update("QUJD", out));
+    // The error sticks until the stream is reset.
+    EXPECT_FALSE(decoder.Update("QUJD", out));
+    EXPECT_FALSE(decoder.Finish(out));
+
+    out.clear();
+    EXPECT_TRUE(decoder.Update("QUJD", out));
+    EXPECT_TRUE(decoder.Update("R", out));
+    EXPECT_FALSE(decoder.Finish(out));
+    EXPECT_EQ(out, "ABC");
+
+    EXPECT_FALSE(decoder.Update("QU D", out));
+    decoder.Reset();
+    EXPECT_TRUE(decoder.Update("QQ", out));
+    EXPECT_TRUE(decoder.Finish(out));
+    EXPECT_EQ(out, "ABCA");
+}
@@ -0,0 +1,114 @@
+#include "fakebroker.hpp"
+#include "stinger/mqtt/brokerconnection.hpp"
+#include <chrono>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace stinger;
+using mqtt::PacketType;
+
+namespace {
+
+mqtt::ConnectOptions ResumableOptions() {
+    mqtt::ConnectOptions options;
+    options.sessionExpiryInterval = 3600;
+    options.onlineStatus = false;
+    return options;
+}
+
+bool WaitUntilConnected(const mqtt::BrokerConnection& connection, bool connected) {
+    for (int i = 0; i < 500 && connection.IsConnected() != connected; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return connection.IsConnected() == connected;
+}
+
+// Subscribes to `topic`, then drops the connection and accepts the reconnect without answering its CONNECT, so that
+// the client is offline until the test sends the CONNACK.
+void SubscribeThenReconnect(test::FakeBroker& broker, mqtt::BrokerConnection& connection, const std::string& topic) {
+    ASSERT_TRUE(broker.AcceptSession(false));
+    ASSERT_TRUE(WaitUntilConnected(connection, true));
+    connection.Subscribe(topic, 1);
+    test::BrokerPacket packet;
+    ASSERT_TRUE(broker.Expect(PacketType::Subscribe, packet));
+    broker.SendSuback(packet);
+
+    broker.Drop();
+    ASSERT_TRUE(broker.Accept(std::chrono::seconds(10)));
+    ASSERT_TRUE(broker.Expect(PacketType::Connect, packet));
+    ASSERT_TRUE(WaitUntilConnected(connection, false));
+}
+
+} // namespace
+
+TEST(BrokerConnectionTest, UnsubscribeWhileOfflineIsSentToResumedSession) {
+    test::FakeBroker broker;
+    mqtt::BrokerConnection connection("127.0.0.1", broker.Port(), "resume", ResumableOptions());
+    SubscribeThenReconnect(broker, connection, "sensor/temperature");
+
+    connection.Unsubscribe("sensor/temperature");
+    broker.SendConnack(true);
+
+    test::BrokerPacket packet;
+    ASSERT_TRUE(broker.Expect(PacketType::Unsubscribe, packet));
+    EXPECT_EQ(packet.Topics(), std::vector<std::string>{"sensor/temperature"});
+}
+
+TEST(BrokerConnectionTest, OriginTagMarksPublishesAndDropsEchoes) {
+    test::FakeBroker broker;
+    mqtt::ConnectOptions options = ResumableOptions();
+    options.originTag = "pool";
+    mqtt::BrokerConnection connection("127.0.0.1", broker.Port(), "tagged", options);
+    std::mutex mutex;
+    std::vector<mqtt::Message> received;
+    connection.AddMessageCallback([&](const mqtt::Message& message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        received.push_back(message);
+    });
+    ASSERT_TRUE(broker.AcceptSession(false));
+    ASSERT_TRUE(WaitUntilConnected(connection, true));
+
+    connection.Publish(mqtt::Message("sensor/temperature", "21.5"));
+    test::BrokerPacket packet;
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, packet));
+    EXPECT_EQ(packet.Publish().FindUserProperty(mqtt::kOriginTagProperty), std::optional<std::string_view>("pool"));
+
+    mqtt::Message echo("sensor/echo", "{}");
+    echo.properties.AddUserProperty(mqtt::kOriginTagProperty, "pool");
+    mqtt::Message other("sensor/other", "{}");
+    other.properties.AddUserProperty(mqtt::kOriginTagProperty, "other-pool");
+    broker.SendPublish(echo);
+    broker.SendPublish(other);
+    broker.SendPublish(mqtt::Message("sensor/plain", "{}"));
+    for (int i = 0; i < 500; ++i) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (received.size() >= 2) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(received.size(), 2u);
+    EXPECT_EQ(received[0].topic, "sensor/other");
+    EXPECT_TRUE(received[0].properties.GetUserProperties().Empty());
+    EXPECT_EQ(received[1].topic, "sensor/plain");
+}
+
+TEST(BrokerConnectionTest, UnsubscribeWhileOfflineIsDroppedWithSession) {
+    test::FakeBroker broker;
+    mqtt::BrokerConnection connection("127.0.0.1", broker.Port(), "fresh", ResumableOptions());
+    SubscribeThenReconnect(broker, connection, "sensor/temperature");
+
+    connection.UnsubscribeMany({"sensor/temperature"});
+    broker.SendConnack(false);
+    ASSERT_TRUE(WaitUntilConnected(connection, true));
+
+    // The broker starts a new session without the subscription, so the next packet is this SUBSCRIBE.
+    connection.Subscribe("sensor/humidity", 1);
+    test::BrokerPacket packet;
+    ASSERT_TRUE(broker.Expect(PacketType::Subscribe, packet));
+    EXPECT_EQ(packet.Topics(), std::vector<std::string>{"sensor/humidity"});
+}
@@ -0,0 +1,39 @@
+#include "stinger/utils/callbacklist.hpp"
+#include <gtest/gtest.h>
+#include <vector>
+
+using namespace stinger;
+
+TEST(MessageCallbackListTest, InvokesInOrderAdded) {
+    utils::MessageCallbackList callbacks;
+    std::vector<int> calls;
+    auto first = callbacks.Add([&](const mqtt::Message&) { calls.push_back(1); });
+    auto second = callbacks.Add([&](const mqtt::Message&) { calls.push_back(2); });
+    EXPECT_EQ(first, 1);
+    EXPECT_EQ(second, 2);
+
+    EXPECT_EQ(callbacks.Invoke(mqtt::Message("a/b", "", 0, false)), 2u);
+    EXPECT_EQ(calls, (std::vector<int>{1, 2}));
+
+    EXPECT_TRUE(callbacks.Remove(first));
+    EXPECT_FALSE(callbacks.Remove(first));
+    EXPECT_EQ(callbacks.Size(), 1u);
+}
+
+TEST(MessageCallbackListTest, CallbackMayChangeTheList) {
+    utils::MessageCallbackList callbacks;
+    int calls = 0;
+    utils::CallbackHandleType handle = 0;
+    handle = callbacks.Add([&](const mqtt::Message&) {
+        calls++;
+        // Neither change affects the message being delivered.
+        callbacks.Remove(handle);
+        callbacks.Add([&](const mqtt::Message&) { calls += 10; });
+    });
+
+    mqtt::Message message("a/b", "", 0, false);
+    EXPECT_EQ(callbacks.Invoke(message), 1u);
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(callbacks.Invoke(message), 1u);
+    EXPECT_EQ(calls, 11);
+}
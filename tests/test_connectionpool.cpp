@@ -0,0 +1,85 @@
+#include "stinger/mqtt/connectionpool.hpp"
+#include <gtest/gtest.h>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace stinger::mqtt;
+
+namespace {
+
+// Nothing listens on port 1, so the members never connect and no broker is needed.
+ConnectOptions offlineOptions() {
+    ConnectOptions options;
+    options.externalLoop = true;
+    options.asyncConnect = true;
+    return options;
+}
+
+// Exposes the inbound path so that tests can hand it messages as if a member had received them.
+class TestPool : public ConnectionPool {
+public:
+    explicit TestPool(std::size_t size) : ConnectionPool("127.0.0.1", 1, "pool", size, offlineOptions()) {
+        AddMessageCallback([this](const Message& message) { received.push_back(message.topic); });
+    }
+
+    using ConnectionPool::Dispatch;
+
+    std::vector<std::string> received;
+};
+
+} // namespace
+
+TEST(ConnectionPoolTest, MembersUseDerivedClientIds) {
+    TestPool pool(3);
+    ASSERT_EQ(pool.Size(), 3u);
+    EXPECT_EQ(pool.GetClientId(), "pool");
+    EXPECT_EQ(pool.GetMember(1).GetClientId(), "pool-1");
+    EXPECT_EQ(pool.GetMember(2).GetClientId(), "pool-2");
+}
+
+TEST(ConnectionPoolTest, RoutesEachTopicToOneMember) {
+    TestPool pool(4);
+    std::set<std::size_t> used;
+    for (int i = 0; i < 200; ++i) {
+        std::string topic = "devices/" + std::to_string(i) + "/state";
+        std::size_t member = pool.MemberForTopic(topic);
+        ASSERT_LT(member, pool.Size());
+        EXPECT_EQ(pool.MemberForTopic(topic), member);
+        used.insert(member);
+    }
+    EXPECT_EQ(used.size(), pool.Size());
+}
+
+TEST(ConnectionPoolTest, OnlyTheFirstMemberReportsStatus) {
+    TestPool pool(3);
+    EXPECT_TRUE(pool.GetMember(0).GetConnectOptions().onlineStatus);
+    EXPECT_FALSE(pool.GetMember(1).GetConnectOptions().onlineStatus);
+    EXPECT_FALSE(pool.GetMember(2).GetConnectOptions().onlineStatus);
+    EXPECT_EQ(pool.GetLastWillTopic(), pool.GetMember(0).GetLastWillTopic());
+}
+
+TEST(ConnectionPoolTest, MembersShareOneOriginTag) {
+    TestPool pool(3);
+    // The subscribing member drops echoes of the others' publishes by their tag.
+    for (std::size_t i = 0; i < pool.Size(); ++i) {
+        EXPECT_EQ(pool.GetMember(i).GetConnectOptions().originTag, std::optional<std::string>("pool"));
+    }
+
+    pool.Dispatch(Message("a", "{}"));
+    EXPECT_EQ(pool.received, std::vector<std::string>{"a"});
+}
+
+TEST(ConnectionPoolTest, SingleMemberBehavesLikeOneConnection) {
+    TestPool pool(1);
+    // The broker filters echoes with No Local, so publishes are not tagged.
+    EXPECT_FALSE(pool.GetMember(0).GetConnectOptions().originTag);
+    EXPECT_TRUE(pool.GetMember(0).GetConnectOptions().onlineStatus);
+}
+
+TEST(ConnectionPoolTest, RejectsLocalDelivery) {
+    ConnectOptions options = offlineOptions();
+    options.localDelivery = true;
+    EXPECT_THROW(ConnectionPool("127.0.0.1", 1, "pool", 2, options), std::invalid_argument);
+}
@@ -1,6 +1,7 @@
 #include <stinger/utils/conversions.hpp>
 
 #include <chrono>
+#include <cstdint>
 #include <stdexcept>
 
 #include <gtest/gtest.h>
@@ -66,13 +67,68 @@ TEST(ParseIsoTimestampTest, SubsecondsDoNotThrow) {
     EXPECT_NO_THROW(parseIsoTimestamp("2023-12-01T15:30:45.999Z"));
 }
 
-// When subseconds are present they are expected to be dropped (whole-second
-// precision); the result must be within 1 second of the no-subsecond form.
-TEST(ParseIsoTimestampTest, SubsecondsAreDiscarded) {
+// Fractional seconds are kept, down to the clock's precision.
+TEST(ParseIsoTimestampTest, SubsecondsAreKept) {
     auto tp_whole = parseIsoTimestamp("2023-12-01T15:30:45Z");
-    auto tp_frac = parseIsoTimestamp("2023-12-01T15:30:45.123Z");
-    auto diff = std::chrono::abs(tp_frac - tp_whole);
-    EXPECT_LT(diff, std::chrono::seconds(1));
+    EXPECT_EQ(parseIsoTimestamp("2023-12-01T15:30:45.123Z") - tp_whole, std::chrono::milliseconds(123));
+    EXPECT_EQ(parseIsoTimestamp("2023-12-01T15:30:45,5Z") - tp_whole, std::chrono::milliseconds(500));
+    EXPECT_EQ(parseIsoTimestamp("2023-12-01T15:30:45.000001Z") - tp_whole, std::chrono::microseconds(1));
+}
+
+// ---------------------------------------------------------------------------
+// parseIsoTimestamp – offsets
+// ---------------------------------------------------------------------------
+
+TEST(ParseIsoTimestampTest, OffsetsAreAppliedToUtc) {
+    auto utc = parseIsoTimestamp("2023-12-01T13:30:45Z");
+    EXPECT_EQ(parseIsoTimestamp("2023-12-01T15:30:45+02:00"), utc);
+    EXPECT_EQ(parseIsoTimestamp("2023-12-01T15:30:45+0200"), utc);
+    EXPECT_EQ(parseIsoTimestamp("2023-12-01T15:30:45+02"), utc);
+    EXPECT_EQ(parseIsoTimestamp("2023-12-01T08:00:45-05:30"), utc);
+    EXPECT_EQ(parseIsoTimestamp("2023-12-01 13:30:45"), utc);
+    EXPECT_EQ(parseIsoTimestamp("2023-12-01t13:30:45z"), utc);
+    // Crosses back over midnight and a year boundary.
+    EXPECT_EQ(parseIsoTimestamp("2024-01-01T01:00:00+02:00"), parseIsoTimestamp("2023-12-31T23:00:00Z"));
+}
+
+TEST(ParseIsoTimestampTest, TryParseRejectsMalformedInput) {
+    std::chrono::system_clock::time_point tp;
+    for (const char* bad : {"2023-13-01", "2023-02-29", "2023-12-01T24:00:00Z", "2023-12-01T15:30:45.Z",
+                            "2023-12-01T15:30:45+02:", "2023-12-01T15:30:45Zjunk", "2023-12-01T15", "20231201",
+                            "2023-12-01T15:30:45+24:00"}) {
+        EXPECT_FALSE(tryParseIsoTimestamp(bad, tp)) << bad;
+    }
+    // Year 9999 is out of range only for a clock as fine as nanoseconds, which cannot reach past 2262.
+    constexpr std::int64_t kLastDayOf9999 = 253402214400;
+    constexpr auto kClockMaxSeconds =
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::duration::max()).count();
+    EXPECT_EQ(tryParseIsoTimestamp("9999-12-31T00:00:00Z", tp), kLastDayOf9999 < kClockMaxSeconds);
+    EXPECT_TRUE(tryParseIsoTimestamp("2024-02-29T00:00Z", tp));
+    EXPECT_TRUE(tryParseIsoTimestamp("1969-12-31T23:59:60Z", tp));
+    EXPECT_EQ(tp, std::chrono::system_clock::from_time_t(0));
+}
+
+// ---------------------------------------------------------------------------
+// formatIsoTimestamp
+// ---------------------------------------------------------------------------
+
+TEST(FormatIsoTimestampTest, WritesRequestedFractionDigits) {
+    auto tp = parseIsoTimestamp("2023-12-01T15:30:45.123456789Z");
+    char buffer[kIsoTimestampMaxLength];
+    char* end = formatIsoTimestamp(tp, buffer, 3);
+    EXPECT_EQ(std::string(buffer, end), "2023-12-01T15:30:45.123Z");
+    end = formatIsoTimestamp(tp, buffer, 9);
+    ASSERT_EQ(static_cast<std::size_t>(end - buffer), kIsoTimestampMaxLength);
+    EXPECT_EQ(std::string(buffer, end), "2023-12-01T15:30:45.123456789Z");
+    EXPECT_EQ(timePointToIsoString(tp), "2023-12-01T15:30:45Z");
+}
+
+TEST(FormatIsoTimestampTest, HandlesTimesBeforeTheEpoch) {
+    auto tp = std::chrono::system_clock::from_time_t(0) - std::chrono::milliseconds(1);
+    char buffer[kIsoTimestampMaxLength];
+    char* end = formatIsoTimestamp(tp, buffer, 3);
+    EXPECT_EQ(std::string(buffer, end), "1969-12-31T23:59:59.999Z");
+    EXPECT_EQ(timePointToIsoString(parseIsoTimestamp("1900-02-28T12:00:00Z")), "1900-02-28T12:00:00Z");
 }
 
 // ---------------------------------------------------------------------------
@@ -113,3 +169,63 @@ TEST(ParseIsoTimestampTest, DateOnlyParsesAsMidnightUtc) {
     auto expected = std::chrono::system_clock::from_time_t(1701388800);
     EXPECT_EQ(tp, expected);
 }
+
+// ---------------------------------------------------------------------------
+// ISO 8601 durations
+// ---------------------------------------------------------------------------
+
+TEST(IsoDurationTest, ParsesEveryComponent) {
+    using namespace std::chrono;
+    nanoseconds d;
+    ASSERT_TRUE(tryParseIsoDuration("P1DT2H30M", d));
+    EXPECT_EQ(d, hours(26) + minutes(30));
+    ASSERT_TRUE(tryParseIsoDuration("PT0.000001S", d));
+    EXPECT_EQ(d, microseconds(1));
+    ASSERT_TRUE(tryParseIsoDuration("-PT1.5S", d));
+    EXPECT_EQ(d, milliseconds(-1500));
+    ASSERT_TRUE(tryParseIsoDuration("P2W", d));
+    EXPECT_EQ(d, hours(24 * 14));
+    ASSERT_TRUE(tryParseIsoDuration("P1Y2M", d));
+    EXPECT_EQ(d, seconds(31556952 + 2 * 2629746));
+    ASSERT_TRUE(tryParseIsoDuration("PT0,5H", d));
+    EXPECT_EQ(d, minutes(30));
+    ASSERT_TRUE(tryParseIsoDuration("P0D", d));
+    EXPECT_EQ(d, nanoseconds(0));
+    EXPECT_EQ(parseIsoDuration("PT2.5S").count(), 2.5);
+}
+
+TEST(IsoDurationTest, RejectsMalformedDurations) {
+    std::chrono::nanoseconds d;
+    for (const char* bad : {"", "P", "PT", "P1DT", "1D", "PT1D", "P1H", "PT1S2M", "P1M1Y", "PT1.5M2S", "PT.5S",
+                            "PT1.S", "PT-1S", "P1D2", "PT1SX", "P300Y", "PT99999999999999999999S"}) {
+        EXPECT_FALSE(tryParseIsoDuration(bad, d)) << bad;
+    }
+    EXPECT_THROW(parseIsoDuration("PTxS"), std::runtime_error);
+}
+
+TEST(IsoDurationTest, FormatsDaysAndTime) {
+    using namespace std::chrono;
+    char buffer[kIsoDurationMaxLength];
+    auto format = [&](nanoseconds d) { return std::string(buffer, formatIsoDuration(d, buffer)); };
+    EXPECT_EQ(format(hours(26) + minutes(30)), "P1DT2H30M");
+    EXPECT_EQ(format(hours(48)), "P2D");
+    EXPECT_EQ(format(nanoseconds(0)), "PT0S");
+    EXPECT_EQ(format(microseconds(-1)), "-PT0.000001S");
+    EXPECT_EQ(format(milliseconds(61250)), "PT1M1.25S");
+    EXPECT_EQ(format(nanoseconds::min()), "-P106751DT23H47M16.854775808S");
+    EXPECT_EQ(format(nanoseconds::min()).size(), kIsoDurationMaxLength);
+
+    nanoseconds parsed;
+    ASSERT_TRUE(tryParseIsoDuration(format(nanoseconds::min()), parsed));
+    EXPECT_EQ(parsed, nanoseconds::min());
+}
+
+TEST(IsoDurationTest, DurationToIsoStringUsesSecondsOnly) {
+    using namespace std::chrono;
+    EXPECT_EQ(durationToIsoString(duration<double>(1.1)), "PT1.1S");
+    EXPECT_EQ(durationToIsoString(duration<double>(5400)), "PT5400S");
+    EXPECT_EQ(durationToIsoString(duration<double>(86400.000001)), "PT86400.000001S");
+    EXPECT_EQ(durationToIsoString(duration<double>(0)), "PT0S");
+    EXPECT_EQ(durationToIsoString(duration<double>(-0.25)), "-PT0.25S");
+    EXPECT_EQ(parseIsoDuration(durationToIsoString(duration<double>(5400.5))).count(), 5400.5);
+}
@@ -0,0 +1,109 @@
+#include "stinger/utils/format.hpp"
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+using namespace stinger::utils;
+
+TEST(FormatTest, ReplacesEveryOccurrence) {
+    std::map<std::string, std::string> values = {{"name", "World"}, {"greeting", "Hello"}};
+    EXPECT_EQ(format("{greeting}, {name}! {name}?", values), "Hello, World! World?");
+}
+
+TEST(FormatTest, LeavesUnknownPlaceholdersAndStrayBraces) {
+    std::map<std::string, std::string> values = {{"a", "{b}"}, {"b", "x"}};
+    EXPECT_EQ(format("{a}/{c}/{}/{{b}/b}", values), "{b}/{c}/{}/{x/b}");
+}
+
+TEST(CompiledTemplateTest, BindsPlaceholdersInOrderOfFirstUse) {
+    CompiledTemplate topic("{prefix}/{device}/signal/{name}/{device}");
+    ASSERT_EQ(topic.PlaceholderCount(), 3u);
+    EXPECT_EQ(topic.PlaceholderName(0), "prefix");
+    EXPECT_EQ(topic.PlaceholderIndex("device"), 1);
+    EXPECT_EQ(topic.PlaceholderIndex("name"), 2);
+    EXPECT_EQ(topic.PlaceholderIndex("missing"), -1);
+    EXPECT_EQ(topic.Render({"home", "lamp-1", "toggled"}), "home/lamp-1/signal/toggled/lamp-1");
+}
+
+TEST(CompiledTemplateTest, RendersIntoCallerBuffers) {
+    CompiledTemplate topic("a/{x}/b");
+    CompiledTemplate moved = std::move(topic);
+    std::string_view values[] = {"value"};
+    EXPECT_EQ(moved.RenderedSize(values, 1), 9u);
+    char buffer[9];
+    EXPECT_EQ(moved.RenderTo(values, 1, buffer), buffer + 9);
+    EXPECT_EQ(std::string(buffer, 9), "a/value/b");
+
+    std::string out = "old contents";
+    moved.Render(values, 1, out);
+    EXPECT_EQ(out, "a/value/b");
+    EXPECT_EQ(moved.Render({""}), "a//b");
+    EXPECT_THROW(moved.Render({"one", "two"}), std::invalid_argument);
+    EXPECT_EQ(CompiledTemplate("no placeholders").Render({}), "no placeholders");
+}
+
+TEST(StaticTemplateTest, ParsesAtCompileTime) {
+    static constexpr StaticTemplate kTopic("{prefix}/{device}/signal/{name}");
+    static_assert(kTopic.PlaceholderCount() == 3);
+    static_assert(kTopic.PlaceholderIndex("device") == 1);
+    static_assert(kTopic.PlaceholderName(2) == "name");
+    EXPECT_EQ(kTopic.Render({"home", "lamp-1", "toggled"}),
+              CompiledTemplate("{prefix}/{device}/signal/{name}").Render({"home", "lamp-1", "toggled"}));
+    EXPECT_THROW(kTopic.Render({"home"}), std::invalid_argument);
+}
+
+TEST(TemplateMatchTest, ExtractsPlaceholderValues) {
+    CompiledTemplate topic("devices/{id}/prop/{name}");
+    std::string_view values[2];
+    ASSERT_TRUE(topic.Match("devices/lamp-1/prop/brightness", values, 2));
+    EXPECT_EQ(values[0], "lamp-1");
+    EXPECT_EQ(values[1], "brightness");
+    EXPECT_EQ(topic.Render(values, 2), "devices/lamp-1/prop/brightness");
+
+    EXPECT_FALSE(topic.Match("devices/lamp-1/prop", values, 2));
+    EXPECT_FALSE(topic.Match("devices/lamp-1/prop/brightness/extra", values, 2));
+    EXPECT_FALSE(topic.Match("devices/a/b/prop/brightness", values, 2));
+    EXPECT_FALSE(topic.Match("device/lamp-1/prop/brightness", values, 2));
+    ASSERT_TRUE(topic.Match("devices//prop/x", values, 2));
+    EXPECT_EQ(values[0], "");
+    EXPECT_THROW(topic.Match("devices/a/prop/b", values, 1), std::invalid_argument);
+}
+
+TEST(TemplateMatchTest, HandlesPartialLevelsAndRepeats) {
+    CompiledTemplate topic("{prefix}/dev-{id}.{format}/{id}");
+    std::string_view values[3];
+    ASSERT_TRUE(topic.Match("home/dev-7.json/7", values, 3));
+    EXPECT_EQ(values[0], "home");
+    EXPECT_EQ(values[1], "7");
+    EXPECT_EQ(values[2], "json");
+    EXPECT_FALSE(topic.Match("home/dev-7.json/8", values, 3));
+    EXPECT_FALSE(topic.Match("home/device-7.json/7", values, 3));
+}
+
+TEST(TemplateMatchTest, BacktracksWithinALevel) {
+    CompiledTemplate topic("{a}_x/y");
+    std::string_view value;
+    ASSERT_TRUE(topic.Match("foo_x_x/y", &value, 1));
+    EXPECT_EQ(value, "foo_x");
+    EXPECT_FALSE(topic.Match("foo_x_y/y", &value, 1));
+
+    // A failed attempt must not leave a later placeholder bound.
+    CompiledTemplate repeated("{a}_{b}_z/{b}");
+    std::string_view values[2];
+    ASSERT_TRUE(repeated.Match("p_q_r_z/r", values, 2));
+    EXPECT_EQ(values[0], "p_q");
+    EXPECT_EQ(values[1], "r");
+}
+
+TEST(TemplateMatchTest, DerivesSubscriptionFilter) {
+    EXPECT_EQ(CompiledTemplate("devices/{id}/prop/{name}").SubscriptionFilter(), "devices/+/prop/+");
+    EXPECT_EQ(CompiledTemplate("{prefix}/dev-{id}/state").SubscriptionFilter(), "+/+/state");
+    EXPECT_EQ(CompiledTemplate("fixed/topic").SubscriptionFilter(), "fixed/topic");
+
+    static constexpr StaticTemplate kTopic("devices/{id}/prop/{name}");
+    EXPECT_EQ(kTopic.SubscriptionFilter(), "devices/+/prop/+");
+    std::string_view values[2];
+    ASSERT_TRUE(kTopic.Match("devices/x/prop/y", values, 2));
+    EXPECT_EQ(values[1], "y");
+}
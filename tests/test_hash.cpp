@@ -0,0 +1,48 @@
+#include "stinger/utils/hash.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <unordered_set>
+
+using namespace stinger::utils;
+
+namespace {
+
+constexpr std::string_view kLongTopic = "building/floor-3/room-12/sensors/temperature/celsius/average-over-5-minutes";
+
+} // namespace
+
+TEST(HashBytesTest, MatchesAtCompileTimeAndRunTime) {
+    static_assert(hashBytes("sensor/temperature") != hashBytes("sensor/humidity"));
+    constexpr std::uint64_t kCompiled = hashBytes(kLongTopic);
+    std::string runtime(kLongTopic);
+    EXPECT_EQ(hashBytes(runtime), kCompiled);
+    for (std::size_t size = 0; size <= kLongTopic.size(); ++size) {
+        EXPECT_EQ(hashBytes(std::string(kLongTopic.substr(0, size))), hashBytes(kLongTopic.substr(0, size)));
+    }
+    EXPECT_NE(hashBytes("topic", 1), hashBytes("topic", 2));
+}
+
+TEST(HashBytesTest, DistinguishesEveryLength) {
+    std::unordered_set<std::uint64_t> seen;
+    std::string zeros;
+    for (int size = 0; size < 200; ++size) {
+        EXPECT_TRUE(seen.insert(hashBytes(zeros)).second) << size;
+        zeros += '\0';
+    }
+}
+
+TEST(HashBytesTest, HasNoCollisionsOnSimilarTopics) {
+    std::unordered_set<std::uint64_t> seen;
+    for (int i = 0; i < 100000; ++i) {
+        ASSERT_TRUE(seen.insert(hashBytes("devices/" + std::to_string(i) + "/prop/value")).second) << i;
+    }
+}
+
+TEST(HasherTest, ChainsPartsInOrder) {
+    static_assert(Hasher().Add("ab").Add("c").Value() != Hasher().Add("a").Add("bc").Value());
+    constexpr std::uint64_t kKey = Hasher().Add("sensor/temperature").Add(42).Value();
+    std::string topic = "sensor/temperature";
+    EXPECT_EQ(Hasher().Add(topic).Add(42u).Value(), kKey);
+    EXPECT_NE(Hasher().Add(42).Add(topic).Value(), kKey);
+    EXPECT_NE(Hasher().Add("").Value(), Hasher().Value());
+}
@@ -126,3 +126,44 @@ TEST_F(MockConnectionTest, TopicMatching) {
     EXPECT_TRUE(mock->TopicMatchesSubscription("sensor/temp/room1", "sensor/#"));
     EXPECT_FALSE(mock->TopicMatchesSubscription("sensor/temp", "device/temp"));
 }
+
+TEST_F(MockConnectionTest, SubscribeMany) {
+    auto subIds = mock->SubscribeMany({"sensor/temperature", "sensor/humidity"}, 1);
+
+    ASSERT_EQ(subIds.size(), 2);
+    EXPECT_GT(subIds[0], 0);
+    EXPECT_EQ(subIds[0], subIds[1]);
+    EXPECT_TRUE(mock->IsSubscribed("sensor/temperature"));
+    EXPECT_TRUE(mock->IsSubscribed("sensor/humidity"));
+    EXPECT_EQ(mock->GetSubscriptionQos("sensor/humidity"), 1);
+}
+
+TEST_F(MockConnectionTest, UnsubscribeMany) {
+    mock->SubscribeMany({"sensor/temperature", "sensor/humidity", "sensor/pressure"}, 1);
+
+    mock->UnsubscribeMany({"sensor/temperature", "sensor/humidity"});
+    EXPECT_FALSE(mock->IsSubscribed("sensor/temperature"));
+    EXPECT_FALSE(mock->IsSubscribed("sensor/humidity"));
+    EXPECT_TRUE(mock->IsSubscribed("sensor/pressure"));
+}
+
+TEST_F(MockConnectionTest, SharedSubscription) {
+    bool callbackCalled = false;
+    mqtt::Message receivedMsg("", "");
+    mock->AddMessageCallback([&](const mqtt::Message& msg) {
+        callbackCalled = true;
+        receivedMsg = msg;
+    });
+
+    int subId = mock->SubscribeShared("workers", "service/+/request", 1);
+    EXPECT_TRUE(mock->IsSubscribed("$share/workers/service/+/request"));
+    EXPECT_TRUE(mock->TopicMatchesSubscription("service/add/request", "$share/workers/service/+/request"));
+
+    mock->SimulateIncomingMessage(mqtt::Message::Signal("service/add/request", "{}"));
+    EXPECT_TRUE(callbackCalled);
+    ASSERT_TRUE(receivedMsg.properties.GetSubscriptionId().has_value());
+    EXPECT_EQ(receivedMsg.properties.GetSubscriptionId().value(), subId);
+
+    mock->UnsubscribeShared("workers", "service/+/request");
+    EXPECT_FALSE(mock->IsSubscribed("$share/workers/service/+/request"));
+}
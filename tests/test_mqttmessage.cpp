@@ -2,6 +2,8 @@
 #include "stinger/mqtt/properties.hpp"
 #include <cstddef>
 #include <gtest/gtest.h>
+#include <optional>
+#include <stdexcept>
 #include <vector>
 
 using namespace stinger;
@@ -167,6 +169,43 @@ TEST(MqttMessageTest, MethodResponseFactoryMethod) {
     EXPECT_EQ(*msg.properties.contentType, "application/json");
 }
 
+TEST(MqttMessageTest, FactoriesTagTheirKind) {
+    using mqtt::MessageKind;
+    using mqtt::MessageSchema;
+    std::vector<std::byte> correlationData = {std::byte{0x01}};
+    auto methodRequest = mqtt::Message::MethodRequest("m", "{}", correlationData, "r");
+    auto propertyValue = mqtt::Message::PropertyValue("p", "{}", 3);
+    auto online = mqtt::Message::ServiceOnline("s", "{}", 60);
+
+    EXPECT_EQ(mqtt::Message("t", "p").kind, MessageKind::Generic);
+    EXPECT_EQ(mqtt::Message::Signal("s", "{}").kind, MessageKind::Signal);
+    EXPECT_EQ(methodRequest.kind, MessageKind::MethodRequest);
+    EXPECT_EQ(methodRequest.qos, MessageSchema<MessageKind::MethodRequest>::kQos);
+    EXPECT_EQ(propertyValue.kind, MessageKind::PropertyValue);
+    EXPECT_EQ(propertyValue.retain, MessageSchema<MessageKind::PropertyValue>::kRetain);
+    EXPECT_EQ(online.kind, MessageKind::ServiceOnline);
+
+    // Every property a factory sets is in its schema.
+    EXPECT_EQ(methodRequest.properties.PresentMask() & ~MessageSchema<MessageKind::MethodRequest>::kProperties, 0);
+    EXPECT_EQ(propertyValue.properties.PresentMask() & ~MessageSchema<MessageKind::PropertyValue>::kProperties, 0);
+    EXPECT_EQ(online.properties.PresentMask() & ~MessageSchema<MessageKind::ServiceOnline>::kProperties, 0);
+
+    methodRequest.Recycle();
+    EXPECT_EQ(methodRequest.kind, MessageKind::Generic);
+}
+
+TEST(MqttMessageTest, UserPropertyNamesAreRecognized) {
+    using mqtt::UserProperty;
+    EXPECT_EQ(mqtt::userPropertyFromName("DebugInfo"), UserProperty::DebugInfo);
+    EXPECT_EQ(mqtt::userPropertyFromName("ReturnCode"), UserProperty::ReturnCode);
+    EXPECT_EQ(mqtt::userPropertyFromName("PropertyVersion"), UserProperty::PropertyVersion);
+    EXPECT_EQ(mqtt::userPropertyFromName("Version"), UserProperty::Version);
+    EXPECT_EQ(mqtt::userPropertyFromName("version"), UserProperty::Unknown);
+    EXPECT_EQ(mqtt::userPropertyFromName("Versions"), UserProperty::Unknown);
+    EXPECT_EQ(mqtt::userPropertyFromName(""), UserProperty::Unknown);
+    static_assert(mqtt::userPropertyFromName("ReturnCode") == UserProperty::ReturnCode, "usable at compile time");
+}
+
 // Test mqtt::Properties
 TEST(MqttPropertiesTest, DefaultConstructor) {
     mqtt::Properties props;
@@ -203,6 +242,266 @@ TEST(MqttPropertiesTest, SetProperties) {
     EXPECT_EQ(*props.version, "1.0.0");
 }
 
+TEST(MqttPropertiesTest, TypicalPropertiesStayInline) {
+    auto msg = mqtt::Message::MethodResponse("client/response", "{}", std::vector<std::byte>(16, std::byte{0x5a}),
+                                             stinger::error::MethodReturnCode::SUCCESS, "ok");
+    EXPECT_TRUE(msg.properties.IsInline());
+    EXPECT_LE(sizeof(mqtt::Properties), 192u);
+
+    mqtt::Properties copy(msg.properties);
+    EXPECT_TRUE(copy.IsInline());
+    EXPECT_EQ(copy.GetCorrelationData(), msg.properties.GetCorrelationData());
+    EXPECT_EQ(copy.GetContentType(), msg.properties.GetContentType());
+    EXPECT_EQ(copy.GetReturnCode(), msg.properties.GetReturnCode());
+}
+
+TEST(MqttPropertiesTest, ReassignShiftsOtherFields) {
+    mqtt::Properties props;
+    props.SetCorrelationData(std::vector<std::byte>{std::byte{1}, std::byte{2}});
+    props.SetResponseTopic("reply/here");
+    props.SetContentType("application/json");
+    props.SetVersion("1.0.0");
+
+    props.SetResponseTopic("a/much/longer/reply/topic");
+    EXPECT_EQ(*props.GetResponseTopic(), "a/much/longer/reply/topic");
+    EXPECT_EQ(*props.GetContentType(), "application/json");
+    EXPECT_EQ(*props.GetVersion(), "1.0.0");
+    EXPECT_STREQ(props.GetContentType()->c_str(), "application/json");
+
+    props.SetResponseTopic("r");
+    props.SetContentType(std::nullopt);
+    EXPECT_FALSE(props.GetContentType().has_value());
+    EXPECT_EQ(*props.GetResponseTopic(), "r");
+    EXPECT_EQ(*props.GetVersion(), "1.0.0");
+    ASSERT_EQ(props.GetCorrelationData()->size(), 2u);
+    EXPECT_EQ((*props.GetCorrelationData())[1], std::byte{2});
+
+    // A value may come from the same Properties.
+    props.SetDebugInfo(props.GetVersion());
+    EXPECT_EQ(*props.GetDebugInfo(), "1.0.0");
+}
+
+TEST(MqttPropertiesTest, LargeValuesMoveToHeap) {
+    mqtt::Properties props;
+    props.SetContentType("application/json");
+    props.SetDebugInfo(std::string(500, 'd'));
+    EXPECT_FALSE(props.IsInline());
+    EXPECT_EQ(props.GetDebugInfo()->size(), 500u);
+    EXPECT_EQ(*props.GetContentType(), "application/json");
+
+    mqtt::Properties copy;
+    copy = props;
+    EXPECT_EQ(copy.GetDebugInfo(), props.GetDebugInfo());
+
+    mqtt::Properties moved(std::move(props));
+    EXPECT_FALSE(moved.IsInline());
+    EXPECT_EQ(moved.GetDebugInfo(), copy.GetDebugInfo());
+    EXPECT_EQ(*moved.GetContentType(), "application/json");
+
+    EXPECT_THROW(copy.SetDebugInfo(std::string(70000, 'x')), std::length_error);
+    EXPECT_EQ(copy.GetDebugInfo(), moved.GetDebugInfo());
+}
+
+TEST(MqttPropertiesTest, SettersTakeOptionals) {
+    mqtt::Properties props;
+    EXPECT_EQ(props.GetReturnCode(), std::nullopt);
+    EXPECT_FALSE(props.GetVersion().has_value());
+
+    std::optional<int> code = -3;
+    props.SetReturnCode(code);
+    EXPECT_EQ(props.GetReturnCode(), code);
+    props.SetReturnCode(std::nullopt);
+    EXPECT_FALSE(props.Has(mqtt::PropertyField::ReturnCode));
+
+    props.SetResponseTopic(std::optional<std::string>("reply"));
+    std::optional<std::string> topic = props.GetResponseTopic()->str();
+    EXPECT_EQ(topic, std::optional<std::string>("reply"));
+    props.SetResponseTopic(std::optional<std::string>());
+    EXPECT_FALSE(props.GetResponseTopic());
+
+    props.SetCorrelationData(std::optional<std::vector<std::byte>>(std::vector<std::byte>(3)));
+    EXPECT_EQ(props.GetCorrelationData()->vec(), std::vector<std::byte>(3));
+    props.SetCorrelationData(std::nullopt);
+    EXPECT_EQ(props.PresentMask(), 0);
+}
+
+TEST(MqttPropertiesTest, FieldsMatchAccessors) {
+    mqtt::Properties props;
+    props.correlationData = std::vector<std::byte>{std::byte{1}, std::byte{2}};
+    props.responseTopic = std::string("reply/here");
+    props.subscriptionId = 7u;
+    props.returnCode = -3;
+    EXPECT_EQ(*props.GetResponseTopic(), "reply/here");
+    EXPECT_EQ(props.GetCorrelationData()->size(), 2u);
+    EXPECT_EQ(props.GetSubscriptionId(), 7u);
+    EXPECT_EQ(props.returnCode, -3);
+    EXPECT_EQ(props.returnCode.value_or(0), -3);
+
+    props.SetContentType("application/json");
+    std::optional<std::string> contentType = props.contentType;
+    EXPECT_EQ(contentType, std::optional<std::string>("application/json"));
+    EXPECT_EQ(props.contentType->size(), contentType->size());
+    EXPECT_EQ(props.version, std::nullopt);
+    EXPECT_EQ(props.version.value_or("none"), "none");
+    EXPECT_THROW(props.version.value(), std::bad_optional_access);
+
+    // Each Properties' fields read its own values after a copy or move.
+    mqtt::Properties copy(props);
+    props.responseTopic = "changed";
+    EXPECT_EQ(*copy.responseTopic, "reply/here");
+    mqtt::Properties moved(std::move(copy));
+    EXPECT_EQ(*moved.responseTopic, "reply/here");
+    moved.contentType = props.responseTopic;
+    EXPECT_EQ(*moved.contentType, "changed");
+
+    moved.correlationData = std::nullopt;
+    moved.returnCode.reset();
+    EXPECT_FALSE(moved.correlationData);
+    EXPECT_FALSE(moved.Has(mqtt::PropertyField::ReturnCode));
+}
+
+TEST(MqttPropertiesTest, UserPropertiesKeepOrderAndStayInline) {
+    mqtt::Properties props;
+    props.SetContentType("application/json");
+    props.AddUserProperty("tenant", "acme");
+    props.AddUserProperty("trace", "4bf92f35");
+    props.AddUserProperty("tenant", "other");
+    EXPECT_TRUE(props.IsInline());
+    EXPECT_EQ(props.GetUserProperties().Size(), 3u);
+    EXPECT_EQ(*props.GetUserProperties().Find("tenant"), "acme");
+    EXPECT_FALSE(props.GetUserProperties().Find("missing").has_value());
+    EXPECT_EQ(*props.GetContentType(), "application/json");
+
+    std::vector<std::string> seen;
+    for (const auto& entry : props.GetUserProperties()) {
+        seen.push_back(entry.name.str() + "=" + entry.value.str());
+    }
+    EXPECT_EQ(seen, (std::vector<std::string>{"tenant=acme", "trace=4bf92f35", "tenant=other"}));
+    EXPECT_STREQ(props.GetUserProperties().begin()->value.c_str(), "acme");
+
+    props.SetUserProperty("tenant", "globex");
+    mqtt::UserProperties entries = props.GetUserProperties();
+    EXPECT_EQ(entries.Size(), 2u);
+    EXPECT_EQ(entries.begin()->name, "tenant");
+    EXPECT_EQ(entries.begin()->value, "globex");
+
+    props.SetContentType("text/plain");
+    EXPECT_EQ(*props.GetUserProperties().Find("trace"), "4bf92f35");
+    EXPECT_EQ(props.EraseUserProperty("trace"), 1u);
+    EXPECT_EQ(props.EraseUserProperty("trace"), 0u);
+    EXPECT_EQ(props.EraseUserProperty("tenant"), 1u);
+    EXPECT_TRUE(props.GetUserProperties().Empty());
+    EXPECT_FALSE(props.Has(mqtt::PropertyField::UserProperties));
+}
+
+TEST(MqttPropertiesTest, UserPropertiesCopyAndGrow) {
+    mqtt::Properties props;
+    for (int i = 0; i < 20; ++i) {
+        props.AddUserProperty("key" + std::to_string(i), std::string(10, static_cast<char>('a' + i)));
+    }
+    EXPECT_FALSE(props.IsInline());
+    props.SetVersion("2.0");
+
+    mqtt::Properties copy(props);
+    EXPECT_EQ(copy.GetUserProperties(), props.GetUserProperties());
+    EXPECT_EQ(*copy.GetUserProperties().Find("key19"), std::string(10, 't'));
+
+    // Values may come from the same Properties.
+    copy.SetUserProperty("key0", *copy.GetUserProperties().Find("key19"));
+    copy.AddUserProperty(*copy.GetVersion(), *copy.GetUserProperties().Find("key1"));
+    EXPECT_EQ(*copy.GetUserProperties().Find("key0"), std::string(10, 't'));
+    EXPECT_EQ(*copy.GetUserProperties().Find("2.0"), std::string(10, 'b'));
+    EXPECT_NE(copy.GetUserProperties(), props.GetUserProperties());
+
+    copy.SetUserProperties(props.GetUserProperties());
+    EXPECT_EQ(copy.GetUserProperties(), props.GetUserProperties());
+    copy.SetUserProperties(copy.GetUserProperties());
+    EXPECT_EQ(copy.GetUserProperties(), props.GetUserProperties());
+    copy.ClearUserProperties();
+    EXPECT_TRUE(copy.GetUserProperties().Empty());
+    EXPECT_EQ(*copy.GetVersion(), "2.0");
+
+    EXPECT_THROW(copy.AddUserProperty("big", std::string(70000, 'x')), std::length_error);
+    EXPECT_TRUE(copy.GetUserProperties().Empty());
+}
+
+TEST(MqttMessageTest, MoveKeepsContents) {
+    auto original = mqtt::Message::MethodRequest("method/call", std::string(100, 'p'), std::vector<std::byte>(16),
+                                                 "method/response");
+    const char* payloadBuffer = original.payload.data();
+    mqtt::Message moved(std::move(original));
+    EXPECT_EQ(moved.payload.data(), payloadBuffer);
+    EXPECT_EQ(*moved.properties.GetResponseTopic(), "method/response");
+
+    mqtt::Message assigned("", "");
+    assigned = std::move(moved);
+    EXPECT_EQ(assigned.topic, "method/call");
+    EXPECT_EQ(assigned.qos, 2u);
+}
+
+TEST(MqttMessageTest, RecycleClearsButKeepsBuffers) {
+    auto msg = mqtt::Message::PropertyValue("prop/value", std::string(100, 'p'), 3);
+    const char* payloadBuffer = msg.payload.data();
+    msg.Recycle();
+    EXPECT_TRUE(msg.topic.empty());
+    EXPECT_TRUE(msg.payload.empty());
+    EXPECT_EQ(msg.qos, 0u);
+    EXPECT_FALSE(msg.retain);
+    EXPECT_FALSE(msg.properties.GetContentType().has_value());
+    EXPECT_FALSE(msg.properties.GetPropertyVersion().has_value());
+    msg.payload.assign(50, 'q');
+    EXPECT_EQ(msg.payload.data(), payloadBuffer);
+}
+
+TEST(MqttMessageTest, CopyOutlivesRecycling) {
+    mqtt::Message received("", "");
+    received.payload.reserve(4096);
+    received.topic = "first/topic";
+    received.payload = "first";
+    received.properties.SetResponseTopic("first/reply");
+
+    mqtt::Message kept = received;
+    received.Recycle();
+    received.topic = "second/topic";
+    received.payload = "second";
+
+    EXPECT_EQ(kept.topic, "first/topic");
+    EXPECT_EQ(kept.payload, "first");
+    EXPECT_EQ(*kept.properties.GetResponseTopic(), "first/reply");
+    EXPECT_LT(kept.payload.capacity(), 4096u);
+}
+
+TEST(MqttMessageTest, RecycleReleasesOutsizedBuffers) {
+    mqtt::Message received("big/topic", std::string(100 * 1024, 'p'));
+    received.properties.SetDebugInfo(std::string(60000, 'd'));
+    received.properties.SetVersion(std::string(10000, 'v'));
+    ASSERT_GT(received.properties.ArenaCapacity(), 64u * 1024);
+
+    received.Recycle();
+    EXPECT_LE(received.payload.capacity(), 64u * 1024);
+    EXPECT_TRUE(received.properties.IsInline());
+}
+
+TEST(MqttMessageTest, ShrinkToFitKeepsValues) {
+    mqtt::Properties props;
+    props.SetDebugInfo(std::string(1000, 'd'));
+    props.SetContentType("application/json");
+    props.SetDebugInfo(std::nullopt);
+    EXPECT_FALSE(props.IsInline());
+
+    props.ShrinkToFit();
+    EXPECT_TRUE(props.IsInline());
+    EXPECT_EQ(*props.GetContentType(), "application/json");
+
+    props.SetDebugInfo(std::string(500, 'd'));
+    props.SetVersion(std::string(1500, 'v'));
+    props.SetVersion(std::nullopt);
+    props.ShrinkToFit();
+    EXPECT_FALSE(props.IsInline());
+    EXPECT_EQ(props.ArenaCapacity(), 500u + 1 + sizeof("application/json"));
+    EXPECT_EQ(props.GetDebugInfo()->size(), 500u);
+}
+
 // Test edge cases
 TEST(MqttMessageTest, EmptyPayload) {
     auto msg = mqtt::Message::Signal("test/topic", "");
@@ -0,0 +1,271 @@
+#include "fakebroker.hpp"
+#include "stinger/mqtt/nativeconnection.hpp"
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <gtest/gtest.h>
+#include <thread>
+
+using namespace stinger;
+using mqtt::PacketType;
+
+namespace {
+
+mqtt::ConnectOptions ResumableOptions() {
+    mqtt::ConnectOptions options;
+    options.sessionExpiryInterval = 3600;
+    return options;
+}
+
+bool WaitUntilConnected(const mqtt::NativeConnection& connection, bool connected) {
+    for (int i = 0; i < 500 && connection.IsConnected() != connected; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return connection.IsConnected() == connected;
+}
+
+// Answers the CONNECT and acknowledges the online message that follows it.
+void CompleteConnect(test::FakeBroker& broker, bool sessionPresent) {
+    broker.SendConnack(sessionPresent);
+    test::BrokerPacket online;
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, online));
+    EXPECT_TRUE(online.Publish().retain);
+    broker.SendAck(PacketType::Puback, online.PacketId());
+}
+
+void Connect(test::FakeBroker& broker, bool sessionPresent) {
+    test::BrokerPacket connect;
+    ASSERT_TRUE(broker.Accept());
+    ASSERT_TRUE(broker.Expect(PacketType::Connect, connect));
+    CompleteConnect(broker, sessionPresent);
+}
+
+// Drops the connection and accepts the reconnect without answering its CONNECT, so that the client is offline until
+// the test calls CompleteConnect().
+void Reconnect(test::FakeBroker& broker, mqtt::NativeConnection& connection) {
+    broker.Drop();
+    test::BrokerPacket connect;
+    ASSERT_TRUE(broker.Accept(std::chrono::seconds(10)));
+    ASSERT_TRUE(broker.Expect(PacketType::Connect, connect));
+    ASSERT_FALSE(connection.IsConnected());
+}
+
+bool IsReady(const std::future<bool>& future) {
+    return future.wait_for(std::chrono::milliseconds(100)) == std::future_status::ready;
+}
+
+void SubscribeOnline(test::FakeBroker& broker, mqtt::NativeConnection& connection, const std::string& topic) {
+    connection.Subscribe(topic, 1);
+    test::BrokerPacket subscribe;
+    ASSERT_TRUE(broker.Expect(PacketType::Subscribe, subscribe));
+    EXPECT_EQ(subscribe.Topics(), std::vector<std::string>{topic});
+    broker.SendSuback(subscribe);
+}
+
+} // namespace
+
+TEST(NativeConnectionTest, UnsubscribeWhileOfflineIsSentToResumedSession) {
+    test::FakeBroker broker;
+    mqtt::NativeConnection connection("127.0.0.1", broker.Port(), "resume", ResumableOptions());
+    Connect(broker, false);
+    SubscribeOnline(broker, connection, "sensor/temperature");
+    Reconnect(broker, connection);
+
+    connection.Unsubscribe("sensor/temperature");
+    broker.SendConnack(true);
+
+    test::BrokerPacket packet;
+    ASSERT_TRUE(broker.Expect(PacketType::Unsubscribe, packet));
+    EXPECT_EQ(packet.Topics(), std::vector<std::string>{"sensor/temperature"});
+}
+
+TEST(NativeConnectionTest, UnsubscribeWhileOfflineIsDroppedWithSession) {
+    test::FakeBroker broker;
+    mqtt::NativeConnection connection("127.0.0.1", broker.Port(), "fresh", ResumableOptions());
+    Connect(broker, false);
+    SubscribeOnline(broker, connection, "sensor/temperature");
+    Reconnect(broker, connection);
+
+    connection.UnsubscribeMany({"sensor/temperature"});
+    CompleteConnect(broker, false);
+    ASSERT_TRUE(WaitUntilConnected(connection, true));
+
+    // The broker starts a new session without the subscription, so the next packet is this SUBSCRIBE.
+    SubscribeOnline(broker, connection, "sensor/humidity");
+}
+
+TEST(NativeConnectionTest, Qos1PublishCompletesOnPuback) {
+    test::FakeBroker broker;
+    mqtt::NativeConnection connection("127.0.0.1", broker.Port(), "qos1", ResumableOptions());
+    Connect(broker, false);
+
+    auto done = connection.Publish(mqtt::Message("sensor/temperature", "21.5", 1));
+    test::BrokerPacket publish;
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, publish));
+    EXPECT_EQ(publish.Publish().qos, 1u);
+    EXPECT_EQ(publish.Publish().payload, "21.5");
+    EXPECT_FALSE(IsReady(done));
+
+    broker.SendAck(PacketType::Puback, publish.PacketId());
+    EXPECT_TRUE(done.get());
+}
+
+TEST(NativeConnectionTest, Qos2PublishCompletesOnPubcomp) {
+    test::FakeBroker broker;
+    mqtt::NativeConnection connection("127.0.0.1", broker.Port(), "qos2", ResumableOptions());
+    Connect(broker, false);
+
+    auto done = connection.Publish(mqtt::Message("sensor/temperature", "21.5", 2));
+    test::BrokerPacket publish;
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, publish));
+    EXPECT_EQ(publish.Publish().qos, 2u);
+
+    broker.SendAck(PacketType::Pubrec, publish.PacketId());
+    test::BrokerPacket pubrel;
+    ASSERT_TRUE(broker.Expect(PacketType::Pubrel, pubrel));
+    EXPECT_EQ(pubrel.PacketId(), publish.PacketId());
+    EXPECT_FALSE(IsReady(done));
+
+    broker.SendAck(PacketType::Pubcomp, publish.PacketId());
+    EXPECT_TRUE(done.get());
+}
+
+TEST(NativeConnectionTest, InboundQos2IsDeliveredOnce) {
+    test::FakeBroker broker;
+    mqtt::NativeConnection connection("127.0.0.1", broker.Port(), "inbound", ResumableOptions());
+    std::atomic<int> received{0};
+    connection.AddMessageCallback([&](const mqtt::Message&) { ++received; });
+    Connect(broker, false);
+
+    // The second copy is what a broker sends when it did not see the PUBREC.
+    mqtt::Message message("sensor/temperature", "21.5", 2);
+    test::BrokerPacket ack;
+    for (int i = 0; i < 2; ++i) {
+        broker.SendPublish(message, 5);
+        ASSERT_TRUE(broker.Expect(PacketType::Pubrec, ack));
+        EXPECT_EQ(ack.PacketId(), 5);
+    }
+    broker.SendAck(PacketType::Pubrel, 5);
+    ASSERT_TRUE(broker.Expect(PacketType::Pubcomp, ack));
+    EXPECT_EQ(ack.PacketId(), 5);
+    EXPECT_EQ(received, 1);
+
+    // Once released, the packet identifier starts a new message.
+    broker.SendPublish(message, 5);
+    ASSERT_TRUE(broker.Expect(PacketType::Pubrec, ack));
+    EXPECT_EQ(received, 2);
+}
+
+TEST(NativeConnectionTest, UnacknowledgedPublishIsRetransmittedToResumedSession) {
+    test::FakeBroker broker;
+    mqtt::NativeConnection connection("127.0.0.1", broker.Port(), "retransmit", ResumableOptions());
+    Connect(broker, false);
+    auto done = connection.Publish(mqtt::Message("sensor/temperature", "21.5", 1));
+    test::BrokerPacket first;
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, first));
+    EXPECT_FALSE(first.Publish().dup);
+    Reconnect(broker, connection);
+    EXPECT_FALSE(IsReady(done));
+
+    // The retransmission goes out before the online message.
+    broker.SendConnack(true);
+    test::BrokerPacket again;
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, again));
+    EXPECT_EQ(again.PacketId(), first.PacketId());
+    EXPECT_TRUE(again.Publish().dup);
+    EXPECT_EQ(again.Publish().payload, "21.5");
+    test::BrokerPacket online;
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, online));
+    EXPECT_TRUE(online.Publish().retain);
+
+    broker.SendAck(PacketType::Puback, again.PacketId());
+    EXPECT_TRUE(done.get());
+}
+
+TEST(NativeConnectionTest, ReleasedPublishResendsPubrelToResumedSession) {
+    test::FakeBroker broker;
+    mqtt::NativeConnection connection("127.0.0.1", broker.Port(), "pubrel", ResumableOptions());
+    Connect(broker, false);
+    auto done = connection.Publish(mqtt::Message("sensor/temperature", "21.5", 2));
+    test::BrokerPacket publish;
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, publish));
+    broker.SendAck(PacketType::Pubrec, publish.PacketId());
+    test::BrokerPacket pubrel;
+    ASSERT_TRUE(broker.Expect(PacketType::Pubrel, pubrel));
+    Reconnect(broker, connection);
+
+    // The broker already has the message, so only the release is repeated.
+    broker.SendConnack(true);
+    ASSERT_TRUE(broker.Expect(PacketType::Pubrel, pubrel));
+    EXPECT_EQ(pubrel.PacketId(), publish.PacketId());
+    test::BrokerPacket online;
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, online));
+    EXPECT_TRUE(online.Publish().retain);
+
+    broker.SendAck(PacketType::Pubcomp, publish.PacketId());
+    EXPECT_TRUE(done.get());
+}
+
+TEST(NativeConnectionTest, ReceiveMaximumHoldsBackPublishes) {
+    test::FakeBroker broker;
+    mqtt::NativeConnection connection("127.0.0.1", broker.Port(), "flow", ResumableOptions());
+    ASSERT_TRUE(broker.AcceptSession(false, 1));
+    test::BrokerPacket online;
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, online));
+    ASSERT_TRUE(WaitUntilConnected(connection, true));
+
+    // The unacknowledged online message takes the only slot the broker allows.
+    auto done = connection.Publish(mqtt::Message("sensor/temperature", "21.5", 1));
+    test::BrokerPacket publish;
+    EXPECT_FALSE(broker.Read(publish, std::chrono::milliseconds(200)));
+
+    broker.SendAck(PacketType::Puback, online.PacketId());
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, publish));
+    EXPECT_EQ(publish.Publish().payload, "21.5");
+    broker.SendAck(PacketType::Puback, publish.PacketId());
+    EXPECT_TRUE(done.get());
+}
+
+TEST(NativeConnectionTest, KeepalivePingsAndDropsSilentBroker) {
+    mqtt::ConnectOptions options = ResumableOptions();
+    options.keepAliveSeconds = 3;
+    test::FakeBroker broker;
+    mqtt::NativeConnection connection("127.0.0.1", broker.Port(), "keepalive", options);
+    Connect(broker, false);
+
+    test::BrokerPacket ping;
+    ASSERT_TRUE(broker.Read(ping, std::chrono::seconds(5)));
+    EXPECT_EQ(ping.type, PacketType::Pingreq);
+
+    // Without a PINGRESP the client gives up on the broker half a keepalive interval later.
+    EXPECT_FALSE(broker.Read(ping, std::chrono::seconds(5)));
+    EXPECT_TRUE(WaitUntilConnected(connection, false));
+}
+
+TEST(NativeConnectionTest, SubscriptionsAreKeptByResumedSession) {
+    test::FakeBroker broker;
+    mqtt::NativeConnection connection("127.0.0.1", broker.Port(), "kept", ResumableOptions());
+    Connect(broker, false);
+    SubscribeOnline(broker, connection, "sensor/temperature");
+    Reconnect(broker, connection);
+
+    // No SUBSCRIBE comes before the online message.
+    CompleteConnect(broker, true);
+}
+
+TEST(NativeConnectionTest, SubscriptionsAreResentToNewSession) {
+    test::FakeBroker broker;
+    mqtt::NativeConnection connection("127.0.0.1", broker.Port(), "resent", ResumableOptions());
+    Connect(broker, false);
+    SubscribeOnline(broker, connection, "sensor/temperature");
+    Reconnect(broker, connection);
+
+    broker.SendConnack(false);
+    test::BrokerPacket subscribe;
+    ASSERT_TRUE(broker.Expect(PacketType::Subscribe, subscribe));
+    EXPECT_EQ(subscribe.Topics(), std::vector<std::string>{"sensor/temperature"});
+    broker.SendSuback(subscribe);
+    test::BrokerPacket online;
+    ASSERT_TRUE(broker.Expect(PacketType::Publish, online));
+    EXPECT_TRUE(online.Publish().retain);
+}
@@ -0,0 +1,309 @@
+#include "stinger/mqtt/packetcodec.hpp"
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace stinger;
+
+namespace {
+
+std::string bytes(std::initializer_list<int> values) {
+    std::string result;
+    for (int value : values) {
+        result.push_back(static_cast<char>(value));
+    }
+    return result;
+}
+
+// Splits a single encoded packet into its fixed header and body.
+std::string_view splitPacket(const std::string& packet, mqtt::FixedHeader& header) {
+    EXPECT_EQ(mqtt::decodeFixedHeader(packet, header), mqtt::DecodeStatus::Complete);
+    EXPECT_EQ(header.Size(), packet.size());
+    return std::string_view(packet).substr(header.headerSize, header.remainingLength);
+}
+
+} // namespace
+
+TEST(PacketCodecTest, EncodesMinimalPublish) {
+    std::string out;
+    mqtt::encodePublish(out, mqtt::Message("a/b", "hi"), 0);
+    EXPECT_EQ(out, bytes({0x30, 8, 0, 3, 'a', '/', 'b', 0, 'h', 'i'}));
+}
+
+TEST(PacketCodecTest, AppendsToExistingBuffer) {
+    std::string out = "xy";
+    mqtt::encodePingreq(out);
+    mqtt::encodeDisconnect(out);
+    EXPECT_EQ(out, bytes({'x', 'y', 0xC0, 0, 0xE0, 0}));
+}
+
+TEST(PacketCodecTest, RejectsStringsLongerThan65535Bytes) {
+    std::string longest(mqtt::kMaxStringSize, 'a');
+    std::string tooLong(mqtt::kMaxStringSize + 1, 'a');
+    std::string out = "xy";
+
+    mqtt::encodePublish(out, mqtt::Message(longest, ""), 0);
+    EXPECT_EQ(out.size(), 2 + 4 + 2 + longest.size() + 1);
+
+    out = "xy";
+    EXPECT_THROW(mqtt::encodePublish(out, mqtt::Message(tooLong, ""), 0), std::length_error);
+    EXPECT_THROW(mqtt::encodeSubscribe(out, 1, {"a/b", tooLong}, 1, 1), std::length_error);
+    EXPECT_THROW(mqtt::encodeUnsubscribe(out, 1, {tooLong}), std::length_error);
+    EXPECT_THROW(mqtt::publishPacketSize(mqtt::Message(tooLong, "")), std::length_error);
+    EXPECT_EQ(out, "xy");
+}
+
+TEST(PacketCodecTest, PublishPacketSizeMatchesEncoding) {
+    mqtt::Message message("a/b", std::string(200, 'p'), 1);
+    message.properties.SetContentType("text/plain");
+    std::string out;
+    mqtt::encodePublish(out, message, 7);
+    EXPECT_EQ(mqtt::publishPacketSize(message), out.size());
+}
+
+TEST(PacketCodecTest, PublishRoundTripsProperties) {
+    mqtt::Properties props;
+    props.SetCorrelationData(std::vector<std::byte>{std::byte{0x01}, std::byte{0xFF}});
+    props.SetResponseTopic("reply/to");
+    props.SetMessageExpiryInterval(3600);
+    props.SetContentType("application/json");
+    props.SetDebugInfo("details");
+    props.SetReturnCode(-3);
+    props.SetPropertyVersion(42);
+    props.SetVersion("1.2.3");
+    mqtt::Message message("service/x/method", std::string(300, 'p'), 1, true, props);
+
+    std::string packet;
+    mqtt::encodePublish(packet, message, 0x0102, true);
+    mqtt::FixedHeader header;
+    std::string_view body = splitPacket(packet, header);
+    EXPECT_EQ(header.type, mqtt::PacketType::Publish);
+    EXPECT_EQ(header.headerSize, 3u); // Two-byte remaining length.
+
+    mqtt::PublishView view;
+    ASSERT_TRUE(mqtt::decodePublish(header.flags, body, view));
+    EXPECT_EQ(view.packetId, 0x0102);
+    EXPECT_TRUE(view.dup);
+
+    mqtt::Message decoded = view.ToMessage();
+    EXPECT_EQ(decoded.topic, message.topic);
+    EXPECT_EQ(decoded.payload, message.payload);
+    EXPECT_EQ(decoded.qos, 1u);
+    EXPECT_TRUE(decoded.retain);
+    EXPECT_EQ(decoded.properties.GetCorrelationData(), props.GetCorrelationData());
+    EXPECT_EQ(decoded.properties.GetResponseTopic(), props.GetResponseTopic());
+    EXPECT_EQ(decoded.properties.GetMessageExpiryInterval(), props.GetMessageExpiryInterval());
+    EXPECT_EQ(decoded.properties.GetContentType(), props.GetContentType());
+    EXPECT_EQ(decoded.properties.GetDebugInfo(), props.GetDebugInfo());
+    EXPECT_EQ(decoded.properties.GetReturnCode(), props.GetReturnCode());
+    EXPECT_EQ(decoded.properties.GetPropertyVersion(), props.GetPropertyVersion());
+    EXPECT_EQ(decoded.properties.GetVersion(), props.GetVersion());
+    EXPECT_FALSE(decoded.properties.GetSubscriptionId());
+}
+
+TEST(PacketCodecTest, SchemaEncodingMatchesGeneric) {
+    std::vector<std::byte> correlationData = {std::byte{0xAB}, std::byte{0xCD}};
+    const mqtt::Message messages[] = {
+        mqtt::Message::Signal("s", "{}"),
+        mqtt::Message::PropertyValue("p", "{}", 7),
+        mqtt::Message::PropertyUpdateRequest("p/u", "{}", 7, correlationData, "reply"),
+        mqtt::Message::PropertyUpdateResponse("reply", "{}", 8, correlationData,
+                                              stinger::error::MethodReturnCode::SUCCESS, "ok"),
+        mqtt::Message::MethodRequest("m", "{}", correlationData, "reply"),
+        mqtt::Message::MethodResponse("reply", "{}", correlationData, stinger::error::MethodReturnCode::SUCCESS, "ok"),
+        mqtt::Message::ServiceOnline("online", "{}", 60),
+        mqtt::Message::ServiceOffline("online"),
+    };
+    for (const auto& message : messages) {
+        mqtt::Message generic = message;
+        generic.kind = mqtt::MessageKind::Generic;
+        std::string specialized;
+        std::string expected;
+        mqtt::encodePublish(specialized, message, 1);
+        mqtt::encodePublish(expected, generic, 1);
+        EXPECT_EQ(specialized, expected) << message.topic;
+    }
+}
+
+TEST(PacketCodecTest, PropertiesOutsideSchemaAreStillEncoded) {
+    mqtt::Message message = mqtt::Message::Signal("s", "{}");
+    message.properties.SetResponseTopic("reply");
+
+    std::string packet;
+    mqtt::encodePublish(packet, message, 1);
+    mqtt::FixedHeader header;
+    mqtt::PublishView view;
+    ASSERT_TRUE(mqtt::decodePublish(header.flags, splitPacket(packet, header), view));
+    mqtt::Message decoded = view.ToMessage();
+    ASSERT_TRUE(decoded.properties.GetResponseTopic().has_value());
+    EXPECT_EQ(*decoded.properties.GetResponseTopic(), "reply");
+    EXPECT_EQ(*decoded.properties.GetContentType(), "application/json");
+}
+
+TEST(PacketCodecTest, PublishRoundTripsUserProperties) {
+    mqtt::Message message = mqtt::Message::Signal("s", "{}");
+    message.properties.AddUserProperty("tenant", "acme");
+    message.properties.AddUserProperty("trace", "00-4bf92f35-01");
+    message.properties.SetDebugInfo("known");
+
+    std::string packet;
+    mqtt::encodePublish(packet, message, 0);
+    mqtt::FixedHeader header;
+    mqtt::PublishView view;
+    ASSERT_TRUE(mqtt::decodePublish(header.flags, splitPacket(packet, header), view));
+    EXPECT_TRUE(view.otherUserProperties);
+    EXPECT_EQ(view.FindUserProperty("trace"), std::optional<std::string_view>("00-4bf92f35-01"));
+    EXPECT_FALSE(view.FindUserProperty("missing").has_value());
+
+    mqtt::Message decoded = view.ToMessage();
+    EXPECT_EQ(decoded.properties.GetUserProperties(), message.properties.GetUserProperties());
+    EXPECT_EQ(*decoded.properties.GetDebugInfo(), "known");
+}
+
+TEST(PacketCodecTest, DecodingRemovesOriginTag) {
+    mqtt::Message message = mqtt::Message::Signal("s", "{}");
+    message.properties.AddUserProperty(mqtt::kOriginTagProperty, "pool");
+    message.properties.AddUserProperty("tenant", "acme");
+
+    std::string packet;
+    mqtt::encodePublish(packet, message, 0);
+    mqtt::FixedHeader header;
+    mqtt::PublishView view;
+    ASSERT_TRUE(mqtt::decodePublish(header.flags, splitPacket(packet, header), view));
+    EXPECT_EQ(view.FindUserProperty(mqtt::kOriginTagProperty), std::optional<std::string_view>("pool"));
+
+    mqtt::Message decoded = view.ToMessage();
+    ASSERT_EQ(decoded.properties.GetUserProperties().Size(), 1u);
+    EXPECT_EQ(*decoded.properties.GetUserProperties().Find("tenant"), "acme");
+}
+
+TEST(PacketCodecTest, DecodedPublishViewsPointIntoPacket) {
+    std::string packet;
+    mqtt::encodePublish(packet, mqtt::Message("t", "payload"), 0);
+    mqtt::FixedHeader header;
+    std::string_view body = splitPacket(packet, header);
+    mqtt::PublishView view;
+    ASSERT_TRUE(mqtt::decodePublish(header.flags, body, view));
+    EXPECT_EQ(view.payload, "payload");
+    EXPECT_GE(view.payload.data(), packet.data());
+    EXPECT_LT(view.payload.data(), packet.data() + packet.size());
+}
+
+TEST(PacketCodecTest, DecodingIntoMessageReusesBuffers) {
+    mqtt::Properties props;
+    props.SetResponseTopic("reply");
+    std::string first;
+    mqtt::encodePublish(first, mqtt::Message("a/long/topic/name", std::string(200, 'x'), 1, false, props), 1);
+    std::string second;
+    mqtt::encodePublish(second, mqtt::Message("b", "short", 0), 0);
+
+    mqtt::Message received("", "");
+    mqtt::FixedHeader header;
+    mqtt::PublishView view;
+    ASSERT_TRUE(mqtt::decodePublish(header.flags, splitPacket(first, header), view));
+    view.ToMessage(received);
+    EXPECT_EQ(*received.properties.GetResponseTopic(), "reply");
+    const char* payloadBuffer = received.payload.data();
+
+    ASSERT_TRUE(mqtt::decodePublish(header.flags, splitPacket(second, header), view));
+    view.ToMessage(received);
+    EXPECT_EQ(received.topic, "b");
+    EXPECT_EQ(received.payload, "short");
+    EXPECT_EQ(received.qos, 0u);
+    EXPECT_FALSE(received.properties.GetResponseTopic().has_value());
+    EXPECT_EQ(received.payload.data(), payloadBuffer);
+}
+
+TEST(PacketCodecTest, RejectsTruncatedPublish) {
+    std::string packet;
+    mqtt::encodePublish(packet, mqtt::Message("a/b", "", 1), 7);
+    mqtt::FixedHeader header;
+    std::string_view body = splitPacket(packet, header);
+    mqtt::PublishView view;
+    EXPECT_FALSE(mqtt::decodePublish(header.flags, body.substr(0, 4), view));
+}
+
+TEST(PacketCodecTest, FixedHeaderNeedsCompleteLength) {
+    mqtt::FixedHeader header;
+    EXPECT_EQ(mqtt::decodeFixedHeader("", header), mqtt::DecodeStatus::Incomplete);
+    EXPECT_EQ(mqtt::decodeFixedHeader(bytes({0x30}), header), mqtt::DecodeStatus::Incomplete);
+    EXPECT_EQ(mqtt::decodeFixedHeader(bytes({0x30, 0x80}), header), mqtt::DecodeStatus::Incomplete);
+    EXPECT_EQ(mqtt::decodeFixedHeader(bytes({0x30, 0xFF, 0xFF, 0xFF, 0xFF}), header), mqtt::DecodeStatus::Malformed);
+    EXPECT_EQ(mqtt::decodeFixedHeader(bytes({0x00, 0x00}), header), mqtt::DecodeStatus::Malformed);
+
+    ASSERT_EQ(mqtt::decodeFixedHeader(bytes({0x32, 0x80, 0x01}), header), mqtt::DecodeStatus::Complete);
+    EXPECT_EQ(header.type, mqtt::PacketType::Publish);
+    EXPECT_EQ(header.flags, 0x02);
+    EXPECT_EQ(header.remainingLength, 128u);
+}
+
+TEST(PacketCodecTest, SubscribeUsesNoLocalExceptForSharedTopics) {
+    std::string out;
+    mqtt::encodeSubscribe(out, 9, {"a/b", "$share/g/c"}, 1, 7);
+    std::string expected = bytes({0x82, 24, 0, 9, 2, 0x0B, 7, 0, 3, 'a', '/', 'b', 0x05, 0, 10});
+    expected += "$share/g/c";
+    expected += bytes({0x01});
+    EXPECT_EQ(out, expected);
+}
+
+TEST(PacketCodecTest, EncodesConnectWithWill) {
+    mqtt::ConnectOptions options;
+    options.keepAliveSeconds = 60;
+    options.receiveMaximum = 20;
+    mqtt::Message will("w", "x", 1, true);
+    std::string out;
+    mqtt::encodeConnect(out, "id", options, true, &will);
+
+    mqtt::FixedHeader header;
+    std::string_view body = splitPacket(out, header);
+    EXPECT_EQ(header.type, mqtt::PacketType::Connect);
+    std::string expected = bytes({0, 4, 'M', 'Q', 'T', 'T', 5, 0x02 | 0x04 | 0x08 | 0x20, 0, 60, 3, 0x21, 0, 20, 0, 2,
+                                  'i', 'd', 0, 0, 1, 'w', 0, 1, 'x'});
+    EXPECT_EQ(body, expected);
+}
+
+TEST(PacketCodecTest, EncodesAcknowledgements) {
+    std::string out;
+    mqtt::encodeAck(out, mqtt::PacketType::Puback, 0x1234);
+    mqtt::encodeAck(out, mqtt::PacketType::Pubrel, 0x1234);
+    mqtt::encodeAck(out, mqtt::PacketType::Pubrec, 1, 0x80);
+    EXPECT_EQ(out, bytes({0x40, 2, 0x12, 0x34, 0x62, 2, 0x12, 0x34, 0x50, 3, 0, 1, 0x80}));
+}
+
+TEST(PacketCodecTest, DecodesConnack) {
+    mqtt::ConnackView connack;
+    ASSERT_TRUE(mqtt::decodeConnack(bytes({0x01, 0x00, 5, 0x21, 0, 10, 0x2A, 0}), connack));
+    EXPECT_TRUE(connack.sessionPresent);
+    EXPECT_EQ(connack.reasonCode, 0);
+    EXPECT_EQ(connack.receiveMaximum, 10);
+    EXPECT_FALSE(connack.sharedSubscriptionAvailable);
+
+    ASSERT_TRUE(mqtt::decodeConnack(bytes({0x00, 0x87}), connack));
+    EXPECT_FALSE(connack.sessionPresent);
+    EXPECT_EQ(connack.reasonCode, 0x87);
+
+    // Unknown property identifier.
+    EXPECT_FALSE(mqtt::decodeConnack(bytes({0x00, 0x00, 2, 0x7F, 0}), connack));
+}
+
+TEST(PacketCodecTest, DecodesAcknowledgements) {
+    mqtt::AckView ack;
+    ASSERT_TRUE(mqtt::decodeAck(mqtt::PacketType::Puback, bytes({0, 5}), ack));
+    EXPECT_EQ(ack.packetId, 5);
+    EXPECT_EQ(ack.FirstReasonCode(), 0);
+
+    std::string puback = bytes({0, 6, 0x10});
+    ASSERT_TRUE(mqtt::decodeAck(mqtt::PacketType::Puback, puback, ack));
+    EXPECT_EQ(ack.FirstReasonCode(), 0x10);
+
+    // The reason codes are a view of the packet, so keep it alive.
+    std::string suback = bytes({0, 7, 0, 0x01, 0x80});
+    ASSERT_TRUE(mqtt::decodeAck(mqtt::PacketType::Suback, suback, ack));
+    EXPECT_EQ(ack.packetId, 7);
+    EXPECT_EQ(ack.reasonCodes, bytes({0x01, 0x80}));
+
+    EXPECT_FALSE(mqtt::decodeAck(mqtt::PacketType::Suback, bytes({0, 7, 0}), ack));
+    EXPECT_FALSE(mqtt::decodeAck(mqtt::PacketType::Puback, bytes({0}), ack));
+}
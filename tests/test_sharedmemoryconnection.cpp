@@ -0,0 +1,228 @@
+#include "stinger/mqtt/message.hpp"
+#include "stinger/utils/sharedmemoryconnection.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace stinger;
+
+namespace {
+
+// Collects the messages delivered to a connection's callbacks on its receive thread.
+class Inbox {
+public:
+    explicit Inbox(utils::IConnection& connection) {
+        connection.AddMessageCallback([this](const mqtt::Message& msg) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _messages.push_back(msg);
+            _cv.notify_all();
+        });
+    }
+
+    bool WaitFor(std::size_t count) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _cv.wait_for(lock, std::chrono::seconds(2), [&] { return _messages.size() >= count; });
+    }
+
+    std::vector<mqtt::Message> Messages() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _messages;
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::vector<mqtt::Message> _messages;
+};
+
+} // namespace
+
+class SharedMemoryConnectionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        domain = "test-" + std::to_string(getpid()) + "-" +
+                 ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    }
+
+    void TearDown() override { utils::SharedMemoryConnection::Unlink(domain); }
+
+    std::string domain;
+};
+
+TEST_F(SharedMemoryConnectionTest, DeliversMessageWithProperties) {
+    utils::SharedMemoryConnection subscriber(domain, "subscriber");
+    utils::SharedMemoryConnection publisher(domain, "publisher");
+    Inbox inbox(subscriber);
+    int subId = subscriber.Subscribe("service/+/method/add", 1);
+
+    std::vector<std::byte> correlation = {std::byte{0x01}, std::byte{0xFE}};
+    auto request = mqtt::Message::MethodRequest("service/calc/method/add", "{\"a\":1}", correlation, "client/resp");
+    request.properties.SetVersion("1.2");
+    request.properties.AddUserProperty("traceparent", "00-abc-01");
+    EXPECT_TRUE(publisher.Publish(request).get());
+
+    ASSERT_TRUE(inbox.WaitFor(1));
+    auto received = inbox.Messages()[0];
+    EXPECT_EQ(received.topic, "service/calc/method/add");
+    EXPECT_EQ(received.payload, "{\"a\":1}");
+    EXPECT_EQ(received.qos, request.qos);
+    EXPECT_EQ(*received.properties.GetCorrelationData(), correlation);
+    EXPECT_EQ(*received.properties.GetResponseTopic(), "client/resp");
+    EXPECT_EQ(*received.properties.GetContentType(), "application/json");
+    EXPECT_EQ(*received.properties.GetVersion(), "1.2");
+    EXPECT_EQ(received.properties.GetUserProperties(), request.properties.GetUserProperties());
+    EXPECT_EQ(static_cast<int>(*received.properties.GetSubscriptionId()), subId);
+}
+
+TEST_F(SharedMemoryConnectionTest, DoesNotDeliverOwnPublishes) {
+    utils::SharedMemoryConnection first(domain, "first");
+    utils::SharedMemoryConnection second(domain, "second");
+    Inbox inbox(first);
+    first.Subscribe("sensor/#", 0);
+
+    first.Publish(mqtt::Message::Signal("sensor/own", "1"));
+    second.Publish(mqtt::Message::Signal("sensor/other", "2"));
+
+    ASSERT_TRUE(inbox.WaitFor(1));
+    auto messages = inbox.Messages();
+    ASSERT_EQ(messages.size(), 1u);
+    EXPECT_EQ(messages[0].topic, "sensor/other");
+}
+
+TEST_F(SharedMemoryConnectionTest, UnsubscribesWhenCountReachesZero) {
+    utils::SharedMemoryConnection subscriber(domain, "subscriber");
+    utils::SharedMemoryConnection publisher(domain, "publisher");
+    Inbox inbox(subscriber);
+    subscriber.Subscribe("a/b", 0);
+    subscriber.Subscribe("a/b", 0);
+    subscriber.Subscribe("marker", 0);
+
+    subscriber.Unsubscribe("a/b");
+    publisher.Publish(mqtt::Message::Signal("a/b", "still subscribed"));
+    subscriber.Unsubscribe("a/b");
+    publisher.Publish(mqtt::Message::Signal("a/b", "unsubscribed"));
+    publisher.Publish(mqtt::Message::Signal("marker", "done"));
+
+    ASSERT_TRUE(inbox.WaitFor(2));
+    auto messages = inbox.Messages();
+    ASSERT_EQ(messages.size(), 2u);
+    EXPECT_EQ(messages[0].payload, "still subscribed");
+    EXPECT_EQ(messages[1].topic, "marker");
+}
+
+TEST_F(SharedMemoryConnectionTest, SharedSubscriptionDeliversToOneMember) {
+    utils::SharedMemoryConnection workerA(domain, "workerA");
+    utils::SharedMemoryConnection workerB(domain, "workerB");
+    utils::SharedMemoryConnection publisher(domain, "publisher");
+    Inbox inboxA(workerA);
+    Inbox inboxB(workerB);
+    workerA.SubscribeShared("workers", "jobs/#", 1);
+    workerB.SubscribeShared("workers", "jobs/#", 1);
+
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_TRUE(publisher.Publish(mqtt::Message::Signal("jobs/" + std::to_string(i), "x")).get());
+    }
+
+    ASSERT_TRUE(inboxA.WaitFor(5));
+    ASSERT_TRUE(inboxB.WaitFor(5));
+    EXPECT_EQ(inboxA.Messages().size() + inboxB.Messages().size(), 10u);
+}
+
+TEST_F(SharedMemoryConnectionTest, DeliversMessagesSpanningSeveralCells) {
+    utils::SharedMemoryConnection subscriber(domain, "subscriber");
+    utils::SharedMemoryConnection publisher(domain, "publisher");
+    Inbox inbox(subscriber);
+    subscriber.Subscribe("big/#", 0);
+
+    // Enough messages of about 13 cells each for the inbox ring to wrap around.
+    std::vector<std::string> payloads;
+    for (std::size_t i = 0; i < 12; ++i) {
+        std::string payload(50000 + i * 1000, '\0');
+        for (std::size_t j = 0; j < payload.size(); ++j) {
+            payload[j] = static_cast<char>('a' + (i + j) % 26);
+        }
+        payloads.push_back(payload);
+        ASSERT_TRUE(publisher.Publish(mqtt::Message::Signal("big/" + std::to_string(i), payload)).get());
+        ASSERT_TRUE(inbox.WaitFor(i + 1));
+    }
+
+    auto messages = inbox.Messages();
+    for (std::size_t i = 0; i < payloads.size(); ++i) {
+        EXPECT_EQ(messages[i].topic, "big/" + std::to_string(i));
+        EXPECT_EQ(messages[i].payload, payloads[i]);
+    }
+}
+
+TEST_F(SharedMemoryConnectionTest, ConcurrentPublishersDoNotOverwriteEachOther) {
+    utils::SharedMemoryConnection subscriber(domain, "subscriber");
+    Inbox inbox(subscriber);
+    subscriber.Subscribe("load/#", 0);
+
+    // Messages of one to three cells from several threads, so reservations of different sizes race for the ring.
+    const int kPublishers = 4;
+    const int kMessagesEach = 150;
+    std::atomic<std::size_t> sent{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kPublishers; ++t) {
+        threads.emplace_back([&, t] {
+            utils::SharedMemoryConnection publisher(domain, "publisher-" + std::to_string(t));
+            for (int i = 0; i < kMessagesEach; ++i) {
+                std::string topic = "load/" + std::to_string(t) + "/" + std::to_string(i);
+                std::string payload((i % 3) * 4000 + 100, static_cast<char>('a' + t));
+                // A full inbox drops the message; wait for the subscriber to catch up and try again.
+                while (!publisher.Publish(mqtt::Message(topic, payload)).get()) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                ++sent;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_TRUE(inbox.WaitFor(sent));
+    auto messages = inbox.Messages();
+    EXPECT_EQ(messages.size(), std::size_t(kPublishers * kMessagesEach));
+    for (const auto& message : messages) {
+        const std::string& topic = message.topic.str();
+        int t = topic[5] - '0';
+        int i = std::stoi(topic.substr(7));
+        EXPECT_EQ(message.payload, std::string((i % 3) * 4000 + 100, static_cast<char>('a' + t))) << message.topic;
+    }
+}
+
+TEST_F(SharedMemoryConnectionTest, ReportsSubscriptionsThatDoNotFit) {
+    utils::SharedMemoryConnection subscriber(domain, "subscriber");
+    utils::SharedMemoryConnection publisher(domain, "publisher");
+    Inbox inbox(subscriber);
+    std::string tooLong(300, 't');
+
+    EXPECT_EQ(subscriber.Subscribe(tooLong, 0), utils::kSubscribeFailed);
+    // A failed topic takes the other new topics of the same call down with it, but not existing ones.
+    int existing = subscriber.Subscribe("marker", 0);
+    auto ids = subscriber.SubscribeMany({"a/b", tooLong, "marker"}, 0);
+    EXPECT_EQ(ids, (std::vector<int>{utils::kSubscribeFailed, utils::kSubscribeFailed, existing}));
+
+    publisher.Publish(mqtt::Message::Signal("a/b", "not subscribed"));
+    publisher.Publish(mqtt::Message::Signal("marker", "done"));
+    ASSERT_TRUE(inbox.WaitFor(1));
+    EXPECT_EQ(inbox.Messages()[0].topic, "marker");
+
+    // Nothing was left registered, so the topic can be subscribed normally.
+    EXPECT_GT(subscriber.Subscribe("a/b", 0), existing);
+}
+
+TEST_F(SharedMemoryConnectionTest, RejectsOversizedMessages) {
+    utils::SharedMemoryConnection subscriber(domain, "subscriber");
+    utils::SharedMemoryConnection publisher(domain, "publisher");
+    subscriber.Subscribe("big", 0);
+
+    std::string payload(utils::SharedMemoryConnection::MaxMessageSize() + 1, 'x');
+    EXPECT_FALSE(publisher.Publish(mqtt::Message::Signal("big", payload)).get());
+}
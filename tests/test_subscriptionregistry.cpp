@@ -0,0 +1,183 @@
+#include "stinger/utils/subscriptionregistry.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+using namespace stinger::utils;
+
+TEST(SubscriptionRegistryTest, AcquireCountsReferences) {
+    SubscriptionRegistry registry;
+    int creates = 0;
+    auto onCreate = [&](std::string_view, SubscriptionRegistry::Subscription& sub) {
+        creates++;
+        sub.subscriptionId = 7;
+    };
+
+    auto first = registry.Acquire("sensor/temperature", 1, onCreate);
+    auto second = registry.Acquire(std::string("sensor/temperature"), 1, onCreate);
+
+    EXPECT_EQ(creates, 1);
+    EXPECT_EQ(first.subscriptionId, 7);
+    EXPECT_EQ(first.refCount, 1);
+    EXPECT_EQ(second.subscriptionId, 7);
+    EXPECT_EQ(second.refCount, 2);
+    EXPECT_EQ(second.qos, 1);
+}
+
+TEST(SubscriptionRegistryTest, ReleaseRemovesAtZero) {
+    SubscriptionRegistry registry;
+    registry.Acquire("a/b", 0, nullptr);
+    registry.Acquire("a/b", 0, nullptr);
+
+    int removes = 0;
+    auto onRemove = [&](std::string_view topic, const SubscriptionRegistry::Subscription&) {
+        removes++;
+        EXPECT_EQ(topic, "a/b");
+    };
+
+    auto sub = registry.Release("a/b", onRemove);
+    ASSERT_TRUE(sub.has_value());
+    EXPECT_EQ(sub->refCount, 1);
+    EXPECT_EQ(removes, 0);
+
+    sub = registry.Release("a/b", onRemove);
+    ASSERT_TRUE(sub.has_value());
+    EXPECT_EQ(sub->refCount, 0);
+    EXPECT_EQ(removes, 1);
+    EXPECT_FALSE(registry.Find("a/b").has_value());
+    EXPECT_FALSE(registry.Release("a/b", onRemove).has_value());
+}
+
+TEST(SubscriptionRegistryTest, AcquireManySharesOneCreate) {
+    SubscriptionRegistry registry;
+    registry.Acquire("existing", 1, [](std::string_view, SubscriptionRegistry::Subscription& sub) {
+        sub.subscriptionId = 1;
+    });
+
+    std::vector<std::string_view> created;
+    auto subs = registry.AcquireMany(
+        {"existing", "new/one", "new/two"}, 1,
+        [&](const std::vector<std::string_view>& topics, SubscriptionRegistry::Subscription& sub) {
+            created = topics;
+            sub.subscriptionId = 2;
+            sub.pending = true;
+        });
+
+    ASSERT_EQ(subs.size(), 3);
+    EXPECT_EQ(created.size(), 2);
+    EXPECT_EQ(subs[0].subscriptionId, 1);
+    EXPECT_EQ(subs[0].refCount, 2);
+    EXPECT_EQ(subs[1].subscriptionId, 2);
+    EXPECT_TRUE(subs[1].pending);
+    EXPECT_EQ(subs[2].subscriptionId, 2);
+}
+
+TEST(SubscriptionRegistryTest, TakePendingClearsFlags) {
+    SubscriptionRegistry registry;
+    auto pending = [](std::string_view, SubscriptionRegistry::Subscription& sub) { sub.pending = true; };
+    registry.Acquire("one", 0, pending);
+    registry.Acquire("two", 0, pending);
+    registry.Acquire("three", 0, nullptr);
+
+    std::vector<std::string> taken;
+    registry.TakePending([&](const std::vector<SubscriptionRegistry::Entry>& entries) {
+        for (const auto& entry : entries) {
+            taken.emplace_back(entry.first);
+        }
+    });
+    EXPECT_EQ(taken.size(), 2);
+
+    taken.clear();
+    registry.TakePending([&](const std::vector<SubscriptionRegistry::Entry>&) { taken.push_back("called"); });
+    EXPECT_TRUE(taken.empty());
+
+    EXPECT_TRUE(registry.MarkPending("three"));
+    EXPECT_FALSE(registry.MarkPending("four"));
+    registry.TakePending([&](const std::vector<SubscriptionRegistry::Entry>& entries) {
+        for (const auto& entry : entries) {
+            taken.emplace_back(entry.first);
+        }
+    });
+    EXPECT_EQ(taken, std::vector<std::string>{"three"});
+}
+
+TEST(SubscriptionRegistryTest, TakePendingUnsubscribesSkipsResubscribedTopics) {
+    SubscriptionRegistry registry;
+    registry.AddPendingUnsubscribe("gone");
+    registry.AddPendingUnsubscribe("back");
+    registry.AddPendingUnsubscribe("gone");
+    registry.Acquire("back", 0, nullptr);
+
+    std::vector<std::string> taken;
+    registry.TakePendingUnsubscribes([&](const std::vector<std::string>& topics) { taken = topics; });
+    EXPECT_EQ(taken, std::vector<std::string>{"gone"});
+
+    taken.clear();
+    registry.TakePendingUnsubscribes([&](const std::vector<std::string>&) { taken.push_back("called"); });
+    EXPECT_TRUE(taken.empty());
+
+    // A lost session has nothing left to unsubscribe from.
+    registry.AddPendingUnsubscribe("gone");
+    registry.MarkAllPending();
+    registry.TakePendingUnsubscribes([&](const std::vector<std::string>&) { taken.push_back("called"); });
+    EXPECT_TRUE(taken.empty());
+}
+
+TEST(SubscriptionRegistryTest, ManyTopicsWithChurn) {
+    SubscriptionRegistry registry(4);
+    const int kTopics = 20000;
+    for (int i = 0; i < kTopics; ++i) {
+        registry.Acquire("devices/" + std::to_string(i) + "/state", 1,
+                         [i](std::string_view, SubscriptionRegistry::Subscription& sub) {
+                             sub.subscriptionId = i + 1;
+                         });
+    }
+    EXPECT_EQ(registry.Size(), kTopics);
+    auto grown = registry.GetMemoryUsage();
+    EXPECT_EQ(grown.entries, kTopics);
+    EXPECT_GT(grown.totalBytes, grown.tableBytes + grown.topicBytes);
+
+    // Remove every other topic, then check the survivors are intact.
+    for (int i = 0; i < kTopics; i += 2) {
+        registry.Release("devices/" + std::to_string(i) + "/state", nullptr);
+    }
+    EXPECT_EQ(registry.Size(), kTopics / 2);
+    for (int i = 0; i < kTopics; ++i) {
+        auto sub = registry.Find("devices/" + std::to_string(i) + "/state");
+        if (i % 2 == 0) {
+            EXPECT_FALSE(sub.has_value());
+        } else {
+            ASSERT_TRUE(sub.has_value());
+            EXPECT_EQ(sub->subscriptionId, i + 1);
+        }
+    }
+    EXPECT_LT(registry.GetMemoryUsage().topicBytes, grown.topicBytes);
+}
+
+TEST(SubscriptionRegistryTest, MatchPrefersExactThenOldestPattern) {
+    SubscriptionRegistry registry;
+    int nextId = 1;
+    auto onCreate = [&](std::string_view, SubscriptionRegistry::Subscription& sub) { sub.subscriptionId = nextId++; };
+    registry.Acquire("sensor/#", 0, onCreate);
+    registry.Acquire("sensor/+/temperature", 0, onCreate);
+    registry.Acquire("sensor/kitchen/temperature", 0, onCreate);
+
+    // Crude matcher that is enough for these filters.
+    auto matches = [](const std::string& subscr) { return subscr == "sensor/#" || subscr == "sensor/+/temperature"; };
+
+    auto exact = registry.Match("sensor/kitchen/temperature", matches);
+    ASSERT_TRUE(exact.has_value());
+    EXPECT_EQ(exact->subscriptionId, 3);
+
+    auto wildcard = registry.Match("sensor/garage/temperature", matches);
+    ASSERT_TRUE(wildcard.has_value());
+    EXPECT_EQ(wildcard->subscriptionId, 1);
+
+    registry.Release("sensor/#", nullptr);
+    wildcard = registry.Match("sensor/garage/temperature", matches);
+    ASSERT_TRUE(wildcard.has_value());
+    EXPECT_EQ(wildcard->subscriptionId, 2);
+
+    registry.Release("sensor/+/temperature", nullptr);
+    EXPECT_FALSE(registry.Match("sensor/garage/temperature", matches).has_value());
+}
@@ -0,0 +1,54 @@
+#include "stinger/mqtt/topic.hpp"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace stinger;
+
+TEST(SharedSubscriptionTest, BuildsShareTopic) {
+    EXPECT_EQ(mqtt::sharedSubscription("workers", "service/+/method/add"), "$share/workers/service/+/method/add");
+}
+
+TEST(SharedSubscriptionTest, RejectsInvalidGroup) {
+    EXPECT_THROW(mqtt::sharedSubscription("", "a/b"), std::invalid_argument);
+    EXPECT_THROW(mqtt::sharedSubscription("a/b", "c"), std::invalid_argument);
+    EXPECT_THROW(mqtt::sharedSubscription("a+", "c"), std::invalid_argument);
+    EXPECT_THROW(mqtt::sharedSubscription("#", "c"), std::invalid_argument);
+}
+
+TEST(SharedSubscriptionTest, DetectsSharedSubscriptions) {
+    EXPECT_TRUE(mqtt::isSharedSubscription("$share/workers/a/b"));
+    EXPECT_FALSE(mqtt::isSharedSubscription("a/b"));
+    EXPECT_FALSE(mqtt::isSharedSubscription("$share/workers"));
+    EXPECT_FALSE(mqtt::isSharedSubscription("$share//a"));
+    EXPECT_FALSE(mqtt::isSharedSubscription("$SYS/broker/uptime"));
+}
+
+TEST(SharedSubscriptionTest, StripsSharePrefix) {
+    EXPECT_EQ(mqtt::subscriptionFilter("$share/workers/a/+/c"), "a/+/c");
+    EXPECT_EQ(mqtt::subscriptionFilter("a/+/c"), "a/+/c");
+}
+
+TEST(TopicMatchesFilterTest, MatchesExactAndSingleLevelWildcards) {
+    EXPECT_TRUE(mqtt::topicMatchesFilter("a/b/c", "a/b/c"));
+    EXPECT_TRUE(mqtt::topicMatchesFilter("a/b/c", "a/+/c"));
+    EXPECT_TRUE(mqtt::topicMatchesFilter("a//c", "a/+/c"));
+    EXPECT_FALSE(mqtt::topicMatchesFilter("a/b/c", "a/b"));
+    EXPECT_FALSE(mqtt::topicMatchesFilter("a/b", "a/b/c"));
+    EXPECT_FALSE(mqtt::topicMatchesFilter("a/b/c/d", "a/+/c"));
+    EXPECT_FALSE(mqtt::topicMatchesFilter("a/bb/c", "a/b/c"));
+}
+
+TEST(TopicMatchesFilterTest, MatchesMultiLevelWildcard) {
+    EXPECT_TRUE(mqtt::topicMatchesFilter("a/b/c", "a/#"));
+    EXPECT_TRUE(mqtt::topicMatchesFilter("a", "a/#"));
+    EXPECT_TRUE(mqtt::topicMatchesFilter("a/b", "#"));
+    EXPECT_TRUE(mqtt::topicMatchesFilter("a/b/c", "+/b/#"));
+    EXPECT_FALSE(mqtt::topicMatchesFilter("b/c", "a/#"));
+    EXPECT_FALSE(mqtt::topicMatchesFilter("a/b", "a/#/b"));
+}
+
+TEST(TopicMatchesFilterTest, DollarTopicsSkipLeadingWildcards) {
+    EXPECT_FALSE(mqtt::topicMatchesFilter("$SYS/uptime", "#"));
+    EXPECT_FALSE(mqtt::topicMatchesFilter("$SYS/uptime", "+/uptime"));
+    EXPECT_TRUE(mqtt::topicMatchesFilter("$SYS/uptime", "$SYS/#"));
+}
@@ -0,0 +1,106 @@
+#include "stinger/mqtt/message.hpp"
+#include "stinger/utils/hash.hpp"
+#include "stinger/utils/subscriptionregistry.hpp"
+#include "stinger/utils/topictable.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace stinger;
+using utils::TopicId;
+using utils::TopicTable;
+
+TEST(TopicTableTest, InternReturnsStableIds) {
+    TopicTable table;
+    TopicId a = table.Intern("sensor/temperature");
+    TopicId b = table.Intern("sensor/humidity");
+    EXPECT_NE(a, utils::kInvalidTopicId);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(table.Intern(std::string("sensor/temperature")), a);
+    EXPECT_EQ(table.Find("sensor/humidity"), b);
+    EXPECT_EQ(table.Find("sensor/pressure"), utils::kInvalidTopicId);
+    EXPECT_EQ(table.Name(a), "sensor/temperature");
+    EXPECT_EQ(table.Hash(a), utils::hashString("sensor/temperature"));
+    EXPECT_EQ(table.Name(utils::kInvalidTopicId), "");
+    EXPECT_EQ(table.Size(), 2u);
+}
+
+TEST(TopicTableTest, NamesSurviveGrowth) {
+    TopicTable table;
+    std::vector<TopicId> ids;
+    for (int i = 0; i < 5000; ++i) {
+        ids.push_back(table.Intern("topic/" + std::to_string(i)));
+    }
+    std::string_view first = table.Name(ids[0]);
+    for (int i = 0; i < 5000; ++i) {
+        ASSERT_EQ(table.Find("topic/" + std::to_string(i)), ids[i]);
+        ASSERT_EQ(table.Name(ids[i]), "topic/" + std::to_string(i));
+    }
+    EXPECT_EQ(first.data(), table.Name(ids[0]).data());
+}
+
+TEST(TopicTableTest, ConcurrentInternAgrees) {
+    TopicTable table;
+    std::vector<std::vector<TopicId>> results(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&table, &results, t]() {
+            for (int i = 0; i < 2000; ++i) {
+                results[t].push_back(table.Intern("shared/" + std::to_string(i)));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(table.Size(), 2000u);
+    for (int t = 1; t < 4; ++t) {
+        EXPECT_EQ(results[t], results[0]);
+    }
+}
+
+TEST(TopicTableTest, MessageTopicIdFollowsTopic) {
+    mqtt::Message msg("a/b", "");
+    TopicId id = msg.GetTopicId();
+    EXPECT_EQ(id, utils::internTopic("a/b"));
+    EXPECT_EQ(mqtt::Message(msg).GetTopicId(), id);
+
+    msg.topic = "a/c";
+    EXPECT_NE(msg.GetTopicId(), id);
+    EXPECT_EQ(TopicTable::Global().Name(msg.GetTopicId()), "a/c");
+
+    msg.topic.assign("a/b", 3);
+    EXPECT_EQ(msg.GetTopicId(), id);
+}
+
+TEST(TopicTableTest, FindTopicIdDoesNotIntern) {
+    mqtt::Message msg("topictable/published/only", "");
+    std::size_t size = TopicTable::Global().Size();
+    EXPECT_EQ(msg.FindTopicId(), utils::kInvalidTopicId);
+    EXPECT_EQ(TopicTable::Global().Size(), size);
+
+    // Interning elsewhere is picked up by the next lookup.
+    TopicId id = utils::internTopic(msg.topic);
+    EXPECT_EQ(msg.FindTopicId(), id);
+}
+
+TEST(TopicTableTest, RegistryInternsOnlyExactTopics) {
+    utils::SubscriptionRegistry registry;
+    auto onCreate = [](std::string_view, utils::SubscriptionRegistry::Subscription&) {};
+    registry.Acquire("registry/exact", 0, onCreate);
+    EXPECT_NE(TopicTable::Global().Find("registry/exact"), utils::kInvalidTopicId);
+    registry.Acquire("registry/+/wild", 0, onCreate);
+    EXPECT_EQ(TopicTable::Global().Find("registry/+/wild"), utils::kInvalidTopicId);
+}
+
+TEST(TopicTableTest, RegistryMatchesById) {
+    utils::SubscriptionRegistry registry;
+    registry.Acquire("home/kitchen/light", 1, [](std::string_view, utils::SubscriptionRegistry::Subscription& sub) {
+        sub.subscriptionId = 7;
+    });
+    auto found = registry.Find(utils::internTopic("home/kitchen/light"));
+    ASSERT_TRUE(found.has_value());
+    EXPECT_EQ(found->subscriptionId, 7);
+    EXPECT_FALSE(registry.Match(utils::internTopic("home/hall/light"), [](const std::string&) { return false; }));
+}
@@ -0,0 +1,84 @@
+#include "stinger/mqtt/message.hpp"
+#include "stinger/utils/uuid.hpp"
+#include <gtest/gtest.h>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using namespace stinger;
+using utils::CorrelationId;
+
+TEST(CorrelationIdTest, IsTriviallyCopyable) {
+    EXPECT_TRUE(std::is_trivially_copyable<CorrelationId>::value);
+    EXPECT_EQ(sizeof(CorrelationId), 16u);
+}
+
+TEST(CorrelationIdTest, RandomSetsVersionAndVariant) {
+    for (int i = 0; i < 100; ++i) {
+        CorrelationId id = CorrelationId::Random();
+        EXPECT_EQ(id.GetVersion(), 4u);
+        EXPECT_EQ(static_cast<unsigned>(id.bytes[8]) & 0xC0, 0x80u);
+    }
+    EXPECT_NE(CorrelationId::Random(), CorrelationId::Random());
+}
+
+TEST(CorrelationIdTest, TimeOrderedIdsIncrease) {
+    std::vector<CorrelationId> ids(10000);
+    CorrelationId::GenerateMany(ids.data(), ids.size(), CorrelationId::Version::TimeOrdered);
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        EXPECT_EQ(ids[i].GetVersion(), 7u);
+        if (i > 0) {
+            ASSERT_LT(ids[i - 1], ids[i]) << "at " << i;
+        }
+    }
+}
+
+TEST(CorrelationIdTest, FormatsAndParses) {
+    auto id = CorrelationId::Parse("0123456789ABCDEF0123456789abcdef");
+    ASSERT_TRUE(id.has_value());
+    EXPECT_EQ(id->ToHex(), "0123456789abcdef0123456789abcdef");
+    EXPECT_EQ(id->ToString(), "01234567-89ab-cdef-0123-456789abcdef");
+    EXPECT_EQ(CorrelationId::Parse(id->ToString()), id);
+
+    EXPECT_FALSE(CorrelationId::Parse("0123456789abcdef0123456789abcde").has_value());
+    EXPECT_FALSE(CorrelationId::Parse("0123456789abcdef0123456789abcdeg").has_value());
+    EXPECT_FALSE(CorrelationId::Parse("01234567-89ab-cdef-0123+456789abcdef").has_value());
+}
+
+TEST(CorrelationIdTest, GeneratesUniqueIdsAcrossThreads) {
+    std::mutex mutex;
+    std::set<CorrelationId> seen;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&]() {
+            std::vector<CorrelationId> ids(5000);
+            CorrelationId::GenerateMany(ids.data(), ids.size());
+            std::lock_guard<std::mutex> lock(mutex);
+            seen.insert(ids.begin(), ids.end());
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(seen.size(), 20000u);
+}
+
+TEST(CorrelationIdTest, StoresInlineInProperties) {
+    CorrelationId id = CorrelationId::Random();
+    auto msg = mqtt::Message::MethodRequest("method/call", "{}", id, "method/response");
+    EXPECT_TRUE(msg.properties.IsInline());
+    ASSERT_EQ(msg.properties.GetCorrelationData()->size(), 16u);
+    EXPECT_EQ(msg.properties.GetCorrelationId(), id);
+
+    msg.properties.SetCorrelationData(std::vector<std::byte>(3));
+    EXPECT_FALSE(msg.properties.GetCorrelationId().has_value());
+}
+
+TEST(CorrelationIdTest, LegacyHelpers) {
+    EXPECT_EQ(utils::generate_uuid_bytes().size(), 16u);
+    std::string hex = utils::generate_uuid_string();
+    EXPECT_EQ(hex.size(), 32u);
+    EXPECT_TRUE(CorrelationId::Parse(hex).has_value());
+}